@@ -23,6 +23,7 @@
 #include "app/app.h"
 
 #include "app/app_options.h"
+#include "app/batch_processor.h"
 #include "app/check_update.h"
 #include "app/color_utils.h"
 #include "app/commands/commands.h"
@@ -112,6 +113,7 @@ App::App(int argc, const char* argv[])
   , m_legacy(NULL)
   , m_isGui(false)
   , m_isShell(false)
+  , m_parseError(false)
 {
   ASSERT(m_instance == NULL);
   m_instance = this;
@@ -121,8 +123,20 @@ App::App(int argc, const char* argv[])
   m_modules = new Modules(!options.startUI(), options.verbose());
   m_isGui = options.startUI();
   m_isShell = options.startShell();
+  m_parseError = options.parseError();
   m_legacy = new LegacyModules(isGui() ? REQUIRE_INTERFACE: 0);
-  m_files = options.files();
+
+  // If the command line is invalid, no file is loaded or processed
+  if (!m_parseError)
+    m_files = options.files();
+
+  // In batch mode the operations specified in the command line are
+  // applied to each file and the GUI is never initialized.
+  if (!isGui() && !m_isShell && !m_parseError) {
+    m_batch.reset(new BatchProcessor(options));
+    if (!m_batch->hasOperations())
+      m_batch.reset(NULL);
+  }
 
   // Register well-known image file types.
   FileFormatsManager::instance().registerAllFormats();
@@ -151,6 +165,10 @@ App::App(int argc, const char* argv[])
 
 int App::run()
 {
+  // The error was already reported by AppOptions
+  if (m_parseError)
+    return 1;
+
   // Initialize GUI interface
   if (isGui()) {
     PRINTF("GUI mode\n");
@@ -178,6 +196,7 @@ int App::run()
   // Procress options
   PRINTF("Processing options...\n");
 
+  int exitCode = 0;
   {
     Console console;
     for (FileList::iterator
@@ -187,8 +206,17 @@ int App::run()
       // Load the sprite
       Document* document = load_document(it->c_str());
       if (!document) {
-        if (!isGui())
+        if (!isGui()) {
           console.printf("Error loading file \"%s\"\n", it->c_str());
+          exitCode = 1;
+        }
+      }
+      // Batch mode: process the sprite and discard it, so we don't
+      // keep all files in memory.
+      else if (m_batch) {
+        base::UniquePtr<Document> documentPtr(document);
+        if (!m_batch->process(document, *it))
+          exitCode = 1;
       }
       else {
         // Mount and select the sprite
@@ -247,7 +275,7 @@ int App::run()
     }
   }
 
-  return 0;
+  return exitCode;
 }
 
 // Finishes the Aseprite application.
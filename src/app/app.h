@@ -38,6 +38,7 @@ namespace raster {
 }
 
 namespace app {
+  class BatchProcessor;
   class Document;
   class LegacyModules;
   class LoggerModule;
@@ -88,7 +89,9 @@ namespace app {
     LegacyModules* m_legacy;
     bool m_isGui;
     bool m_isShell;
+    bool m_parseError;
     base::UniquePtr<MainWindow> m_mainWindow;
+    base::UniquePtr<BatchProcessor> m_batch;
     FileList m_files;
   };
 
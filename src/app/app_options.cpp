@@ -24,6 +24,7 @@
 
 #include "base/path.h"
 
+#include <cstdio>
 #include <iostream>
 
 namespace app {
@@ -32,13 +33,31 @@ typedef base::ProgramOptions::Option Option;
 
 AppOptions::AppOptions(int argc, const char* argv[])
   : m_exeName(base::get_file_name(argv[0]))
+  , m_parseError(false)
   , m_startUI(true)
   , m_startShell(false)
   , m_verbose(false)
+  , m_sheetColumns(0)
+  , m_resizeWidth(0)
+  , m_resizeHeight(0)
+  , m_resizeMethod(raster::RESIZE_METHOD_NEAREST_NEIGHBOR)
+  , m_changeColorMode(false)
+  , m_colorMode(raster::IMAGE_RGB)
+  , m_ditheringMethod(raster::DITHERING_NONE)
+  , m_quantize(false)
+  , m_quantizationMethod(raster::QUANTIZATION_MEDIAN_CUT)
 {
   Option& palette = m_po.add("palette").requiresValue("GFXFILE").description("Use a specific palette by default");
   Option& shell = m_po.add("shell").description("Start an interactive console to execute scripts");
   Option& batch = m_po.add("batch").description("Do not start the UI");
+  Option& resize = m_po.add("resize").requiresValue("WxH").description("Resize the sprite (batch mode)");
+  Option& resizeMethod = m_po.add("resize-method").requiresValue("METHOD").description("Use nearest, bilinear or area method to resize the sprite");
+  Option& colorMode = m_po.add("color-mode").requiresValue("MODE").description("Change the color mode to rgb, grayscale or indexed (batch mode)");
+  Option& dithering = m_po.add("dithering").requiresValue("METHOD").description("Use none, ordered, floyd-steinberg or atkinson dithering to convert to indexed");
+  Option& quantize = m_po.add("quantize").requiresValue("METHOD").description("Create a palette for all frames with median-cut or octree method (batch mode)");
+  Option& sheet = m_po.add("sheet").requiresValue("FILE").description("Export all frames as a sprite sheet (batch mode)");
+  Option& sheetColumns = m_po.add("sheet-columns").requiresValue("N").description("Number of columns of the sprite sheet (all frames in one row by default)");
+  Option& saveAs = m_po.add("save-as").requiresValue("FILE").description("Save the sprite with other name/format (batch mode)");
   Option& verbose = m_po.add("verbose").description("Explain what is being done (in stderr or a log file)");
   Option& help = m_po.add("help").mnemonic('?').description("Display this help and exits");
   Option& version = m_po.add("version").description("Output version information and exit");
@@ -46,9 +65,86 @@ AppOptions::AppOptions(int argc, const char* argv[])
   try {
     m_po.parse(argc, argv);
 
+    // Options are parsed in local variables and assigned to the
+    // members only if all of them are valid.
+    int resizeWidth = 0;
+    int resizeHeight = 0;
+    raster::ResizeMethod resizeMethodValue = m_resizeMethod;
+    raster::PixelFormat colorModeValue = m_colorMode;
+    raster::DitheringMethod ditheringMethod = m_ditheringMethod;
+    raster::QuantizationMethod quantizationMethod = m_quantizationMethod;
+    int columns = 0;
+
+    if (resize.enabled()) {
+      if (std::sscanf(resize.value().c_str(), "%dx%d", &resizeWidth, &resizeHeight) != 2 ||
+          resizeWidth < 1 || resizeHeight < 1)
+        throw std::runtime_error("Invalid size for --resize option: " + resize.value());
+    }
+
+    if (resizeMethod.enabled()) {
+      if (resizeMethod.value() == "nearest")
+        resizeMethodValue = raster::RESIZE_METHOD_NEAREST_NEIGHBOR;
+      else if (resizeMethod.value() == "bilinear")
+        resizeMethodValue = raster::RESIZE_METHOD_BILINEAR;
+      else if (resizeMethod.value() == "area")
+        resizeMethodValue = raster::RESIZE_METHOD_AREA;
+      else
+        throw std::runtime_error("Invalid method for --resize-method option: " + resizeMethod.value());
+    }
+
+    if (colorMode.enabled()) {
+      if (colorMode.value() == "rgb")
+        colorModeValue = raster::IMAGE_RGB;
+      else if (colorMode.value() == "grayscale")
+        colorModeValue = raster::IMAGE_GRAYSCALE;
+      else if (colorMode.value() == "indexed")
+        colorModeValue = raster::IMAGE_INDEXED;
+      else
+        throw std::runtime_error("Invalid color mode for --color-mode option: " + colorMode.value());
+    }
+
+    if (dithering.enabled()) {
+      if (dithering.value() == "none")
+        ditheringMethod = raster::DITHERING_NONE;
+      else if (dithering.value() == "ordered")
+        ditheringMethod = raster::DITHERING_ORDERED;
+      else if (dithering.value() == "floyd-steinberg")
+        ditheringMethod = raster::DITHERING_FLOYD_STEINBERG;
+      else if (dithering.value() == "atkinson")
+        ditheringMethod = raster::DITHERING_ATKINSON;
+      else
+        throw std::runtime_error("Invalid method for --dithering option: " + dithering.value());
+    }
+
+    if (quantize.enabled()) {
+      if (quantize.value() == "median-cut")
+        quantizationMethod = raster::QUANTIZATION_MEDIAN_CUT;
+      else if (quantize.value() == "octree")
+        quantizationMethod = raster::QUANTIZATION_OCTREE;
+      else
+        throw std::runtime_error("Invalid method for --quantize option: " + quantize.value());
+    }
+
+    if (sheetColumns.enabled()) {
+      if (std::sscanf(sheetColumns.value().c_str(), "%d", &columns) != 1 ||
+          columns < 1)
+        throw std::runtime_error("Invalid number of columns for --sheet-columns option: " + sheetColumns.value());
+    }
+
     m_verbose = verbose.enabled();
     m_paletteFileName = palette.value();
     m_startShell = shell.enabled();
+    m_saveAsFileName = saveAs.value();
+    m_sheetFileName = sheet.value();
+    m_sheetColumns = columns;
+    m_resizeWidth = resizeWidth;
+    m_resizeHeight = resizeHeight;
+    m_resizeMethod = resizeMethodValue;
+    m_changeColorMode = colorMode.enabled();
+    m_colorMode = colorModeValue;
+    m_ditheringMethod = ditheringMethod;
+    m_quantize = quantize.enabled();
+    m_quantizationMethod = quantizationMethod;
 
     if (help.enabled()) {
       showHelp();
@@ -67,6 +163,7 @@ AppOptions::AppOptions(int argc, const char* argv[])
     std::cerr << m_exeName << ": " << parseError.what() << '\n'
               << "Try \"" << m_exeName << " --help\" for more information.\n";
     m_startUI = false;
+    m_parseError = true;
   }
 }
 
@@ -24,6 +24,10 @@
 #include <vector>
 
 #include "base/program_options.h"
+#include "raster/dithering_method.h"
+#include "raster/pixel_format.h"
+#include "raster/quantization_method.h"
+#include "raster/resize_method.h"
 
 namespace app {
 
@@ -31,12 +35,29 @@ class AppOptions {
 public:
   AppOptions(int argc, const char* argv[]);
 
+  // Returns true if the command line cannot be parsed (in that case
+  // no file should be loaded or processed).
+  bool parseError() const { return m_parseError; }
+
   bool startUI() const { return m_startUI; }
   bool startShell() const { return m_startShell; }
   bool verbose() const { return m_verbose; }
 
   const std::string& paletteFileName() const { return m_paletteFileName; }
 
+  // Operations to apply to each file in batch mode.
+  const std::string& saveAsFileName() const { return m_saveAsFileName; }
+  const std::string& sheetFileName() const { return m_sheetFileName; }
+  int sheetColumns() const { return m_sheetColumns; }
+  int resizeWidth() const { return m_resizeWidth; }
+  int resizeHeight() const { return m_resizeHeight; }
+  raster::ResizeMethod resizeMethod() const { return m_resizeMethod; }
+  bool changeColorMode() const { return m_changeColorMode; }
+  raster::PixelFormat colorMode() const { return m_colorMode; }
+  raster::DitheringMethod ditheringMethod() const { return m_ditheringMethod; }
+  bool quantize() const { return m_quantize; }
+  raster::QuantizationMethod quantizationMethod() const { return m_quantizationMethod; }
+
   const base::ProgramOptions::ValueList& files() const {
     return m_po.values();
   }
@@ -47,10 +68,22 @@ private:
 
   std::string m_exeName;
   base::ProgramOptions m_po;
+  bool m_parseError;
   bool m_startUI;
   bool m_startShell;
   bool m_verbose;
   std::string m_paletteFileName;
+  std::string m_saveAsFileName;
+  std::string m_sheetFileName;
+  int m_sheetColumns;
+  int m_resizeWidth;
+  int m_resizeHeight;
+  raster::ResizeMethod m_resizeMethod;
+  bool m_changeColorMode;
+  raster::PixelFormat m_colorMode;
+  raster::DitheringMethod m_ditheringMethod;
+  bool m_quantize;
+  raster::QuantizationMethod m_quantizationMethod;
 };
 
 } // namespace app
@@ -0,0 +1,231 @@
+/* Aseprite
+ * Copyright (C) 2001-2013  David Capello
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "app/batch_processor.h"
+
+#include "app/app_options.h"
+#include "app/console.h"
+#include "app/document.h"
+#include "app/document_api.h"
+#include "app/document_undo.h"
+#include "app/file/file.h"
+#include "base/path.h"
+#include "base/unique_ptr.h"
+#include "raster/cel.h"
+#include "raster/image.h"
+#include "raster/palette.h"
+#include "raster/quantization.h"
+#include "raster/sprite.h"
+#include "raster/stock.h"
+
+#include <vector>
+
+namespace app {
+
+BatchProcessor::BatchProcessor(const AppOptions& options)
+  : m_saveAsFileName(options.saveAsFileName())
+  , m_sheetFileName(options.sheetFileName())
+  , m_sheetColumns(options.sheetColumns())
+  , m_resizeWidth(options.resizeWidth())
+  , m_resizeHeight(options.resizeHeight())
+  , m_resizeMethod(options.resizeMethod())
+  , m_changeColorMode(options.changeColorMode())
+  , m_colorMode(options.colorMode())
+  , m_ditheringMethod(options.ditheringMethod())
+  , m_quantize(options.quantize())
+  , m_quantizationMethod(options.quantizationMethod())
+{
+}
+
+bool BatchProcessor::hasOperations() const
+{
+  return (!m_saveAsFileName.empty() ||
+          !m_sheetFileName.empty() ||
+          m_resizeWidth > 0 ||
+          m_changeColorMode ||
+          m_quantize);
+}
+
+bool BatchProcessor::process(Document* document, const std::string& filename)
+{
+  Sprite* sprite = document->getSprite();
+  bool result = true;
+
+  // The document is discarded after the processing, so we don't
+  // need undo information.
+  document->getUndo()->setEnabled(false);
+
+  if (m_resizeWidth > 0 &&
+      (m_resizeWidth != sprite->getWidth() ||
+       m_resizeHeight != sprite->getHeight()))
+    resizeSprite(document);
+
+  if (m_quantize && sprite->getPixelFormat() == IMAGE_RGB)
+    quantizeSprite(document);
+
+  if (m_changeColorMode && m_colorMode != sprite->getPixelFormat())
+    document->getApi().setPixelFormat(sprite, m_colorMode, m_ditheringMethod);
+
+  if (!m_sheetFileName.empty()) {
+    if (!saveSpriteSheet(document, getOutputFileName(m_sheetFileName, filename)))
+      result = false;
+  }
+
+  if (!m_saveAsFileName.empty()) {
+    if (!saveDocumentAs(document, getOutputFileName(m_saveAsFileName, filename)))
+      result = false;
+  }
+
+  return result;
+}
+
+void BatchProcessor::resizeSprite(Document* document)
+{
+  Sprite* sprite = document->getSprite();
+  Stock* stock = sprite->getStock();
+  DocumentApi api = document->getApi();
+  int old_w = sprite->getWidth();
+  int old_h = sprite->getHeight();
+
+  // Linked cels share the same image, so each image of the stock is
+  // resized just one time.
+  std::vector<bool> resized(stock->size(), false);
+
+  CelList cels;
+  sprite->getCels(cels);
+
+  for (CelIterator it = cels.begin(); it != cels.end(); ++it) {
+    Cel* cel = *it;
+
+    api.setCelPosition(sprite, cel,
+                       cel->getX() * m_resizeWidth / old_w,
+                       cel->getY() * m_resizeHeight / old_h);
+
+    int index = cel->getImage();
+    if (index < 0 || index >= (int)resized.size() || resized[index])
+      continue;
+
+    Image* image = stock->getImage(index);
+    if (!image)
+      continue;
+
+    Image* new_image = Image::create(image->getPixelFormat(),
+                                     MAX(1, image->w * m_resizeWidth / old_w),
+                                     MAX(1, image->h * m_resizeHeight / old_h));
+
+    image_fixup_transparent_colors(image);
+    image_resize(image, new_image,
+                 m_resizeMethod,
+                 sprite->getPalette(cel->getFrame()),
+                 sprite->getRgbMap(cel->getFrame()));
+
+    api.replaceStockImage(sprite, index, new_image);
+    resized[index] = true;
+  }
+
+  api.setSpriteSize(sprite, m_resizeWidth, m_resizeHeight);
+}
+
+// Replaces all palettes with one palette optimized for all frames, so
+// a following --color-mode indexed uses it.
+void BatchProcessor::quantizeSprite(Document* document)
+{
+  Sprite* sprite = document->getSprite();
+  base::UniquePtr<Palette> palette(
+    quantization::create_palette_from_rgb(sprite, FrameNumber(0),
+                                          m_quantizationMethod, true));
+
+  sprite->resetPalettes();
+  sprite->setPalette(palette, false);
+}
+
+bool BatchProcessor::saveSpriteSheet(Document* document, const std::string& filename)
+{
+  Sprite* sprite = document->getSprite();
+  FrameNumber nframes = sprite->getTotalFrames();
+  int columns = (m_sheetColumns > 0 ? m_sheetColumns: nframes);
+  columns = MID(1, columns, nframes);
+
+  int sheet_w = sprite->getWidth()*columns;
+  int sheet_h = sprite->getHeight()*((nframes/columns)+((nframes%columns)>0?1:0));
+
+  base::UniquePtr<Document> sheetDoc(
+    Document::createBasicDocument(sprite->getPixelFormat(), sheet_w, sheet_h,
+                                  sprite->getPalette(FrameNumber(0))->size()));
+  Sprite* sheetSprite = sheetDoc->getSprite();
+  sheetSprite->setPalette(sprite->getPalette(FrameNumber(0)), true);
+  sheetSprite->setTransparentColor(sprite->getTransparentColor());
+
+  // The basic document has just one cel where we draw all frames.
+  CelList cels;
+  sheetSprite->getCels(cels);
+  Image* resultImage = sheetSprite->getStock()->getImage(cels.front()->getImage());
+  base::UniquePtr<Image> tempImage(Image::create(sprite->getPixelFormat(),
+                                                 sprite->getWidth(),
+                                                 sprite->getHeight()));
+  image_clear(resultImage, sprite->getTransparentColor());
+
+  int column = 0, row = 0;
+  for (FrameNumber frame(0); frame<nframes; ++frame) {
+    tempImage->clear(sprite->getTransparentColor());
+    sprite->render(tempImage, 0, 0, frame);
+    resultImage->copy(tempImage, column*sprite->getWidth(), row*sprite->getHeight());
+
+    if (++column >= columns) {
+      column = 0;
+      ++row;
+    }
+  }
+
+  return saveDocumentAs(sheetDoc, filename);
+}
+
+bool BatchProcessor::saveDocumentAs(Document* document, const std::string& filename)
+{
+  document->setFilename(filename.c_str());
+
+  if (save_document(document) != 0) {
+    Console console;
+    console.printf("Error saving file \"%s\"\n", filename.c_str());
+    return false;
+  }
+  return true;
+}
+
+// Replaces "{title}" in the given output file name with the title of
+// the input file, so several files can be converted in one call.
+std::string BatchProcessor::getOutputFileName(const std::string& pattern,
+                                              const std::string& filename) const
+{
+  static const std::string tag = "{title}";
+  std::string result = pattern;
+  std::string title = base::get_file_title(filename);
+
+  for (std::string::size_type i = result.find(tag);
+       i != std::string::npos;
+       i = result.find(tag, i+title.size()))
+    result.replace(i, tag.size(), title);
+
+  return result;
+}
+
+} // namespace app
@@ -0,0 +1,71 @@
+/* Aseprite
+ * Copyright (C) 2001-2013  David Capello
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#ifndef APP_BATCH_PROCESSOR_H_INCLUDED
+#define APP_BATCH_PROCESSOR_H_INCLUDED
+
+#include "raster/dithering_method.h"
+#include "raster/pixel_format.h"
+#include "raster/quantization_method.h"
+#include "raster/resize_method.h"
+
+#include <string>
+
+namespace app {
+  class AppOptions;
+  class Document;
+
+  // Applies the operations given in the command line (--resize,
+  // --quantize, --color-mode, --sheet, --save-as) to each file loaded in batch
+  // mode. Documents are modified without undo information, as they
+  // are discarded after the processing.
+  class BatchProcessor {
+  public:
+    BatchProcessor(const AppOptions& options);
+
+    // Returns true if there is at least one operation to apply.
+    bool hasOperations() const;
+
+    // Applies all operations to the given document (loaded from
+    // "filename"). Returns false if some file cannot be saved.
+    bool process(Document* document, const std::string& filename);
+
+  private:
+    void resizeSprite(Document* document);
+    void quantizeSprite(Document* document);
+    bool saveSpriteSheet(Document* document, const std::string& filename);
+    bool saveDocumentAs(Document* document, const std::string& filename);
+    std::string getOutputFileName(const std::string& pattern,
+                                  const std::string& filename) const;
+
+    std::string m_saveAsFileName;
+    std::string m_sheetFileName;
+    int m_sheetColumns;
+    int m_resizeWidth;
+    int m_resizeHeight;
+    raster::ResizeMethod m_resizeMethod;
+    bool m_changeColorMode;
+    raster::PixelFormat m_colorMode;
+    raster::DitheringMethod m_ditheringMethod;
+    bool m_quantize;
+    raster::QuantizationMethod m_quantizationMethod;
+  };
+
+} // namespace app
+
+#endif
@@ -123,7 +123,9 @@ void OpenFileCommand::onExecute(Context* context)
   }
 
   if (!m_filename.empty()) {
-    base::UniquePtr<FileOp> fop(fop_to_load_document(m_filename.c_str(), FILE_LOAD_SEQUENCE_ASK));
+    base::UniquePtr<FileOp> fop(fop_to_load_document(m_filename.c_str(),
+                                                     FILE_LOAD_SEQUENCE_ASK |
+                                                     FILE_LOAD_LAZY_IMAGES));
     bool unrecent = false;
 
     if (fop) {
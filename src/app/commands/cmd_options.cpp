@@ -83,6 +83,9 @@ void OptionsCommand::onExecute(Context* context)
   Button* checked_bg_reset = app::find_widget<Button>(window, "checked_bg_reset");
   Widget* undo_size_limit = app::find_widget<Widget>(window, "undo_size_limit");
   Widget* undo_goto_modified = app::find_widget<Widget>(window, "undo_goto_modified");
+  Widget* undo_swap_to_disk = app::find_widget<Widget>(window, "undo_swap_to_disk");
+  Slider* ase_compression_level = app::find_widget<Slider>(window, "ase_compression_level");
+  Widget* gif_transparent_diff = app::find_widget<Widget>(window, "gif_transparent_diff");
   Widget* button_ok = app::find_widget<Widget>(window, "button_ok");
 
   // Cursor color
@@ -141,6 +144,17 @@ void OptionsCommand::onExecute(Context* context)
   if (get_config_bool("Options", "UndoGotoModified", true))
     undo_goto_modified->setSelected(true);
 
+  // Save old undo information in a temporary file
+  if (get_config_bool("Options", "UndoSwapToDisk", false))
+    undo_swap_to_disk->setSelected(true);
+
+  // Compression level of .ase files (-1 is zlib default level, 6)
+  int compression_level = get_config_int("AseFormat", "CompressionLevel", -1);
+  ase_compression_level->setValue(compression_level < 0 ? 6: compression_level);
+
+  if (get_config_bool("GifFormat", "TransparentDiff", false))
+    gif_transparent_diff->setSelected(true);
+
   // Show the window and wait the user to close it
   window->openWindowInForeground();
 
@@ -164,6 +178,9 @@ void OptionsCommand::onExecute(Context* context)
     undo_size_limit_value = MID(1, undo_size_limit_value, 9999);
     set_config_int("Options", "UndoSizeLimit", undo_size_limit_value);
     set_config_bool("Options", "UndoGotoModified", undo_goto_modified->isSelected());
+    set_config_bool("Options", "UndoSwapToDisk", undo_swap_to_disk->isSelected());
+    set_config_int("AseFormat", "CompressionLevel", ase_compression_level->getValue());
+    set_config_bool("GifFormat", "TransparentDiff", gif_transparent_diff->isSelected());
 
     // Save configuration
     flush_config_file();
@@ -219,6 +219,7 @@ void SpriteSizeCommand::onExecute(Context* context)
 
   method->addItem("Nearest-neighbor");
   method->addItem("Bilinear");
+  method->addItem("Area");
   method->setSelectedItemIndex(get_config_int("SpriteSize", "Method", RESIZE_METHOD_NEAREST_NEIGHBOR));
 
   window->remapWindow();
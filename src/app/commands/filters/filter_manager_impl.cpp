@@ -28,6 +28,9 @@
 #include "app/ui/editor/editor.h"
 #include "app/undo_transaction.h"
 #include "app/undoers/image_area.h"
+#include "base/mutex.h"
+#include "base/parallel_for.h"
+#include "base/scoped_lock.h"
 #include "filters/filter.h"
 #include "raster/cel.h"
 #include "raster/image.h"
@@ -48,7 +51,117 @@ namespace app {
 
 using namespace std;
 using namespace ui;
-  
+
+// Minimum number of pixels to apply the filter using several threads.
+static const int kMinParallelArea = 128*128;
+
+// Number of rows processed by each task when the filter is applied
+// using several threads (progress is reported after each band).
+static const int kRowsPerBand = 16;
+
+// Moves to the next pixel in the mask (if there is a mask), returns
+// true if the current pixel is not selected.
+static inline bool skip_masked_pixel(unsigned char*& mask_address, div_t& d)
+{
+  bool skip = false;
+
+  if (mask_address) {
+    if (!((*mask_address) & (1<<d.rem)))
+      skip = true;
+
+    // Move to the next pixel in the mask.
+    _image_bitmap_next_bit(d, mask_address);
+  }
+
+  return skip;
+}
+
+// FilterManager given to the filter to process the rows of a band
+// in one thread. It has its own row/mask position, all other data is
+// shared with the FilterManagerImpl.
+class FilterManagerImpl::RowManager : public FilterManager {
+public:
+  RowManager(FilterManagerImpl* mgr)
+    : m_mgr(mgr), m_row(0), m_mask_address(NULL) {
+  }
+
+  void setRow(int row) {
+    m_row = row;
+    m_mask_address = m_mgr->getMaskAddress(row, m_d);
+  }
+
+  // FilterManager implementation
+  const void* getSourceAddress() { return image_address(m_mgr->m_src, m_mgr->m_x, m_mgr->m_y+m_row); }
+  void* getDestinationAddress() { return image_address(m_mgr->m_dst, m_mgr->m_x, m_mgr->m_y+m_row); }
+  int getWidth() { return m_mgr->m_w; }
+  Target getTarget() { return m_mgr->m_target; }
+  FilterIndexedData* getIndexedData() { return m_mgr; }
+  bool skipPixel() { return skip_masked_pixel(m_mask_address, m_d); }
+  const Image* getSourceImage() { return m_mgr->m_src; }
+  int getX() { return m_mgr->m_x; }
+  int getY() { return m_mgr->m_y+m_row; }
+  FilterRowsData* getRowsData() { return m_rowsData; }
+  void setRowsData(FilterRowsData* data) { m_rowsData.reset(data); }
+
+private:
+  FilterManagerImpl* m_mgr;
+  int m_row;
+  unsigned char* m_mask_address;
+  div_t m_d;
+  base::UniquePtr<FilterRowsData> m_rowsData;
+};
+
+// Applies the filter to a band of kRowsPerBand rows. It's called from
+// several threads, so the progress and the cancellation state are
+// guarded with a mutex.
+class FilterManagerImpl::ApplyBandTask {
+public:
+  ApplyBandTask(FilterManagerImpl* mgr)
+    : m_mgr(mgr), m_rows(0), m_cancelled(false) {
+  }
+
+  void operator()(int band) {
+    if (isCancelled())
+      return;
+
+    RowManager rowMgr(m_mgr);
+    int row1 = band*kRowsPerBand;
+    int row2 = MIN(row1+kRowsPerBand, m_mgr->m_h);
+
+    for (int row=row1; row<row2; ++row) {
+      rowMgr.setRow(row);
+      m_mgr->applyToRow(&rowMgr);
+    }
+
+    IProgressDelegate* delegate = m_mgr->m_progressDelegate;
+    if (delegate) {
+      bool cancelled = delegate->isCancelled();
+
+      base::scoped_lock lock(m_mutex);
+      m_rows += row2 - row1;
+
+      // Report progress.
+      delegate->reportProgress(m_mgr->m_progressBase +
+                               m_mgr->m_progressWidth * m_rows / m_mgr->m_h);
+
+      // Does the user cancelled the whole process?
+      if (cancelled)
+        m_cancelled = true;
+    }
+  }
+
+  bool isCancelled() {
+    base::scoped_lock lock(m_mutex);
+    return m_cancelled;
+  }
+
+private:
+  FilterManagerImpl* m_mgr;
+  base::mutex m_mutex;
+  int m_rows;                   // Number of processed rows.
+  bool m_cancelled;
+};
+
 FilterManagerImpl::FilterManagerImpl(Context* context, Filter* filter)
   : m_context(context)
   , m_location(context->getActiveLocation())
@@ -106,6 +219,7 @@ void FilterManagerImpl::begin()
 
   m_row = 0;
   m_mask = (document->isMaskVisible() ? document->getMask(): NULL);
+  m_rowsData.reset(NULL);
 
   updateMask(m_mask, m_src);
 }
@@ -124,6 +238,7 @@ void FilterManagerImpl::beginForPreview()
 
   m_row = 0;
   m_mask = m_preview_mask;
+  m_rowsData.reset(NULL);
 
   {
     Editor* editor = current_editor;
@@ -164,18 +279,8 @@ void FilterManagerImpl::beginForPreview()
 bool FilterManagerImpl::applyStep()
 {
   if ((m_row >= 0) && (m_row < m_h)) {
-    if ((m_mask) && (m_mask->getBitmap())) {
-      m_d = div(m_x-m_mask->getBounds().x+m_offset_x, 8);
-      m_mask_address = ((uint8_t**)m_mask->getBitmap()->line)[m_row+m_y-m_mask->getBounds().y+m_offset_y]+m_d.quot;
-    }
-    else
-      m_mask_address = NULL;
-
-    switch (m_location.sprite()->getPixelFormat()) {
-      case IMAGE_RGB:       m_filter->applyToRgba(this); break;
-      case IMAGE_GRAYSCALE: m_filter->applyToGrayscale(this); break;
-      case IMAGE_INDEXED:   m_filter->applyToIndexed(this); break;
-    }
+    m_mask_address = getMaskAddress(m_row, m_d);
+    applyToRow(this);
     ++m_row;
 
     return true;
@@ -190,13 +295,19 @@ void FilterManagerImpl::apply()
   bool cancelled = false;
 
   begin();
-  while (!cancelled && applyStep()) {
-    if (m_progressDelegate) {
-      // Report progress.
-      m_progressDelegate->reportProgress(m_progressBase + m_progressWidth * (m_row+1) / m_h);
 
-      // Does the user cancelled the whole process?
-      cancelled = m_progressDelegate->isCancelled();
+  if (m_w*m_h >= kMinParallelArea) {
+    cancelled = !applyInParallel();
+  }
+  else {
+    while (!cancelled && applyStep()) {
+      if (m_progressDelegate) {
+        // Report progress.
+        m_progressDelegate->reportProgress(m_progressBase + m_progressWidth * (m_row+1) / m_h);
+
+        // Does the user cancelled the whole process?
+        cancelled = m_progressDelegate->isCancelled();
+      }
     }
   }
 
@@ -214,6 +325,43 @@ void FilterManagerImpl::apply()
   }
 }
 
+// Applies the filter to bands of rows in several threads. Returns
+// false if the user cancelled the process.
+bool FilterManagerImpl::applyInParallel()
+{
+  // The RgbMap is generated the first time it's used, so we generate
+  // it here before the threads use it.
+  if (getPixelFormat() == IMAGE_INDEXED)
+    getRgbMap();
+
+  ApplyBandTask task(this);
+  base::parallel_for((m_h+kRowsPerBand-1) / kRowsPerBand, task);
+
+  return !task.isCancelled();
+}
+
+void FilterManagerImpl::applyToRow(FilterManager* rowMgr)
+{
+  switch (m_location.sprite()->getPixelFormat()) {
+    case IMAGE_RGB:       m_filter->applyToRgba(rowMgr); break;
+    case IMAGE_GRAYSCALE: m_filter->applyToGrayscale(rowMgr); break;
+    case IMAGE_INDEXED:   m_filter->applyToIndexed(rowMgr); break;
+  }
+}
+
+// Returns the address of the first pixel of the given row in the
+// mask bitmap (with the bit position in "d"), or NULL if the whole
+// row is selected.
+unsigned char* FilterManagerImpl::getMaskAddress(int row, div_t& d) const
+{
+  if ((m_mask) && (m_mask->getBitmap())) {
+    d = div(m_x-m_mask->getBounds().x+m_offset_x, 8);
+    return ((uint8_t**)m_mask->getBitmap()->line)[row+m_y-m_mask->getBounds().y+m_offset_y]+d.quot;
+  }
+  else
+    return NULL;
+}
+
 void FilterManagerImpl::applyToTarget()
 {
   bool cancelled = false;
@@ -295,17 +443,7 @@ void* FilterManagerImpl::getDestinationAddress()
 
 bool FilterManagerImpl::skipPixel()
 {
-  bool skip = false;
-
-  if (m_mask_address) {
-    if (!((*m_mask_address) & (1<<m_d.rem)))
-      skip = true;
-
-    // Move to the next pixel in the mask.
-    _image_bitmap_next_bit(m_d, m_mask_address);
-  }
-
-  return skip;
+  return skip_masked_pixel(m_mask_address, m_d);
 }
 
 Palette* FilterManagerImpl::getPalette()
@@ -332,6 +470,7 @@ void FilterManagerImpl::init(const Layer* layer, Image* image, int offset_x, int
   m_mask = NULL;
   m_preview_mask.reset(NULL);
   m_mask_address = NULL;
+  m_rowsData.reset(NULL);
 
   m_target = m_targetOrig;
 
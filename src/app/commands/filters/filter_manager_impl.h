@@ -107,14 +107,22 @@ namespace app {
     const Image* getSourceImage() { return m_src; }
     int getX() { return m_x; }
     int getY() { return m_y+m_row; }
+    FilterRowsData* getRowsData() { return m_rowsData; }
+    void setRowsData(FilterRowsData* data) { m_rowsData.reset(data); }
 
     // FilterIndexedData implementation
     Palette* getPalette();
     RgbMap* getRgbMap();
 
   private:
+    class RowManager;
+    class ApplyBandTask;
+
     void init(const Layer* layer, Image* image, int offset_x, int offset_y);
     void apply();
+    bool applyInParallel();
+    void applyToRow(FilterManager* rowMgr);
+    unsigned char* getMaskAddress(int row, div_t& d) const;
     void applyToImage(Layer* layer, Image* image, int x, int y);
     bool updateMask(Mask* mask, const Image* image);
 
@@ -132,6 +140,7 @@ namespace app {
     div_t m_d;
     Target m_targetOrig;          // Original targets
     Target m_target;              // Filtered targets
+    base::UniquePtr<FilterRowsData> m_rowsData;
 
     // Hooks
     float m_progressBase;
@@ -150,11 +150,12 @@ void Document::notifyGeneralUpdate()
   notifyObservers<DocumentEvent&>(&DocumentObserver::onGeneralUpdate, ev);
 }
 
-void Document::notifySpritePixelsModified(Sprite* sprite, const gfx::Region& region)
+void Document::notifySpritePixelsModified(Sprite* sprite, const gfx::Region& region, FrameNumber frame)
 {
   DocumentEvent ev(this);
   ev.sprite(sprite);
   ev.region(region);
+  ev.frame(frame);
   notifyObservers<DocumentEvent&>(&DocumentObserver::onSpritePixelsModified, ev);
 }
 
@@ -65,6 +65,7 @@
 #include "raster/mask.h"
 #include "raster/palette.h"
 #include "raster/quantization.h"
+#include "raster/rgbmap.h"
 #include "raster/sprite.h"
 #include "raster/stock.h"
 
@@ -155,8 +156,10 @@ void DocumentApi::setPixelFormat(Sprite* sprite, PixelFormat newFormat, Ditherin
   // TODO Review this, why we use the palette in frame 0?
   FrameNumber frame(0);
 
-  // Use the rgbmap for the specified sprite
-  const RgbMap* rgbmap = sprite->getRgbMap(frame);
+  // The whole sprite is converted just one time, so we can use a
+  // more precise map than the one of the sprite.
+  RgbMap rgbmap(6);
+  rgbmap.regenerate(sprite->getPalette(frame));
 
   for (c=0; c<sprite->getStock()->size(); c++) {
     old_image = sprite->getStock()->getImage(c);
@@ -164,7 +167,7 @@ void DocumentApi::setPixelFormat(Sprite* sprite, PixelFormat newFormat, Ditherin
       continue;
 
     new_image = quantization::convert_pixel_format
-      (old_image, newFormat, dithering_method, rgbmap,
+      (old_image, newFormat, dithering_method, &rgbmap,
        sprite->getPalette(frame),
        sprite->getBackgroundLayer() != NULL);
 
@@ -22,12 +22,16 @@
 
 #include "app/document_undo.h"
 
+#include "app/ini_file.h"
 #include "app/objects_container_impl.h"
 #include "app/undoers/close_group.h"
+#include "base/path.h"
+#include "base/temp_dir.h"
 #include "undo/undo_history.h"
 
 #include <allegro/config.h>     // TODO remove this when get_config_int() is removed from here
 #include <cassert>
+#include <cstdio>
 #include <stdexcept>
 
 namespace app {
@@ -39,6 +43,17 @@ DocumentUndo::DocumentUndo()
 {
 }
 
+DocumentUndo::~DocumentUndo()
+{
+  // Destroy the undoers before the swap file
+  m_undoHistory.reset();
+
+  if (m_swapFile) {
+    m_swapFile->close();
+    std::remove(m_swapFileName.c_str());
+  }
+}
+
 bool DocumentUndo::canUndo() const
 {
   return m_undoHistory->canUndo();
@@ -74,6 +89,11 @@ void DocumentUndo::markSavedState()
   return m_undoHistory->markSavedState();
 }
 
+int DocumentUndo::getVersion() const
+{
+  return m_undoHistory->getVersion();
+}
+
 void DocumentUndo::pushUndoer(undo::Undoer* undoer)
 {
   return m_undoHistory->pushUndoer(undoer);
@@ -89,6 +109,27 @@ size_t DocumentUndo::getUndoSizeLimit() const
   return ((size_t)get_config_int("Options", "UndoSizeLimit", 8))*1024*1024;
 }
 
+std::iostream* DocumentUndo::getSwapStream()
+{
+  if (!get_config_bool("Options", "UndoSwapToDisk", false))
+    return NULL;
+
+  if (!m_swapFile) {
+    m_swapDir.reset(new base::TempDir(PACKAGE));
+    m_swapFileName = base::join_path(m_swapDir->path(), "undo.swp");
+    m_swapFile.reset(new std::fstream(m_swapFileName.c_str(),
+                                      std::ios::in | std::ios::out |
+                                      std::ios::binary | std::ios::trunc));
+    if (!*m_swapFile) {
+      m_swapFile.reset();
+      m_swapDir.reset();
+      return NULL;
+    }
+  }
+
+  return m_swapFile.get();
+}
+
 const char* DocumentUndo::getNextUndoLabel() const
 {
   return getNextUndoGroup()->getLabel();
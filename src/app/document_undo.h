@@ -21,10 +21,17 @@
 
 #include "base/compiler_specific.h"
 #include "base/disable_copying.h"
+#include "base/string.h"
 #include "base/unique_ptr.h"
 #include "raster/sprite_position.h"
 #include "undo/undo_history.h"
 
+#include <fstream>
+
+namespace base {
+  class TempDir;
+}
+
 namespace undo {
   class ObjectsContainer;
   class Undoer;
@@ -40,6 +47,7 @@ namespace app {
   class DocumentUndo : public undo::UndoHistoryDelegate {
   public:
     DocumentUndo();
+    ~DocumentUndo();
 
     bool isEnabled() const { return m_enabled; }
     void setEnabled(bool state) { m_enabled = state; }
@@ -55,9 +63,13 @@ namespace app {
     bool isSavedState() const;
     void markSavedState();
 
+    // See undo::UndoHistory::getVersion()
+    int getVersion() const;
+
     // UndoHistoryDelegate implementation.
     undo::ObjectsContainer* getObjects() const OVERRIDE { return m_objects; }
     size_t getUndoSizeLimit() const OVERRIDE;
+    std::iostream* getSwapStream() OVERRIDE;
 
     void pushUndoer(undo::Undoer* undoer);
 
@@ -84,6 +96,12 @@ namespace app {
     // to keep references to deleted objects.
     base::UniquePtr<undo::ObjectsContainer> m_objects;
 
+    // Temporary file where the oldest undoers are saved when the
+    // "UndoSwapToDisk" option is enabled (see getSwapStream()).
+    base::UniquePtr<base::TempDir> m_swapDir;
+    base::UniquePtr<std::fstream> m_swapFile;
+    base::string m_swapFileName;
+
     // Stack of undoers to undo operations.
     base::UniquePtr<undo::UndoHistory> m_undoHistory;
 
@@ -25,11 +25,18 @@
 #include "app/file/file_format.h"
 #include "app/file/file_handle.h"
 #include "app/file/format_options.h"
+#include "app/ini_file.h"
 #include "base/cfile.h"
+#include "base/compiler_specific.h"
 #include "base/exception.h"
+#include "base/mutex.h"
+#include "base/parallel_for.h"
+#include "base/scoped_lock.h"
 #include "raster/raster.h"
 #include "zlib.h"
 
+#include <algorithm>
+#include <map>
 #include <stdio.h>
 
 #define ASE_FILE_MAGIC                  0xA5E0
@@ -75,6 +82,64 @@ struct ASE_FrameHeader {
   uint16_t duration;
 };
 
+// Compressed pixels of a cel read from the file.
+struct AseCompressedImage {
+  PixelFormat format;
+  int w, h;
+  std::vector<uint8_t> data;
+};
+
+// Compressed images of the stock that weren't decompressed yet (when
+// the file is loaded with FILE_LOAD_LAZY_IMAGES flag), by stock index.
+typedef std::map<int, SharedPtr<AseCompressedImage> > AseLazyImages;
+
+// Cels to be written in the file. Cels with the same image of a
+// previous cel (in the same layer) are written as links to that cel,
+// and the images of the other cels are compressed in parallel (before
+// the file is written) with compressImages().
+class AseCels {
+public:
+  struct Entry {
+    const Cel* link;                // Previous cel with the same image
+    const Image* image;
+    std::vector<uint8_t> compressed; // Compressed pixels (if link == NULL)
+  };
+
+  void addCel(const Layer* layer, const Cel* cel, const Image* image) {
+    uint32_t hash = image_hash(image);
+    std::pair<Hashes::const_iterator, Hashes::const_iterator> range =
+      m_hashes.equal_range(HashKey(layer, hash));
+
+    Entry& entry = m_entries[cel];
+    entry.link = NULL;
+    entry.image = image;
+
+    for (Hashes::const_iterator it=range.first; it!=range.second; ++it) {
+      if (image_is_equal(m_entries[it->second].image, image)) {
+        entry.link = it->second;
+        return;
+      }
+    }
+
+    m_hashes.insert(std::make_pair(HashKey(layer, hash), cel));
+  }
+
+  const Entry* getEntry(const Cel* cel) const {
+    Entries::const_iterator it = m_entries.find(cel);
+    return (it != m_entries.end() ? &it->second: NULL);
+  }
+
+  void compressImages(int level, FileOp* fop);
+
+private:
+  typedef std::pair<const Layer*, uint32_t> HashKey;
+  typedef std::multimap<HashKey, const Cel*> Hashes;
+  typedef std::map<const Cel*, Entry> Entries;
+
+  Hashes m_hashes;
+  Entries m_entries;
+};
+
 // TODO Warning: the writing routines aren't thread-safe
 static ASE_FrameHeader *current_frame_header = NULL;
 static int chunk_type;
@@ -89,7 +154,10 @@ static void ase_file_prepare_frame_header(FILE *f, ASE_FrameHeader *frame_header
 static void ase_file_write_frame_header(FILE *f, ASE_FrameHeader *frame_header);
 
 static void ase_file_write_layers(FILE *f, Layer *layer);
-static void ase_file_write_cels(FILE *f, Sprite *sprite, Layer *layer, FrameNumber frame);
+static void ase_file_collect_cels(Sprite *sprite, Layer *layer, FrameNumber frame,
+                                  AseCels& cels);
+static void ase_file_write_cels(FILE *f, Sprite *sprite, Layer *layer, FrameNumber frame,
+                                const AseCels& cels);
 
 static void ase_file_read_padding(FILE *f, int bytes);
 static void ase_file_write_padding(FILE *f, int bytes);
@@ -104,12 +172,19 @@ static Palette *ase_file_read_color2_chunk(FILE *f, Sprite *sprite, FrameNumber
 static void ase_file_write_color2_chunk(FILE *f, Palette *pal);
 static Layer *ase_file_read_layer_chunk(FILE *f, Sprite *sprite, Layer **previous_layer, int *current_level);
 static void ase_file_write_layer_chunk(FILE *f, Layer *layer);
-static Cel *ase_file_read_cel_chunk(FILE *f, Sprite *sprite, FrameNumber frame, PixelFormat pixelFormat, FileOp *fop, ASE_Header *header, size_t chunk_end);
-static void ase_file_write_cel_chunk(FILE *f, Cel *cel, LayerImage *layer, Sprite *sprite);
+static Cel *ase_file_read_cel_chunk(FILE *f, Sprite *sprite, FrameNumber frame, PixelFormat pixelFormat, FileOp *fop, ASE_Header *header, size_t chunk_end, AseLazyImages& lazyImages);
+static void ase_file_write_cel_chunk(FILE *f, Cel *cel, LayerImage *layer, Sprite *sprite,
+                                     const AseCels::Entry* entry);
 static Mask *ase_file_read_mask_chunk(FILE *f);
 static void ase_file_write_mask_chunk(FILE *f, Mask *mask);
 
 class AseFormat : public FileFormat {
+  // Data for .ase files
+  class AseOptions : public FormatOptions {
+  public:
+    int compressionLevel;       // zlib compression level (0-9, or -1 for default).
+  };
+
   const char* onGetName() const { return "ase"; }
   const char* onGetExtensions() const { return "ase,aseprite"; }
   int onGetFlags() const {
@@ -123,11 +198,14 @@ class AseFormat : public FileFormat {
       FILE_SUPPORT_INDEXED |
       FILE_SUPPORT_LAYERS |
       FILE_SUPPORT_FRAMES |
-      FILE_SUPPORT_PALETTES;
+      FILE_SUPPORT_PALETTES |
+      FILE_SUPPORT_GET_FORMAT_OPTIONS;
   }
 
   bool onLoad(FileOp* fop);
   bool onSave(FileOp* fop);
+
+  SharedPtr<FormatOptions> onGetFormatOptions(FileOp* fop) OVERRIDE;
 };
 
 FileFormat* CreateAseFormat()
@@ -167,6 +245,9 @@ bool AseFormat::onLoad(FileOp *fop)
   Layer* last_layer = sprite->getFolder();
   int current_level = -1;
 
+  // Compressed data of images that are decompressed on demand
+  AseLazyImages lazyImages;
+
   /* read frame by frame to end-of-file */
   for (FrameNumber frame(0); frame<sprite->getTotalFrames(); ++frame) {
     /* start frame position */
@@ -231,7 +312,7 @@ bool AseFormat::onLoad(FileOp *fop)
 
             ase_file_read_cel_chunk(f, sprite, frame,
                                     sprite->getPixelFormat(), fop, &header,
-                                    chunk_pos+chunk_size);
+                                    chunk_pos+chunk_size, lazyImages);
             break;
           }
 
@@ -292,6 +373,15 @@ bool AseFormat::onSave(FileOp *fop)
   ASE_FrameHeader frame_header;
 
   FileHandle f(fop->filename.c_str(), "wb");
+  SharedPtr<AseOptions> ase_options = fop->seq.format_options;
+  AseCels cels;
+
+  // Compress all cels before writing the file
+  for (FrameNumber frame(0); frame<sprite->getTotalFrames(); ++frame)
+    ase_file_collect_cels(sprite, sprite->getFolder(), frame, cels);
+
+  cels.compressImages(ase_options ? ase_options->compressionLevel:
+                                    Z_DEFAULT_COMPRESSION, fop);
 
   /* prepare the header */
   ase_file_prepare_header(f, &header, sprite);
@@ -323,14 +413,10 @@ bool AseFormat::onSave(FileOp *fop)
     }
 
     /* write cel chunks */
-    ase_file_write_cels(f, sprite, sprite->getFolder(), frame);
+    ase_file_write_cels(f, sprite, sprite->getFolder(), frame, cels);
 
     /* write the frame header */
     ase_file_write_frame_header(f, &frame_header);
-
-    /* progress */
-    if (sprite->getTotalFrames() > 1)
-      fop_progress(fop, (float)(frame.next()) / (float)(sprite->getTotalFrames()));
   }
 
   /* write the header */
@@ -480,7 +566,29 @@ static void ase_file_write_layers(FILE *f, Layer *layer)
   }
 }
 
-static void ase_file_write_cels(FILE *f, Sprite *sprite, Layer *layer, FrameNumber frame)
+static void ase_file_collect_cels(Sprite *sprite, Layer *layer, FrameNumber frame,
+                                  AseCels& cels)
+{
+  if (layer->isImage()) {
+    Cel* cel = static_cast<LayerImage*>(layer)->getCel(frame);
+    if (cel) {
+      Image* image = sprite->getStock()->getImage(cel->getImage());
+      if (image)
+        cels.addCel(layer, cel, image);
+    }
+  }
+
+  if (layer->isFolder()) {
+    LayerIterator it = static_cast<LayerFolder*>(layer)->getLayerBegin();
+    LayerIterator end = static_cast<LayerFolder*>(layer)->getLayerEnd();
+
+    for (; it != end; ++it)
+      ase_file_collect_cels(sprite, *it, frame, cels);
+  }
+}
+
+static void ase_file_write_cels(FILE *f, Sprite *sprite, Layer *layer, FrameNumber frame,
+                                const AseCels& cels)
 {
   if (layer->isImage()) {
     Cel* cel = static_cast<LayerImage*>(layer)->getCel(frame);
@@ -488,7 +596,8 @@ static void ase_file_write_cels(FILE *f, Sprite *sprite, Layer *layer, FrameNumb
 /*       fop_error(fop, "New cel in frame %d, in layer %d\n", */
 /*                   frame, sprite_layer2index(sprite, layer)); */
 
-      ase_file_write_cel_chunk(f, cel, static_cast<LayerImage*>(layer), sprite);
+      ase_file_write_cel_chunk(f, cel, static_cast<LayerImage*>(layer), sprite,
+                               cels.getEntry(cel));
     }
   }
 
@@ -497,7 +606,7 @@ static void ase_file_write_cels(FILE *f, Sprite *sprite, Layer *layer, FrameNumb
     LayerIterator end = static_cast<LayerFolder*>(layer)->getLayerEnd();
 
     for (; it != end; ++it)
-      ase_file_write_cels(f, sprite, *it, frame);
+      ase_file_write_cels(f, sprite, *it, frame, cels);
   }
 }
 
@@ -859,7 +968,7 @@ static void write_raw_image(FILE* f, Image* image)
 //////////////////////////////////////////////////////////////////////
 
 template<typename ImageTraits>
-static void read_compressed_image(FILE* f, Image* image, size_t chunk_end, FileOp* fop, ASE_Header* header)
+static void decompress_image(const std::vector<uint8_t>& compressed, Image* image)
 {
   PixelIO<ImageTraits> pixel_io;
   z_stream zstream;
@@ -873,57 +982,43 @@ static void read_compressed_image(FILE* f, Image* image, size_t chunk_end, FileO
   if (err != Z_OK)
     throw base::Exception("ZLib error %d in inflateInit().", err);
 
+  // Each scanline is inflated and converted to the image row before
+  // inflating the next one (there is no buffer for the whole image).
   std::vector<uint8_t> scanline(ImageTraits::scanline_size(image->w));
-  std::vector<uint8_t> uncompressed(image->h * ImageTraits::scanline_size(image->w));
-  std::vector<uint8_t> compressed(4096);
-  int uncompressed_offset = 0;
-
-  while (true) {
-    size_t input_bytes;
-
-    if (ftell(f)+compressed.size() > chunk_end) {
-      input_bytes = chunk_end - ftell(f); // Remaining bytes
-      ASSERT(input_bytes < compressed.size());
-
-      if (input_bytes == 0)
-        break;                  // Done, we consumed all chunk
-    }
-    else
-      input_bytes = compressed.size();
 
-    size_t bytes_read = fread(&compressed[0], 1, input_bytes, f);
-    zstream.next_in = (Bytef*)&compressed[0];
-    zstream.avail_in = bytes_read;
+  zstream.next_in = (Bytef*)(compressed.empty() ? NULL: &compressed[0]);
+  zstream.avail_in = compressed.size();
+  err = Z_OK;
 
-    do {
-      zstream.next_out = (Bytef*)&scanline[0];
-      zstream.avail_out = scanline.size();
+  for (y=0; y<image->h; y++) {
+    zstream.next_out = (Bytef*)&scanline[0];
+    zstream.avail_out = scanline.size();
 
+    // When the stream ends before the last row, the missing pixels
+    // are zero.
+    while (err == Z_OK && zstream.avail_out > 0) {
       err = inflate(&zstream, Z_NO_FLUSH);
-      if (err != Z_OK && err != Z_STREAM_END && err != Z_BUF_ERROR)
+      if (err != Z_OK && err != Z_STREAM_END && err != Z_BUF_ERROR) {
+        inflateEnd(&zstream);
         throw base::Exception("ZLib error %d in inflate().", err);
-
-      size_t uncompressed_bytes = scanline.size() - zstream.avail_out;
-      if (uncompressed_bytes > 0) {
-        if (uncompressed_offset+uncompressed_bytes > uncompressed.size())
-          throw base::Exception("Bad compressed image.");
-
-        std::copy(scanline.begin(), scanline.begin()+uncompressed_bytes,
-                  uncompressed.begin()+uncompressed_offset);
-
-        uncompressed_offset += uncompressed_bytes;
       }
-    } while (zstream.avail_out == 0);
+    }
+    std::fill(scanline.end()-zstream.avail_out, scanline.end(), 0);
 
-    fop_progress(fop, (float)ftell(f) / (float)header->size);
+    typename ImageTraits::address_t address = image_address_fast<ImageTraits>(image, 0, y);
+    pixel_io.read_scanline(address, image->w, &scanline[0]);
   }
 
-  uncompressed_offset = 0;
-  for (y=0; y<image->h; y++) {
-    typename ImageTraits::address_t address = image_address_fast<ImageTraits>(image, 0, y);
-    pixel_io.read_scanline(address, image->w, &uncompressed[uncompressed_offset]);
+  // The stream cannot contain more pixels than the image
+  if (err == Z_OK) {
+    zstream.next_out = (Bytef*)&scanline[0];
+    zstream.avail_out = scanline.size();
 
-    uncompressed_offset += ImageTraits::scanline_size(image->w);
+    err = inflate(&zstream, Z_NO_FLUSH);
+    if (zstream.avail_out < scanline.size()) {
+      inflateEnd(&zstream);
+      throw base::Exception("Bad compressed image.");
+    }
   }
 
   err = inflateEnd(&zstream);
@@ -931,8 +1026,55 @@ static void read_compressed_image(FILE* f, Image* image, size_t chunk_end, FileO
     throw base::Exception("ZLib error %d in inflateEnd().", err);
 }
 
+static void decompress_image(const std::vector<uint8_t>& compressed, Image* image)
+{
+  switch (image->getPixelFormat()) {
+
+    case IMAGE_RGB:
+      decompress_image<RgbTraits>(compressed, image);
+      break;
+
+    case IMAGE_GRAYSCALE:
+      decompress_image<GrayscaleTraits>(compressed, image);
+      break;
+
+    case IMAGE_INDEXED:
+      decompress_image<IndexedTraits>(compressed, image);
+      break;
+  }
+}
+
+// Decompresses a cel image the first time it's used.
+class AseImageLoader : public ImageLoader {
+public:
+  AseImageLoader(const SharedPtr<AseCompressedImage>& compressed)
+    : m_compressed(compressed) {
+  }
+
+  Image* loadImage() OVERRIDE {
+    Image* image = Image::create(m_compressed->format, m_compressed->w, m_compressed->h);
+
+    // Errors cannot be reported to the user here (the file was
+    // already loaded), so the error is logged and the image is left
+    // with the mask color instead of partially decompressed pixels.
+    try {
+      decompress_image(m_compressed->data, image);
+    }
+    catch (const std::exception& e) {
+      PRINTF("Error decompressing a %dx%d cel image: %s\n",
+             image->w, image->h, e.what());
+      image_clear(image, image->mask_color);
+    }
+
+    return image;
+  }
+
+private:
+  SharedPtr<AseCompressedImage> m_compressed;
+};
+
 template<typename ImageTraits>
-static void write_compressed_image(FILE* f, Image* image)
+static void compress_image(const Image* image, int level, std::vector<uint8_t>& output)
 {
   PixelIO<ImageTraits> pixel_io;
   z_stream zstream;
@@ -941,7 +1083,7 @@ static void write_compressed_image(FILE* f, Image* image)
   zstream.zalloc = (alloc_func)0;
   zstream.zfree  = (free_func)0;
   zstream.opaque = (voidpf)0;
-  err = deflateInit(&zstream, Z_DEFAULT_COMPRESSION);
+  err = deflateInit(&zstream, level);
   if (err != Z_OK)
     throw base::Exception("ZLib error %d in deflateInit().", err);
 
@@ -949,7 +1091,8 @@ static void write_compressed_image(FILE* f, Image* image)
   std::vector<uint8_t> compressed(4096);
 
   for (y=0; y<image->h; y++) {
-    typename ImageTraits::address_t address = image_address_fast<ImageTraits>(image, 0, y);
+    typename ImageTraits::address_t address =
+      image_address_fast<ImageTraits>(const_cast<Image*>(image), 0, y);
     pixel_io.write_scanline(address, image->w, &scanline[0]);
 
     zstream.next_in = (Bytef*)&scanline[0];
@@ -962,15 +1105,14 @@ static void write_compressed_image(FILE* f, Image* image)
 
       // Compress
       err = deflate(&zstream, flush);
-      if (err != Z_OK && err != Z_STREAM_END && err != Z_BUF_ERROR)
+      if (err != Z_OK && err != Z_STREAM_END && err != Z_BUF_ERROR) {
+        deflateEnd(&zstream);
         throw base::Exception("ZLib error %d in deflate().", err);
+      }
 
       int output_bytes = compressed.size() - zstream.avail_out;
-      if (output_bytes > 0) {
-        if ((fwrite(&compressed[0], 1, output_bytes, f) != (size_t)output_bytes)
-            || ferror(f))
-          throw base::Exception("Error writing compressed image pixels.\n");
-      }
+      if (output_bytes > 0)
+        output.insert(output.end(), compressed.begin(), compressed.begin()+output_bytes);
     } while (zstream.avail_out == 0);
   }
 
@@ -979,13 +1121,66 @@ static void write_compressed_image(FILE* f, Image* image)
     throw base::Exception("ZLib error %d in deflateEnd().", err);
 }
 
+// Compresses one image of AseCels in a worker thread.
+class AseCompressTask {
+public:
+  AseCompressTask(const std::vector<AseCels::Entry*>& entries, int level, FileOp* fop)
+    : m_entries(entries), m_level(level), m_fop(fop), m_done(0) {
+  }
+
+  void operator()(int i) {
+    AseCels::Entry* entry = m_entries[i];
+
+    switch (entry->image->getPixelFormat()) {
+
+      case IMAGE_RGB:
+        compress_image<RgbTraits>(entry->image, m_level, entry->compressed);
+        break;
+
+      case IMAGE_GRAYSCALE:
+        compress_image<GrayscaleTraits>(entry->image, m_level, entry->compressed);
+        break;
+
+      case IMAGE_INDEXED:
+        compress_image<IndexedTraits>(entry->image, m_level, entry->compressed);
+        break;
+    }
+
+    // Compression is the slowest part of the whole operation
+    base::scoped_lock lock(m_mutex);
+    ++m_done;
+    fop_progress(m_fop, (float)m_done / (float)m_entries.size());
+  }
+
+private:
+  const std::vector<AseCels::Entry*>& m_entries;
+  int m_level;
+  FileOp* m_fop;
+  base::mutex m_mutex;
+  int m_done;
+};
+
+void AseCels::compressImages(int level, FileOp* fop)
+{
+  std::vector<Entry*> entries;
+
+  for (Entries::iterator it=m_entries.begin(), end=m_entries.end(); it!=end; ++it) {
+    if (!it->second.link)
+      entries.push_back(&it->second);
+  }
+
+  AseCompressTask task(entries, level, fop);
+  base::parallel_for(entries.size(), task);
+}
+
 //////////////////////////////////////////////////////////////////////
 // Cel Chunk
 //////////////////////////////////////////////////////////////////////
 
 static Cel *ase_file_read_cel_chunk(FILE *f, Sprite *sprite, FrameNumber frame,
                                     PixelFormat pixelFormat,
-                                    FileOp *fop, ASE_Header *header, size_t chunk_end)
+                                    FileOp *fop, ASE_Header *header, size_t chunk_end,
+                                    AseLazyImages& lazyImages)
 {
   /* read chunk data */
   LayerIndex layer_index = LayerIndex(fgetw(f));
@@ -1051,9 +1246,20 @@ static Cel *ase_file_read_cel_chunk(FILE *f, Sprite *sprite, FrameNumber frame,
       Cel* link = static_cast<LayerImage*>(layer)->getCel(link_frame);
 
       if (link) {
-        // Create a copy of the linked cel (avoid using links cel)
-        Image* image = Image::createCopy(sprite->getStock()->getImage(link->getImage()));
-        cel->setImage(sprite->getStock()->addImage(image));
+        AseLazyImages::iterator it = lazyImages.find(link->getImage());
+
+        // The linked cel wasn't decompressed yet, so this cel will
+        // decompress the same data when it's needed.
+        if (it != lazyImages.end()) {
+          int index = sprite->getStock()->addLazyImage(new AseImageLoader(it->second));
+          lazyImages[index] = it->second;
+          cel->setImage(index);
+        }
+        else {
+          // Create a copy of the linked cel (avoid using links cel)
+          Image* image = Image::createCopy(sprite->getStock()->getImage(link->getImage()));
+          cel->setImage(sprite->getStock()->addImage(image));
+        }
       }
       else {
         // Linked cel doesn't found
@@ -1068,32 +1274,39 @@ static Cel *ase_file_read_cel_chunk(FILE *f, Sprite *sprite, FrameNumber frame,
       int h = fgetw(f);
 
       if (w > 0 && h > 0) {
-        Image* image = Image::create(pixelFormat, w, h);
-
-        // Try to read pixel data
-        try {
-          switch (image->getPixelFormat()) {
-
-            case IMAGE_RGB:
-              read_compressed_image<RgbTraits>(f, image, chunk_end, fop, header);
-              break;
+        SharedPtr<AseCompressedImage> compressed(new AseCompressedImage);
+        compressed->format = pixelFormat;
+        compressed->w = w;
+        compressed->h = h;
+
+        // Read the compressed pixels (the rest of the chunk)
+        long pos = ftell(f);
+        if (chunk_end > (size_t)pos) {
+          compressed->data.resize(chunk_end - pos);
+          compressed->data.resize(fread(&compressed->data[0], 1, compressed->data.size(), f));
+        }
 
-            case IMAGE_GRAYSCALE:
-              read_compressed_image<GrayscaleTraits>(f, image, chunk_end, fop, header);
-              break;
+        // Decompress the image when it's used for first time
+        if (fop->lazyimages) {
+          int index = sprite->getStock()->addLazyImage(new AseImageLoader(compressed));
+          lazyImages[index] = compressed;
+          cel->setImage(index);
+        }
+        else {
+          Image* image = Image::create(pixelFormat, w, h);
 
-            case IMAGE_INDEXED:
-              read_compressed_image<IndexedTraits>(f, image, chunk_end, fop, header);
-              break;
+          // Try to decompress pixel data
+          try {
+            decompress_image(compressed->data, image);
+          }
+          // OK, in case of error we can show the problem, but continue
+          // loading more cels.
+          catch (const std::exception& e) {
+            fop_error(fop, e.what());
           }
-        }
-        // OK, in case of error we can show the problem, but continue
-        // loading more cels.
-        catch (const std::exception& e) {
-          fop_error(fop, e.what());
-        }
 
-        cel->setImage(sprite->getStock()->addImage(image));
+          cel->setImage(sprite->getStock()->addImage(image));
+        }
       }
       break;
     }
@@ -1105,10 +1318,11 @@ static Cel *ase_file_read_cel_chunk(FILE *f, Sprite *sprite, FrameNumber frame,
   return newCel;
 }
 
-static void ase_file_write_cel_chunk(FILE *f, Cel *cel, LayerImage *layer, Sprite *sprite)
+static void ase_file_write_cel_chunk(FILE *f, Cel *cel, LayerImage *layer, Sprite *sprite,
+                                     const AseCels::Entry* entry)
 {
   int layer_index = sprite->layerToIndex(layer);
-  int cel_type = ASE_FILE_COMPRESSED_CEL;
+  int cel_type = (entry && entry->link ? ASE_FILE_LINK_CEL: ASE_FILE_COMPRESSED_CEL);
 
   ase_file_write_start_chunk(f, ASE_FILE_CHUNK_CEL);
 
@@ -1155,32 +1369,20 @@ static void ase_file_write_cel_chunk(FILE *f, Cel *cel, LayerImage *layer, Sprit
 
     case ASE_FILE_LINK_CEL:
       // Linked cel to another frame
-      //fputw(link->frame, f);
-      fputw(0, f);
+      fputw(entry->link->getFrame(), f);
       break;
 
     case ASE_FILE_COMPRESSED_CEL: {
-      Image* image = sprite->getStock()->getImage(cel->getImage());
-
-      if (image) {
+      if (entry) {
         // Width and height
-        fputw(image->w, f);
-        fputw(image->h, f);
-
-        // Pixel data
-        switch (image->getPixelFormat()) {
-
-          case IMAGE_RGB:
-            write_compressed_image<RgbTraits>(f, image);
-            break;
-
-          case IMAGE_GRAYSCALE:
-            write_compressed_image<GrayscaleTraits>(f, image);
-            break;
-
-          case IMAGE_INDEXED:
-            write_compressed_image<IndexedTraits>(f, image);
-            break;
+        fputw(entry->image->w, f);
+        fputw(entry->image->h, f);
+
+        // Pixel data (compressed by AseCels::compressImages)
+        if (!entry->compressed.empty()) {
+          if ((fwrite(&entry->compressed[0], 1, entry->compressed.size(), f)
+               != entry->compressed.size()) || ferror(f))
+            throw base::Exception("Error writing compressed image pixels.\n");
         }
       }
       else {
@@ -1252,4 +1454,14 @@ static void ase_file_write_mask_chunk(FILE *f, Mask *mask)
   ase_file_write_close_chunk(f);
 }
 
+// Reads the compression level from the configuration (there is no
+// dialog to ask for it, it's specified in the Options dialog).
+SharedPtr<FormatOptions> AseFormat::onGetFormatOptions(FileOp* fop)
+{
+  SharedPtr<AseOptions> ase_options(new AseOptions());
+  ase_options->compressionLevel =
+    MID(-1, get_config_int("AseFormat", "CompressionLevel", Z_DEFAULT_COMPRESSION), 9);
+  return ase_options;
+}
+
 } // namespace app
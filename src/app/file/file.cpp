@@ -224,6 +224,9 @@ FileOp* fop_to_load_document(const char* filename, int flags)
   if (flags & FILE_LOAD_ONE_FRAME)
     fop->oneframe = true;
 
+  if (flags & FILE_LOAD_LAZY_IMAGES)
+    fop->lazyimages = true;
+
 done:;
   return fop;
 }
@@ -805,6 +808,7 @@ static FileOp* fop_new(FileOpType type)
   fop->done = false;
   fop->stop = false;
   fop->oneframe = false;
+  fop->lazyimages = false;
 
   fop->seq.palette = NULL;
   fop->seq.image = NULL;
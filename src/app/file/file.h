@@ -31,6 +31,7 @@
 #define FILE_LOAD_SEQUENCE_ASK          0x00000002
 #define FILE_LOAD_SEQUENCE_YES          0x00000004
 #define FILE_LOAD_ONE_FRAME             0x00000008
+#define FILE_LOAD_LAZY_IMAGES           0x00000010
 
 namespace base {
   class mutex;
@@ -82,6 +83,8 @@ namespace app {
     bool oneframe : 1;            // Load just one frame (in formats
     // that support animation like
     // GIF/FLI/ASE).
+    bool lazyimages : 1;          // Decompress images when they are
+    // used for first time (ASE).
 
     // Data for sequences.
     struct {
@@ -29,7 +29,8 @@
 #include <cstdlib>
 #include <vector>
 
-using namespace app::file;
+using namespace app;
+using namespace raster;
 
 TEST(File, SeveralSizes)
 {
@@ -20,12 +20,17 @@
 #include "config.h"
 #endif
 
+#include "base/disable_copying.h"
+#include "base/parallel_for.h"
+#include "base/thread.h"
 #include "base/unique_ptr.h"
 #include "app/document.h"
 #include "app/file/file.h"
 #include "app/file/file_format.h"
 #include "app/file/format_options.h"
+#include "app/ini_file.h"
 #include "app/modules/gui.h"
+#include "raster/image_rows.h"
 #include "raster/raster.h"
 #include "ui/alert.h"
 #include "app/util/autocrop.h"
@@ -98,6 +103,43 @@ FileFormat* CreateGifFormat()
 static int interlaced_offset[] = { 0, 4, 2, 1 };
 static int interlaced_jumps[] = { 8, 8, 4, 2 };
 
+// Converts RGB pixels to the index of the nearest palette entry.
+// Pixels with less than 50% of opacity are converted to the
+// transparent index.
+class RgbToIndexed {
+public:
+  RgbToIndexed(const Palette* palette, int transparent_index)
+    : m_palette(palette), m_transparent_index(transparent_index) { }
+
+  IndexedTraits::pixel_t operator()(RgbTraits::pixel_t c) const {
+    if (_rgba_geta(c) >= 128)
+      return m_palette->findBestfit(_rgba_getr(c), _rgba_getg(c), _rgba_getb(c));
+    else
+      return m_transparent_index;
+  }
+
+private:
+  const Palette* m_palette;
+  int m_transparent_index;
+};
+
+class GrayscaleToIndexed {
+public:
+  GrayscaleToIndexed(const Palette* palette, int transparent_index)
+    : m_palette(palette), m_transparent_index(transparent_index) { }
+
+  IndexedTraits::pixel_t operator()(GrayscaleTraits::pixel_t c) const {
+    if (_graya_geta(c) >= 128)
+      return m_palette->findBestfit(_graya_getv(c), _graya_getv(c), _graya_getv(c));
+    else
+      return m_transparent_index;
+  }
+
+private:
+  const Palette* m_palette;
+  int m_transparent_index;
+};
+
 bool GifFormat::onLoad(FileOp* fop)
 {
   base::UniquePtr<GifFileType, int(*)(GifFileType*)> gif_file(DGifOpenFileName(fop->filename.c_str()),
@@ -482,6 +524,153 @@ void GifFormat::onDestroyData(FileOp* fop)
   }
 }
 
+// Images where a group of frames are converted before they are saved.
+class ImagesArray {
+public:
+  ImagesArray(int size, int w, int h) : m_images(size) {
+    for (int i=0; i<size; ++i)
+      m_images[i] = Image::create(IMAGE_INDEXED, w, h);
+  }
+
+  ~ImagesArray() {
+    for (int i=0; i<size(); ++i)
+      delete m_images[i];
+  }
+
+  int size() const { return m_images.size(); }
+  Image* operator[](int i) const { return m_images[i]; }
+
+private:
+  std::vector<Image*> m_images;
+
+  DISABLE_COPYING(ImagesArray);
+};
+
+// Renders each frame of a group and converts it to indexed (this is
+// called from several threads, one frame in each one).
+class ConvertFramesTask {
+public:
+  ConvertFramesTask(const Sprite* sprite, FrameNumber first_frame,
+                    const ImagesArray& images,
+                    int background_color, int transparent_index)
+    : m_sprite(sprite)
+    , m_firstFrame(first_frame)
+    , m_images(images)
+    , m_backgroundColor(background_color)
+    , m_transparentIndex(transparent_index) {
+  }
+
+  void operator()(int i) {
+    FrameNumber frame = m_firstFrame.next(i);
+    Image* current_image = m_images[i];
+    const Palette* palette = m_sprite->getPalette(frame);
+
+    // If the sprite is Indexed, we can render directly into "current_image".
+    if (m_sprite->getPixelFormat() == IMAGE_INDEXED) {
+      image_clear(current_image, m_backgroundColor);
+      layer_render(m_sprite->getFolder(), current_image, 0, 0, frame);
+      return;
+    }
+
+    // If the sprite is RGB or Grayscale, we must to convert it to Indexed on the fly.
+    base::UniquePtr<Image> buffer_image(Image::create(m_sprite->getPixelFormat(),
+                                                      m_sprite->getWidth(),
+                                                      m_sprite->getHeight()));
+    image_clear(buffer_image, 0);
+    layer_render(m_sprite->getFolder(), buffer_image, 0, 0, frame);
+
+    switch (m_sprite->getPixelFormat()) {
+
+      // Convert the RGB image to Indexed
+      case IMAGE_RGB: {
+        RgbToIndexed convert(palette, m_transparentIndex);
+        transform_pixels<RgbTraits, IndexedTraits>(buffer_image, current_image, convert);
+        break;
+      }
+
+      // Convert the Grayscale image to Indexed
+      case IMAGE_GRAYSCALE: {
+        GrayscaleToIndexed convert(palette, m_transparentIndex);
+        transform_pixels<GrayscaleTraits, IndexedTraits>(buffer_image, current_image, convert);
+        break;
+      }
+    }
+  }
+
+private:
+  const Sprite* m_sprite;
+  FrameNumber m_firstFrame;
+  const ImagesArray& m_images;
+  int m_backgroundColor;
+  int m_transparentIndex;
+};
+
+// Copies the "bounds" of "current_image" in "diff_image" replacing
+// the pixels that are equal in "previous_image" with an index that is
+// not used in "bounds" (which is returned, so it can be used as the
+// transparent index of the frame). Returns -1 if all indexes of the
+// palette are used.
+//
+// The previous frame is displayed with its own palette, so if the
+// palette changed, pixels are compared by their RGB values instead
+// of their indexes.
+static int create_diff_image(const Image* current_image,
+                             const Palette* current_palette,
+                             const Image* previous_image,
+                             const Palette* previous_palette,
+                             Image* diff_image,
+                             const gfx::Rect& bounds)
+{
+  std::vector<bool> used(256, false);
+
+  for (int y=bounds.y; y<bounds.y+bounds.h; ++y) {
+    const uint8_t* address = image_address_fast<IndexedTraits>(current_image, bounds.x, y);
+    for (int x=0; x<bounds.w; ++x, ++address)
+      used[*address] = true;
+  }
+
+  int unused_index = -1;
+  for (int i=current_palette->size()-1; i>=0; --i) {
+    if (!used[i]) {
+      unused_index = i;
+      break;
+    }
+  }
+  if (unused_index < 0)
+    return -1;
+
+  bool same_palette =
+    (current_palette == previous_palette ||
+     current_palette->countDiff(previous_palette, NULL, NULL) == 0);
+
+  for (int y=bounds.y; y<bounds.y+bounds.h; ++y) {
+    const uint8_t* current_address = image_address_fast<IndexedTraits>(current_image, bounds.x, y);
+    const uint8_t* previous_address = image_address_fast<IndexedTraits>(previous_image, bounds.x, y);
+    uint8_t* diff_address = image_address_fast<IndexedTraits>(diff_image, bounds.x, y);
+
+    for (int x=0; x<bounds.w; ++x, ++current_address, ++previous_address, ++diff_address) {
+      bool equal;
+
+      if (same_palette)
+        equal = (*current_address == *previous_address);
+      else if (*current_address < current_palette->size() &&
+               *previous_address < previous_palette->size()) {
+        uint32_t c = current_palette->getEntry(*current_address);
+        uint32_t p = previous_palette->getEntry(*previous_address);
+        equal = (_rgba_getr(c) == _rgba_getr(p) &&
+                 _rgba_getg(c) == _rgba_getg(p) &&
+                 _rgba_getb(c) == _rgba_getb(p));
+      }
+      else
+        equal = false;
+
+      *diff_address = (equal ? unused_index: *current_address);
+    }
+  }
+
+  return unused_index;
+}
+
 bool GifFormat::onSave(FileOp* fop)
 {
   base::UniquePtr<GifFileType, int(*)(GifFileType*)> gif_file(EGifOpenFileName(fop->filename.c_str(), 0),
@@ -500,6 +689,7 @@ bool GifFormat::onSave(FileOp* fop)
 
   Palette* current_palette = sprite->getPalette(FrameNumber(0));
   Palette* previous_palette = current_palette;
+  Palette* global_palette = current_palette;
   ColorMapObject* color_map = MakeMapObject(current_palette->size(), NULL);
   for (int i = 0; i < current_palette->size(); ++i) {
     color_map->Colors[i].Red   = _rgba_getr(current_palette->getEntry(i));
@@ -512,65 +702,53 @@ bool GifFormat::onSave(FileOp* fop)
                         background_color, color_map) == GIF_ERROR)
     throw base::Exception("Error writing GIF header.\n");
 
-  base::UniquePtr<Image> buffer_image;
-  base::UniquePtr<Image> current_image(Image::create(IMAGE_INDEXED, sprite_w, sprite_h));
   base::UniquePtr<Image> previous_image(Image::create(IMAGE_INDEXED, sprite_w, sprite_h));
+  base::UniquePtr<Image> diff_image;
   int frame_x, frame_y, frame_w, frame_h;
   int u1, v1, u2, v2;
   int i1, j1, i2, j2;
 
-  // If the sprite is not Indexed type, we will need a temporary
-  // buffer to render the full RGB or Grayscale sprite.
-  if (sprite_format != IMAGE_INDEXED)
-    buffer_image.reset(Image::create(sprite_format, sprite_w, sprite_h));
-
-  image_clear(current_image, background_color);
   image_clear(previous_image, background_color);
 
-  for (FrameNumber frame_num(0); frame_num<sprite->getTotalFrames(); ++frame_num) {
+  // Unchanged pixels can be saved as transparent only if the previous
+  // frame is not disposed, and the sprite doesn't use the transparent
+  // index (i.e. it has a background layer).
+  bool transparent_diff =
+    (get_config_bool("GifFormat", "TransparentDiff", false) &&
+     transparent_index < 0);
+  if (transparent_diff)
+    diff_image.reset(Image::create(IMAGE_INDEXED, sprite_w, sprite_h));
+
+  // Frames are rendered and converted to indexed in groups, one
+  // thread for each frame, before they are compressed by the writer.
+  FrameNumber total_frames = sprite->getTotalFrames();
+  int group_size = MIN(2*base::thread::hardware_concurrency(), (int)total_frames);
+  ImagesArray images(group_size, sprite_w, sprite_h);
+  FrameNumber group_frame(0);
+  int group_frames = 0;
+
+  for (FrameNumber frame_num(0); frame_num<total_frames; ++frame_num) {
     current_palette = sprite->getPalette(frame_num);
 
-    // If the sprite is RGB or Grayscale, we must to convert it to Indexed on the fly.
-    if (sprite_format != IMAGE_INDEXED) {
-      image_clear(buffer_image, 0);
-      layer_render(sprite->getFolder(), buffer_image, 0, 0, frame_num);
-
-      switch (sprite_format) {
-
-        // Convert the RGB image to Indexed
-        case IMAGE_RGB:
-          for (int y = 0; y < sprite_h; ++y)
-            for (int x = 0; x < sprite_w; ++x) {
-              uint32_t pixel_value = image_getpixel_fast<RgbTraits>(buffer_image, x, y);
-              image_putpixel_fast<IndexedTraits>(current_image, x, y,
-                                                 (_rgba_geta(pixel_value) >= 128) ?
-                                                 current_palette->findBestfit(_rgba_getr(pixel_value),
-                                                                              _rgba_getg(pixel_value),
-                                                                              _rgba_getb(pixel_value)):
-                                                 transparent_index);
-            }
-          break;
-
-        // Convert the Grayscale image to Indexed
-        case IMAGE_GRAYSCALE:
-          for (int y = 0; y < sprite_h; ++y)
-            for (int x = 0; x < sprite_w; ++x) {
-              uint16_t pixel_value = image_getpixel_fast<GrayscaleTraits>(buffer_image, x, y);
-              image_putpixel_fast<IndexedTraits>(current_image, x, y,
-                                                 (_graya_geta(pixel_value) >= 128) ?
-                                                 current_palette->findBestfit(_graya_getv(pixel_value),
-                                                                              _graya_getv(pixel_value),
-                                                                              _graya_getv(pixel_value)):
-                                                 transparent_index);
-            }
-          break;
+    // Convert the next group of frames
+    if (frame_num == group_frame.next(group_frames)) {
+      group_frame = frame_num;
+      group_frames = MIN(images.size(), (int)(total_frames - frame_num));
+
+      // The bestfit index of each palette is created before the threads
+      // use it (Palette::findBestfit() creates it on demand).
+      if (sprite_format != IMAGE_INDEXED) {
+        for (int i=0; i<group_frames; ++i)
+          sprite->getPalette(frame_num.next(i))->findBestfit(0, 0, 0);
       }
+
+      ConvertFramesTask task(sprite, group_frame, images, background_color, transparent_index);
+      base::parallel_for(group_frames, task);
     }
-    // If the sprite is Indexed, we can render directly into "current_image".
-    else {
-      image_clear(current_image, background_color);
-      layer_render(sprite->getFolder(), current_image, 0, 0, frame_num);
-    }
+
+    Image* current_image = images[frame_num - group_frame];
+    Image* frame_image = current_image;
+    int frame_transparent_index = transparent_index;
 
     if (frame_num == 0) {
       frame_x = 0;
@@ -589,8 +767,19 @@ bool GifFormat::onSave(FileOp* fop)
           frame_h = MAX(v2, j2) - MIN(v1, j1) + 1;
         }
       }
+
+      if (transparent_diff) {
+        frame_transparent_index =
+          create_diff_image(current_image, current_palette,
+                            previous_image, previous_palette, diff_image,
+                            gfx::Rect(frame_x, frame_y, frame_w, frame_h));
+        if (frame_transparent_index >= 0)
+          frame_image = diff_image;
+      }
     }
 
+    fop_progress(fop, (float)(frame_num+1) / (float)(total_frames));
+
     // Specify loop extension.
     if (frame_num == 0 && loop >= 0) {
       unsigned char extension_bytes[11];
@@ -618,32 +807,36 @@ bool GifFormat::onSave(FileOp* fop)
       int frame_delay = sprite->getFrameDuration(frame_num) / 10;
 
       extension_bytes[0] = (((disposal_method & 7) << 2) |
-                            (transparent_index >= 0 ? 1: 0));
+                            (frame_transparent_index >= 0 ? 1: 0));
       extension_bytes[1] = (frame_delay & 0xff);
       extension_bytes[2] = (frame_delay >> 8) & 0xff;
-      extension_bytes[3] = (transparent_index >= 0 ? transparent_index: 0);
+      extension_bytes[3] = (frame_transparent_index >= 0 ? frame_transparent_index: 0);
 
       if (EGifPutExtension(gif_file, GRAPHICS_EXT_FUNC_CODE, 4, extension_bytes) == GIF_ERROR)
         throw base::Exception("Error writing GIF graphics extension record for frame %d.\n", (int)frame_num);
     }
 
-    // Image color map
+    // Image color map (frames without a color map are displayed with
+    // the global one, not with the color map of the previous frame)
     ColorMapObject* image_color_map = NULL;
-    if (current_palette != previous_palette) {
+    if (current_palette != global_palette) {
       image_color_map = MakeMapObject(current_palette->size(), NULL);
       for (int i = 0; i < current_palette->size(); ++i) {
         image_color_map->Colors[i].Red   = _rgba_getr(current_palette->getEntry(i));
         image_color_map->Colors[i].Green = _rgba_getg(current_palette->getEntry(i));
         image_color_map->Colors[i].Blue  = _rgba_getb(current_palette->getEntry(i));
       }
-      previous_palette = current_palette;
     }
-
-    // Write the image record.
-    if (EGifPutImageDesc(gif_file,
-                         frame_x, frame_y,
-                         frame_w, frame_h, interlace ? 1: 0,
-                         image_color_map) == GIF_ERROR)
+    previous_palette = current_palette;
+
+    // Write the image record (giflib makes its own copy of the color map).
+    int result = EGifPutImageDesc(gif_file,
+                                  frame_x, frame_y,
+                                  frame_w, frame_h, interlace ? 1: 0,
+                                  image_color_map);
+    if (image_color_map)
+      FreeMapObject(image_color_map);
+    if (result == GIF_ERROR)
       throw base::Exception("Error writing GIF frame %d.\n", (int)frame_num);
 
     // Write the image data (pixels).
@@ -651,7 +844,7 @@ bool GifFormat::onSave(FileOp* fop)
       // Need to perform 4 passes on the images.
       for (int i=0; i<4; ++i)
         for (int y = interlaced_offset[i]; y < frame_h; y += interlaced_jumps[i]) {
-          IndexedTraits::address_t addr = image_address_fast<IndexedTraits>(current_image, frame_x, frame_y + y);
+          IndexedTraits::address_t addr = image_address_fast<IndexedTraits>(frame_image, frame_x, frame_y + y);
           if (EGifPutLine(gif_file, addr, frame_w) == GIF_ERROR)
             throw base::Exception("Error writing GIF image scanlines for frame %d.\n", (int)frame_num);
         }
@@ -659,7 +852,7 @@ bool GifFormat::onSave(FileOp* fop)
     else {
       // Write all image scanlines (not interlaced in this case).
       for (int y = 0; y < frame_h; ++y) {
-        IndexedTraits::address_t addr = image_address_fast<IndexedTraits>(current_image, frame_x, frame_y + y);
+        IndexedTraits::address_t addr = image_address_fast<IndexedTraits>(frame_image, frame_x, frame_y + y);
         if (EGifPutLine(gif_file, addr, frame_w) == GIF_ERROR)
           throw base::Exception("Error writing GIF image scanlines for frame %d.\n", (int)frame_num);
       }
@@ -0,0 +1,354 @@
+/* Aseprite
+ * Copyright (C) 2001-2013  David Capello
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#include "tests/test.h"
+
+#include "app/app.h"
+#include "app/document.h"
+#include "app/file/file.h"
+#include "app/ini_file.h"
+#include "base/fs.h"
+#include "base/path.h"
+#include "base/unique_ptr.h"
+#include "raster/raster.h"
+#include "she/she.h"
+#include "ui/base.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+#include <gif_lib.h>
+
+using namespace app;
+using namespace raster;
+
+static const int kWidth = 100;
+static const int kHeight = 80;
+static const int kFrames = 6;
+static const int kColors = 64;
+
+// Frame where the palette of the sprite changes.
+static const int kPaletteFrame = 3;
+
+static std::string temp_file_name(const char* filename)
+{
+  return base::join_path(base::get_temp_path(), filename);
+}
+
+static long file_size(const std::string& filename)
+{
+  FILE* f = std::fopen(filename.c_str(), "rb");
+  if (!f)
+    return -1;
+  std::fseek(f, 0, SEEK_END);
+  long size = std::ftell(f);
+  std::fclose(f);
+  return size;
+}
+
+// Only the first kColors entries of the palette are used, so there are
+// unused indexes to save unchanged pixels as transparent.
+static int random_color(PixelFormat format, const Palette* pal)
+{
+  switch (format) {
+    case IMAGE_RGB: {
+      uint32_t c = pal->getEntry(std::rand() % kColors);
+      return _rgba(_rgba_getr(c), _rgba_getg(c), _rgba_getb(c), 255);
+    }
+    case IMAGE_GRAYSCALE:
+      return _graya(std::rand() % kColors, 255);
+    case IMAGE_INDEXED:
+      return std::rand() % kColors;
+  }
+  return 0;
+}
+
+static void draw_random_rect(Image* image, const Palette* pal, int x, int y, int w, int h)
+{
+  for (int v=y; v<y+h; ++v)
+    for (int u=x; u<x+w; ++u)
+      image_putpixel(image, u, v, random_color(image->getPixelFormat(), pal));
+}
+
+static void add_cel(Sprite* sprite, LayerImage* layer, FrameNumber frame, Image* image, int x, int y)
+{
+  Cel* cel = new Cel(frame, sprite->getStock()->addImage(image));
+  cel->setPosition(x, y);
+  layer->addCel(cel);
+}
+
+// Creates a sprite with two layers: the bottom one with noise that
+// changes only in a small area in each frame (it's the background
+// layer if "background" is true), and a transparent layer with a
+// small image that moves. The palette changes in kPaletteFrame.
+static Document* create_document(PixelFormat format, bool background)
+{
+  base::UniquePtr<Sprite> sprite(new Sprite(format, kWidth, kHeight, 256));
+  sprite->setTotalFrames(FrameNumber(kFrames));
+
+  Palette* pal = sprite->getPalette(FrameNumber(0));
+  for (int i=0; i<pal->size(); ++i)
+    pal->setEntry(i, _rgba(std::rand() & 255, std::rand() & 255, std::rand() & 255, 255));
+
+  Palette newPal(*pal);
+  newPal.setFrame(FrameNumber(kPaletteFrame));
+  for (int i=0; i<16; ++i)
+    newPal.setEntry(std::rand() % kColors, _rgba(std::rand() & 255, std::rand() & 255, std::rand() & 255, 255));
+  sprite->setPalette(&newPal, true);
+
+  // Indexed images use a transparent color different from the mask
+  // color of the cel images.
+  int transparent = 0;
+  if (format == IMAGE_INDEXED && !background) {
+    transparent = 3;
+    sprite->setTransparentColor(transparent);
+  }
+
+  LayerImage* bottom = new LayerImage(sprite);
+  LayerImage* top = new LayerImage(sprite);
+  sprite->getFolder()->addLayer(bottom);
+  sprite->getFolder()->addLayer(top);
+  if (background)
+    bottom->configureAsBackground();
+
+  base::UniquePtr<Image> noise(Image::create(format, kWidth, kHeight));
+  draw_random_rect(noise, pal, 0, 0, kWidth, kHeight);
+
+  for (FrameNumber frame(0); frame<kFrames; ++frame) {
+    const Palette* framePal = sprite->getPalette(frame);
+
+    if (frame > 0)
+      draw_random_rect(noise, framePal, std::rand() % 60, std::rand() % 40, 30, 20);
+    add_cel(sprite, bottom, frame, Image::createCopy(noise), 0, 0);
+
+    // Transparent pixels with holes (using the transparent color of
+    // the sprite in Indexed images).
+    Image* image = Image::create(format, 20, 20);
+    image_clear(image, transparent);
+    draw_random_rect(image, framePal, 2, 2, 16, 16);
+    for (int i=0; i<20; ++i)
+      image_putpixel(image, std::rand() % 20, std::rand() % 20, transparent);
+    add_cel(sprite, top, frame, image, 10*frame, 5*frame);
+  }
+
+  Document* document = new Document(sprite);
+  sprite.release();
+  return document;
+}
+
+// Renders and converts each frame to indexed sequentially (in the same
+// way that GifFormat::onSave() should do it from several threads).
+static Image* render_indexed_frame(const Sprite* sprite, FrameNumber frame)
+{
+  PixelFormat format = sprite->getPixelFormat();
+  int background_color = (format == IMAGE_INDEXED ? sprite->getTransparentColor(): 0);
+  int transparent_index = (sprite->getBackgroundLayer() ? -1: sprite->getTransparentColor());
+  const Palette* pal = sprite->getPalette(frame);
+
+  Image* result = Image::create(IMAGE_INDEXED, sprite->getWidth(), sprite->getHeight());
+  if (format == IMAGE_INDEXED) {
+    image_clear(result, background_color);
+    layer_render(sprite->getFolder(), result, 0, 0, frame);
+    return result;
+  }
+
+  base::UniquePtr<Image> buffer(Image::create(format, sprite->getWidth(), sprite->getHeight()));
+  image_clear(buffer, 0);
+  layer_render(sprite->getFolder(), buffer, 0, 0, frame);
+
+  for (int y=0; y<buffer->h; ++y) {
+    for (int x=0; x<buffer->w; ++x) {
+      int c = image_getpixel(buffer, x, y);
+      int index;
+
+      if (format == IMAGE_RGB)
+        index = (_rgba_geta(c) >= 128 ?
+                 pal->findBestfit(_rgba_getr(c), _rgba_getg(c), _rgba_getb(c)):
+                 transparent_index);
+      else
+        index = (_graya_geta(c) >= 128 ?
+                 pal->findBestfit(_graya_getv(c), _graya_getv(c), _graya_getv(c)):
+                 transparent_index);
+
+      image_putpixel(result, x, y, index);
+    }
+  }
+
+  return result;
+}
+
+// Decodes the GIF file frame by frame (with giflib directly, without
+// the conversions of GifFormat::onLoad()) and compares each frame with
+// the sequentially rendered one. If "compareIndexes" is false, only
+// the RGB values are compared (unchanged pixels can be saved with
+// other indexes when the palette changes).
+static void expect_same_frames(const Sprite* sprite, const std::string& filename, bool compareIndexes)
+{
+  GifFileType* gif = DGifOpenFileName(filename.c_str());
+  ASSERT_TRUE(gif != NULL);
+  ASSERT_NE(GIF_ERROR, DGifSlurp(gif));
+  ASSERT_EQ(kFrames, gif->ImageCount);
+
+  std::vector<int> indexes(kWidth*kHeight, gif->SBackGroundColor);
+  std::vector<int> colors(kWidth*kHeight, -1);
+
+  for (int frame=0; frame<gif->ImageCount; ++frame) {
+    const SavedImage* saved = &gif->SavedImages[frame];
+    const GifImageDesc& desc = saved->ImageDesc;
+    const ColorMapObject* colorMap = (desc.ColorMap ? desc.ColorMap: gif->SColorMap);
+    int transparent = -1;
+    int disposal = 0;
+
+    for (int i=0; i<saved->ExtensionBlockCount; ++i) {
+      const ExtensionBlock* block = &saved->ExtensionBlocks[i];
+      if (block->Function == GRAPHICS_EXT_FUNC_CODE && block->ByteCount >= 4) {
+        disposal = (block->Bytes[0] >> 2) & 7;
+        if (block->Bytes[0] & 1)
+          transparent = (unsigned char)block->Bytes[3];
+      }
+    }
+
+    for (int y=0; y<desc.Height; ++y) {
+      for (int x=0; x<desc.Width; ++x) {
+        int index = saved->RasterBits[y*desc.Width + x];
+        if (index == transparent)
+          continue;
+
+        int i = (desc.Top+y)*kWidth + desc.Left+x;
+        const GifColorType& c = colorMap->Colors[index];
+        indexes[i] = index;
+        colors[i] = _rgba(c.Red, c.Green, c.Blue, 255);
+      }
+    }
+
+    base::UniquePtr<Image> expected(render_indexed_frame(sprite, FrameNumber(frame)));
+    const Palette* pal = sprite->getPalette(FrameNumber(frame));
+
+    for (int y=0; y<kHeight; ++y) {
+      for (int x=0; x<kWidth; ++x) {
+        int index = image_getpixel(expected, x, y);
+        if (compareIndexes)
+          ASSERT_EQ(index, indexes[y*kWidth + x])
+            << "(" << x << ", " << y << ") in frame " << frame;
+
+        // Transparent pixels of sprites without background
+        if (index == (int)sprite->getTransparentColor() && !sprite->getBackgroundLayer())
+          continue;
+
+        ASSERT_EQ(pal->getEntry(index) | _rgba(0, 0, 0, 255), (uint32_t)colors[y*kWidth + x])
+          << "(" << x << ", " << y << ") in frame " << frame;
+      }
+    }
+
+    if (disposal == 2) {
+      for (int y=desc.Top; y<desc.Top+desc.Height; ++y)
+        for (int x=desc.Left; x<desc.Left+desc.Width; ++x) {
+          indexes[y*kWidth + x] = gif->SBackGroundColor;
+          colors[y*kWidth + x] = -1;
+        }
+    }
+  }
+
+  DGifCloseFile(gif);
+}
+
+// The application is initialized once in batch mode (without UI) as
+// save_document() needs it to report unsupported features.
+class GifFormatTest : public ::testing::Test {
+protected:
+  static void SetUpTestCase() {
+    static const char* argv[] = { "gif_format_unittest", "--batch" };
+    m_system = she::CreateSystem();
+    m_guiSystem = new ui::GuiSystem;
+    m_app = new App(2, argv);
+  }
+
+  static void TearDownTestCase() {
+    delete m_app;
+    delete m_guiSystem;
+    m_system->dispose();
+  }
+
+private:
+  static she::System* m_system;
+  static ui::GuiSystem* m_guiSystem;
+  static App* m_app;
+};
+
+she::System* GifFormatTest::m_system = NULL;
+ui::GuiSystem* GifFormatTest::m_guiSystem = NULL;
+App* GifFormatTest::m_app = NULL;
+
+TEST_F(GifFormatTest, FramesEqualToSequentialConversion)
+{
+  set_config_bool("GifFormat", "TransparentDiff", false);
+
+  PixelFormat formats[] = { IMAGE_RGB, IMAGE_GRAYSCALE, IMAGE_INDEXED };
+  std::string fn = temp_file_name("gif_format_unittest.gif");
+  std::srand(1);
+
+  for (int f=0; f<3; ++f) {
+    for (int background=0; background<2; ++background) {
+      base::UniquePtr<Document> doc(create_document(formats[f], background ? true: false));
+      doc->setFilename(fn.c_str());
+      save_document(doc);
+
+      // The saved pixels are the same indexes of the sequential
+      // conversion (so the file is equal to the one saved without
+      // threads).
+      expect_same_frames(doc->getSprite(), fn, true);
+    }
+  }
+
+  std::remove(fn.c_str());
+}
+
+TEST_F(GifFormatTest, TransparentDiff)
+{
+
+  PixelFormat formats[] = { IMAGE_RGB, IMAGE_INDEXED };
+  std::string fn = temp_file_name("gif_format_unittest.gif");
+  std::string diffFn = temp_file_name("gif_format_unittest_diff.gif");
+  std::srand(2);
+
+  for (int f=0; f<2; ++f) {
+    base::UniquePtr<Document> doc(create_document(formats[f], true));
+
+    set_config_bool("GifFormat", "TransparentDiff", false);
+    doc->setFilename(fn.c_str());
+    save_document(doc);
+
+    set_config_bool("GifFormat", "TransparentDiff", true);
+    doc->setFilename(diffFn.c_str());
+    save_document(doc);
+
+    // Unchanged pixels are transparent (with an index that is not
+    // used in the frame), so the frames look the same even after the
+    // palette changes.
+    expect_same_frames(doc->getSprite(), diffFn, false);
+
+    // Noise with small changes is saved as transparent pixels
+    EXPECT_LT(file_size(diffFn), file_size(fn));
+  }
+
+  set_config_bool("GifFormat", "TransparentDiff", false);
+  std::remove(fn.c_str());
+  std::remove(diffFn.c_str());
+}
@@ -73,6 +73,7 @@ namespace app {
 
     virtual int getOpacity() = 0;
     virtual int getTolerance() = 0;
+    virtual bool getContiguous() = 0;
     virtual bool getFilled() = 0;
     virtual bool getPreviewFilled() = 0;
     virtual int getSprayWidth() = 0;
@@ -81,6 +82,7 @@ namespace app {
 
     virtual void setOpacity(int opacity) = 0;
     virtual void setTolerance(int tolerance) = 0;
+    virtual void setContiguous(bool state) = 0;
     virtual void setFilled(bool state) = 0;
     virtual void setPreviewFilled(bool state) = 0;
     virtual void setSprayWidth(int width) = 0;
@@ -475,6 +475,7 @@ class UIToolSettingsImpl : public IToolSettings {
   UIPenSettingsImpl m_pen;
   int m_opacity;
   int m_tolerance;
+  bool m_contiguous;
   bool m_filled;
   bool m_previewFilled;
   int m_spray_width;
@@ -492,6 +493,7 @@ public:
     m_opacity = MID(0, m_opacity, 255);
     m_tolerance = get_config_int(cfg_section.c_str(), "Tolerance", 0);
     m_tolerance = MID(0, m_tolerance, 255);
+    m_contiguous = get_config_bool(cfg_section.c_str(), "Contiguous", true);
     m_filled = false;
     m_previewFilled = get_config_bool(cfg_section.c_str(), "PreviewFilled", false);
     m_spray_width = 16;
@@ -517,6 +519,7 @@ public:
 
     set_config_int(cfg_section.c_str(), "Opacity", m_opacity);
     set_config_int(cfg_section.c_str(), "Tolerance", m_tolerance);
+    set_config_bool(cfg_section.c_str(), "Contiguous", m_contiguous);
     set_config_int(cfg_section.c_str(), "PenType", m_pen.getType());
     set_config_int(cfg_section.c_str(), "PenSize", m_pen.getSize());
     set_config_int(cfg_section.c_str(), "PenAngle", m_pen.getAngle());
@@ -536,6 +539,7 @@ public:
 
   int getOpacity() OVERRIDE { return m_opacity; }
   int getTolerance() OVERRIDE { return m_tolerance; }
+  bool getContiguous() OVERRIDE { return m_contiguous; }
   bool getFilled() OVERRIDE { return m_filled; }
   bool getPreviewFilled() OVERRIDE { return m_previewFilled; }
   int getSprayWidth() OVERRIDE { return m_spray_width; }
@@ -544,6 +548,7 @@ public:
 
   void setOpacity(int opacity) OVERRIDE { m_opacity = opacity; }
   void setTolerance(int tolerance) OVERRIDE { m_tolerance = tolerance; }
+  void setContiguous(bool state) OVERRIDE { m_contiguous = state; }
   void setFilled(bool state) OVERRIDE { m_filled = state; }
   void setPreviewFilled(bool state) OVERRIDE { m_previewFilled = state; }
   void setSprayWidth(int width) OVERRIDE { m_spray_width = width; }
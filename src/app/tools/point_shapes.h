@@ -75,7 +75,8 @@ public:
 
   void transformPoint(ToolLoop* loop, int x, int y)
   {
-    algo_floodfill(loop->getSrcImage(), x, y, loop->getTolerance(), loop, (AlgoHLine)doInkHline);
+    algo_floodfill(loop->getSrcImage(), x, y, loop->getTolerance(),
+                   loop->getContiguous(), loop, (AlgoHLine)doInkHline);
   }
   void getModifiedArea(ToolLoop* loop, int x, int y, Rect& area)
   {
@@ -86,6 +86,13 @@ namespace app {
       // Should return an image where we can write pixels
       virtual Image* getDstImage() = 0;
 
+      // Should be called before reading pixels from getSrcImage() or
+      // modifying pixels of getDstImage() in the given region (sprite
+      // coordinates). The source image is filled on demand, so only
+      // the validated areas contain the original pixels.
+      virtual void validateSrcImage(const gfx::Region& rgn) = 0;
+      virtual void validateDstImage(const gfx::Region& rgn) = 0;
+
       // Returns the RGB map used to convert RGB values to palette index.
       virtual RgbMap* getRgbMap() = 0;
 
@@ -122,6 +129,11 @@ namespace app {
       // Returns the tolerance to be used by the ink (Ink).
       virtual int getTolerance() = 0;
 
+      // Returns true if the flood fill must fill only the contiguous
+      // area of the clicked pixel (or false to fill all pixels with
+      // the same color).
+      virtual bool getContiguous() = 0;
+
       // Returns the current settings. Used to know current
       // foreground/background color (certain tools needs to know the
       // exact foreground/background color, they cannot used the
@@ -60,10 +60,6 @@ void ToolLoopManager::prepareLoop(const Pointer& pointer)
   // Start with no points at all
   m_points.clear();
 
-  // Prepare the image where we will draw on
-  image_copy(m_toolLoop->getDstImage(),
-             m_toolLoop->getSrcImage(), 0, 0);
-
   // Prepare the ink
   m_toolLoop->getInk()->prepareInk(m_toolLoop);
 
@@ -159,6 +155,18 @@ void ToolLoopManager::doLoopStep(bool last_step)
   for (size_t i=0; i<points_to_interwine.size(); ++i)
     points_to_interwine[i] += offset;
 
+  // Calculate the area to be modified in the sprite with this
+  // intertwined set of points
+  Region& dirty_area = m_toolLoop->getDirtyArea();
+  calculateDirtyArea(m_toolLoop, points_to_interwine, dirty_area);
+
+  // Validate the source pixels that the ink can read and the
+  // destination area that will be modified
+  Region src_area;
+  calculateSourceArea(m_toolLoop, dirty_area, src_area);
+  m_toolLoop->validateSrcImage(src_area);
+  m_toolLoop->validateDstImage(dirty_area);
+
   switch (m_toolLoop->getTracePolicy()) {
 
     case TracePolicyAccumulate:
@@ -167,33 +175,34 @@ void ToolLoopManager::doLoopStep(bool last_step)
 
     case TracePolicyLast:
       // Copy source to destination (reset the previous trace). Useful
-      // for tools like Line and Ellipse tools (we kept the last trace only).
-      image_clear(m_toolLoop->getDstImage(), 0);
-      image_copy(m_toolLoop->getDstImage(), m_toolLoop->getSrcImage(), 0, 0);
+      // for tools like Line and Ellipse tools (we kept the last trace
+      // only). Only the area modified by the previous trace differs.
+      image_copy_region(m_toolLoop->getDstImage(), m_toolLoop->getSrcImage(),
+                        m_oldDirtyArea, offset.x, offset.y);
       break;
 
     case TracePolicyOverlap:
       // Copy destination to source (yes, destination to source). In
       // this way each new trace overlaps the previous one.
-      image_copy(m_toolLoop->getSrcImage(), m_toolLoop->getDstImage(), 0, 0);
+      image_copy_region(m_toolLoop->getSrcImage(), m_toolLoop->getDstImage(),
+                        m_oldDirtyArea, offset.x, offset.y);
       break;
   }
 
-  // Get the modified area in the sprite with this intertwined set of points
+  // Draw the intertwined set of points
   if (!m_toolLoop->getFilled() || (!last_step && !m_toolLoop->getPreviewFilled()))
     m_toolLoop->getIntertwine()->joinPoints(m_toolLoop, points_to_interwine);
   else
     m_toolLoop->getIntertwine()->fillPoints(m_toolLoop, points_to_interwine);
 
   // Calculate the area to be updated in all document observers.
-  Region& dirty_area = m_toolLoop->getDirtyArea();
-  calculateDirtyArea(m_toolLoop, points_to_interwine, dirty_area);
-
   if (m_toolLoop->getTracePolicy() == TracePolicyLast) {
     Region prev_dirty_area = dirty_area;
     dirty_area.createUnion(dirty_area, m_oldDirtyArea);
     m_oldDirtyArea = prev_dirty_area;
   }
+  else if (m_toolLoop->getTracePolicy() == TracePolicyOverlap)
+    m_oldDirtyArea = dirty_area;
 
   if (!dirty_area.isEmpty())
     m_toolLoop->updateDirtyArea();
@@ -276,6 +285,32 @@ void ToolLoopManager::calculateDirtyArea(ToolLoop* loop, const Points& points, R
   }
 }
 
+// Some inks read source pixels around the modified area (the blur
+// ink reads the 3x3 neighborhood, and the jumble ink reads pixels
+// displaced by the mouse speed).
+void ToolLoopManager::calculateSourceArea(ToolLoop* loop, const Region& dirty_area, Region& src_area)
+{
+  src_area.clear();
+
+  // In tiled mode inks can read pixels from the other side of the
+  // sprite, so we use the whole sprite area.
+  if (loop->getDocumentSettings()->getTiledMode() != TILED_NONE) {
+    src_area = Region(Rect(0, 0,
+                           loop->getSprite()->getWidth(),
+                           loop->getSprite()->getHeight()));
+    return;
+  }
+
+  Point speed(loop->getSpeed() / 4);
+  int margin = 2 + MAX(ABS(speed.x), ABS(speed.y));
+
+  for (Region::const_iterator it=dirty_area.begin(), end=dirty_area.end();
+       it != end; ++it) {
+    Rect rc = *it;
+    src_area.createUnion(src_area, Region(rc.enlarge(margin)));
+  }
+}
+
 void ToolLoopManager::calculateMinMax(const Points& points, Point& minpt, Point& maxpt)
 {
   ASSERT(points.size() > 0);
@@ -103,6 +103,10 @@ namespace app {
                                      const Points& points,
                                      gfx::Region& dirty_area);
 
+      static void calculateSourceArea(ToolLoop* loop,
+                                      const gfx::Region& dirty_area,
+                                      gfx::Region& src_area);
+
       static void calculateMinMax(const Points& points,
                                   gfx::Point& minpt,
                                   gfx::Point& maxpt);
@@ -246,6 +246,23 @@ protected:
   }
 };
 
+class ContextBar::ContiguousField : public CheckBox
+{
+public:
+  ContiguousField() : CheckBox("Contiguous") {
+  }
+
+protected:
+  void onClick(Event& ev) OVERRIDE {
+    CheckBox::onClick(ev);
+
+    ISettings* settings = UIContext::instance()->getSettings();
+    Tool* currentTool = settings->getCurrentTool();
+    settings->getToolSettings(currentTool)
+      ->setContiguous(isSelected());
+  }
+};
+
 class ContextBar::InkTypeField : public ComboBox
 {
 public:
@@ -344,6 +361,7 @@ ContextBar::ContextBar()
 
   addChild(m_toleranceLabel = new Label("Tolerance:"));
   addChild(m_tolerance = new ToleranceField());
+  addChild(m_contiguous = new ContiguousField());
 
   addChild(m_inkLabel = new Label("Ink:"));
   addChild(m_inkType = new InkTypeField());
@@ -419,6 +437,7 @@ void ContextBar::onCurrentToolChange()
   m_brushAngle->setTextf("%d", penSettings->getAngle());
 
   m_tolerance->setTextf("%d", toolSettings->getTolerance());
+  m_contiguous->setSelected(toolSettings->getContiguous());
 
   m_inkType->setInkType(toolSettings->getInkType());
   m_inkOpacity->setTextf("%d", toolSettings->getOpacity());
@@ -455,6 +474,7 @@ void ContextBar::onCurrentToolChange()
   m_inkOpacity->setVisible(hasOpacity);
   m_toleranceLabel->setVisible(hasTolerance);
   m_tolerance->setVisible(hasTolerance);
+  m_contiguous->setVisible(hasTolerance);
   m_sprayBox->setVisible(hasSprayOptions);
 
   layout();
@@ -46,6 +46,7 @@ namespace app {
     class BrushAngleField;
     class BrushSizeField;
     class ToleranceField;
+    class ContiguousField;
     class InkTypeField;
     class InkOpacityField;
     class SprayWidthField;
@@ -57,6 +58,7 @@ namespace app {
     BrushSizeField* m_brushSize;
     ui::Label* m_toleranceLabel;
     ToleranceField* m_tolerance;
+    ContiguousField* m_contiguous;
     ui::Label* m_inkLabel;
     InkTypeField* m_inkType;
     ui::Label* m_opacityLabel;
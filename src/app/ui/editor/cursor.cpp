@@ -318,7 +318,8 @@ void Editor::editor_draw_cursor(int x, int y, bool refresh)
         (m_sprite,
          gfx::Region(gfx::Rect(x+penBounds.x,
                                y+penBounds.y,
-                               penBounds.w, penBounds.h)));
+                               penBounds.w, penBounds.h)),
+         m_frame);
     }
   }
 
@@ -372,7 +373,7 @@ void Editor::editor_move_cursor(int x, int y, bool refresh)
       gfx::Rect rc1(old_x+penBounds.x, old_y+penBounds.y, penBounds.w, penBounds.h);
       gfx::Rect rc2(new_x+penBounds.x, new_y+penBounds.y, penBounds.w, penBounds.h);
       m_document->notifySpritePixelsModified
-        (m_sprite, gfx::Region(rc1.createUnion(rc2)));
+        (m_sprite, gfx::Region(rc1.createUnion(rc2)), m_frame);
     }
 
     /* save area and draw the cursor */
@@ -434,7 +435,8 @@ void Editor::editor_clean_cursor(bool refresh)
         (m_sprite,
          gfx::Region(gfx::Rect(x+penBounds.x,
                                y+penBounds.y,
-                               penBounds.w, penBounds.h)));
+                               penBounds.w, penBounds.h)),
+         m_frame);
     }
   }
 
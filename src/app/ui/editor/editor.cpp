@@ -161,12 +161,17 @@ Editor::Editor(Document* document)
 
   m_fgColorChangeSlot =
     ColorBar::instance()->FgColorChange.connect(Bind<void>(&Editor::onFgColorChange, this));
+
+  // The render cache must know when the document is modified
+  m_document->addObserver(&m_renderCache);
 }
 
 Editor::~Editor()
 {
   setCustomizationDelegate(NULL);
 
+  m_document->removeObserver(&m_renderCache);
+
   m_mask_timer.stop();
 
   // Remove this editor as observer of CurrentToolChange signal.
@@ -406,6 +411,7 @@ void Editor::drawSpriteUnclippedRect(const gfx::Rect& rc)
 
   if ((width > 0) && (height > 0)) {
     RenderEngine renderEngine(m_document, m_sprite, m_layer, m_frame);
+    renderEngine.setCache(&m_renderCache);
 
     // Generate the rendered image
     base::UniquePtr<Image> rendered
@@ -24,6 +24,7 @@
 #include "app/ui/editor/editor_observers.h"
 #include "app/ui/editor/editor_state.h"
 #include "app/ui/editor/editor_states_history.h"
+#include "app/util/render_cache.h"
 #include "base/compiler_specific.h"
 #include "base/signal.h"
 #include "gfx/fwd.h"
@@ -208,6 +209,10 @@ namespace app {
     FrameNumber m_frame;          // Active frame in the editor
     int m_zoom;                   // Zoom in the editor
 
+    // Flattened layers below/above the active layer (and onion-skin
+    // frames) to redraw the sprite faster.
+    RenderCache m_renderCache;
+
     // Drawing cursor
     int m_cursor_thick;
     int m_cursor_screen_x; // Position in the screen (view)
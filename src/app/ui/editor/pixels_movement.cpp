@@ -418,7 +418,8 @@ void PixelsMovement::moveImage(int x, int y, MoveModifier moveModifier)
   // If "fullBounds" is empty is because the cel was not moved
   if (!fullBounds.isEmpty()) {
     // Notify the modified region.
-    m_document->notifySpritePixelsModified(m_sprite, gfx::Region(fullBounds));
+    m_document->notifySpritePixelsModified(m_sprite, gfx::Region(fullBounds),
+                                           m_reader.frame());
   }
 }
 
@@ -466,6 +467,9 @@ void PixelsMovement::stampImage()
       ExpandCelCanvas expandCelCanvas(writer.context(), TILED_NONE,
                                       m_undoTransaction);
 
+      expandCelCanvas.validateDestCanvas(
+        gfx::Region(gfx::Rect(cel->getX(), cel->getY(), image->w, image->h)));
+
       image_merge(expandCelCanvas.getDestCanvas(), image,
                   -expandCelCanvas.getCel()->getX(),
                   -expandCelCanvas.getCel()->getY(),
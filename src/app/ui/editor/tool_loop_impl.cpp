@@ -76,6 +76,7 @@ class ToolLoopImpl : public tools::ToolLoop,
   gfx::Point m_maskOrigin;
   int m_opacity;
   int m_tolerance;
+  bool m_contiguous;
   gfx::Point m_offset;
   gfx::Point m_speed;
   bool m_canceled;
@@ -163,6 +164,7 @@ public:
 
     m_opacity = m_toolSettings->getOpacity();
     m_tolerance = m_toolSettings->getTolerance();
+    m_contiguous = m_toolSettings->getContiguous();
     m_speed.x = 0;
     m_speed.y = 0;
 
@@ -202,6 +204,12 @@ public:
   Layer* getLayer() OVERRIDE { return m_layer; }
   Image* getSrcImage() OVERRIDE { return m_expandCelCanvas.getSourceCanvas(); }
   Image* getDstImage() OVERRIDE { return m_expandCelCanvas.getDestCanvas(); }
+  void validateSrcImage(const gfx::Region& rgn) OVERRIDE {
+    m_expandCelCanvas.validateSourceCanvas(rgn);
+  }
+  void validateDstImage(const gfx::Region& rgn) OVERRIDE {
+    m_expandCelCanvas.validateDestCanvas(rgn);
+  }
   RgbMap* getRgbMap() OVERRIDE { return m_sprite->getRgbMap(m_frame); }
   bool useMask() OVERRIDE { return m_useMask; }
   Mask* getMask() OVERRIDE { return m_mask; }
@@ -213,6 +221,7 @@ public:
   void setSecondaryColor(int color) OVERRIDE { m_secondary_color = color; }
   int getOpacity() OVERRIDE { return m_opacity; }
   int getTolerance() OVERRIDE { return m_tolerance; }
+  bool getContiguous() OVERRIDE { return m_contiguous; }
   ISettings* getSettings() OVERRIDE { return m_settings; }
   IDocumentSettings* getDocumentSettings() OVERRIDE { return m_docSettings; }
   bool getFilled() OVERRIDE { return m_filled; }
@@ -247,7 +256,7 @@ public:
 
   void updateDirtyArea() OVERRIDE
   {
-    m_document->notifySpritePixelsModified(m_sprite, m_dirtyArea);
+    m_document->notifySpritePixelsModified(m_sprite, m_dirtyArea, m_frame);
   }
 
   void updateStatusBar(const char* text) OVERRIDE
@@ -46,6 +46,8 @@ namespace app {
       Modification getModification() const { return m_modification; }
       bool isOpenGroup() const OVERRIDE { return false; }
       bool isCloseGroup() const OVERRIDE { return true; }
+      bool swapOut(std::ostream& os) OVERRIDE { return false; }
+      void swapIn(std::istream& is) OVERRIDE { }
       void revert(ObjectsContainer* objects, UndoersCollector* redoers) OVERRIDE;
 
       const char* getLabel() { return m_label; }
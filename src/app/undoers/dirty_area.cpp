@@ -29,6 +29,9 @@
 #include "undo/objects_container.h"
 #include "undo/undoers_collector.h"
 
+#include <sstream>
+#include <string>
+
 namespace app {
 namespace undoers {
 
@@ -37,7 +40,11 @@ using namespace undo;
 DirtyArea::DirtyArea(ObjectsContainer* objects, Image* image, Dirty* dirty)
   : m_imageId(objects->addObject(image))
 {
-  raster::write_dirty(m_stream, dirty);
+  std::ostringstream os;
+  raster::write_dirty(os, dirty);
+
+  const std::string& data = os.str();
+  m_data.compress(data.c_str(), data.size());
 }
 
 void DirtyArea::dispose()
@@ -48,7 +55,12 @@ void DirtyArea::dispose()
 void DirtyArea::revert(ObjectsContainer* objects, UndoersCollector* redoers)
 {
   Image* image = objects->getObjectT<Image>(m_imageId);
-  base::UniquePtr<Dirty> dirty(raster::read_dirty(m_stream));
+  std::string data(m_data.getUncompressedSize(), 0);
+  if (!data.empty())
+    m_data.uncompress(&data[0]);
+
+  std::istringstream is(data);
+  base::UniquePtr<Dirty> dirty(raster::read_dirty(is));
 
   // Swap the saved pixels in the dirty with the pixels in the image
   dirty->swapImagePixels(image);
@@ -58,5 +70,21 @@ void DirtyArea::revert(ObjectsContainer* objects, UndoersCollector* redoers)
   redoers->pushUndoer(new DirtyArea(objects, image, dirty));
 }
 
+bool DirtyArea::swapOut(std::ostream& os)
+{
+  m_data.write(os);
+  os.flush();
+  if (!os.good())
+    return false;
+
+  m_data.clear();
+  return true;
+}
+
+void DirtyArea::swapIn(std::istream& is)
+{
+  m_data.read(is);
+}
+
 } // namespace undoers
 } // namespace app
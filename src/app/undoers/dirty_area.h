@@ -20,10 +20,9 @@
 #define APP_UNDOERS_DIRTY_AREA_H_INCLUDED
 
 #include "app/undoers/undoer_base.h"
+#include "raster/compressed_data.h"
 #include "undo/object_id.h"
 
-#include <sstream>
-
 namespace raster {
   class Dirty;
   class Image;
@@ -39,16 +38,14 @@ namespace app {
       DirtyArea(ObjectsContainer* objects, Image* image, Dirty* dirty);
 
       void dispose() OVERRIDE;
-      size_t getMemSize() const OVERRIDE { return sizeof(*this) + getStreamSize(); }
+      size_t getMemSize() const OVERRIDE { return sizeof(*this) + m_data.getCompressedSize(); }
       void revert(ObjectsContainer* objects, UndoersCollector* redoers) OVERRIDE;
+      bool swapOut(std::ostream& os) OVERRIDE;
+      void swapIn(std::istream& is) OVERRIDE;
 
     private:
-      size_t getStreamSize() const {
-        return const_cast<std::stringstream*>(&m_stream)->tellp();
-      }
-
       ObjectId m_imageId;
-      std::stringstream m_stream;
+      CompressedData m_data;    // Serialized Dirty (see write_dirty)
     };
 
   } // namespace undoers
@@ -35,15 +35,20 @@ using namespace undo;
 ImageArea::ImageArea(ObjectsContainer* objects, Image* image, int x, int y, int w, int h)
   : m_imageId(objects->addObject(image))
   , m_format(image->getPixelFormat())
-  , m_x(x), m_y(y), m_w(w), m_h(h)
-  , m_lineSize(image_line_size(image, w))
-  , m_data(m_lineSize * h)
+  , m_tiles(image, gfx::Rect(x, y, w, h))
 {
   ASSERT(w >= 1 && h >= 1);
   ASSERT(x >= 0 && y >= 0 && x+w <= image->w && y+h <= image->h);
+}
 
-  for (int v=0; v<h; ++v)
-    memcpy(&m_data[m_lineSize*v], image_address(image, x, y+v), m_lineSize);
+ImageArea::ImageArea(ObjectsContainer* objects, Image* image, const ImageTiles& tiles)
+  : m_imageId(objects->addObject(image))
+  , m_format(image->getPixelFormat())
+  , m_tiles(tiles)
+{
+  // Tiles that are equal in "tiles" and in the current image are
+  // kept shared between both undoers.
+  m_tiles.updateFromImage(image, m_tiles.getBounds());
 }
 
 void ImageArea::dispose()
@@ -59,11 +64,10 @@ void ImageArea::revert(ObjectsContainer* objects, UndoersCollector* redoers)
     throw UndoException("Image type does not match");
 
   // Backup the current image portion
-  redoers->pushUndoer(new ImageArea(objects, image, m_x, m_y, m_w, m_h));
+  redoers->pushUndoer(new ImageArea(objects, image, m_tiles));
 
   // Restore the old image portion
-  for (int v=0; v<m_h; ++v)
-    memcpy(image_address(image, m_x, m_y+v), &m_data[m_lineSize*v], m_lineSize);
+  m_tiles.copyToImage(image);
 }
 
 } // namespace undoers
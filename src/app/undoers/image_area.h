@@ -20,10 +20,9 @@
 #define APP_UNDOERS_IMAGE_AREA_H_INCLUDED
 
 #include "app/undoers/undoer_base.h"
+#include "raster/image_tiles.h"
 #include "undo/object_id.h"
 
-#include <vector>
-
 namespace raster {
   class Image;
 }
@@ -38,15 +37,17 @@ namespace app {
       ImageArea(ObjectsContainer* objects, Image* image, int x, int y, int w, int h);
 
       void dispose() OVERRIDE;
-      size_t getMemSize() const OVERRIDE { return sizeof(*this) + m_data.size(); }
+      size_t getMemSize() const OVERRIDE { return sizeof(*this) + m_tiles.getMemSize(); }
       void revert(ObjectsContainer* objects, UndoersCollector* redoers) OVERRIDE;
+      bool swapOut(std::ostream& os) OVERRIDE { return m_tiles.swapOut(os); }
+      void swapIn(std::istream& is) OVERRIDE { m_tiles.swapIn(is); }
 
     private:
+      ImageArea(ObjectsContainer* objects, Image* image, const ImageTiles& tiles);
+
       ObjectId m_imageId;
       uint8_t m_format;
-      uint16_t m_x, m_y, m_w, m_h;
-      uint32_t m_lineSize;
-      std::vector<uint8_t> m_data;
+      ImageTiles m_tiles;
     };
 
   } // namespace undoers
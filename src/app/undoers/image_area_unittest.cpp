@@ -0,0 +1,101 @@
+/* Aseprite
+ * Copyright (C) 2001-2013  David Capello
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#include "tests/test.h"
+
+#include "app/objects_container_impl.h"
+#include "app/undoers/image_area.h"
+#include "base/unique_ptr.h"
+#include "raster/image.h"
+#include "undo/undoer.h"
+#include "undo/undoers_stack.h"
+
+#include <cstdlib>
+
+using namespace app;
+using namespace app::undoers;
+using namespace raster;
+using namespace undo;
+
+// The size of the stack must be the sum of the sizes of its undoers.
+static void expect_balanced_size(const UndoersStack& stack)
+{
+  size_t size = 0;
+  for (UndoersStack::const_iterator it=stack.begin(), end=stack.end(); it!=end; ++it)
+    size += (*it)->getMemSize();
+
+  EXPECT_EQ(size, stack.getMemSize());
+}
+
+// Pops the last undoer from "from" and reverts it into "to".
+static void revert(ObjectsContainer* objects, UndoersStack& from, UndoersStack& to)
+{
+  Undoer* undoer = from.popUndoer(UndoersStack::PopFromHead);
+  ASSERT_TRUE(undoer != NULL);
+  undoer->revert(objects, &to);
+  undoer->dispose();
+}
+
+static void draw_random_rect(Image* image, int x, int y, int w, int h)
+{
+  for (int v=y; v<y+h; ++v)
+    for (int u=x; u<x+w; ++u)
+      image->putpixel(u, v, _rgba(std::rand() & 255, std::rand() & 255, std::rand() & 255, 255));
+}
+
+TEST(ImageArea, UndoRedoKeepsStackSizeBalanced)
+{
+  ObjectsContainerImpl objects;
+  base::UniquePtr<Image> image(Image::create(IMAGE_RGB, 300, 200));
+  image_clear(image, _rgba(0, 0, 0, 255));
+  std::srand(1);
+
+  UndoersStack undoers(NULL);
+  UndoersStack redoers(NULL);
+
+  // Two changes that modify only some tiles of the image, so the
+  // undoers and redoers share the other tiles.
+  for (int i=0; i<2; ++i) {
+    undoers.pushUndoer(new ImageArea(&objects, image, 0, 0, 300, 200));
+    draw_random_rect(image, 10+i*100, 10, 50, 50);
+  }
+  expect_balanced_size(undoers);
+
+  // Undo, redo, and undo again
+  revert(&objects, undoers, redoers);
+  expect_balanced_size(undoers);
+  expect_balanced_size(redoers);
+
+  revert(&objects, redoers, undoers);
+  expect_balanced_size(undoers);
+  expect_balanced_size(redoers);
+
+  revert(&objects, undoers, redoers);
+  revert(&objects, undoers, redoers);
+  expect_balanced_size(undoers);
+  expect_balanced_size(redoers);
+
+  // Remove all redoers in the same order they are discarded by the
+  // UndoHistory (from the tail)
+  while (Undoer* undoer = redoers.popUndoer(UndoersStack::PopFromTail)) {
+    undoer->dispose();
+    expect_balanced_size(redoers);
+  }
+  EXPECT_EQ(0u, redoers.getMemSize());
+  EXPECT_EQ(0u, undoers.getMemSize());
+}
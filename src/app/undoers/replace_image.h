@@ -40,6 +40,8 @@ namespace app {
       void dispose() OVERRIDE;
       size_t getMemSize() const OVERRIDE { return sizeof(*this) + getStreamSize(); }
       void revert(ObjectsContainer* objects, UndoersCollector* redoers) OVERRIDE;
+      bool swapOut(std::ostream& os) OVERRIDE { return swapOutStream(os, m_stream); }
+      void swapIn(std::istream& is) OVERRIDE { swapInStream(is, m_stream); }
 
     private:
       size_t getStreamSize() const {
@@ -36,6 +36,8 @@ namespace app {
       void dispose() OVERRIDE;
       size_t getMemSize() const OVERRIDE { return sizeof(*this) + getStreamSize(); }
       void revert(undo::ObjectsContainer* objects, undo::UndoersCollector* redoers) OVERRIDE;
+      bool swapOut(std::ostream& os) OVERRIDE { return swapOutStream(os, m_stream); }
+      void swapIn(std::istream& is) OVERRIDE { swapInStream(is, m_stream); }
 
     private:
       size_t getStreamSize() const {
@@ -0,0 +1,80 @@
+/* Aseprite
+ * Copyright (C) 2001-2013  David Capello
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "app/undoers/undoer_base.h"
+
+#include "base/serialization.h"
+#include "undo/undo_exception.h"
+
+#include <iostream>
+#include <string>
+
+namespace app {
+namespace undoers {
+
+using namespace base::serialization;
+using namespace base::serialization::little_endian;
+
+// Swapped out stream data:
+//
+//    DWORD             size of the data
+//    BYTE[size]        data
+
+// static
+bool UndoerBase::swapOutStream(std::ostream& os, std::stringstream& stream)
+{
+  const std::string& data = stream.str();
+
+  write32(os, data.size());
+  os.write(data.c_str(), data.size());
+
+  // The stream is released only if the data was written
+  os.flush();
+  if (!os.good())
+    return false;
+
+  // Release the memory used by the stream
+  stream.str(std::string());
+  stream.clear();
+  return true;
+}
+
+// static
+void UndoerBase::swapInStream(std::istream& is, std::stringstream& stream)
+{
+  size_t size = read32(is);
+  if (!is.good())
+    throw undo::UndoException("Error reading undo data from the swap stream");
+
+  std::string data(size, 0);
+  if (!data.empty()) {
+    is.read(&data[0], data.size());
+    if (!is.good())
+      throw undo::UndoException("Error reading undo data from the swap stream");
+  }
+
+  stream.str(data);
+  stream.clear();
+}
+
+} // namespace undoers
+} // namespace app
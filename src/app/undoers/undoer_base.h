@@ -22,6 +22,8 @@
 #include "base/compiler_specific.h"
 #include "undo/undoer.h"
 
+#include <sstream>
+
 namespace app {
   namespace undoers {
 
@@ -32,6 +34,14 @@ namespace app {
       undo::Modification getModification() const OVERRIDE { return undo::DoesntModifyDocument; }
       bool isOpenGroup() const OVERRIDE { return false; }
       bool isCloseGroup() const OVERRIDE { return false; }
+      bool swapOut(std::ostream& os) OVERRIDE { return false; }
+      void swapIn(std::istream& is) OVERRIDE { }
+
+    protected:
+      // Helpers to implement swapOut()/swapIn() in undoers that keep
+      // their data in a std::stringstream.
+      static bool swapOutStream(std::ostream& os, std::stringstream& stream);
+      static void swapInStream(std::istream& is, std::stringstream& stream);
     };
 
   } // namespace undoers
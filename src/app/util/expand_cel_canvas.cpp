@@ -34,10 +34,13 @@
 #include "base/unique_ptr.h"
 #include "raster/cel.h"
 #include "raster/dirty.h"
+#include "raster/image_tiles.h"
 #include "raster/layer.h"
 #include "raster/sprite.h"
 #include "raster/stock.h"
 
+#include <cstring>
+
 namespace app {
 
 ExpandCelCanvas::ExpandCelCanvas(Context* context, TiledMode tiledMode, UndoTransaction& undo)
@@ -91,13 +94,20 @@ ExpandCelCanvas::ExpandCelCanvas(Context* context, TiledMode tiledMode, UndoTran
     y2 = m_sprite->getHeight();
   }
 
-  // create two copies of the image region which we'll modify with the tool
-  m_srcImage = image_crop(m_celImage,
+  m_bounds = gfx::Rect(x1, y1, x2-x1, y2-y1);
+
+  // Create a copy of the image region which we'll modify with the
+  // tool. The destination canvas is a complete copy because it is
+  // used to preview the whole cel (see RenderEngine::setPreviewImage),
+  // but the source canvas is filled on demand (validateSourceCanvas).
+  m_dstImage = image_crop(m_celImage,
                           x1-m_cel->getX(),
                           y1-m_cel->getY(), x2-x1, y2-y1,
                           m_sprite->getTransparentColor());
 
-  m_dstImage = Image::createCopy(m_srcImage);
+  m_srcImage = Image::create(m_dstImage->getPixelFormat(),
+                             m_dstImage->w, m_dstImage->h);
+  m_srcImage->mask_color = m_dstImage->mask_color;
 
   // We have to adjust the cel position to match the m_dstImage
   // position (the new m_dstImage will be used in RenderEngine to
@@ -133,8 +143,9 @@ void ExpandCelCanvas::commit()
     if (m_celCreated) {
       // We can keep the m_celImage
 
-      // We copy the destination image to the m_celImage
-      image_copy(m_celImage, m_dstImage, 0, 0);
+      // We copy the destination image to the m_celImage (the rest
+      // of m_celImage is already cleared)
+      copyValidDestToCelImage();
 
       // Add the m_celImage in the images stock of the sprite.
       m_cel->setImage(m_sprite->getStock()->addImage(m_celImage));
@@ -159,7 +170,8 @@ void ExpandCelCanvas::commit()
     else {
       // Add to the undo history the differences between m_celImage and m_dstImage
       if (m_undo.isEnabled()) {
-        base::UniquePtr<Dirty> dirty(new Dirty(m_celImage, m_dstImage));
+        base::UniquePtr<Dirty> dirty(new Dirty(m_celImage, m_dstImage,
+                                               m_validDstRegion));
 
         dirty->saveImagePixels(m_celImage);
         if (dirty != NULL)
@@ -167,7 +179,7 @@ void ExpandCelCanvas::commit()
       }
 
       // Copy the destination to the cel image.
-      image_copy(m_celImage, m_dstImage, 0, 0);
+      copyValidDestToCelImage();
     }
   }
   // If the size of both images are different, we have to
@@ -219,4 +231,91 @@ void ExpandCelCanvas::rollback()
   m_closed = true;
 }
 
+void ExpandCelCanvas::validateSourceCanvas(const gfx::Region& rgn)
+{
+  gfx::Region rgnToValidate;
+  getTilesRegion(rgn, rgnToValidate);
+  rgnToValidate.createSubtraction(rgnToValidate, m_validSrcRegion);
+  if (rgnToValidate.isEmpty())
+    return;
+
+  m_validSrcRegion.createUnion(m_validSrcRegion, rgnToValidate);
+
+  // Bounds of the original cel image in canvas coordinates
+  gfx::Rect celBounds(m_originalCelX - m_bounds.x,
+                      m_originalCelY - m_bounds.y,
+                      m_celImage->w, m_celImage->h);
+
+  for (gfx::Region::const_iterator it=rgnToValidate.begin(), end=rgnToValidate.end();
+       it != end; ++it) {
+    const gfx::Rect& rc = *it;
+    gfx::Rect area = rc.createIntersect(celBounds);
+
+    if (area != rc)
+      image_rectfill(m_srcImage, rc.x, rc.y, rc.x+rc.w-1, rc.y+rc.h-1,
+                     m_sprite->getTransparentColor());
+
+    if (area.isEmpty())
+      continue;
+
+    int line_size = image_line_size(m_srcImage, area.w);
+    for (int y=area.y; y<area.y+area.h; ++y)
+      std::memcpy(image_address(m_srcImage, area.x, y),
+                  image_address(m_celImage, area.x - celBounds.x, y - celBounds.y),
+                  line_size);
+  }
+}
+
+void ExpandCelCanvas::validateDestCanvas(const gfx::Region& rgn)
+{
+  // The destination canvas is a complete copy of the cel, here we
+  // only keep track of the modified tiles.
+  gfx::Region tiles;
+  getTilesRegion(rgn, tiles);
+  m_validDstRegion.createUnion(m_validDstRegion, tiles);
+}
+
+// Converts the given region in sprite coordinates to the region of
+// tiles (in canvas coordinates) that intersect it.
+void ExpandCelCanvas::getTilesRegion(const gfx::Region& rgn, gfx::Region& tiles) const
+{
+  const int tileSize = ImageTiles::TileSize;
+  gfx::Rect canvasBounds(0, 0, m_bounds.w, m_bounds.h);
+
+  tiles.clear();
+  for (gfx::Region::const_iterator it=rgn.begin(), end=rgn.end();
+       it != end; ++it) {
+    gfx::Rect rc = *it;
+    rc.offset(-m_bounds.x, -m_bounds.y);
+    rc = rc.createIntersect(canvasBounds);
+    if (rc.isEmpty())
+      continue;
+
+    int u1 = rc.x / tileSize;
+    int v1 = rc.y / tileSize;
+    int u2 = (rc.x+rc.w-1) / tileSize;
+    int v2 = (rc.y+rc.h-1) / tileSize;
+
+    rc = gfx::Rect(u1*tileSize, v1*tileSize,
+                   (u2-u1+1)*tileSize, (v2-v1+1)*tileSize);
+    tiles.createUnion(tiles, gfx::Region(rc.createIntersect(canvasBounds)));
+  }
+}
+
+void ExpandCelCanvas::copyValidDestToCelImage()
+{
+  ASSERT(m_celImage->w == m_dstImage->w);
+  ASSERT(m_celImage->h == m_dstImage->h);
+
+  for (gfx::Region::const_iterator it=m_validDstRegion.begin(), end=m_validDstRegion.end();
+       it != end; ++it) {
+    const gfx::Rect& rc = *it;
+    int line_size = image_line_size(m_dstImage, rc.w);
+
+    for (int y=rc.y; y<rc.y+rc.h; ++y)
+      std::memcpy(image_address(m_celImage, rc.x, y),
+                  image_address(m_dstImage, rc.x, y), line_size);
+  }
+}
+
 } // namespace app
@@ -20,6 +20,8 @@
 #define APP_UTIL_EXPAND_CEL_CANVAS_H_INCLUDED
 
 #include "filters/tiled_mode.h"
+#include "gfx/rect.h"
+#include "gfx/region.h"
 
 namespace raster {
   class Cel;
@@ -56,21 +58,37 @@ namespace app {
     // was created.
     void rollback();
 
-    // You can read pixels from here
+    // You can read pixels from here (only inside the areas
+    // validated with validateSourceCanvas())
     Image* getSourceCanvas() {    // TODO this should be "const"
       return m_srcImage;
     }
 
-    // You can write pixels right here
+    // You can write pixels right here (only inside the areas
+    // validated with validateDestCanvas())
     Image* getDestCanvas() {
       return m_dstImage;
     }
 
+    // Copies the original pixels of the cel in the given region
+    // (sprite coordinates) to the source canvas. The source canvas is
+    // filled on demand in tiles of ImageTiles::TileSize pixels.
+    void validateSourceCanvas(const gfx::Region& rgn);
+
+    // Marks the given region (sprite coordinates) of the destination
+    // canvas as modified. Only the touched tiles are compared with
+    // the original cel image in commit() to create the undo
+    // information.
+    void validateDestCanvas(const gfx::Region& rgn);
+
     const Cel* getCel() const {
       return m_cel;
     }
 
   private:
+    void getTilesRegion(const gfx::Region& rgn, gfx::Region& tiles) const;
+    void copyValidDestToCelImage();
+
     Document* m_document;
     Sprite* m_sprite;
     Layer* m_layer;
@@ -81,6 +99,9 @@ namespace app {
     int m_originalCelY;
     Image* m_srcImage;
     Image* m_dstImage;
+    gfx::Rect m_bounds;
+    gfx::Region m_validSrcRegion;
+    gfx::Region m_validDstRegion;
     bool m_closed;
     bool m_committed;
     UndoTransaction& m_undo;
@@ -0,0 +1,152 @@
+/* Aseprite
+ * Copyright (C) 2001-2013  David Capello
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#include "tests/test.h"
+
+#include "app/app.h"
+#include "app/context.h"
+#include "app/document.h"
+#include "app/document_location.h"
+#include "app/document_undo.h"
+#include "app/undo_transaction.h"
+#include "app/util/expand_cel_canvas.h"
+#include "base/unique_ptr.h"
+#include "raster/raster.h"
+#include "she/she.h"
+#include "ui/base.h"
+
+#include <cstdlib>
+
+using namespace app;
+using namespace raster;
+
+// Context where the active location is the first cel of a document.
+class TestContext : public Context {
+public:
+  TestContext(Document* document) : Context(NULL), m_document(document) { }
+
+protected:
+  void onGetActiveLocation(DocumentLocation* location) const OVERRIDE {
+    Sprite* sprite = m_document->getSprite();
+    location->document(m_document);
+    location->sprite(sprite);
+    location->layer(sprite->getFolder()->getFirstLayer());
+    location->frame(FrameNumber(0));
+  }
+
+private:
+  Document* m_document;
+};
+
+// The undo history needs the configuration of the App.
+class ExpandCelCanvasTest : public ::testing::Test {
+protected:
+  static void SetUpTestCase() {
+    static const char* argv[] = { "expand_cel_canvas_unittest", "--batch" };
+    m_system = she::CreateSystem();
+    m_guiSystem = new ui::GuiSystem;
+    m_app = new App(2, argv);
+  }
+
+  static void TearDownTestCase() {
+    delete m_app;
+    delete m_guiSystem;
+    m_system->dispose();
+  }
+
+private:
+  static she::System* m_system;
+  static ui::GuiSystem* m_guiSystem;
+  static App* m_app;
+};
+
+she::System* ExpandCelCanvasTest::m_system = NULL;
+ui::GuiSystem* ExpandCelCanvasTest::m_guiSystem = NULL;
+App* ExpandCelCanvasTest::m_app = NULL;
+
+static void draw_random_pixels(Image* image, const gfx::Rect& rc)
+{
+  for (int y=rc.y; y<rc.y+rc.h; ++y)
+    for (int x=rc.x; x<rc.x+rc.w; ++x)
+      if (std::rand() % 2)
+        image->putpixel(x, y, _rgba(std::rand() & 255, std::rand() & 255, std::rand() & 255, 255));
+}
+
+static bool equal_pixels(const Image* a, const Image* b, const gfx::Rect& rc)
+{
+  for (int y=rc.y; y<rc.y+rc.h; ++y)
+    for (int x=rc.x; x<rc.x+rc.w; ++x)
+      if (a->getpixel(x, y) != b->getpixel(x, y))
+        return false;
+  return true;
+}
+
+// The source canvas is filled only in the validated tiles and only
+// these tiles are compared to create the undo information, this must
+// give the same result as the old full copy of the cel image.
+TEST_F(ExpandCelCanvasTest, ValidatedTilesGiveSameResultThanFullCopy)
+{
+  const int w = 200, h = 150;
+  base::UniquePtr<Document> doc(Document::createBasicDocument(IMAGE_RGB, w, h, 256));
+  Sprite* sprite = doc->getSprite();
+  Image* celImage = sprite->getStock()->getImage(
+    static_cast<LayerImage*>(sprite->getFolder()->getFirstLayer())->getCel(FrameNumber(0))->getImage());
+  std::srand(1);
+  draw_random_pixels(celImage, gfx::Rect(0, 0, w, h));
+
+  // Old implementation: source and destination canvas are complete
+  // copies of the cel image.
+  base::UniquePtr<Image> original(Image::createCopy(celImage));
+  base::UniquePtr<Image> expected(Image::createCopy(celImage));
+
+  TestContext context(doc);
+  {
+    UndoTransaction undo(&context, "Test");
+    ExpandCelCanvas canvas(&context, TILED_NONE, undo);
+
+    gfx::Rect areas[] = { gfx::Rect(5, 5, 10, 10),
+                          gfx::Rect(100, 60, 70, 40),
+                          gfx::Rect(190, 140, 30, 30) };
+
+    for (int i=0; i<3; ++i) {
+      gfx::Region rgn(areas[i]);
+      gfx::Rect rc = areas[i].createIntersect(gfx::Rect(0, 0, w, h));
+
+      canvas.validateSourceCanvas(rgn);
+      EXPECT_TRUE(equal_pixels(original, canvas.getSourceCanvas(), rc));
+
+      canvas.validateDestCanvas(rgn);
+      std::srand(i);
+      draw_random_pixels(canvas.getDestCanvas(), rc);
+      std::srand(i);
+      draw_random_pixels(expected, rc);
+    }
+
+    canvas.commit();
+    undo.commit();
+  }
+
+  EXPECT_EQ(0, image_count_diff(expected, celImage));
+
+  // The undo information contains all the modified pixels
+  doc->getUndo()->doUndo();
+  EXPECT_EQ(0, image_count_diff(original, celImage));
+
+  doc->getUndo()->doRedo();
+  EXPECT_EQ(0, image_count_diff(expected, celImage));
+}
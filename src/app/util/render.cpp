@@ -24,102 +24,145 @@
 
 #include "app/color_utils.h"
 #include "app/document.h"
+#include "app/document_undo.h"
 #include "app/ini_file.h"
 #include "raster/raster.h"
 #include "app/settings/document_settings.h"
 #include "app/settings/settings.h"
 #include "app/ui_context.h"
+#include "app/util/render_cache.h"
+#include "base/mutex.h"
+#include "base/parallel_for.h"
+#include "base/scoped_lock.h"
+#include "base/unique_ptr.h"
+
+#include <vector>
 
 namespace app {
 
 //////////////////////////////////////////////////////////////////////
 // Zoomed merge
 
+// BlenderHelper::blendRow() blends "n" source pixels over the
+// "scanline" (which contains the destination pixels to be blended).
+
 template<class DstTraits, class SrcTraits>
 class BlenderHelper
 {
-  BLEND_COLOR m_blend_color;
-  uint32_t m_mask_color;
+  typename SrcTraits::row_blender_t m_row_blender;
+  typename SrcTraits::pixel_t m_mask_color;
+  const typename SrcTraits::pixel_t* m_mask;
 public:
-  BlenderHelper(const Image* src, const Palette* pal, int blend_mode)
+  BlenderHelper(const Image* src, uint32_t mask_color, const Palette* pal, int blend_mode)
   {
-    m_blend_color = SrcTraits::get_blender(blend_mode);
-    m_mask_color = src->mask_color;
+    m_row_blender = SrcTraits::get_row_blender(blend_mode);
+    m_mask_color = mask_color;
+    m_mask = (m_mask_color == mask_color ? &m_mask_color: NULL);
   }
-  inline void operator()(typename DstTraits::address_t& scanline_address,
-                         typename DstTraits::address_t& dst_address,
-                         typename SrcTraits::address_t& src_address,
-                         int opacity)
+  inline void blendRow(typename DstTraits::address_t scanline,
+                       typename SrcTraits::address_t src_address,
+                       int n, int opacity)
+  {
+    (*m_row_blender)(scanline, src_address, n, m_mask, opacity);
+  }
+};
+
+// Helper for source images that must be converted to RGBA before
+// blending them. Masked pixels are converted to a color which gives
+// the original destination pixel as result of the blender.
+class ConvertedBlenderHelper
+{
+  BLEND_RGBA_ROW m_row_blender;
+  bool m_copy;
+  std::vector<uint32_t> m_row;
+protected:
+  ConvertedBlenderHelper(const Image* src, int blend_mode)
+    : m_row_blender(RgbTraits::get_row_blender(blend_mode))
+    , m_copy(blend_mode == BLEND_MODE_COPY)
+    , m_row(src->w)
   {
-    if (*src_address != m_mask_color)
-      *scanline_address = (*m_blend_color)(*dst_address, *src_address, opacity);
-    else
-      *scanline_address = *dst_address;
+  }
+  uint32_t* getRow() { return &m_row[0]; }
+  inline uint32_t maskedPixel(uint32_t dst) const
+  {
+    // Normal blending of a completely transparent front pixel gives
+    // the back pixel if the back is opaque, or the front RGB values
+    // if the back is transparent too.
+    return (m_copy ? dst: dst & 0x00ffffff);
+  }
+  inline void blendConvertedRow(uint32_t* scanline, int n, int opacity)
+  {
+    (*m_row_blender)(scanline, &m_row[0], n, NULL, opacity);
   }
 };
 
 template<>
-class BlenderHelper<RgbTraits, GrayscaleTraits>
+class BlenderHelper<RgbTraits, GrayscaleTraits> : public ConvertedBlenderHelper
 {
-  BLEND_COLOR m_blend_color;
   uint32_t m_mask_color;
 public:
-  BlenderHelper(const Image* src, const Palette* pal, int blend_mode)
+  BlenderHelper(const Image* src, uint32_t mask_color, const Palette* pal, int blend_mode)
+    : ConvertedBlenderHelper(src, blend_mode)
   {
-    m_blend_color = RgbTraits::get_blender(blend_mode);
-    m_mask_color = src->mask_color;
+    m_mask_color = mask_color;
   }
-  inline void operator()(RgbTraits::address_t& scanline_address,
-                         RgbTraits::address_t& dst_address,
-                         GrayscaleTraits::address_t& src_address,
-                         int opacity)
+  inline void blendRow(RgbTraits::address_t scanline,
+                       GrayscaleTraits::address_t src_address,
+                       int n, int opacity)
   {
-    if (*src_address != m_mask_color) {
-      int v = _graya_getv(*src_address);
-      *scanline_address = (*m_blend_color)(*dst_address, _rgba(v, v, v, _graya_geta(*src_address)), opacity);
+    uint32_t* row = getRow();
+
+    for (int x=0; x<n; ++x, ++src_address) {
+      if (*src_address != m_mask_color) {
+        int v = _graya_getv(*src_address);
+        row[x] = _rgba(v, v, v, _graya_geta(*src_address));
+      }
+      else
+        row[x] = maskedPixel(scanline[x]);
     }
-    else
-      *scanline_address = *dst_address;
+
+    blendConvertedRow(scanline, n, opacity);
   }
 };
 
 template<>
-class BlenderHelper<RgbTraits, IndexedTraits>
+class BlenderHelper<RgbTraits, IndexedTraits> : public ConvertedBlenderHelper
 {
   const Palette* m_pal;
   int m_blend_mode;
   uint32_t m_mask_color;
 public:
-  BlenderHelper(const Image* src, const Palette* pal, int blend_mode)
+  BlenderHelper(const Image* src, uint32_t mask_color, const Palette* pal, int blend_mode)
+    : ConvertedBlenderHelper(src, (blend_mode == BLEND_MODE_COPY ? BLEND_MODE_COPY:
+                                                                   BLEND_MODE_NORMAL))
   {
     m_blend_mode = blend_mode;
-    m_mask_color = src->mask_color;
+    m_mask_color = mask_color;
     m_pal = pal;
   }
-  inline void operator()(RgbTraits::address_t& scanline_address,
-                         RgbTraits::address_t& dst_address,
-                         IndexedTraits::address_t& src_address,
-                         int opacity)
+  inline void blendRow(RgbTraits::address_t scanline,
+                       IndexedTraits::address_t src_address,
+                       int n, int opacity)
   {
-    if (m_blend_mode == BLEND_MODE_COPY) {
-      *scanline_address = m_pal->getEntry(*src_address);
-    }
-    else {
-      if (*src_address != m_mask_color) {
-        *scanline_address = _rgba_blend_normal(*dst_address, m_pal->getEntry(*src_address), opacity);
-      }
+    uint32_t* row = getRow();
+
+    for (int x=0; x<n; ++x, ++src_address) {
+      if (m_blend_mode == BLEND_MODE_COPY || *src_address != m_mask_color)
+        row[x] = m_pal->getEntry(*src_address);
       else
-        *scanline_address = *dst_address;
+        row[x] = maskedPixel(scanline[x]);
     }
+
+    blendConvertedRow(scanline, n, opacity);
   }
 };
 
 template<class DstTraits, class SrcTraits>
 static void merge_zoomed_image(Image* dst, const Image* src, const Palette* pal,
-                               int x, int y, int opacity,
+                               uint32_t mask_color, int x, int y, int opacity,
                                int blend_mode, int zoom)
 {
-  BlenderHelper<DstTraits, SrcTraits> blender(src, pal, blend_mode);
+  BlenderHelper<DstTraits, SrcTraits> blender(src, mask_color, pal, blend_mode);
   typename SrcTraits::address_t src_address;
   typename DstTraits::address_t dst_address, dst_address_end;
   typename DstTraits::address_t scanline, scanline_address;
@@ -192,30 +235,31 @@ static void merge_zoomed_image(Image* dst, const Image* src, const Palette* pal,
     dst_address_end = dst_address + dst_w;
     scanline_address = scanline;
 
-    // read 'src' and 'dst' and blend them, put the result in `scanline'
+    // read the 'dst' pixels to be blended in `scanline'
     for (x=0; x<src_w; x++) {
       ASSERT(scanline_address >= scanline);
       ASSERT(scanline_address <  scanline + src_w);
 
-      ASSERT(src_address >= image_address_fast<SrcTraits>(src, src_x, src_y));
-      ASSERT(src_address <= image_address_fast<SrcTraits>(src, src_x+src_w-1, src_y));
       ASSERT(dst_address >= image_address_fast<DstTraits>(dst, dst_x, dst_y));
       ASSERT(dst_address <= image_address_fast<DstTraits>(dst, dst_x+dst_w-1, dst_y));
       ASSERT(dst_address <  dst_address_end);
 
-      blender(scanline_address, dst_address, src_address, opacity);
+      *(scanline_address++) = *dst_address;
 
-      src_address++;
       if ((x == 0) && (first_box_w > 0))
         dst_address += first_box_w;
       else
         dst_address += box_w;
-      scanline_address++;
 
-      if (dst_address >= dst_address_end)
+      if (dst_address >= dst_address_end) {
+        x++;
         break;
+      }
     }
 
+    // blend 'src' pixels with `scanline'
+    blender.blendRow(scanline, src_address, x, opacity);
+
     // get the 'height' of the line to be painted in 'dst'
     if ((y == 0) && (first_box_h > 0))
       line_h = first_box_h;
@@ -287,9 +331,16 @@ static bool checked_bg_zoom;
 static app::Color checked_bg_color1;
 static app::Color checked_bg_color2;
 
-static int global_opacity = 255;
-static const Layer* selected_layer = NULL;
-static Image* rastering_image = NULL;
+// Image used to preview the changes of the current tool/filter.
+static base::mutex preview_mutex;
+static const Layer* preview_layer = NULL;
+static Image* preview_image = NULL;
+
+// Sprites are rendered in bands of this height in different threads.
+const int kRenderBandHeight = 64;
+
+// Minimum number of pixels of the rendered area to use threads.
+const int kMinParallelRenderArea = 256*256;
 
 // static
 void RenderEngine::loadConfig()
@@ -363,16 +414,66 @@ RenderEngine::RenderEngine(const Document* document,
   , m_sprite(sprite)
   , m_currentLayer(currentLayer)
   , m_currentFrame(currentFrame)
+  , m_onionskin(false)
+  , m_onionskinPrevs(0)
+  , m_onionskinNexts(0)
+  , m_onionskinOpacityBase(0)
+  , m_onionskinOpacityStep(0)
+  , m_cache(NULL)
+  , m_useCache(false)
 {
+  base::scoped_lock lock(preview_mutex);
+  m_previewLayer = preview_layer;
+  m_previewImage = preview_image;
 }
 
 // static
 void RenderEngine::setPreviewImage(const Layer* layer, Image* image)
 {
-  selected_layer = layer;
-  rastering_image = image;
+  base::scoped_lock lock(preview_mutex);
+  preview_layer = layer;
+  preview_image = image;
 }
 
+// Renders one band of the sprite in a worker thread.
+class RenderEngine::RenderBandTask {
+public:
+  RenderBandTask(RenderEngine* engine, Image* image,
+                 int source_x, int source_y,
+                 FrameNumber frame, int zoom,
+                 ZoomedMergeFunc zoomed_func,
+                 bool draw_checked_bg, uint32_t bg_color)
+    : m_engine(engine), m_image(image)
+    , m_source_x(source_x), m_source_y(source_y)
+    , m_frame(frame), m_zoom(zoom)
+    , m_zoomed_func(zoomed_func)
+    , m_draw_checked_bg(draw_checked_bg), m_bg_color(bg_color) {
+  }
+
+  void operator()(int band) {
+    int y = band*kRenderBandHeight;
+    int h = MIN(kRenderBandHeight, m_image->h - y);
+    base::UniquePtr<Image> bandImage(Image::create(IMAGE_RGB, m_image->w, h));
+
+    m_engine->renderArea(bandImage, m_source_x, m_source_y+y,
+                         m_frame, m_zoom, m_zoomed_func,
+                         m_draw_checked_bg, m_bg_color);
+
+    // Each band is copied to different scanlines of the final image
+    image_copy(m_image, bandImage, 0, y);
+  }
+
+private:
+  RenderEngine* m_engine;
+  Image* m_image;
+  int m_source_x, m_source_y;
+  FrameNumber m_frame;
+  int m_zoom;
+  ZoomedMergeFunc m_zoomed_func;
+  bool m_draw_checked_bg;
+  uint32_t m_bg_color;
+};
+
 /**
    Draws the @a frame of animation of the specified @a sprite
    in a new image and return it.
@@ -385,7 +486,7 @@ Image* RenderEngine::renderSprite(int source_x, int source_y,
                                   FrameNumber frame, int zoom,
                                   bool draw_tiled_bg)
 {
-  void (*zoomed_func)(Image*, const Image*, const Palette*, int, int, int, int, int);
+  ZoomedMergeFunc zoomed_func;
   const LayerImage* background = m_sprite->getBackgroundLayer();
   bool need_checked_bg = (background != NULL ? !background->isReadable(): true);
   uint32_t bg_color = 0;
@@ -416,59 +517,344 @@ Image* RenderEngine::renderSprite(int source_x, int source_y,
   if (!image)
     return NULL;
 
+  // Onion-skin settings are read here because the settings cannot be
+  // accessed from the rendering threads.
+  IDocumentSettings* docSettings = UIContext::instance()
+    ->getSettings()->getDocumentSettings(m_document);
+
+  m_onionskin = docSettings->getUseOnionskin();
+  if (m_onionskin) {
+    m_onionskinPrevs = docSettings->getOnionskinPrevFrames();
+    m_onionskinNexts = docSettings->getOnionskinNextFrames();
+    m_onionskinOpacityBase = docSettings->getOnionskinOpacityBase();
+    m_onionskinOpacityStep = docSettings->getOnionskinOpacityStep();
+  }
+
+  // The cache of flattened layers is updated here (before the
+  // threads start) as it's shared by all bands.
+  m_useCache = (m_cache != NULL && !m_onionskin && updateCache(frame, zoomed_func));
+  if (m_cache != NULL && m_onionskin)
+    updateOnionskinCache(frame, zoomed_func);
+
+  int bands = (height+kRenderBandHeight-1) / kRenderBandHeight;
+
+  if (bands > 1 && width*height >= kMinParallelRenderArea) {
+    base::UniquePtr<Image> imagePtr(image);
+    RenderBandTask task(this, image, source_x, source_y, frame, zoom,
+                        zoomed_func, need_checked_bg && draw_tiled_bg, bg_color);
+
+    base::parallel_for(bands, task);
+    imagePtr.release();
+  }
+  else {
+    renderArea(image, source_x, source_y, frame, zoom, zoomed_func,
+               need_checked_bg && draw_tiled_bg, bg_color);
+  }
+
+  return image;
+}
+
+// Renders the sprite area which starts in source_x/y (with zoom)
+// in the whole given image. It's called from several threads at the
+// same time (with different images), so it cannot modify the
+// RenderEngine state.
+void RenderEngine::renderArea(Image* image,
+                              int source_x, int source_y,
+                              FrameNumber frame, int zoom,
+                              ZoomedMergeFunc zoomed_func,
+                              bool draw_checked_bg,
+                              uint32_t bg_color)
+{
   // Draw checked background
-  if (need_checked_bg && draw_tiled_bg)
+  if (draw_checked_bg)
     renderCheckedBackground(image, source_x, source_y, zoom);
   else
     image_clear(image, bg_color);
 
-  // Onion-skin feature: draw the previous frame
-  IDocumentSettings* docSettings = UIContext::instance()
-    ->getSettings()->getDocumentSettings(m_document);
+  // Draw the current layer between the flattened images of the
+  // other layers.
+  if (m_useCache) {
+    const Image* below = m_cache->getBelowImage();
+    const Image* above = m_cache->getAboveImage();
 
-  if (docSettings->getUseOnionskin()) {
+    if (below)
+      merge_zoomed_image<RgbTraits, RgbTraits>(image, below, NULL, 0,
+                                               -source_x, -source_y, 255,
+                                               BLEND_MODE_NORMAL, zoom);
+
+    renderLayer(m_currentLayer, image,
+                source_x, source_y, frame, zoom, zoomed_func,
+                true, true, 255);
+
+    if (above)
+      merge_zoomed_image<RgbTraits, RgbTraits>(image, above, NULL, 0,
+                                               -source_x, -source_y, 255,
+                                               BLEND_MODE_NORMAL, zoom);
+  }
+  // Onion-skin feature: draw the previous frame
+  else if (m_onionskin) {
     // Draw background layer of the current frame with opacity=255
-    global_opacity = 255;
     renderLayer(m_sprite->getFolder(), image,
                 source_x, source_y, frame, zoom, zoomed_func,
-                true, false);
+                true, false, 255);
 
     // Draw transparent layers of the previous/next frames with different opacity (<255) (it is the onion-skinning)
-    {
-      int prevs = docSettings->getOnionskinPrevFrames();
-      int nexts = docSettings->getOnionskinNextFrames();
-      int opacity_base = docSettings->getOnionskinOpacityBase();
-      int opacity_step = docSettings->getOnionskinOpacityStep();
-
-      for (FrameNumber f=frame.previous(prevs); f <= frame.next(nexts); ++f) {
-        if (f == frame || f < 0 || f > m_sprite->getLastFrame())
-          continue;
-        else if (f < frame)
-          global_opacity = opacity_base - opacity_step * ((frame - f)-1);
+    for (FrameNumber f=frame.previous(m_onionskinPrevs); f <= frame.next(m_onionskinNexts); ++f) {
+      if (f == frame || f < 0 || f > m_sprite->getLastFrame())
+        continue;
+
+      int global_opacity = getOnionskinOpacity(frame, f);
+      if (global_opacity > 0) {
+        const RenderCache::OnionskinFrame* onionskinFrame =
+          (m_cache ? m_cache->getOnionskinFrame(f): NULL);
+
+        // The layers of the cached frame were already blended with
+        // the global opacity
+        if (onionskinFrame && onionskinFrame->image)
+          merge_zoomed_image<RgbTraits, RgbTraits>(image, onionskinFrame->image, NULL, 0,
+                                                   -source_x, -source_y, 255,
+                                                   BLEND_MODE_NORMAL, zoom);
         else
-          global_opacity = opacity_base - opacity_step * ((f - frame)-1);
-
-        if (global_opacity > 0)
           renderLayer(m_sprite->getFolder(), image,
                       source_x, source_y, f, zoom, zoomed_func,
-                      false, true);
+                      false, true, global_opacity);
       }
     }
 
     // Draw transparent layers of the current frame with opacity=255
-    global_opacity = 255;
     renderLayer(m_sprite->getFolder(), image,
                 source_x, source_y, frame, zoom, zoomed_func,
-                false, true);
+                false, true, 255);
   }
   // Onion-skin is disabled: just draw the current frame
   else {
     renderLayer(m_sprite->getFolder(), image,
                 source_x, source_y, frame, zoom, zoomed_func,
-                true, true);
+                true, true, 255);
   }
+}
 
-  return image;
+// Adds the readable image layers (with a cel in the given frame) that
+// are below/above the current layer to the given vectors.
+static void collect_layers(const Layer* layer, const Layer* currentLayer,
+                           const Sprite* sprite, FrameNumber frame,
+                           RenderCache::LayerStates& below,
+                           RenderCache::LayerStates& above,
+                           bool& currentFound)
+{
+  if (!layer->isReadable())
+    return;
+
+  switch (layer->getType()) {
+
+    case GFXOBJ_LAYER_IMAGE: {
+      if (layer == currentLayer) {
+        currentFound = true;
+        break;
+      }
+
+      const Cel* cel = static_cast<const LayerImage*>(layer)->getCel(frame);
+      if (cel == NULL ||
+          cel->getImage() < 0 ||
+          cel->getImage() >= sprite->getStock()->size())
+        break;
+
+      RenderCache::LayerState state;
+      state.layer = layer;
+      state.cel = cel;
+      state.image = sprite->getStock()->getImage(cel->getImage());
+      state.x = cel->getX();
+      state.y = cel->getY();
+      state.opacity = cel->getOpacity();
+      state.blendMode = static_cast<const LayerImage*>(layer)->getBlendMode();
+
+      if (currentFound)
+        above.push_back(state);
+      else
+        below.push_back(state);
+      break;
+    }
+
+    case GFXOBJ_LAYER_FOLDER: {
+      LayerConstIterator it = static_cast<const LayerFolder*>(layer)->getLayerBegin();
+      LayerConstIterator end = static_cast<const LayerFolder*>(layer)->getLayerEnd();
+
+      for (; it != end; ++it)
+        collect_layers(*it, currentLayer, sprite, frame, below, above, currentFound);
+      break;
+    }
+
+  }
+}
+
+static bool all_layers_are_normal(const RenderCache::LayerStates& layers)
+{
+  for (RenderCache::LayerStates::const_iterator
+         it=layers.begin(), end=layers.end(); it!=end; ++it) {
+    if (it->blendMode != BLEND_MODE_NORMAL)
+      return false;
+  }
+  return true;
+}
+
+// Flattens the layers below and above the current layer in the cache
+// (if they were modified since the last call). Returns false if the
+// cache cannot be used to render the given frame.
+bool RenderEngine::updateCache(FrameNumber frame, ZoomedMergeFunc zoomed_func)
+{
+  if (m_currentLayer == NULL || !m_currentLayer->isImage())
+    return false;
+
+  // The preview image of other layer cannot be flattened
+  if (m_previewImage != NULL && m_previewLayer != m_currentLayer)
+    return false;
+
+  RenderCache::Key key;
+  bool currentFound = false;
+
+  key.sprite = m_sprite;
+  key.undoVersion = m_document->getUndo()->getVersion();
+  key.frame = frame;
+  key.currentLayer = m_currentLayer;
+  key.transparentColor = m_sprite->getTransparentColor();
+
+  collect_layers(m_sprite->getFolder(), m_currentLayer, m_sprite, frame,
+                 key.below, key.above, currentFound);
+
+  // The current layer is hidden (or inside a hidden folder)
+  if (!currentFound)
+    return false;
+
+  // Flattened layers are blended in the final image with the normal
+  // blend mode, so the result is the same only if the layers use
+  // the normal blend mode too. The exception is when the bottom
+  // layer is the background (the flattened image is opaque).
+  const LayerImage* background = m_sprite->getBackgroundLayer();
+  bool opaqueBelow = (background != NULL &&
+                      !key.below.empty() &&
+                      key.below.front().layer == background);
+
+  if ((!opaqueBelow && !all_layers_are_normal(key.below)) ||
+      !all_layers_are_normal(key.above))
+    return false;
+
+  const Palette* palette = m_sprite->getPalette(frame);
+  key.palette.resize(palette->size());
+  for (int i=0; i<palette->size(); ++i)
+    key.palette[i] = palette->getEntry(i);
+
+  if (m_cache->isValid() && m_cache->getKey() == key)
+    return true;
+
+  base::UniquePtr<Image> below, above;
+
+  if (!key.below.empty()) {
+    below.reset(Image::create(IMAGE_RGB, m_sprite->getWidth(), m_sprite->getHeight()));
+    image_clear(below, 0);
+
+    for (RenderCache::LayerStates::const_iterator
+           it=key.below.begin(), end=key.below.end(); it!=end; ++it)
+      renderLayer(it->layer, below, 0, 0, frame, 0, zoomed_func, true, true, 255);
+  }
+
+  if (!key.above.empty()) {
+    above.reset(Image::create(IMAGE_RGB, m_sprite->getWidth(), m_sprite->getHeight()));
+    image_clear(above, 0);
+
+    for (RenderCache::LayerStates::const_iterator
+           it=key.above.begin(), end=key.above.end(); it!=end; ++it)
+      renderLayer(it->layer, above, 0, 0, frame, 0, zoomed_func, true, true, 255);
+  }
+
+  m_cache->reset(key, below.release(), above.release());
+  return true;
+}
+
+// Flattens the transparent layers of the onion-skin frames around the
+// given frame in the cache. Only the frames that were modified since
+// the last call (or the modified regions of them) are rendered again.
+void RenderEngine::updateOnionskinCache(FrameNumber frame, ZoomedMergeFunc zoomed_func)
+{
+  FrameNumber first = frame.previous(m_onionskinPrevs);
+  FrameNumber last = frame.next(m_onionskinNexts);
+  const LayerImage* background = m_sprite->getBackgroundLayer();
+  const gfx::Rect spriteBounds(0, 0, m_sprite->getWidth(), m_sprite->getHeight());
+
+  m_cache->removeOnionskinFramesOutside(first, last);
+
+  for (FrameNumber f=first; f <= last; ++f) {
+    if (f == frame || f < 0 || f > m_sprite->getLastFrame())
+      continue;
+
+    int opacity = getOnionskinOpacity(frame, f);
+    if (opacity <= 0)
+      continue;
+
+    RenderCache::OnionskinKey key;
+    RenderCache::LayerStates above;
+    bool currentFound = false;
+
+    key.sprite = m_sprite;
+    key.transparentColor = m_sprite->getTransparentColor();
+    key.opacity = opacity;
+
+    collect_layers(m_sprite->getFolder(), NULL, m_sprite, f,
+                   key.layers, above, currentFound);
+
+    // The background layer is not drawn in onion-skin frames
+    if (!key.layers.empty() && key.layers.front().layer == background)
+      key.layers.erase(key.layers.begin());
+
+    const Palette* palette = m_sprite->getPalette(f);
+    key.palette.resize(palette->size());
+    for (int i=0; i<palette->size(); ++i)
+      key.palette[i] = palette->getEntry(i);
+
+    RenderCache::OnionskinFrame* onionskinFrame = m_cache->getOnionskinFrame(f);
+    if (!onionskinFrame || onionskinFrame->key != key) {
+      onionskinFrame = m_cache->createOnionskinFrame(f);
+      onionskinFrame->key = key;
+
+      // Frames with other blend modes cannot be flattened (they are
+      // kept in the cache without image so renderArea() uses the
+      // layers directly).
+      if (!all_layers_are_normal(key.layers))
+        continue;
+
+      onionskinFrame->image.reset(Image::create(IMAGE_RGB, spriteBounds.w, spriteBounds.h));
+      onionskinFrame->dirty = gfx::Region(spriteBounds);
+    }
+
+    if (!onionskinFrame->image || onionskinFrame->dirty.isEmpty())
+      continue;
+
+    gfx::Region dirty;
+    dirty.createIntersection(onionskinFrame->dirty, gfx::Region(spriteBounds));
+
+    for (gfx::Region::const_iterator it=dirty.begin(), end=dirty.end(); it!=end; ++it) {
+      const gfx::Rect& rc = *it;
+      base::UniquePtr<Image> area(Image::create(IMAGE_RGB, rc.w, rc.h));
+      image_clear(area, 0);
+
+      for (RenderCache::LayerStates::const_iterator
+             it2=key.layers.begin(), end2=key.layers.end(); it2!=end2; ++it2)
+        renderLayer(it2->layer, area, rc.x, rc.y, f, 0, zoomed_func, false, true, opacity);
+
+      image_copy(onionskinFrame->image, area, rc.x, rc.y);
+    }
+
+    onionskinFrame->dirty.clear();
+  }
+}
+
+// Returns the opacity used to draw the transparent layers of
+// "onionskinFrame" when "frame" is the current one.
+int RenderEngine::getOnionskinOpacity(FrameNumber frame, FrameNumber onionskinFrame) const
+{
+  if (onionskinFrame < frame)
+    return m_onionskinOpacityBase - m_onionskinOpacityStep * ((frame - onionskinFrame)-1);
+  else
+    return m_onionskinOpacityBase - m_onionskinOpacityStep * ((onionskinFrame - frame)-1);
 }
 
 // static
@@ -540,7 +926,7 @@ void RenderEngine::renderCheckedBackground(Image* image,
 void RenderEngine::renderImage(Image* rgb_image, Image* src_image, const Palette* pal,
                                int x, int y, int zoom)
 {
-  void (*zoomed_func)(Image*, const Image*, const Palette*, int, int, int, int, int);
+  ZoomedMergeFunc zoomed_func;
 
   ASSERT(rgb_image->getPixelFormat() == IMAGE_RGB && "renderImage accepts RGB destination images only");
 
@@ -562,16 +948,18 @@ void RenderEngine::renderImage(Image* rgb_image, Image* src_image, const Palette
       return;
   }
 
-  (*zoomed_func)(rgb_image, src_image, pal, x, y, 255, BLEND_MODE_NORMAL, zoom);
+  (*zoomed_func)(rgb_image, src_image, pal, src_image->mask_color,
+                 x, y, 255, BLEND_MODE_NORMAL, zoom);
 }
 
 void RenderEngine::renderLayer(const Layer* layer,
                                Image *image,
                                int source_x, int source_y,
                                FrameNumber frame, int zoom,
-                               void (*zoomed_func)(Image*, const Image*, const Palette*, int, int, int, int, int),
+                               ZoomedMergeFunc zoomed_func,
                                bool render_background,
-                               bool render_transparent)
+                               bool render_transparent,
+                               int global_opacity)
 {
   // we can't read from this layer
   if (!layer->isReadable())
@@ -588,11 +976,11 @@ void RenderEngine::renderLayer(const Layer* layer,
       if (cel != NULL) {
         Image* src_image;
 
-        // Is the 'rastering_image' set to be used with this layer?
+        // Is the preview image set to be used with this layer?
         if ((frame == m_currentFrame) &&
-            (selected_layer == layer) &&
-            (rastering_image != NULL)) {
-          src_image = rastering_image;
+            (m_previewLayer == layer) &&
+            (m_previewImage != NULL)) {
+          src_image = m_previewImage;
         }
         // If not, we use the original cel-image from the images' stock
         else if ((cel->getImage() >= 0) &&
@@ -608,9 +996,8 @@ void RenderEngine::renderLayer(const Layer* layer,
           output_opacity = MID(0, cel->getOpacity(), 255);
           output_opacity = INT_MULT(output_opacity, global_opacity, t);
 
-          src_image->mask_color = m_sprite->getTransparentColor();
-
           (*zoomed_func)(image, src_image, m_sprite->getPalette(frame),
+                         m_sprite->getTransparentColor(),
                          (cel->getX() << zoom) - source_x,
                          (cel->getY() << zoom) - source_y,
                          output_opacity,
@@ -629,21 +1016,24 @@ void RenderEngine::renderLayer(const Layer* layer,
                     source_x, source_y,
                     frame, zoom, zoomed_func,
                     render_background,
-                    render_transparent);
+                    render_transparent,
+                    global_opacity);
       }
       break;
     }
 
   }
 
-  // Draw extras
+  // Draw extras (only in the current frame, not in onion-skin frames)
   if (layer == m_currentLayer &&
+      frame == m_currentFrame &&
       m_document->getExtraCel() != NULL) {
     Cel* extraCel = m_document->getExtraCel();
     if (extraCel->getOpacity() > 0) {
       Image* extraImage = m_document->getExtraCelImage();
 
       (*zoomed_func)(image, extraImage, m_sprite->getPalette(frame),
+                     extraImage->mask_color,
                      (extraCel->getX() << zoom) - source_x,
                      (extraCel->getY() << zoom) - source_y,
                      extraCel->getOpacity(), BLEND_MODE_NORMAL, zoom);
@@ -31,6 +31,7 @@ namespace raster {
 
 namespace app {
   class Document;
+  class RenderCache;
 
   using namespace raster;
 
@@ -64,6 +65,16 @@ namespace app {
 
     static void setPreviewImage(const Layer* layer, Image* drawable);
 
+    //////////////////////////////////////////////////////////////////////
+    // Cache of flattened layers
+
+    // Sets the cache used to keep the layers below/above the current
+    // layer (and onion-skin frames) flattened between renderSprite()
+    // calls. It's optional
+    // (NULL by default), and the same cache should be used to render
+    // the same sprite each time (e.g. one cache for each editor).
+    void setCache(RenderCache* cache) { m_cache = cache; }
+
     //////////////////////////////////////////////////////////////////////
     // Main function used by sprite-editors to render the sprite
 
@@ -83,18 +94,52 @@ namespace app {
                             int x, int y, int zoom);
 
   private:
+    typedef void (*ZoomedMergeFunc)(Image* dst, const Image* src, const Palette* pal,
+                                    uint32_t mask_color, int x, int y, int opacity,
+                                    int blend_mode, int zoom);
+
+    class RenderBandTask;
+
+    bool updateCache(FrameNumber frame, ZoomedMergeFunc zoomed_func);
+    void updateOnionskinCache(FrameNumber frame, ZoomedMergeFunc zoomed_func);
+    int getOnionskinOpacity(FrameNumber frame, FrameNumber onionskinFrame) const;
+
+    void renderArea(Image* image,
+                    int source_x, int source_y,
+                    FrameNumber frame, int zoom,
+                    ZoomedMergeFunc zoomed_func,
+                    bool draw_checked_bg,
+                    uint32_t bg_color);
+
     void renderLayer(const Layer* layer,
                      Image* image,
                      int source_x, int source_y,
                      FrameNumber frame, int zoom,
-                     void (*zoomed_func)(Image*, const Image*, const Palette*, int, int, int, int, int),
+                     ZoomedMergeFunc zoomed_func,
                      bool render_background,
-                     bool render_transparent);
+                     bool render_transparent,
+                     int global_opacity);
 
     const Document* m_document;
     const Sprite* m_sprite;
     const Layer* m_currentLayer;
     FrameNumber m_currentFrame;
+
+    // Preview image (see setPreviewImage) when this engine was created.
+    const Layer* m_previewLayer;
+    Image* m_previewImage;
+
+    // Onion-skin settings of the current renderSprite() call.
+    bool m_onionskin;
+    int m_onionskinPrevs;
+    int m_onionskinNexts;
+    int m_onionskinOpacityBase;
+    int m_onionskinOpacityStep;
+
+    // Cache of flattened layers, and true if it can be used in the
+    // current renderSprite() call.
+    RenderCache* m_cache;
+    bool m_useCache;
   };
 
 } // namespace app
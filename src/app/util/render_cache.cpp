@@ -0,0 +1,156 @@
+/* Aseprite
+ * Copyright (C) 2001-2013  David Capello
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "app/util/render_cache.h"
+
+#include "app/document_event.h"
+#include "raster/image.h"
+
+namespace app {
+
+bool RenderCache::LayerState::operator==(const LayerState& other) const
+{
+  return (layer == other.layer &&
+          cel == other.cel &&
+          image == other.image &&
+          x == other.x &&
+          y == other.y &&
+          opacity == other.opacity &&
+          blendMode == other.blendMode);
+}
+
+RenderCache::Key::Key()
+  : sprite(NULL)
+  , undoVersion(0)
+  , frame(0)
+  , currentLayer(NULL)
+  , transparentColor(0)
+{
+}
+
+bool RenderCache::Key::operator==(const Key& other) const
+{
+  return (sprite == other.sprite &&
+          undoVersion == other.undoVersion &&
+          frame == other.frame &&
+          currentLayer == other.currentLayer &&
+          transparentColor == other.transparentColor &&
+          palette == other.palette &&
+          below == other.below &&
+          above == other.above);
+}
+
+RenderCache::OnionskinKey::OnionskinKey()
+  : sprite(NULL)
+  , transparentColor(0)
+  , opacity(0)
+{
+}
+
+bool RenderCache::OnionskinKey::operator==(const OnionskinKey& other) const
+{
+  return (sprite == other.sprite &&
+          transparentColor == other.transparentColor &&
+          palette == other.palette &&
+          layers == other.layers &&
+          opacity == other.opacity);
+}
+
+RenderCache::RenderCache()
+  : m_valid(false)
+{
+}
+
+RenderCache::~RenderCache()
+{
+  invalidateOnionskinFrames();
+}
+
+void RenderCache::reset(const Key& key, Image* below, Image* above)
+{
+  m_valid = true;
+  m_key = key;
+  m_below.reset(below);
+  m_above.reset(above);
+}
+
+void RenderCache::invalidate()
+{
+  m_valid = false;
+  m_key = Key();
+  m_below.reset(NULL);
+  m_above.reset(NULL);
+}
+
+RenderCache::OnionskinFrame* RenderCache::getOnionskinFrame(FrameNumber frame) const
+{
+  OnionskinFrames::const_iterator it = m_onionskinFrames.find(frame);
+  if (it != m_onionskinFrames.end())
+    return it->second;
+  else
+    return NULL;
+}
+
+RenderCache::OnionskinFrame* RenderCache::createOnionskinFrame(FrameNumber frame)
+{
+  OnionskinFrame*& onionskinFrame = m_onionskinFrames[frame];
+  delete onionskinFrame;
+  onionskinFrame = new OnionskinFrame;
+  return onionskinFrame;
+}
+
+void RenderCache::removeOnionskinFramesOutside(FrameNumber first, FrameNumber last)
+{
+  OnionskinFrames::iterator it = m_onionskinFrames.begin();
+  while (it != m_onionskinFrames.end()) {
+    if (it->first < first || last < it->first) {
+      delete it->second;
+      m_onionskinFrames.erase(it++);
+    }
+    else
+      ++it;
+  }
+}
+
+void RenderCache::invalidateOnionskinFrames()
+{
+  for (OnionskinFrames::iterator it=m_onionskinFrames.begin(), end=m_onionskinFrames.end();
+       it != end; ++it)
+    delete it->second;
+
+  m_onionskinFrames.clear();
+}
+
+void RenderCache::onGeneralUpdate(DocumentEvent& ev)
+{
+  // Anything could be modified (e.g. an undo in other frame)
+  invalidateOnionskinFrames();
+}
+
+void RenderCache::onSpritePixelsModified(DocumentEvent& ev)
+{
+  OnionskinFrame* onionskinFrame = getOnionskinFrame(ev.frame());
+  if (onionskinFrame && onionskinFrame->key.sprite == ev.sprite())
+    onionskinFrame->dirty.createUnion(onionskinFrame->dirty, ev.region());
+}
+
+} // namespace app
@@ -0,0 +1,156 @@
+/* Aseprite
+ * Copyright (C) 2001-2013  David Capello
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#ifndef APP_UTIL_RENDER_CACHE_H_INCLUDED
+#define APP_UTIL_RENDER_CACHE_H_INCLUDED
+
+#include "app/document_observer.h"
+#include "base/compiler_specific.h"
+#include "base/disable_copying.h"
+#include "base/unique_ptr.h"
+#include "gfx/region.h"
+#include "raster/frame_number.h"
+
+#include <map>
+#include <vector>
+
+namespace raster {
+  class Cel;
+  class Image;
+  class Layer;
+  class Sprite;
+}
+
+namespace app {
+
+  using namespace raster;
+
+  // Flattened images of the layers that are below and above the
+  // current layer in a specific frame. RenderEngine uses them so it
+  // only needs to blend three images (below, current layer, above)
+  // while the user is modifying the current layer.
+  //
+  // It keeps the flattened frames used for onion-skin too. These
+  // frames are invalidated through the DocumentObserver interface (so
+  // the cache must be added as an observer of the rendered document).
+  class RenderCache : public DocumentObserver {
+  public:
+    // State of a layer that is flattened in the cache.
+    struct LayerState {
+      const Layer* layer;
+      const Cel* cel;
+      const Image* image;
+      int x, y;
+      int opacity;
+      int blendMode;
+
+      bool operator==(const LayerState& other) const;
+    };
+
+    typedef std::vector<LayerState> LayerStates;
+
+    // Everything that the flattened images depend on. If the key of
+    // the cache is equal to the current state of the sprite, the
+    // cached images can be used.
+    struct Key {
+      const Sprite* sprite;
+      int undoVersion;
+      FrameNumber frame;
+      const Layer* currentLayer;
+      int transparentColor;
+      std::vector<uint32_t> palette;
+      LayerStates below;
+      LayerStates above;
+
+      Key();
+      bool operator==(const Key& other) const;
+      bool operator!=(const Key& other) const { return !operator==(other); }
+    };
+
+    // Everything that a flattened onion-skin frame depends on
+    // (except the pixels of the images).
+    struct OnionskinKey {
+      const Sprite* sprite;
+      int transparentColor;
+      std::vector<uint32_t> palette;
+      LayerStates layers;
+      int opacity;              // Onion-skin opacity of the frame.
+
+      OnionskinKey();
+      bool operator==(const OnionskinKey& other) const;
+      bool operator!=(const OnionskinKey& other) const { return !operator==(other); }
+    };
+
+    // Transparent layers of a frame flattened in a RGB image (with the
+    // same size as the sprite). Each layer is blended with the
+    // onion-skin opacity (as when the layers are drawn directly), so
+    // the image is drawn with full opacity.
+    struct OnionskinFrame {
+      OnionskinKey key;
+      gfx::Region dirty;        // Region that must be rendered again.
+      base::UniquePtr<Image> image;
+    };
+
+    RenderCache();
+    ~RenderCache();
+
+    bool isValid() const { return m_valid; }
+    const Key& getKey() const { return m_key; }
+
+    // Flattened RGB images (with the same size as the sprite). They
+    // are NULL if there are no layers below/above the current layer.
+    const Image* getBelowImage() const { return m_below.get(); }
+    const Image* getAboveImage() const { return m_above.get(); }
+
+    // Replaces the cached images. The cache takes the ownership of
+    // the given images.
+    void reset(const Key& key, Image* below, Image* above);
+
+    // Discards the cached images.
+    void invalidate();
+
+    // Returns the flattened onion-skin frame, or NULL if it isn't in
+    // the cache.
+    OnionskinFrame* getOnionskinFrame(FrameNumber frame) const;
+    OnionskinFrame* createOnionskinFrame(FrameNumber frame);
+
+    // Removes the onion-skin frames that are not in the given range.
+    void removeOnionskinFramesOutside(FrameNumber first, FrameNumber last);
+
+    // Discards all onion-skin frames.
+    void invalidateOnionskinFrames();
+
+    // DocumentObserver implementation
+    void onGeneralUpdate(DocumentEvent& ev) OVERRIDE;
+    void onSpritePixelsModified(DocumentEvent& ev) OVERRIDE;
+
+  private:
+    typedef std::map<FrameNumber, OnionskinFrame*> OnionskinFrames;
+
+    bool m_valid;
+    Key m_key;
+    base::UniquePtr<Image> m_below;
+    base::UniquePtr<Image> m_above;
+    OnionskinFrames m_onionskinFrames;
+
+    DISABLE_COPYING(RenderCache);
+  };
+
+} // namespace app
+
+#endif
@@ -0,0 +1,53 @@
+// Aseprite Base Library
+// Copyright (c) 2001-2013 David Capello
+//
+// This source file is distributed under MIT license,
+// please read LICENSE.txt for more information.
+
+#ifndef BASE_ATOMIC_H_INCLUDED
+#define BASE_ATOMIC_H_INCLUDED
+
+#ifdef _MSC_VER
+  #include <intrin.h>
+#endif
+
+namespace base {
+
+  // Reads a value written by other thread with atomic_store_release().
+  // All memory writes made by the other thread before the store are
+  // visible to this thread after the load returns that value.
+  inline int atomic_load_acquire(const volatile int* ptr)
+  {
+#if defined(_MSC_VER)
+    // Volatile reads have acquire semantics in MSVC
+    int value = *ptr;
+    _ReadWriteBarrier();
+    return value;
+#elif defined(__ATOMIC_ACQUIRE)
+    return __atomic_load_n(ptr, __ATOMIC_ACQUIRE);
+#else
+    int value = *ptr;
+    __sync_synchronize();
+    return value;
+#endif
+  }
+
+  // Writes a value so other threads can read it with
+  // atomic_load_acquire() (see above).
+  inline void atomic_store_release(volatile int* ptr, int value)
+  {
+#if defined(_MSC_VER)
+    // Volatile writes have release semantics in MSVC
+    _ReadWriteBarrier();
+    *ptr = value;
+#elif defined(__ATOMIC_RELEASE)
+    __atomic_store_n(ptr, value, __ATOMIC_RELEASE);
+#else
+    __sync_synchronize();
+    *ptr = value;
+#endif
+  }
+
+} // namespace base
+
+#endif
@@ -0,0 +1,120 @@
+// Aseprite Base Library
+// Copyright (c) 2001-2013 David Capello
+//
+// This source file is distributed under MIT license,
+// please read LICENSE.txt for more information.
+
+#ifndef BASE_PARALLEL_FOR_H_INCLUDED
+#define BASE_PARALLEL_FOR_H_INCLUDED
+
+#include "base/disable_copying.h"
+#include "base/exception.h"
+#include "base/mutex.h"
+#include "base/scoped_lock.h"
+#include "base/thread.h"
+#include "base/thread_pool.h"
+
+#include <string>
+#include <vector>
+
+namespace base {
+
+  namespace details {
+
+    // Shared state between all the threads of a parallel_for() call.
+    template<class Task>
+    class parallel_for_state {
+    public:
+      parallel_for_state(int n, Task& task)
+        : m_n(n), m_next(0), m_task(task), m_failed(false) {
+      }
+
+      static void thread_proc(void* state) {
+        static_cast<parallel_for_state*>(state)->run();
+      }
+
+      void run() {
+        for (;;) {
+          int i;
+          {
+            scoped_lock lock(m_mutex);
+            if (m_next >= m_n || m_failed)
+              return;
+            i = m_next++;
+          }
+
+          try {
+            m_task(i);
+          }
+          catch (const std::exception& e) {
+            fail(e.what());
+          }
+          catch (...) {
+            fail("Unknown error in parallel task");
+          }
+        }
+      }
+
+      bool failed() const { return m_failed; }
+      const std::string& errorMessage() const { return m_error; }
+
+    private:
+      void fail(const char* msg) {
+        scoped_lock lock(m_mutex);
+        if (!m_failed) {
+          m_failed = true;
+          m_error = msg;
+        }
+      }
+
+      mutex m_mutex;
+      int m_n;
+      int m_next;
+      Task& m_task;
+      bool m_failed;
+      std::string m_error;
+
+      DISABLE_COPYING(parallel_for_state);
+    };
+
+  } // namespace details
+
+  // Calls task(i) for each "i" in [0, n) distributing the calls
+  // between "threads" threads (the calling thread and workers of the
+  // thread_pool). If "threads" is 0, one thread for each processor is
+  // used. Returns when all the calls were made.
+  //
+  // If a task throws an exception, the remaining tasks are not
+  // started and a base::Exception with the same message is thrown
+  // from parallel_for().
+  template<class Task>
+  void parallel_for(int n, Task& task, int threads = 0)
+  {
+    if (n <= 0)
+      return;
+
+    if (threads <= 0)
+      threads = thread::hardware_concurrency();
+    if (threads > n)
+      threads = n;
+
+    details::parallel_for_state<Task> state(n, task);
+
+    if (threads > 1) {
+      thread_pool* pool = thread_pool::instance();
+      thread_pool::group group;
+
+      pool->add_jobs(group, &details::parallel_for_state<Task>::thread_proc, &state, threads-1);
+      state.run();
+      pool->wait(group);
+    }
+    else
+      state.run();
+
+    if (state.failed())
+      throw Exception(state.errorMessage());
+  }
+
+} // namespace base
+
+#endif
@@ -0,0 +1,96 @@
+// Aseprite Base Library
+// Copyright (c) 2001-2013 David Capello
+//
+// This source file is distributed under MIT license,
+// please read LICENSE.txt for more information.
+
+#include <gtest/gtest.h>
+
+#include "base/parallel_for.h"
+
+#include <stdexcept>
+#include <vector>
+
+using namespace base;
+
+class FillTask {
+public:
+  FillTask(std::vector<int>& values) : m_values(values) { }
+  void operator()(int i) { m_values[i] += i; }
+private:
+  std::vector<int>& m_values;
+};
+
+class ThrowingTask {
+public:
+  void operator()(int i) {
+    if (i == 5)
+      throw std::runtime_error("task 5 failed");
+  }
+};
+
+TEST(ParallelFor, CallsEachIndexOnce)
+{
+  for (int threads=1; threads<=8; ++threads) {
+    std::vector<int> values(1000, 0);
+    FillTask task(values);
+    parallel_for(values.size(), task, threads);
+
+    for (int i=0; i<(int)values.size(); ++i)
+      EXPECT_EQ(i, values[i]);
+  }
+}
+
+class NestedTask {
+public:
+  NestedTask(std::vector<std::vector<int> >& values) : m_values(values) { }
+  void operator()(int i) {
+    FillTask task(m_values[i]);
+    parallel_for(m_values[i].size(), task, 4);
+  }
+private:
+  std::vector<std::vector<int> >& m_values;
+};
+
+TEST(ParallelFor, Nested)
+{
+  // All workers can be busy waiting nested calls
+  std::vector<std::vector<int> > values(16, std::vector<int>(100, 0));
+  NestedTask task(values);
+  parallel_for(values.size(), task, 4);
+
+  for (int j=0; j<(int)values.size(); ++j)
+    for (int i=0; i<(int)values[j].size(); ++i)
+      EXPECT_EQ(i, values[j][i]);
+}
+
+TEST(ParallelFor, ReusesThreads)
+{
+  for (int k=0; k<1000; ++k) {
+    std::vector<int> values(8, 0);
+    FillTask task(values);
+    parallel_for(values.size(), task, 4);
+
+    for (int i=0; i<(int)values.size(); ++i)
+      ASSERT_EQ(i, values[i]);
+  }
+}
+
+TEST(ParallelFor, Empty)
+{
+  std::vector<int> values;
+  FillTask task(values);
+  parallel_for(0, task);
+}
+
+TEST(ParallelFor, Exception)
+{
+  ThrowingTask task;
+  EXPECT_THROW(parallel_for(10, task, 4), base::Exception);
+}
+
+int main(int argc, char** argv)
+{
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,41 @@
+// Aseprite Base Library
+// Copyright (c) 2001-2013 David Capello
+//
+// This source file is distributed under MIT license,
+// please read LICENSE.txt for more information.
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "base/semaphore.h"
+
+#ifdef WIN32
+  #include "base/semaphore_win32.h"
+#else
+  #include "base/semaphore_pthread.h"
+#endif
+
+namespace base {
+
+semaphore::semaphore(int count)
+  : m_impl(new semaphore_impl(count))
+{
+}
+
+semaphore::~semaphore()
+{
+  delete m_impl;
+}
+
+void semaphore::acquire()
+{
+  m_impl->acquire();
+}
+
+void semaphore::release(int count)
+{
+  m_impl->release(count);
+}
+
+} // namespace base
@@ -0,0 +1,33 @@
+// Aseprite Base Library
+// Copyright (c) 2001-2013 David Capello
+//
+// This source file is distributed under MIT license,
+// please read LICENSE.txt for more information.
+
+#ifndef BASE_SEMAPHORE_H_INCLUDED
+#define BASE_SEMAPHORE_H_INCLUDED
+
+#include "base/disable_copying.h"
+
+namespace base {
+
+  // Counting semaphore: acquire() waits until the count is greater
+  // than zero and decrements it, release() increments it.
+  class semaphore {
+  public:
+    semaphore(int count = 0);
+    ~semaphore();
+
+    void acquire();
+    void release(int count = 1);
+
+  private:
+    class semaphore_impl;
+    semaphore_impl* m_impl;
+
+    DISABLE_COPYING(semaphore);
+  };
+
+} // namespace base
+
+#endif
@@ -0,0 +1,53 @@
+// Aseprite Base Library
+// Copyright (c) 2001-2013 David Capello
+//
+// This source file is distributed under MIT license,
+// please read LICENSE.txt for more information.
+
+#ifndef BASE_SEMAPHORE_PTHREAD_H_INCLUDED
+#define BASE_SEMAPHORE_PTHREAD_H_INCLUDED
+
+#include <pthread.h>
+
+// Unnamed POSIX semaphores are not available in all Unix-like
+// systems (e.g. Mac OS X), so a mutex and a condition are used.
+class base::semaphore::semaphore_impl
+{
+public:
+
+  semaphore_impl(int count) : m_count(count) {
+    pthread_mutex_init(&m_mutex, NULL);
+    pthread_cond_init(&m_cond, NULL);
+  }
+
+  ~semaphore_impl() {
+    pthread_cond_destroy(&m_cond);
+    pthread_mutex_destroy(&m_mutex);
+  }
+
+  void acquire() {
+    pthread_mutex_lock(&m_mutex);
+    while (m_count == 0)
+      pthread_cond_wait(&m_cond, &m_mutex);
+    --m_count;
+    pthread_mutex_unlock(&m_mutex);
+  }
+
+  void release(int count) {
+    pthread_mutex_lock(&m_mutex);
+    m_count += count;
+    if (count == 1)
+      pthread_cond_signal(&m_cond);
+    else
+      pthread_cond_broadcast(&m_cond);
+    pthread_mutex_unlock(&m_mutex);
+  }
+
+private:
+  pthread_mutex_t m_mutex;
+  pthread_cond_t m_cond;
+  int m_count;
+
+};
+
+#endif
@@ -0,0 +1,37 @@
+// Aseprite Base Library
+// Copyright (c) 2001-2013 David Capello
+//
+// This source file is distributed under MIT license,
+// please read LICENSE.txt for more information.
+
+#ifndef BASE_SEMAPHORE_WIN32_H_INCLUDED
+#define BASE_SEMAPHORE_WIN32_H_INCLUDED
+
+#include <windows.h>
+#include <limits.h>
+
+class base::semaphore::semaphore_impl
+{
+public:
+
+  semaphore_impl(int count) {
+    m_handle = CreateSemaphore(NULL, count, LONG_MAX, NULL);
+  }
+
+  ~semaphore_impl() {
+    CloseHandle(m_handle);
+  }
+
+  void acquire() {
+    WaitForSingleObject(m_handle, INFINITE);
+  }
+
+  void release(int count) {
+    ReleaseSemaphore(m_handle, count, NULL);
+  }
+
+private:
+  HANDLE m_handle;
+};
+
+#endif
@@ -42,6 +42,9 @@ namespace base {                // Based on C++0x threads lib
 
     native_handle_type native_handle();
 
+    // Returns the number of processors (or 1 if it's unknown).
+    static int hardware_concurrency();
+
     class details {
     public:
       static void thread_proxy(void* data);
@@ -0,0 +1,114 @@
+// Aseprite Base Library
+// Copyright (c) 2001-2013 David Capello
+//
+// This source file is distributed under MIT license,
+// please read LICENSE.txt for more information.
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "base/thread_pool.h"
+
+#include "base/scoped_lock.h"
+#include "base/thread.h"
+
+namespace base {
+
+// static
+thread_pool* thread_pool::instance()
+{
+  static thread_pool pool;
+  return &pool;
+}
+
+thread_pool::thread_pool()
+  : m_exit(false)
+{
+}
+
+thread_pool::~thread_pool()
+{
+  {
+    scoped_lock lock(m_mutex);
+    m_exit = true;
+  }
+  m_work.release(m_workers.size());
+
+  for (size_t i=0; i<m_workers.size(); ++i) {
+    m_workers[i]->join();
+    delete m_workers[i];
+  }
+}
+
+void thread_pool::add_jobs(group& g, job_proc proc, void* data, int count)
+{
+  {
+    scoped_lock lock(m_mutex);
+
+    while ((int)m_workers.size() < count)
+      m_workers.push_back(new thread(&thread_pool::worker_proc, this));
+
+    for (int i=0; i<count; ++i) {
+      job j = { proc, data, &g };
+      m_jobs.push_back(j);
+    }
+  }
+  m_work.release(count);
+}
+
+void thread_pool::wait(group& g)
+{
+  int started;
+  {
+    scoped_lock lock(m_mutex);
+
+    for (std::deque<job>::iterator it=m_jobs.begin(); it!=m_jobs.end(); ) {
+      if (it->g == &g)
+        it = m_jobs.erase(it);
+      else
+        ++it;
+    }
+
+    started = g.m_started;
+  }
+
+  for (int i=0; i<started; ++i)
+    g.m_done.acquire();
+}
+
+// static
+void thread_pool::worker_proc(thread_pool* pool)
+{
+  pool->run_worker();
+}
+
+void thread_pool::run_worker()
+{
+  for (;;) {
+    m_work.acquire();
+
+    job j;
+    {
+      scoped_lock lock(m_mutex);
+      if (m_exit)
+        return;
+
+      // The job could be removed by wait()
+      if (m_jobs.empty())
+        continue;
+
+      j = m_jobs.front();
+      m_jobs.pop_front();
+      ++j.g->m_started;
+    }
+
+    j.proc(j.data);
+
+    // The group cannot be used after this (the waiting thread can
+    // destroy it)
+    j.g->m_done.release();
+  }
+}
+
+} // namespace base
@@ -0,0 +1,78 @@
+// Aseprite Base Library
+// Copyright (c) 2001-2013 David Capello
+//
+// This source file is distributed under MIT license,
+// please read LICENSE.txt for more information.
+
+#ifndef BASE_THREAD_POOL_H_INCLUDED
+#define BASE_THREAD_POOL_H_INCLUDED
+
+#include "base/disable_copying.h"
+#include "base/mutex.h"
+#include "base/semaphore.h"
+
+#include <deque>
+#include <vector>
+
+namespace base {
+
+  class thread;
+
+  // Worker threads that are created the first time they are needed
+  // and reused by all parallel_for() calls, so short parallel tasks
+  // don't pay the creation of threads in each call.
+  class thread_pool {
+  public:
+    typedef void (*job_proc)(void* data);
+
+    // Jobs added with the same group are waited with wait().
+    class group {
+    public:
+      group() : m_started(0) { }
+
+    private:
+      int m_started;            // Jobs taken by a worker
+      semaphore m_done;         // Released when a started job finishes
+
+      friend class thread_pool;
+      DISABLE_COPYING(group);
+    };
+
+    static thread_pool* instance();
+
+    // Adds "count" calls to proc(data) to be run by the workers. The
+    // pool grows if it has less than "count" workers. The job cannot
+    // throw exceptions.
+    void add_jobs(group& g, job_proc proc, void* data, int count);
+
+    // Removes the jobs of the group that weren't started yet and
+    // waits the started ones. As the caller must be able to do all
+    // the work by itself, it cannot be blocked if all workers are
+    // busy (e.g. with nested parallel_for() calls).
+    void wait(group& g);
+
+  private:
+    struct job {
+      job_proc proc;
+      void* data;
+      group* g;
+    };
+
+    thread_pool();
+    ~thread_pool();
+
+    static void worker_proc(thread_pool* pool);
+    void run_worker();
+
+    mutex m_mutex;
+    std::deque<job> m_jobs;
+    semaphore m_work;           // Released for each added job
+    std::vector<thread*> m_workers;
+    bool m_exit;
+
+    DISABLE_COPYING(thread_pool);
+  };
+
+} // namespace base
+
+#endif
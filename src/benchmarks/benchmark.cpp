@@ -0,0 +1,313 @@
+/* Aseprite
+ * Copyright (C) 2001-2013  David Capello
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "benchmarks/benchmark.h"
+
+#include "app/app.h"
+#include "app/document.h"
+#include "base/path.h"
+#include "base/fs.h"
+#include "base/program_options.h"
+#include "base/unique_ptr.h"
+#include "raster/raster.h"
+#include "she/she.h"
+#include "ui/base.h"
+
+#include <cstdio>
+#include <iostream>
+#include <stdexcept>
+#include <vector>
+
+namespace benchmarks {
+
+using namespace raster;
+
+// Minimum number of iterations of each benchmark.
+static const int kMinIterations = 3;
+
+namespace {
+
+  struct BenchmarkInfo {
+    std::string name;
+    BenchmarkFunc func;
+    int param;
+  };
+
+  typedef std::vector<BenchmarkInfo> Benchmarks;
+
+  // Function-level static to avoid problems with the initialization
+  // order of the Registrar objects.
+  Benchmarks& get_benchmarks()
+  {
+    static Benchmarks benchmarks;
+    return benchmarks;
+  }
+
+  struct Result {
+    std::string name;
+    int param;
+    int iterations;
+    double secondsPerIteration;
+    double itemsPerSecond;
+  };
+
+  // Simple linear congruential generator, used instead of std::rand()
+  // to generate the same sequence in all platforms.
+  class Random {
+  public:
+    Random(int seed) : m_value(seed) { }
+    int next(int n) {
+      m_value = m_value*1103515245 + 12345;
+      return (m_value >> 16) % n;
+    }
+  private:
+    uint32_t m_value;
+  };
+
+}
+
+State::State(int param, double minTime)
+  : m_param(param)
+  , m_minTime(minTime)
+  , m_iterations(0)
+  , m_elapsed(0.0)
+  , m_itemsPerIteration(0.0)
+  , m_started(false)
+  , m_paused(false)
+{
+}
+
+bool State::keepRunning()
+{
+  if (!m_started) {
+    m_started = true;
+    m_chrono.reset();
+    return true;
+  }
+
+  ++m_iterations;
+
+  double total = m_elapsed + (m_paused ? 0.0: m_chrono.elapsed());
+  if (m_iterations >= kMinIterations && total >= m_minTime) {
+    m_elapsed = total;
+    return false;
+  }
+  return true;
+}
+
+void State::pauseTiming()
+{
+  ASSERT(!m_paused);
+  m_elapsed += m_chrono.elapsed();
+  m_paused = true;
+}
+
+void State::resumeTiming()
+{
+  ASSERT(m_paused);
+  m_chrono.reset();
+  m_paused = false;
+}
+
+Registrar::Registrar(const char* name, BenchmarkFunc func, const int* params, int nparams)
+{
+  for (int i=0; i<nparams; ++i) {
+    BenchmarkInfo info;
+    info.name = name;
+    info.func = func;
+    info.param = params[i];
+    get_benchmarks().push_back(info);
+  }
+}
+
+Image* create_image(PixelFormat format, int w, int h, int seed)
+{
+  base::UniquePtr<Image> image(Image::create(format, w, h));
+  Random random(seed);
+  uint32_t c = 0;
+
+  for (int y=0; y<h; ++y) {
+    for (int x=0; x<w; ++x) {
+      // Change the color after some pixels.
+      if (random.next(16) == 0) {
+        bool transparent = (random.next(8) == 0);
+
+        switch (format) {
+          case IMAGE_RGB:
+            c = _rgba(random.next(256), random.next(256), random.next(256),
+                      transparent ? 0: 255);
+            break;
+          case IMAGE_GRAYSCALE:
+            c = _graya(random.next(256), transparent ? 0: 255);
+            break;
+          case IMAGE_INDEXED:
+            c = (transparent ? 0: random.next(256));
+            break;
+          case IMAGE_BITMAP:
+            c = (transparent ? 0: 1);
+            break;
+        }
+      }
+      image->putpixel(x, y, c);
+    }
+  }
+
+  return image.release();
+}
+
+app::Document* create_document(PixelFormat format, int w, int h, int layers, int frames)
+{
+  base::UniquePtr<Sprite> sprite(new Sprite(format, w, h, 256));
+  sprite->setTotalFrames(FrameNumber(frames));
+
+  for (int i=0; i<layers; ++i) {
+    LayerImage* layer = new LayerImage(sprite);
+    sprite->getFolder()->addLayer(layer);
+
+    for (FrameNumber frame(0); frame<frames; ++frame) {
+      int index = sprite->getStock()->addImage(create_image(format, w, h, i*frames + frame));
+      layer->addCel(new Cel(frame, index));
+    }
+  }
+
+  app::Document* document = new app::Document(sprite);
+  sprite.release();
+  return document;
+}
+
+std::string get_temp_file_name(const char* filename)
+{
+  return base::join_path(base::get_temp_path(), filename);
+}
+
+static void print_results(const std::vector<Result>& results, const std::string& format)
+{
+  if (format == "csv") {
+    std::printf("name,param,iterations,seconds_per_iteration,items_per_second\n");
+    for (size_t i=0; i<results.size(); ++i) {
+      const Result& r = results[i];
+      std::printf("%s,%d,%d,%.9f,%.1f\n", r.name.c_str(), r.param,
+                  r.iterations, r.secondsPerIteration, r.itemsPerSecond);
+    }
+  }
+  else if (format == "json") {
+    std::printf("{\n  \"benchmarks\": [");
+    for (size_t i=0; i<results.size(); ++i) {
+      const Result& r = results[i];
+      std::printf("%s\n    { \"name\": \"%s\", \"param\": %d, \"iterations\": %d, "
+                  "\"seconds_per_iteration\": %.9f, \"items_per_second\": %.1f }",
+                  (i > 0 ? ",": ""), r.name.c_str(), r.param,
+                  r.iterations, r.secondsPerIteration, r.itemsPerSecond);
+    }
+    std::printf("\n  ]\n}\n");
+  }
+}
+
+static int run_benchmarks(const std::string& filter, double minTime,
+                          const std::string& format)
+{
+  const Benchmarks& benchmarks = get_benchmarks();
+  std::vector<Result> results;
+
+  for (Benchmarks::const_iterator it=benchmarks.begin(), end=benchmarks.end(); it!=end; ++it) {
+    char fullName[256];
+    std::sprintf(fullName, "%s/%d", it->name.c_str(), it->param);
+    if (!filter.empty() && std::string(fullName).find(filter) == std::string::npos)
+      continue;
+
+    State state(it->param, minTime);
+    it->func(state);
+
+    Result result;
+    result.name = it->name;
+    result.param = it->param;
+    result.iterations = state.iterations();
+    result.secondsPerIteration = (state.iterations() > 0 ? state.elapsed() / state.iterations(): 0.0);
+    result.itemsPerSecond = (state.elapsed() > 0.0 ? state.itemsPerIteration() * state.iterations() / state.elapsed(): 0.0);
+    results.push_back(result);
+
+    // Human readable output is printed while the benchmarks run.
+    if (format == "text") {
+      std::printf("%-40s %8d iterations %12.3f ms/iteration %10.2f Mitems/s\n",
+                  fullName, result.iterations,
+                  result.secondsPerIteration*1000.0,
+                  result.itemsPerSecond/1000000.0);
+      std::fflush(stdout);
+    }
+  }
+
+  print_results(results, format);
+  return 0;
+}
+
+} // namespace benchmarks
+
+typedef base::ProgramOptions::Option Option;
+
+// Entry point (called from she library).
+int app_main(int argc, char* argv[])
+{
+  base::ProgramOptions po;
+  Option& filter = po.add("filter").requiresValue("TEXT").description("Run only benchmarks that contain TEXT in their name");
+  Option& minTime = po.add("min-time").requiresValue("SECONDS").description("Minimum time to run each benchmark (0.5 by default)");
+  Option& format = po.add("format").requiresValue("FORMAT").description("Output format: text, csv or json");
+  Option& help = po.add("help").mnemonic('?').description("Display this help and exits");
+
+  try {
+    po.parse(argc, const_cast<const char**>(argv));
+  }
+  catch (const std::runtime_error& parseError) {
+    std::cerr << argv[0] << ": " << parseError.what() << '\n';
+    return 1;
+  }
+
+  if (help.enabled()) {
+    std::cout << "Usage:\n  " << base::get_file_name(argv[0]) << " [OPTIONS]\n\n"
+              << "Options:\n" << po;
+    return 0;
+  }
+
+  double minTimeValue = 0.5;
+  if (minTime.enabled())
+    std::sscanf(minTime.value().c_str(), "%lf", &minTimeValue);
+
+  std::string formatValue = (format.enabled() ? format.value(): "text");
+  if (formatValue != "text" && formatValue != "csv" && formatValue != "json") {
+    std::cerr << argv[0] << ": Invalid output format \"" << formatValue << "\"\n";
+    return 1;
+  }
+
+  try {
+    // The application is initialized in batch mode (without UI) as
+    // some benchmarks need the file formats and the UIContext.
+    she::ScopedHandle<she::System> system(she::CreateSystem());
+    ui::GuiSystem guiSystem;
+    const char* appArgv[] = { argv[0], "--batch" };
+    app::App app(2, appArgv);
+
+    return benchmarks::run_benchmarks(filter.value(), minTimeValue, formatValue);
+  }
+  catch (std::exception& e) {
+    std::cerr << e.what() << '\n';
+    return 1;
+  }
+}
@@ -0,0 +1,107 @@
+/* Aseprite
+ * Copyright (C) 2001-2013  David Capello
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#ifndef BENCHMARKS_BENCHMARK_H_INCLUDED
+#define BENCHMARKS_BENCHMARK_H_INCLUDED
+
+#include "base/chrono.h"
+#include "raster/pixel_format.h"
+
+#include <string>
+
+namespace raster {
+  class Image;
+}
+
+namespace app {
+  class Document;
+}
+
+namespace benchmarks {
+
+  // State of one benchmark run. The benchmark function must do its
+  // setup, and then execute the measured code in a loop like this:
+  //
+  //   while (state.keepRunning()) {
+  //     ...code to measure...
+  //   }
+  //
+  // The code is executed until the minimum time is reached (and at
+  // least a couple of times), so results are stable between runs.
+  class State {
+  public:
+    State(int param, double minTime);
+
+    // Parameter of the benchmark (generally the size of the sprite).
+    int param() const { return m_param; }
+
+    bool keepRunning();
+
+    // Excludes some code inside the loop from the measured time.
+    void pauseTiming();
+    void resumeTiming();
+
+    // Number of items (pixels) processed in each iteration, used to
+    // report the throughput of the benchmark.
+    void setItemsPerIteration(double items) { m_itemsPerIteration = items; }
+
+    int iterations() const { return m_iterations; }
+    double elapsed() const { return m_elapsed; }
+    double itemsPerIteration() const { return m_itemsPerIteration; }
+
+  private:
+    int m_param;
+    double m_minTime;
+    int m_iterations;
+    double m_elapsed;
+    double m_itemsPerIteration;
+    bool m_started;
+    bool m_paused;
+    base::Chrono m_chrono;
+  };
+
+  typedef void (*BenchmarkFunc)(State& state);
+
+  // Registers a benchmark to be executed one time for each parameter.
+  // Use the BENCHMARK() macro instead of this class.
+  class Registrar {
+  public:
+    Registrar(const char* name, BenchmarkFunc func, const int* params, int nparams);
+  };
+
+  // Creates an image with reproducible content (the same seed
+  // generates the same pixels in all platforms). Pixels are grouped in
+  // horizontal runs of the same color, with some transparent areas, so
+  // it's similar to a real sprite.
+  raster::Image* create_image(raster::PixelFormat format, int w, int h, int seed);
+
+  // Creates a document with the given number of layers and frames,
+  // each cel with a different image created with create_image().
+  app::Document* create_document(raster::PixelFormat format, int w, int h,
+                                 int layers, int frames);
+
+  // Returns a path to save temporary files.
+  std::string get_temp_file_name(const char* filename);
+
+} // namespace benchmarks
+
+#define BENCHMARK(func, params)                                         \
+  static benchmarks::Registrar func##_registrar(#func, func, params,    \
+                                                sizeof(params) / sizeof(params[0]))
+
+#endif
@@ -0,0 +1,87 @@
+/* Aseprite
+ * Copyright (C) 2001-2013  David Capello
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "benchmarks/benchmark.h"
+
+#include "app/document.h"
+#include "app/file/file.h"
+#include "base/unique_ptr.h"
+#include "raster/raster.h"
+
+#include <cstdio>
+
+using namespace benchmarks;
+using namespace raster;
+
+static const int kSizes[] = { 64, 256, 1024 };
+
+// Number of frames of the sprites used to benchmark formats with
+// animation support.
+static const int kFrames = 4;
+
+static void save_file(State& state, const char* filename, PixelFormat format, int frames)
+{
+  int size = state.param();
+  std::string fn = get_temp_file_name(filename);
+  base::UniquePtr<app::Document> doc(create_document(format, size, size, 1, frames));
+  doc->setFilename(fn.c_str());
+
+  state.setItemsPerIteration(size*size*frames);
+  while (state.keepRunning())
+    app::save_document(doc);
+
+  std::remove(fn.c_str());
+}
+
+static void load_file(State& state, const char* filename, PixelFormat format, int frames)
+{
+  int size = state.param();
+  std::string fn = get_temp_file_name(filename);
+  {
+    base::UniquePtr<app::Document> doc(create_document(format, size, size, 1, frames));
+    doc->setFilename(fn.c_str());
+    app::save_document(doc);
+  }
+
+  state.setItemsPerIteration(size*size*frames);
+  while (state.keepRunning()) {
+    base::UniquePtr<app::Document> doc(app::load_document(fn.c_str()));
+  }
+
+  std::remove(fn.c_str());
+}
+
+static void save_ase(State& state) { save_file(state, "benchmark.ase", IMAGE_RGB, kFrames); }
+static void load_ase(State& state) { load_file(state, "benchmark.ase", IMAGE_RGB, kFrames); }
+static void save_png(State& state) { save_file(state, "benchmark.png", IMAGE_RGB, 1); }
+static void load_png(State& state) { load_file(state, "benchmark.png", IMAGE_RGB, 1); }
+static void save_gif(State& state) { save_file(state, "benchmark.gif", IMAGE_INDEXED, kFrames); }
+static void load_gif(State& state) { load_file(state, "benchmark.gif", IMAGE_INDEXED, kFrames); }
+static void save_gif_rgb(State& state) { save_file(state, "benchmark_rgb.gif", IMAGE_RGB, kFrames); }
+
+BENCHMARK(save_ase, kSizes);
+BENCHMARK(load_ase, kSizes);
+BENCHMARK(save_png, kSizes);
+BENCHMARK(load_png, kSizes);
+BENCHMARK(save_gif, kSizes);
+BENCHMARK(load_gif, kSizes);
+BENCHMARK(save_gif_rgb, kSizes);
@@ -0,0 +1,110 @@
+/* Aseprite
+ * Copyright (C) 2001-2013  David Capello
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "benchmarks/benchmark.h"
+
+#include "base/shared_ptr.h"
+#include "base/unique_ptr.h"
+#include "filters/convolution_matrix.h"
+#include "filters/convolution_matrix_filter.h"
+#include "filters/median_filter.h"
+#include "raster/raster.h"
+#include "tests/simple_filter_manager.h"
+
+#include <vector>
+
+using namespace benchmarks;
+using namespace filters;
+using namespace raster;
+using namespace tests;
+
+static const int kSizes[] = { 64, 256, 1024 };
+
+static void apply_filter(State& state, PixelFormat format, Filter* filter)
+{
+  int size = state.param();
+  base::UniquePtr<Image> src(create_image(format, size, size, 1));
+  base::UniquePtr<Image> dst(Image::create(format, size, size));
+  Palette palette(FrameNumber(0), 256);
+  RgbMap rgbmap;
+  rgbmap.regenerate(&palette);
+  SimpleFilterManager filterMgr(src, dst, &palette, &rgbmap);
+
+  state.setItemsPerIteration(size*size);
+  while (state.keepRunning())
+    filterMgr.apply(filter);
+}
+
+static void median_filter(State& state, PixelFormat format, int size)
+{
+  MedianFilter filter;
+  filter.setSize(size, size);
+  apply_filter(state, format, &filter);
+}
+
+static void median_rgb_3x3(State& state) { median_filter(state, IMAGE_RGB, 3); }
+static void median_rgb_7x7(State& state) { median_filter(state, IMAGE_RGB, 7); }
+static void median_rgb_15x15(State& state) { median_filter(state, IMAGE_RGB, 15); }
+static void median_rgb_31x31(State& state) { median_filter(state, IMAGE_RGB, 31); }
+static void median_grayscale_7x7(State& state) { median_filter(state, IMAGE_GRAYSCALE, 7); }
+BENCHMARK(median_rgb_3x3, kSizes);
+BENCHMARK(median_rgb_7x7, kSizes);
+BENCHMARK(median_rgb_15x15, kSizes);
+BENCHMARK(median_rgb_31x31, kSizes);
+BENCHMARK(median_grayscale_7x7, kSizes);
+
+// Applies a size x size matrix. If "separable" is true the matrix is
+// a binomial blur, in other case it has one non-separable value.
+static void convolution_filter(State& state, PixelFormat format, int size, bool separable)
+{
+  SharedPtr<ConvolutionMatrix> matrix(new ConvolutionMatrix(size, size));
+  std::vector<int> binomial(size, 1);
+  int div = 0;
+
+  for (int i=1; i<size; ++i)
+    for (int j=i-1; j>0; --j)
+      binomial[j] += binomial[j-1];
+
+  for (int y=0; y<size; ++y)
+    for (int x=0; x<size; ++x)
+      div += (matrix->value(x, y) = binomial[x] * binomial[y]);
+
+  if (!separable) {
+    div -= matrix->value(0, 0);
+    matrix->value(0, 0) = 0;
+  }
+
+  matrix->setCenterX(size/2);
+  matrix->setCenterY(size/2);
+  matrix->setDiv(div);
+
+  ConvolutionMatrixFilter filter;
+  filter.setMatrix(matrix);
+  apply_filter(state, format, &filter);
+}
+
+static void convolution_rgb_3x3(State& state) { convolution_filter(state, IMAGE_RGB, 3, true); }
+static void convolution_rgb_7x7(State& state) { convolution_filter(state, IMAGE_RGB, 7, true); }
+static void convolution_rgb_7x7_nonseparable(State& state) { convolution_filter(state, IMAGE_RGB, 7, false); }
+BENCHMARK(convolution_rgb_3x3, kSizes);
+BENCHMARK(convolution_rgb_7x7, kSizes);
+BENCHMARK(convolution_rgb_7x7_nonseparable, kSizes);
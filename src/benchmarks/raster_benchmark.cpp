@@ -0,0 +1,308 @@
+/* Aseprite
+ * Copyright (C) 2001-2013  David Capello
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "benchmarks/benchmark.h"
+
+#include "app/document.h"
+#include "base/unique_ptr.h"
+#include "raster/quantization.h"
+#include "raster/raster.h"
+
+using namespace benchmarks;
+using namespace raster;
+
+static const int kSizes[] = { 64, 256, 1024 };
+
+static void merge_rgb(State& state)
+{
+  int size = state.param();
+  base::UniquePtr<Image> dst(create_image(IMAGE_RGB, size, size, 1));
+  base::UniquePtr<Image> src(create_image(IMAGE_RGB, size, size, 2));
+
+  state.setItemsPerIteration(size*size);
+  while (state.keepRunning())
+    image_merge(dst, src, 0, 0, 255, BLEND_MODE_NORMAL);
+}
+BENCHMARK(merge_rgb, kSizes);
+
+static void merge_rgb_opacity(State& state)
+{
+  int size = state.param();
+  base::UniquePtr<Image> dst(create_image(IMAGE_RGB, size, size, 1));
+  base::UniquePtr<Image> src(create_image(IMAGE_RGB, size, size, 2));
+
+  state.setItemsPerIteration(size*size);
+  while (state.keepRunning())
+    image_merge(dst, src, 0, 0, 128, BLEND_MODE_NORMAL);
+}
+BENCHMARK(merge_rgb_opacity, kSizes);
+
+static void merge_indexed(State& state)
+{
+  int size = state.param();
+  base::UniquePtr<Image> dst(create_image(IMAGE_INDEXED, size, size, 1));
+  base::UniquePtr<Image> src(create_image(IMAGE_INDEXED, size, size, 2));
+
+  state.setItemsPerIteration(size*size);
+  while (state.keepRunning())
+    image_merge(dst, src, 0, 0, 255, BLEND_MODE_NORMAL);
+}
+BENCHMARK(merge_indexed, kSizes);
+
+// Resizes the image to the double of its size (or to the half if
+// "reduce" is true).
+static void resize_image(State& state, PixelFormat format, ResizeMethod method,
+                         bool reduce = false)
+{
+  int size = state.param();
+  int dstSize = (reduce ? size/2: size*2);
+  base::UniquePtr<app::Document> doc(create_document(format, size, size, 1, 1));
+  Sprite* sprite = doc->getSprite();
+  base::UniquePtr<Image> src(create_image(format, size, size, 1));
+  base::UniquePtr<Image> dst(Image::create(format, dstSize, dstSize));
+
+  state.setItemsPerIteration(dst->w*dst->h);
+  while (state.keepRunning())
+    image_resize(src, dst, method,
+                 sprite->getPalette(FrameNumber(0)),
+                 sprite->getRgbMap(FrameNumber(0)));
+}
+
+static void resize_rgb_nearest(State& state)
+{
+  resize_image(state, IMAGE_RGB, RESIZE_METHOD_NEAREST_NEIGHBOR);
+}
+BENCHMARK(resize_rgb_nearest, kSizes);
+
+static void resize_rgb_bilinear(State& state)
+{
+  resize_image(state, IMAGE_RGB, RESIZE_METHOD_BILINEAR);
+}
+BENCHMARK(resize_rgb_bilinear, kSizes);
+
+static void resize_indexed_bilinear(State& state)
+{
+  resize_image(state, IMAGE_INDEXED, RESIZE_METHOD_BILINEAR);
+}
+BENCHMARK(resize_indexed_bilinear, kSizes);
+
+static void resize_rgb_area_reduce(State& state)
+{
+  resize_image(state, IMAGE_RGB, RESIZE_METHOD_AREA, true);
+}
+BENCHMARK(resize_rgb_area_reduce, kSizes);
+
+static void count_hline(int x1, int y, int x2, void* data)
+{
+  *((int*)data) += x2-x1+1;
+}
+
+// Fills an area with some obstacles (horizontal lines with holes)
+// so the algorithm has to go up and down several times.
+static void floodfill(State& state)
+{
+  int size = state.param();
+  base::UniquePtr<Image> image(Image::create(IMAGE_INDEXED, size, size));
+  image_clear(image, 0);
+  for (int y=4; y<size; y+=8)
+    for (int x=(y/8)%2 ? 0: 4; x<size-4; x+=size/4)
+      image_hline(image, x, y, x+size/4-5, 1);
+
+  int pixels = 0;
+  algo_floodfill(image, 0, 0, 0, true, &pixels, count_hline);
+
+  state.setItemsPerIteration(pixels);
+  while (state.keepRunning()) {
+    int count = 0;
+    algo_floodfill(image, 0, 0, 0, true, &count, count_hline);
+  }
+}
+BENCHMARK(floodfill, kSizes);
+
+// Fills an image with random noise (a lot of small spans in each
+// row), contiguous or the whole image.
+static void floodfill_noise(State& state, bool contiguous)
+{
+  int size = state.param();
+  base::UniquePtr<Image> image(Image::create(IMAGE_INDEXED, size, size));
+  unsigned int seed = 1;
+  for (int y=0; y<size; ++y) {
+    for (int x=0; x<size; ++x) {
+      seed = seed*1103515245 + 12345;
+      image_putpixel(image, x, y, ((seed >> 16) % 5) == 0 ? 1: 0);
+    }
+  }
+  image_putpixel(image, 0, 0, 0);
+
+  int pixels = 0;
+  algo_floodfill(image, 0, 0, 0, contiguous, &pixels, count_hline);
+
+  state.setItemsPerIteration(pixels);
+  while (state.keepRunning()) {
+    int count = 0;
+    algo_floodfill(image, 0, 0, 0, contiguous, &count, count_hline);
+  }
+}
+
+static void floodfill_noise_contiguous(State& state) { floodfill_noise(state, true); }
+static void floodfill_noise_global(State& state) { floodfill_noise(state, false); }
+BENCHMARK(floodfill_noise_contiguous, kSizes);
+BENCHMARK(floodfill_noise_global, kSizes);
+
+static void mask_by_color(State& state)
+{
+  int size = state.param();
+  base::UniquePtr<Image> image(create_image(IMAGE_RGB, size, size, 1));
+  int color = image_getpixel(image, size/2, size/2);
+
+  state.setItemsPerIteration(size*size);
+  while (state.keepRunning()) {
+    Mask mask;
+    mask.byColor(image, color, 16);
+  }
+}
+BENCHMARK(mask_by_color, kSizes);
+
+static void count_diff_rgb(State& state)
+{
+  int size = state.param();
+  base::UniquePtr<Image> image1(create_image(IMAGE_RGB, size, size, 1));
+  base::UniquePtr<Image> image2(create_image(IMAGE_RGB, size, size, 2));
+
+  state.setItemsPerIteration(size*size);
+  while (state.keepRunning())
+    image_count_diff(image1, image2);
+}
+BENCHMARK(count_diff_rgb, kSizes);
+
+static void rotate_rgb_90(State& state)
+{
+  int size = state.param();
+  base::UniquePtr<Image> src(create_image(IMAGE_RGB, size, size, 1));
+  base::UniquePtr<Image> dst(Image::create(IMAGE_RGB, size, size));
+
+  state.setItemsPerIteration(size*size);
+  while (state.keepRunning())
+    image_rotate(src, dst, 90);
+}
+BENCHMARK(rotate_rgb_90, kSizes);
+
+static void quantization_create_palette(State& state, QuantizationMethod method,
+                                        int frames, bool allFrames)
+{
+  int size = state.param();
+  base::UniquePtr<app::Document> doc(create_document(IMAGE_RGB, size, size, 1, frames));
+
+  state.setItemsPerIteration(size*size*frames);
+  while (state.keepRunning()) {
+    base::UniquePtr<Palette> palette(
+      quantization::create_palette_from_rgb(doc->getSprite(), FrameNumber(0),
+                                            method, allFrames));
+  }
+}
+
+static void quantization_create_palette(State& state) { quantization_create_palette(state, QUANTIZATION_MEDIAN_CUT, 1, false); }
+static void quantization_create_palette_octree(State& state) { quantization_create_palette(state, QUANTIZATION_OCTREE, 1, false); }
+static void quantization_create_palette_16_frames(State& state) { quantization_create_palette(state, QUANTIZATION_MEDIAN_CUT, 16, true); }
+BENCHMARK(quantization_create_palette, kSizes);
+BENCHMARK(quantization_create_palette_octree, kSizes);
+BENCHMARK(quantization_create_palette_16_frames, kSizes);
+
+static void quantization_convert_to_indexed(State& state, DitheringMethod ditheringMethod)
+{
+  int size = state.param();
+  base::UniquePtr<app::Document> doc(create_document(IMAGE_RGB, size, size, 1, 1));
+  Sprite* sprite = doc->getSprite();
+  base::UniquePtr<Image> src(create_image(IMAGE_RGB, size, size, 1));
+
+  state.setItemsPerIteration(size*size);
+  while (state.keepRunning()) {
+    base::UniquePtr<Image> dst(
+      quantization::convert_pixel_format(src, IMAGE_INDEXED, ditheringMethod,
+                                         sprite->getRgbMap(FrameNumber(0)),
+                                         sprite->getPalette(FrameNumber(0)),
+                                         false));
+  }
+}
+
+static void quantization_convert_to_indexed(State& state) { quantization_convert_to_indexed(state, DITHERING_NONE); }
+static void quantization_convert_to_indexed_ordered(State& state) { quantization_convert_to_indexed(state, DITHERING_ORDERED); }
+static void quantization_convert_to_indexed_floyd_steinberg(State& state) { quantization_convert_to_indexed(state, DITHERING_FLOYD_STEINBERG); }
+BENCHMARK(quantization_convert_to_indexed, kSizes);
+BENCHMARK(quantization_convert_to_indexed_ordered, kSizes);
+BENCHMARK(quantization_convert_to_indexed_floyd_steinberg, kSizes);
+
+// Simulates the edition of the palette: each iteration changes one
+// entry, so the RgbMap must be regenerated before the image is
+// converted to indexed.
+static void rgbmap_regenerate(State& state, int bits)
+{
+  int size = state.param();
+  base::UniquePtr<Image> src(create_image(IMAGE_RGB, size, size, 1));
+  Palette palette(FrameNumber(0), 256);
+  for (int i=0; i<256; ++i)
+    palette.setEntry(i, _rgba((i & 7) * 255 / 7, ((i >> 3) & 7) * 255 / 7, (i >> 6) * 255 / 3, 255));
+  RgbMap rgbmap(bits);
+
+  state.setItemsPerIteration(size*size);
+  while (state.keepRunning()) {
+    palette.setEntry(1, palette.getEntry(1) ^ 1);
+    rgbmap.regenerate(&palette);
+
+    base::UniquePtr<Image> dst(
+      quantization::convert_pixel_format(src, IMAGE_INDEXED, DITHERING_NONE,
+                                         &rgbmap, &palette, false));
+  }
+}
+
+static void rgbmap_regenerate_5bits(State& state) { rgbmap_regenerate(state, 5); }
+static void rgbmap_regenerate_6bits(State& state) { rgbmap_regenerate(state, 6); }
+BENCHMARK(rgbmap_regenerate_5bits, kSizes);
+BENCHMARK(rgbmap_regenerate_6bits, kSizes);
+
+// Converts an RGB image to indexed with Palette::findBestfit() (as the
+// GIF encoder does for each pixel).
+static void palette_find_bestfit(State& state)
+{
+  int size = state.param();
+  base::UniquePtr<Image> src(create_image(IMAGE_RGB, size, size, 1));
+  base::UniquePtr<Image> dst(Image::create(IMAGE_INDEXED, size, size));
+  Palette palette(FrameNumber(0), 256);
+  unsigned int seed = 1;
+  for (int i=0; i<256; ++i) {
+    seed = seed*1103515245 + 12345;
+    palette.setEntry(i, _rgba((seed >> 8) & 255, (seed >> 16) & 255, (seed >> 24) & 255, 255));
+  }
+
+  state.setItemsPerIteration(size*size);
+  while (state.keepRunning()) {
+    for (int y=0; y<size; ++y) {
+      const uint32_t* src_address = image_address_fast<RgbTraits>(src, 0, y);
+      uint8_t* dst_address = image_address_fast<IndexedTraits>(dst, 0, y);
+      for (int x=0; x<size; ++x, ++src_address, ++dst_address)
+        *dst_address = palette.findBestfit(_rgba_getr(*src_address),
+                                           _rgba_getg(*src_address),
+                                           _rgba_getb(*src_address));
+    }
+  }
+}
+BENCHMARK(palette_find_bestfit, kSizes);
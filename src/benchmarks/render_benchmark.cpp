@@ -0,0 +1,73 @@
+/* Aseprite
+ * Copyright (C) 2001-2013  David Capello
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "benchmarks/benchmark.h"
+
+#include "app/document.h"
+#include "app/util/render.h"
+#include "app/util/render_cache.h"
+#include "base/unique_ptr.h"
+#include "raster/raster.h"
+
+using namespace benchmarks;
+using namespace raster;
+
+static const int kSizes[] = { 64, 256, 1024 };
+
+// Renders the whole sprite (three layers) like a sprite editor.
+static void render_sprite(State& state, int zoom, bool useCache)
+{
+  int size = state.param();
+  base::UniquePtr<app::Document> doc(create_document(IMAGE_RGB, size, size, 3, 1));
+  Sprite* sprite = doc->getSprite();
+  app::RenderCache cache;
+
+  state.setItemsPerIteration((size << zoom) * (size << zoom));
+  while (state.keepRunning()) {
+    app::RenderEngine renderEngine(doc, sprite, sprite->getFolder()->getFirstLayer(),
+                                   FrameNumber(0));
+    if (useCache)
+      renderEngine.setCache(&cache);
+
+    base::UniquePtr<Image> image(
+      renderEngine.renderSprite(0, 0, size << zoom, size << zoom,
+                                FrameNumber(0), zoom, true));
+  }
+}
+
+static void render_sprite_zoom1(State& state)
+{
+  render_sprite(state, 0, false);
+}
+BENCHMARK(render_sprite_zoom1, kSizes);
+
+static void render_sprite_zoom4(State& state)
+{
+  render_sprite(state, 2, false);
+}
+BENCHMARK(render_sprite_zoom4, kSizes);
+
+static void render_sprite_cached(State& state)
+{
+  render_sprite(state, 0, true);
+}
+BENCHMARK(render_sprite_cached, kSizes);
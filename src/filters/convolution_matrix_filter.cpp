@@ -30,95 +30,248 @@
 #include "raster/palette.h"
 #include "raster/rgbmap.h"
 
+#include <cstdlib>
+
 namespace filters {
 
 using namespace raster;
 
 namespace {
 
-  struct GetPixelsDelegate {
-    uint32_t color;
-    int div;
-    const int* matrixData;
-
-    void reset(const ConvolutionMatrix* matrix) {
-      div = matrix->getDiv();
-      matrixData = &matrix->value(0, 0);
+  // Each pixel format is split in "nchannels" integers to accumulate
+  // them in different rows of sums. The last channel is 1 for
+  // transparent pixels: the matrix values of transparent pixels are
+  // subtracted from the divisor (they don't count in the average).
+  struct SplitRgba {
+    enum { nchannels = 5 };
+
+    void operator()(RgbTraits::pixel_t color, int* values) const {
+      if (_rgba_geta(color) == 0) {
+        values[0] = values[1] = values[2] = values[3] = 0;
+        values[4] = 1;
+      }
+      else {
+        values[0] = _rgba_getr(color);
+        values[1] = _rgba_getg(color);
+        values[2] = _rgba_getb(color);
+        values[3] = _rgba_geta(color);
+        values[4] = 0;
+      }
     }
-
   };
 
-  struct GetPixelsDelegateRgba : public GetPixelsDelegate {
-    int r, g, b, a;
+  struct SplitGrayscale {
+    enum { nchannels = 3 };
 
-    void reset(const ConvolutionMatrix* matrix) {
-      GetPixelsDelegate::reset(matrix);
-      r = g = b = a = 0;
-    }
-
-    void operator()(RgbTraits::pixel_t color)
-    {
-      if (*matrixData) {
-        if (_rgba_geta(color) == 0)
-          div -= *matrixData;
-        else {
-          r += _rgba_getr(color) * (*matrixData);
-          g += _rgba_getg(color) * (*matrixData);
-          b += _rgba_getb(color) * (*matrixData);
-          a += _rgba_geta(color) * (*matrixData);
-        }
+    void operator()(GrayscaleTraits::pixel_t color, int* values) const {
+      if (_graya_geta(color) == 0) {
+        values[0] = values[1] = 0;
+        values[2] = 1;
+      }
+      else {
+        values[0] = _graya_getv(color);
+        values[1] = _graya_geta(color);
+        values[2] = 0;
       }
-      matrixData++;
     }
-
   };
 
-  struct GetPixelsDelegateGrayscale : public GetPixelsDelegate {
-    int v, a;
+  // Indexed images don't have transparent pixels (the mask color is
+  // used as any other index).
+  struct SplitIndexed {
+    enum { nchannels = 4 };
+    const Palette* pal;
+
+    SplitIndexed(const Palette* pal) : pal(pal) { }
 
-    void reset(const ConvolutionMatrix* matrix) {
-      GetPixelsDelegate::reset(matrix);
-      v = a = 0;
+    void operator()(IndexedTraits::pixel_t color, int* values) const {
+      uint32_t rgba = pal->getEntry(color);
+      values[0] = _rgba_getr(rgba);
+      values[1] = _rgba_getg(rgba);
+      values[2] = _rgba_getb(rgba);
+      values[3] = color;
     }
+  };
 
-    void operator()(GrayscaleTraits::pixel_t color)
-    {
-      if (*matrixData) {
-        if (_graya_geta(color) == 0)
-          div -= *matrixData;
-        else {
-          v += _graya_getv(color) * (*matrixData);
-          a += _graya_geta(color) * (*matrixData);
-        }
+  // Adds k*src[i] to dst[i] for the whole row. It's a separated
+  // function with plain arrays so the compiler can vectorize it.
+  inline void add_scaled_row(int* dst, const int* src, int k, int n)
+  {
+    for (int i=0; i<n; ++i)
+      dst[i] += k*src[i];
+  }
+
+  // Calculates the sums of all channels of the current row of the
+  // FilterManager multiplied by the matrix. The result is
+  // Split::nchannels rows of getWidth() integers in "sums".
+  //
+  // Instead of accumulating each pixel of the matrix for each pixel
+  // of the row, the source rows are unpacked in channels and the
+  // matrix is applied to the whole row at once. If the matrix is
+  // separable, the rows of the window are first added in one row
+  // using the column kernel, and then the row kernel is applied to
+  // that row, so the cost per pixel is O(width+height) instead of
+  // O(width*height).
+  template<typename Traits, typename Split>
+  void convolve_row(FilterManager* filterMgr,
+                    const ConvolutionMatrix* matrix,
+                    const std::vector<int>& rowKernel,
+                    const std::vector<int>& colKernel,
+                    TiledMode tiledMode,
+                    const Split& split,
+                    std::vector<int>& sums)
+  {
+    const Image* src = filterMgr->getSourceImage();
+    const int x = filterMgr->getX();
+    const int y = filterMgr->getY();
+    const int w = filterMgr->getWidth();
+    const int mw = matrix->getWidth();
+    const int mh = matrix->getHeight();
+    const int cx = matrix->getCenterX();
+    const int cy = matrix->getCenterY();
+    const int len = w+mw-1;     // Source pixels needed in each row
+    const bool tiledX = ((tiledMode & TILED_X_AXIS) == TILED_X_AXIS);
+    const bool tiledY = ((tiledMode & TILED_Y_AXIS) == TILED_Y_AXIS);
+    const bool separable = !rowKernel.empty();
+    std::vector<int> line(separable ? 0: Split::nchannels*len);
+    std::vector<int> colSums(separable ? Split::nchannels*len: 0, 0);
+    int values[Split::nchannels];
+    int c, u, v, i, k;
+
+    sums.assign(Split::nchannels*w, 0);
+
+    // Source columns of each pixel of "line"
+    std::vector<int> columns(len);
+    for (i=0; i<len; ++i)
+      columns[i] = get_neighboring_coord(x-cx+i, src->w, tiledX);
+
+    for (v=0; v<mh; ++v) {
+      if (separable) {
+        if (colKernel[v] == 0)
+          continue;
+      }
+      else {
+        for (u=0; u<mw && matrix->value(u, v) == 0; ++u)
+          ;
+        if (u == mw)
+          continue;
       }
-      matrixData++;
-    }
 
-  };
+      // Unpack the source row in channels (adding it directly to the
+      // column sums if the matrix is separable)
+      typename Traits::const_address_t srcAddress =
+        image_address_fast<Traits>(
+          src, 0, get_neighboring_coord(y-cy+v, src->h, tiledY));
+
+      if (separable) {
+        k = colKernel[v];
+        for (i=0; i<len; ++i) {
+          split(srcAddress[columns[i]], values);
+          for (c=0; c<Split::nchannels; ++c)
+            colSums[c*len+i] += k*values[c];
+        }
+      }
+      else {
+        for (i=0; i<len; ++i) {
+          split(srcAddress[columns[i]], values);
+          for (c=0; c<Split::nchannels; ++c)
+            line[c*len+i] = values[c];
+        }
 
-  struct GetPixelsDelegateIndexed : public GetPixelsDelegate {
-    const Palette* pal;
-    int r, g, b, index;
+        for (u=0; u<mw; ++u) {
+          k = matrix->value(u, v);
+          if (k != 0) {
+            for (c=0; c<Split::nchannels; ++c)
+              add_scaled_row(&sums[c*w], &line[c*len+u], k, w);
+          }
+        }
+      }
+    }
 
-    GetPixelsDelegateIndexed(const Palette* pal) : pal(pal) { }
+    if (separable) {
+      for (u=0; u<mw; ++u) {
+        k = rowKernel[u];
+        if (k != 0) {
+          for (c=0; c<Split::nchannels; ++c)
+            add_scaled_row(&sums[c*w], &colSums[c*len+u], k, w);
+        }
+      }
+    }
+  }
 
-    void reset(const ConvolutionMatrix* matrix) {
-      GetPixelsDelegate::reset(matrix);
-      r = g = b = index = 0;
+  int gcd(int a, int b)
+  {
+    a = std::abs(a);
+    b = std::abs(b);
+    while (b != 0) {
+      int t = a % b;
+      a = b;
+      b = t;
     }
+    return a;
+  }
 
-    void operator()(GrayscaleTraits::pixel_t color)
-    {
-      if (*matrixData) {
-        r += _rgba_getr(pal->getEntry(color)) * (*matrixData);
-        g += _rgba_getg(pal->getEntry(color)) * (*matrixData);
-        b += _rgba_getb(pal->getEntry(color)) * (*matrixData);
-        index += color * (*matrixData);
+  // Returns true if the matrix can be expressed as the product of a
+  // column and a row (matrix(x, y) == colKernel[y] * rowKernel[x]),
+  // e.g. box filters and most blurs.
+  bool split_separable_matrix(const ConvolutionMatrix* matrix,
+                              std::vector<int>& rowKernel,
+                              std::vector<int>& colKernel)
+  {
+    const int mw = matrix->getWidth();
+    const int mh = matrix->getHeight();
+    int x, y, x0, y0 = -1, div = 0;
+
+    // A matrix with one row or one column is already a 1-D kernel
+    if (mw < 2 || mh < 2)
+      return false;
+
+    // Find the first row with non-zero values
+    for (y=0; y<mh && y0 < 0; ++y) {
+      for (x=0; x<mw; ++x) {
+        if (matrix->value(x, y) != 0) {
+          y0 = y;
+          break;
+        }
       }
-      matrixData++;
+    }
+    if (y0 < 0)
+      return false;
+
+    // The row kernel is that row divided by the GCD of its values
+    for (x=0; x<mw; ++x)
+      div = gcd(div, matrix->value(x, y0));
+
+    for (x0=0; matrix->value(x0, y0) == 0; ++x0)
+      ;
+    if (matrix->value(x0, y0) < 0)
+      div = -div;
+
+    rowKernel.resize(mw);
+    for (x=0; x<mw; ++x)
+      rowKernel[x] = matrix->value(x, y0) / div;
+
+    colKernel.resize(mh);
+    for (y=0; y<mh; ++y) {
+      if (matrix->value(x0, y) % rowKernel[x0] != 0)
+        break;
+
+      colKernel[y] = matrix->value(x0, y) / rowKernel[x0];
+
+      for (x=0; x<mw; ++x)
+        if (matrix->value(x, y) != colKernel[y] * rowKernel[x])
+          break;
+      if (x < mw)
+        break;
     }
 
-  };
+    if (y < mh) {
+      rowKernel.clear();
+      colKernel.clear();
+      return false;
+    }
+    return true;
+  }
 
 }
 
@@ -131,7 +284,11 @@ ConvolutionMatrixFilter::ConvolutionMatrixFilter()
 void ConvolutionMatrixFilter::setMatrix(const SharedPtr<ConvolutionMatrix>& matrix)
 {
   m_matrix = matrix;
-  m_lines.resize(matrix->getHeight());
+  m_rowKernel.clear();
+  m_colKernel.clear();
+
+  if (m_matrix)
+    split_separable_matrix(m_matrix, m_rowKernel, m_colKernel);
 }
 
 void ConvolutionMatrixFilter::setTiledMode(TiledMode tiledMode)
@@ -153,61 +310,58 @@ void ConvolutionMatrixFilter::applyToRgba(FilterManager* filterMgr)
   uint32_t* dst_address = (uint32_t*)filterMgr->getDestinationAddress();
   Target target = filterMgr->getTarget();
   uint32_t color;
-  GetPixelsDelegateRgba delegate;
+  int r, g, b, a, div;
   int x = filterMgr->getX();
-  int x2 = x+filterMgr->getWidth();
+  int w = filterMgr->getWidth();
   int y = filterMgr->getY();
+  std::vector<int> sums;
+
+  convolve_row<RgbTraits>(filterMgr, m_matrix, m_rowKernel, m_colKernel,
+                          m_tiledMode, SplitRgba(), sums);
 
-  for (; x<x2; ++x) {
+  for (int i=0; i<w; ++i, ++x) {
     // Avoid the non-selected region
     if (filterMgr->skipPixel()) {
       ++dst_address;
       continue;
     }
 
-    delegate.reset(m_matrix);
-    get_neighboring_pixels<RgbTraits>(src, x, y,
-                                      m_matrix->getWidth(),
-                                      m_matrix->getHeight(),
-                                      m_matrix->getCenterX(),
-                                      m_matrix->getCenterY(),
-                                      m_tiledMode, delegate);
-
     color = image_getpixel_fast<RgbTraits>(src, x, y);
-    if (delegate.div == 0) {
+    div = m_matrix->getDiv() - sums[4*w+i];
+    if (div == 0) {
       *(dst_address++) = color;
       continue;
     }
 
     if (target & TARGET_RED_CHANNEL) {
-      delegate.r = delegate.r / delegate.div + m_matrix->getBias();
-      delegate.r = MID(0, delegate.r, 255);
+      r = sums[i] / div + m_matrix->getBias();
+      r = MID(0, r, 255);
     }
     else
-      delegate.r = _rgba_getr(color);
+      r = _rgba_getr(color);
 
     if (target & TARGET_GREEN_CHANNEL) {
-      delegate.g = delegate.g / delegate.div + m_matrix->getBias();
-      delegate.g = MID(0, delegate.g, 255);
+      g = sums[w+i] / div + m_matrix->getBias();
+      g = MID(0, g, 255);
     }
     else
-      delegate.g = _rgba_getg(color);
+      g = _rgba_getg(color);
 
     if (target & TARGET_BLUE_CHANNEL) {
-      delegate.b = delegate.b / delegate.div + m_matrix->getBias();
-      delegate.b = MID(0, delegate.b, 255);
+      b = sums[2*w+i] / div + m_matrix->getBias();
+      b = MID(0, b, 255);
     }
     else
-      delegate.b = _rgba_getb(color);
+      b = _rgba_getb(color);
 
     if (target & TARGET_ALPHA_CHANNEL) {
-      delegate.a = delegate.a / m_matrix->getDiv() + m_matrix->getBias();
-      delegate.a = MID(0, delegate.a, 255);
+      a = sums[3*w+i] / m_matrix->getDiv() + m_matrix->getBias();
+      a = MID(0, a, 255);
     }
     else
-      delegate.a = _rgba_geta(color);
+      a = _rgba_geta(color);
 
-    *(dst_address++) = _rgba(delegate.r, delegate.g, delegate.b, delegate.a);
+    *(dst_address++) = _rgba(r, g, b, a);
   }
 }
 
@@ -220,47 +374,44 @@ void ConvolutionMatrixFilter::applyToGrayscale(FilterManager* filterMgr)
   uint16_t* dst_address = (uint16_t*)filterMgr->getDestinationAddress();
   Target target = filterMgr->getTarget();
   uint16_t color;
-  GetPixelsDelegateGrayscale delegate;
+  int k, a, div;
   int x = filterMgr->getX();
-  int x2 = x+filterMgr->getWidth();
+  int w = filterMgr->getWidth();
   int y = filterMgr->getY();
+  std::vector<int> sums;
+
+  convolve_row<GrayscaleTraits>(filterMgr, m_matrix, m_rowKernel, m_colKernel,
+                                m_tiledMode, SplitGrayscale(), sums);
 
-  for (; x<x2; ++x) {
+  for (int i=0; i<w; ++i, ++x) {
     // Avoid the non-selected region
     if (filterMgr->skipPixel()) {
       ++dst_address;
       continue;
     }
 
-    delegate.reset(m_matrix);
-    get_neighboring_pixels<GrayscaleTraits>(src, x, y,
-                                            m_matrix->getWidth(),
-                                            m_matrix->getHeight(),
-                                            m_matrix->getCenterX(),
-                                            m_matrix->getCenterY(),
-                                            m_tiledMode, delegate);
-
     color = image_getpixel_fast<GrayscaleTraits>(src, x, y);
-    if (delegate.div == 0) {
+    div = m_matrix->getDiv() - sums[2*w+i];
+    if (div == 0) {
       *(dst_address++) = color;
       continue;
     }
 
     if (target & TARGET_GRAY_CHANNEL) {
-      delegate.v = delegate.v / delegate.div + m_matrix->getBias();
-      delegate.v = MID(0, delegate.v, 255);
+      k = sums[i] / div + m_matrix->getBias();
+      k = MID(0, k, 255);
     }
     else
-      delegate.v = _graya_getv(color);
+      k = _graya_getv(color);
 
     if (target & TARGET_ALPHA_CHANNEL) {
-      delegate.a = delegate.a / m_matrix->getDiv() + m_matrix->getBias();
-      delegate.a = MID(0, delegate.a, 255);
+      a = sums[w+i] / m_matrix->getDiv() + m_matrix->getBias();
+      a = MID(0, a, 255);
     }
     else
-      delegate.a = _graya_geta(color);
+      a = _graya_geta(color);
 
-    *(dst_address++) = _graya(delegate.v, delegate.a);
+    *(dst_address++) = _graya(k, a);
   }
 }
 
@@ -275,61 +426,58 @@ void ConvolutionMatrixFilter::applyToIndexed(FilterManager* filterMgr)
   const RgbMap* rgbmap = filterMgr->getIndexedData()->getRgbMap();
   Target target = filterMgr->getTarget();
   uint8_t color;
-  GetPixelsDelegateIndexed delegate(pal);
+  int r, g, b, index;
+  int div = m_matrix->getDiv();
   int x = filterMgr->getX();
-  int x2 = x+filterMgr->getWidth();
+  int w = filterMgr->getWidth();
   int y = filterMgr->getY();
+  std::vector<int> sums;
 
-  for (; x<x2; ++x) {
+  convolve_row<IndexedTraits>(filterMgr, m_matrix, m_rowKernel, m_colKernel,
+                              m_tiledMode, SplitIndexed(pal), sums);
+
+  for (int i=0; i<w; ++i, ++x) {
     // Avoid the non-selected region
     if (filterMgr->skipPixel()) {
       ++dst_address;
       continue;
     }
 
-    delegate.reset(m_matrix);
-    get_neighboring_pixels<IndexedTraits>(src, x, y,
-                                          m_matrix->getWidth(),
-                                          m_matrix->getHeight(),
-                                          m_matrix->getCenterX(),
-                                          m_matrix->getCenterY(),
-                                          m_tiledMode, delegate);
-
     color = image_getpixel_fast<IndexedTraits>(src, x, y);
-    if (delegate.div == 0) {
+    if (div == 0) {
       *(dst_address++) = color;
       continue;
     }
 
     if (target & TARGET_INDEX_CHANNEL) {
-      delegate.index = delegate.index / m_matrix->getDiv() + m_matrix->getBias();
-      delegate.index = MID(0, delegate.index, 255);
+      index = sums[3*w+i] / div + m_matrix->getBias();
+      index = MID(0, index, 255);
 
-      *(dst_address++) = delegate.index;
+      *(dst_address++) = index;
     }
     else {
       if (target & TARGET_RED_CHANNEL) {
-        delegate.r = delegate.r / delegate.div + m_matrix->getBias();
-        delegate.r = MID(0, delegate.r, 255);
+        r = sums[i] / div + m_matrix->getBias();
+        r = MID(0, r, 255);
       }
       else
-        delegate.r = _rgba_getr(pal->getEntry(color));
+        r = _rgba_getr(pal->getEntry(color));
 
       if (target & TARGET_GREEN_CHANNEL) {
-        delegate.g =  delegate.g / delegate.div + m_matrix->getBias();
-        delegate.g = MID(0, delegate.g, 255);
+        g = sums[w+i] / div + m_matrix->getBias();
+        g = MID(0, g, 255);
       }
       else
-        delegate.g = _rgba_getg(pal->getEntry(color));
+        g = _rgba_getg(pal->getEntry(color));
 
       if (target & TARGET_BLUE_CHANNEL) {
-        delegate.b = delegate.b / delegate.div + m_matrix->getBias();
-        delegate.b = MID(0, delegate.b, 255);
+        b = sums[2*w+i] / div + m_matrix->getBias();
+        b = MID(0, b, 255);
       }
       else
-        delegate.b = _rgba_getb(pal->getEntry(color));
+        b = _rgba_getb(pal->getEntry(color));
 
-      *(dst_address++) = rgbmap->mapColor(delegate.r, delegate.g, delegate.b);
+      *(dst_address++) = rgbmap->mapColor(r, g, b);
     }
   }
 }
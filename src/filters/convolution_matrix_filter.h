@@ -48,7 +48,12 @@ namespace filters {
   private:
     SharedPtr<ConvolutionMatrix> m_matrix;
     TiledMode m_tiledMode;
-    std::vector<uint8_t*> m_lines;
+
+    // If the matrix is separable (it's equal to m_colKernel *
+    // m_rowKernel), these are the 1-D kernels to apply it in two
+    // passes. They are empty for non-separable matrices.
+    std::vector<int> m_rowKernel;
+    std::vector<int> m_colKernel;
   };
 
 } // namespace filters
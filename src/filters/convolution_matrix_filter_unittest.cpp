@@ -0,0 +1,264 @@
+/* Aseprite
+ * Copyright (C) 2001-2013  David Capello
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#include "tests/test.h"
+
+#include "base/shared_ptr.h"
+#include "base/unique_ptr.h"
+#include "filters/convolution_matrix.h"
+#include "filters/convolution_matrix_filter.h"
+#include "filters/neighboring_pixels.h"
+#include "raster/raster.h"
+#include "tests/simple_filter_manager.h"
+
+#include <cstdlib>
+
+using namespace filters;
+using namespace raster;
+using namespace tests;
+
+namespace {
+
+  // Old implementation of the convolution filter: the whole matrix is
+  // applied to each pixel with get_neighboring_pixels().
+  struct OldDelegate {
+    const ConvolutionMatrix* matrix;
+    const Palette* pal;
+    const int* matrixData;
+    int div;
+    int c[4];
+
+    OldDelegate(const ConvolutionMatrix* matrix, const Palette* pal)
+      : matrix(matrix), pal(pal) {
+    }
+
+    void reset() {
+      matrixData = &matrix->value(0, 0);
+      div = matrix->getDiv();
+      c[0] = c[1] = c[2] = c[3] = 0;
+    }
+
+    void add(int alpha, int c0, int c1, int c2, int c3) {
+      if (*matrixData) {
+        if (alpha == 0)
+          div -= *matrixData;
+        else {
+          c[0] += c0 * (*matrixData);
+          c[1] += c1 * (*matrixData);
+          c[2] += c2 * (*matrixData);
+          c[3] += c3 * (*matrixData);
+        }
+      }
+      matrixData++;
+    }
+
+    int channel(int i, int div) const {
+      return MID(0, c[i] / div + matrix->getBias(), 255);
+    }
+  };
+
+  struct OldRgbaDelegate : OldDelegate {
+    OldRgbaDelegate(const ConvolutionMatrix* matrix) : OldDelegate(matrix, NULL) { }
+    void operator()(RgbTraits::pixel_t color) {
+      add(_rgba_geta(color), _rgba_getr(color), _rgba_getg(color), _rgba_getb(color), _rgba_geta(color));
+    }
+  };
+
+  struct OldGrayscaleDelegate : OldDelegate {
+    OldGrayscaleDelegate(const ConvolutionMatrix* matrix) : OldDelegate(matrix, NULL) { }
+    void operator()(GrayscaleTraits::pixel_t color) {
+      add(_graya_geta(color), _graya_getv(color), _graya_geta(color), 0, 0);
+    }
+  };
+
+  struct OldIndexedDelegate : OldDelegate {
+    OldIndexedDelegate(const ConvolutionMatrix* matrix, const Palette* pal) : OldDelegate(matrix, pal) { }
+    void operator()(IndexedTraits::pixel_t color) {
+      // Indexed images don't have transparent pixels
+      uint32_t rgba = pal->getEntry(color);
+      add(255, _rgba_getr(rgba), _rgba_getg(rgba), _rgba_getb(rgba), color);
+    }
+  };
+
+  template<class Traits, class Delegate>
+  void apply_old_filter(const ConvolutionMatrix* matrix, TiledMode tiledMode,
+                        const Image* src, Image* dst,
+                        Delegate& delegate, const RgbMap* rgbmap, Target target)
+  {
+    for (int y=0; y<src->h; ++y) {
+      for (int x=0; x<src->w; ++x) {
+        delegate.reset();
+        get_neighboring_pixels<Traits>(src, x, y,
+                                       matrix->getWidth(), matrix->getHeight(),
+                                       matrix->getCenterX(), matrix->getCenterY(),
+                                       tiledMode, delegate);
+
+        int color = image_getpixel_fast<Traits>(src, x, y);
+        if (delegate.div == 0) {
+          dst->putpixel(x, y, color);
+          continue;
+        }
+
+        switch (src->getPixelFormat()) {
+          case IMAGE_RGB:
+            color = _rgba(delegate.channel(0, delegate.div),
+                          delegate.channel(1, delegate.div),
+                          delegate.channel(2, delegate.div),
+                          delegate.channel(3, matrix->getDiv()));
+            break;
+          case IMAGE_GRAYSCALE:
+            color = _graya(delegate.channel(0, delegate.div),
+                           delegate.channel(1, matrix->getDiv()));
+            break;
+          case IMAGE_INDEXED:
+            if (target & TARGET_INDEX_CHANNEL)
+              color = delegate.channel(3, matrix->getDiv());
+            else
+              color = rgbmap->mapColor(delegate.channel(0, delegate.div),
+                                       delegate.channel(1, delegate.div),
+                                       delegate.channel(2, delegate.div));
+            break;
+        }
+        dst->putpixel(x, y, color);
+      }
+    }
+  }
+
+  void apply_old_filter(const ConvolutionMatrix* matrix, TiledMode tiledMode,
+                        const Image* src, Image* dst,
+                        const Palette* pal, const RgbMap* rgbmap, Target target)
+  {
+    switch (src->getPixelFormat()) {
+      case IMAGE_RGB: {
+        OldRgbaDelegate delegate(matrix);
+        apply_old_filter<RgbTraits>(matrix, tiledMode, src, dst, delegate, rgbmap, target);
+        break;
+      }
+      case IMAGE_GRAYSCALE: {
+        OldGrayscaleDelegate delegate(matrix);
+        apply_old_filter<GrayscaleTraits>(matrix, tiledMode, src, dst, delegate, rgbmap, target);
+        break;
+      }
+      case IMAGE_INDEXED: {
+        OldIndexedDelegate delegate(matrix, pal);
+        apply_old_filter<IndexedTraits>(matrix, tiledMode, src, dst, delegate, rgbmap, target);
+        break;
+      }
+    }
+  }
+
+  // Random image where a quarter of the pixels are transparent.
+  Image* create_random_image(PixelFormat format, int w, int h)
+  {
+    Image* image = Image::create(format, w, h);
+    for (int y=0; y<h; ++y) {
+      for (int x=0; x<w; ++x) {
+        int a = (std::rand() % 4 == 0 ? 0: std::rand() & 255);
+        int c;
+        switch (format) {
+          case IMAGE_RGB: c = _rgba(std::rand() & 255, std::rand() & 255, std::rand() & 255, a); break;
+          case IMAGE_GRAYSCALE: c = _graya(std::rand() & 255, a); break;
+          default: c = std::rand() & 255; break;
+        }
+        image->putpixel(x, y, c);
+      }
+    }
+    return image;
+  }
+
+  // Matrix with binomial coefficients (separable), or with random
+  // values (non-separable).
+  SharedPtr<ConvolutionMatrix> create_matrix(int w, int h, bool separable)
+  {
+    SharedPtr<ConvolutionMatrix> matrix(new ConvolutionMatrix(w, h));
+    int div = 0;
+
+    for (int y=0; y<h; ++y) {
+      for (int x=0; x<w; ++x) {
+        int value;
+        if (separable)
+          value = (1 + x*(w-1-x)) * (1 + y*(h-1-y));
+        else
+          value = (std::rand() % 7) - 2;
+        matrix->value(x, y) = value;
+        div += value;
+      }
+    }
+
+    matrix->setCenterX(w/2);
+    matrix->setCenterY(h/2);
+    matrix->setDiv(div > 0 ? div: 1);
+    matrix->setBias(separable ? 0: 16);
+    return matrix;
+  }
+
+}
+
+TEST(ConvolutionMatrixFilter, SameResultsThanOldImplementation)
+{
+  PixelFormat formats[] = { IMAGE_RGB, IMAGE_GRAYSCALE, IMAGE_INDEXED };
+  TiledMode tiledModes[] = { TILED_NONE, TILED_X_AXIS, TILED_Y_AXIS, TILED_BOTH };
+  const int matrixSizes[][2] = { { 3, 3 }, { 5, 3 }, { 1, 7 }, { 9, 9 } };
+  std::srand(1);
+
+  Palette palette(FrameNumber(0), 256);
+  for (int i=0; i<256; ++i)
+    palette.setEntry(i, _rgba(std::rand() & 255, std::rand() & 255, std::rand() & 255, 255));
+  RgbMap rgbmap;
+  rgbmap.regenerate(&palette);
+
+  for (int f=0; f<3; ++f) {
+    // Images smaller than the matrix use the edges of the image (or
+    // wrap around it in tiled mode) several times. The small image is
+    // not narrower than the matrix because get_neighboring_pixels()
+    // doesn't clamp the right edge correctly in that case.
+    for (int size=0; size<2; ++size) {
+      int w = (size == 0 ? 37: 9);
+      int h = (size == 0 ? 21: 3);
+      base::UniquePtr<Image> src(create_random_image(formats[f], w, h));
+
+      for (int m=0; m<4; ++m) {
+        for (int separable=0; separable<2; ++separable) {
+          SharedPtr<ConvolutionMatrix> matrix =
+            create_matrix(matrixSizes[m][0], matrixSizes[m][1], separable ? true: false);
+
+          for (int t=0; t<4; ++t) {
+            for (int indexTarget=0; indexTarget<(formats[f] == IMAGE_INDEXED ? 2: 1); ++indexTarget) {
+              Target target = (indexTarget ? TARGET_INDEX_CHANNEL: TARGET_ALL_CHANNELS);
+              base::UniquePtr<Image> expected(Image::create(formats[f], w, h));
+              base::UniquePtr<Image> result(Image::create(formats[f], w, h));
+
+              apply_old_filter(matrix, tiledModes[t], src, expected, &palette, &rgbmap, target);
+
+              ConvolutionMatrixFilter filter;
+              filter.setMatrix(matrix);
+              filter.setTiledMode(tiledModes[t]);
+              SimpleFilterManager filterMgr(src, result, &palette, &rgbmap, target);
+              filterMgr.apply(&filter);
+
+              EXPECT_EQ(0, image_count_diff(expected, result))
+                << "format=" << formats[f] << " size=" << w << "x" << h
+                << " matrix=" << m << " separable=" << separable
+                << " tiled=" << tiledModes[t] << " target=" << target;
+            }
+          }
+        }
+      }
+    }
+  }
+}
@@ -25,6 +25,10 @@ namespace filters {
 
   // Interface which applies a filter to a sprite given a FilterManager
   // which indicates where we have to apply the filter.
+  //
+  // The applyTo*() member functions can be called from several
+  // threads at the same time (each one with its own FilterManager to
+  // process different rows), so they must not modify the filter state.
   class Filter {
   public:
     virtual ~Filter() { }
@@ -29,6 +29,13 @@ namespace filters {
 
   class FilterIndexedData;
 
+  // Data that a filter can keep between the rows processed with the
+  // same FilterManager (see FilterManager::getRowsData()).
+  class FilterRowsData {
+  public:
+    virtual ~FilterRowsData() { }
+  };
+
   // Information given to a filter (Filter interface) to apply it to a
   // single row. Basically an Filter implementation has to obtain
   // colors from getSourceAddress(), applies some kind of transformation
@@ -80,6 +87,15 @@ namespace filters {
     // Returns the Y coordinate of the row.
     virtual int getY() = 0;
 
+    // Returns the data stored with setRowsData() by the filter when
+    // it was applied to previous rows of this FilterManager (or NULL).
+    // Rows are given from top to bottom, so a 2D filter can use it to
+    // update its state incrementally when getY() is the next row.
+    virtual FilterRowsData* getRowsData() = 0;
+
+    // Replaces the data kept between rows. The FilterManager owns the
+    // data and deletes it when it's replaced or no longer needed.
+    virtual void setRowsData(FilterRowsData* data) = 0;
   };
 
 } // namespace filters
@@ -32,68 +32,523 @@
 #include "raster/rgbmap.h"
 
 #include <algorithm>
+#include <vector>
 
 namespace filters {
 
 using namespace raster;
 
+// Minimum height of the window to calculate the median with column
+// histograms (apply_column_median()). Smaller windows are faster
+// with the sliding histogram of apply_sliding_median().
+static const int kMinColumnMedianHeight = 8;
+
 namespace {
-  struct GetPixelsDelegateRgba {
-    std::vector<std::vector<uint8_t> >& channel;
-    int c;
+  // Histogram of the values of one channel inside the window of the
+  // filter. The median is updated incrementally when pixels enter or
+  // leave the window (Huang's algorithm), so moving the window one
+  // pixel doesn't need to sort all the neighbors again.
+  class Histogram {
+  public:
+    void reset(int ncolors) {
+      std::fill(m_bins, m_bins+256, 0);
+      m_median = 0;
+      m_below = 0;
+      m_half = ncolors/2;
+    }
+
+    void add(int value) {
+      ++m_bins[value];
+      if (value < m_median)
+        ++m_below;
+    }
+
+    void remove(int value) {
+      --m_bins[value];
+      if (value < m_median)
+        --m_below;
+    }
+
+    // Returns the value that would be in the middle of the sorted
+    // window (the same element as sorted_values[ncolors/2]).
+    int getMedian() {
+      while (m_below > m_half)
+        m_below -= m_bins[--m_median];
 
-    GetPixelsDelegateRgba(std::vector<std::vector<uint8_t> >& channel) : channel(channel) { }
+      while (m_below + m_bins[m_median] <= m_half)
+        m_below += m_bins[m_median++];
 
-    void reset() { c = 0; }
+      return m_median;
+    }
+
+  private:
+    int m_bins[256];
+    int m_median;               // Current median value
+    int m_below;                // Number of values < m_median
+    int m_half;
+  };
 
-    void operator()(RgbTraits::pixel_t color)
+  // Histograms of the image columns used by the window in the current
+  // row, one for each channel, with 256 fine bins and 16 coarse bins
+  // (the sum of 16 fine bins). They are kept between rows with
+  // FilterManager::setRowsData(), so moving the window to the next
+  // row only needs to remove the top pixel and add the new bottom
+  // pixel of each column.
+  class ColumnHistograms : public FilterRowsData {
+  public:
+    ColumnHistograms(const Image* image, int x, int w, int y,
+                     int width, int height, TiledMode tiledMode, int nchannels)
+      : m_image(image), m_x(x), m_w(w), m_y(y)
+      , m_width(width), m_height(height)
+      , m_tiledMode(tiledMode), m_nchannels(nchannels)
     {
-      channel[0][c] = _rgba_getr(color);
-      channel[1][c] = _rgba_getg(color);
-      channel[2][c] = _rgba_getb(color);
-      channel[3][c] = _rgba_geta(color);
-      c++;
+      bool tiledX = ((tiledMode & TILED_X_AXIS) == TILED_X_AXIS);
+      std::vector<int> index(image->w, -1);
+
+      // Image columns inside the window for each position, and the
+      // list of different columns that are used.
+      m_windowCols.resize(w+width-1);
+      for (int i=0; i<(int)m_windowCols.size(); ++i) {
+        int col = get_neighboring_coord(x-width/2+i, image->w, tiledX);
+        if (index[col] < 0) {
+          index[col] = m_imageCols.size();
+          m_imageCols.push_back(col);
+        }
+        m_windowCols[i] = index[col];
+      }
+
+      m_fine.resize(m_imageCols.size()*nchannels*256, 0);
+      m_coarse.resize(m_imageCols.size()*nchannels*16, 0);
+    }
+
+    // Returns true if these histograms were used in the previous row
+    // (y-1) with the same image area and window.
+    bool isPreviousRow(const Image* image, int x, int w, int y,
+                       int width, int height, TiledMode tiledMode, int nchannels) const {
+      return (m_image == image && m_x == x && m_w == w && m_y == y-1 &&
+              m_width == width && m_height == height &&
+              m_tiledMode == tiledMode && m_nchannels == nchannels);
+    }
+
+    void setY(int y) { m_y = y; }
+
+    // Columns used by the window in the position "i" of the row are
+    // getWindowCols()[i...i+width-1].
+    const int* getWindowCols() const { return &m_windowCols[0]; }
+    const std::vector<int>& getImageCols() const { return m_imageCols; }
+
+    const uint16_t* getFine(int col, int channel) const {
+      return &m_fine[(col*m_nchannels + channel) * 256];
+    }
+
+    const uint16_t* getCoarse(int col, int channel) const {
+      return &m_coarse[(col*m_nchannels + channel) * 16];
+    }
+
+    void add(int col, int channel, int value) {
+      int i = col*m_nchannels + channel;
+      ++m_fine[i*256 + value];
+      ++m_coarse[i*16 + (value >> 4)];
+    }
+
+    void remove(int col, int channel, int value) {
+      int i = col*m_nchannels + channel;
+      --m_fine[i*256 + value];
+      --m_coarse[i*16 + (value >> 4)];
     }
+
+  private:
+    const Image* m_image;
+    int m_x, m_w, m_y;
+    int m_width, m_height;
+    TiledMode m_tiledMode;
+    int m_nchannels;
+    std::vector<int> m_windowCols;
+    std::vector<int> m_imageCols;
+    std::vector<uint16_t> m_fine;
+    std::vector<uint16_t> m_coarse;
   };
 
-  struct GetPixelsDelegateGrayscale {
-    std::vector<std::vector<uint8_t> >& channel;
-    int c;
+  // Histogram of one channel of the window, calculated adding and
+  // removing the histograms of the columns (Perreault and Hebert's
+  // constant time median filter). The coarse bins are moved with the
+  // window for each pixel, but the 16 fine bins of a coarse bin are
+  // updated only when the median is inside it.
+  class WindowHistogram {
+  public:
+    void reset(const ColumnHistograms* columns, int channel, int width, int ncolors) {
+      m_columns = columns;
+      m_cols = columns->getWindowCols();
+      m_channel = channel;
+      m_width = width;
+      m_half = ncolors/2;
+      m_pos = 0;
+
+      std::fill(m_coarse, m_coarse+16, 0);
+      for (int u=0; u<width; ++u)
+        addCoarse(m_cols[u]);
+
+      // Fine bins are calculated from scratch the first time
+      for (int k=0; k<16; ++k)
+        m_updated[k] = -width;
+    }
 
-    GetPixelsDelegateGrayscale(std::vector<std::vector<uint8_t> >& channel) : channel(channel) { }
+    // Moves the window one pixel to the right.
+    void next() {
+      ++m_pos;
+      removeCoarse(m_cols[m_pos-1]);
+      addCoarse(m_cols[m_pos+m_width-1]);
+    }
 
-    void reset() { c = 0; }
+    // Returns the same value as Histogram::getMedian().
+    int getMedian() {
+      int below = 0;
+      int k = 0;
+      while (below + m_coarse[k] <= m_half)
+        below += m_coarse[k++];
 
-    void operator()(GrayscaleTraits::pixel_t color)
-    {
-      channel[0][c] = _graya_getv(color);
-      channel[1][c] = _graya_geta(color);
-      c++;
+      const int* fine = updateFine(k);
+      int v = 0;
+      while (below + fine[v] <= m_half)
+        below += fine[v++];
+
+      return (k << 4) + v;
+    }
+
+  private:
+    void addCoarse(int col) {
+      const uint16_t* coarse = m_columns->getCoarse(col, m_channel);
+      for (int k=0; k<16; ++k)
+        m_coarse[k] += coarse[k];
+    }
+
+    void removeCoarse(int col) {
+      const uint16_t* coarse = m_columns->getCoarse(col, m_channel);
+      for (int k=0; k<16; ++k)
+        m_coarse[k] -= coarse[k];
+    }
+
+    // Moves the fine bins of the coarse bin "k" to the current window
+    // position, replaying the steps since the last update or adding
+    // all the columns again if that is cheaper.
+    const int* updateFine(int k) {
+      int* fine = m_fine[k];
+      int i, v;
+
+      if (2*(m_pos - m_updated[k]) > m_width) {
+        std::fill(fine, fine+16, 0);
+        for (i=m_pos; i<m_pos+m_width; ++i) {
+          const uint16_t* col = m_columns->getFine(m_cols[i], m_channel) + (k << 4);
+          for (v=0; v<16; ++v)
+            fine[v] += col[v];
+        }
+      }
+      else {
+        for (i=m_updated[k]+1; i<=m_pos; ++i) {
+          const uint16_t* oldCol = m_columns->getFine(m_cols[i-1], m_channel) + (k << 4);
+          const uint16_t* newCol = m_columns->getFine(m_cols[i+m_width-1], m_channel) + (k << 4);
+          for (v=0; v<16; ++v)
+            fine[v] += newCol[v] - oldCol[v];
+        }
+      }
+
+      m_updated[k] = m_pos;
+      return fine;
+    }
+
+    const ColumnHistograms* m_columns;
+    const int* m_cols;
+    int m_channel;
+    int m_width;
+    int m_half;
+    int m_pos;                  // Position of the window in the row
+    int m_coarse[16];
+    int m_fine[16][16];
+    int m_updated[16];          // Position of the last update of m_fine[k]
+  };
+
+  // Channels of each pixel format. "nchannels" is the number of
+  // histograms needed by each pixel.
+  struct SplitRgba {
+    enum { nchannels = 4 };
+
+    void operator()(RgbTraits::pixel_t color, int* values) const {
+      values[0] = _rgba_getr(color);
+      values[1] = _rgba_getg(color);
+      values[2] = _rgba_getb(color);
+      values[3] = _rgba_geta(color);
+    }
+  };
+
+  struct SplitGrayscale {
+    enum { nchannels = 2 };
+
+    void operator()(GrayscaleTraits::pixel_t color, int* values) const {
+      values[0] = _graya_getv(color);
+      values[1] = _graya_geta(color);
     }
   };
 
-  struct GetPixelsDelegateIndexed {
+  struct SplitIndex {
+    enum { nchannels = 1 };
+
+    void operator()(IndexedTraits::pixel_t color, int* values) const {
+      values[0] = color;
+    }
+  };
+
+  struct SplitPaletteRgb {
+    enum { nchannels = 3 };
     const Palette* pal;
-    std::vector<std::vector<uint8_t> >& channel;
+
+    SplitPaletteRgb(const Palette* pal) : pal(pal) { }
+
+    void operator()(IndexedTraits::pixel_t color, int* values) const {
+      uint32_t rgba = pal->getEntry(color);
+      values[0] = _rgba_getr(rgba);
+      values[1] = _rgba_getg(rgba);
+      values[2] = _rgba_getb(rgba);
+    }
+  };
+
+  // Moves a window of width x height pixels through the current row
+  // of the FilterManager, keeping one histogram for each channel
+  // (Split::nchannels) of the pixels inside the window. For each
+  // pixel in the row, calls output(x, skip, histograms).
+  //
+  // Each step only removes the column that leaves the window and adds
+  // the new one, so the cost per pixel is O(height) instead of the
+  // O(width*height*log(width*height)) of sorting the whole window.
+  template<typename Traits, typename Split, typename Output>
+  void apply_sliding_median(FilterManager* filterMgr,
+                            int width, int height, TiledMode tiledMode,
+                            const Split& split, Output& output)
+  {
+    const Image* src = filterMgr->getSourceImage();
+    int x = filterMgr->getX();
+    int x2 = x+filterMgr->getWidth();
+    int y = filterMgr->getY();
+    int cx = width/2;
+    int cy = height/2;
+    bool tiledX = ((tiledMode & TILED_X_AXIS) == TILED_X_AXIS);
+    bool tiledY = ((tiledMode & TILED_Y_AXIS) == TILED_Y_AXIS);
+    Histogram histogram[Split::nchannels];
+    int values[Split::nchannels];
+    int c, u, v;
+
+    // Rows of the image that are inside the window
+    std::vector<typename Traits::const_address_t> rows(height);
+    for (v=0; v<height; ++v)
+      rows[v] = image_address_fast<Traits>(
+        src, 0, get_neighboring_coord(y-cy+v, src->h, tiledY));
+
+    for (c=0; c<Split::nchannels; ++c)
+      histogram[c].reset(width*height);
+
+    for (u=0; u<width; ++u) {
+      int getx = get_neighboring_coord(x-cx+u, src->w, tiledX);
+
+      for (v=0; v<height; ++v) {
+        split(rows[v][getx], values);
+        for (c=0; c<Split::nchannels; ++c)
+          histogram[c].add(values[c]);
+      }
+    }
+
+    for (;;) {
+      output(x, filterMgr->skipPixel(), histogram);
+
+      if (++x == x2)
+        break;
+
+      // Move the window one pixel to the right
+      int oldx = get_neighboring_coord(x-cx-1, src->w, tiledX);
+      int newx = get_neighboring_coord(x-cx+width-1, src->w, tiledX);
+      if (oldx == newx)
+        continue;
+
+      for (v=0; v<height; ++v) {
+        split(rows[v][oldx], values);
+        for (c=0; c<Split::nchannels; ++c)
+          histogram[c].remove(values[c]);
+
+        split(rows[v][newx], values);
+        for (c=0; c<Split::nchannels; ++c)
+          histogram[c].add(values[c]);
+      }
+    }
+  }
+
+  // Does the same as apply_sliding_median() but the histogram of the
+  // window is calculated from the histograms of its columns, so the
+  // cost per pixel doesn't depend on the size of the window. The
+  // column histograms of the previous row are reused when the
+  // FilterManager gives the next row, which is what happens in each
+  // band of rows.
+  template<typename Traits, typename Split, typename Output>
+  void apply_column_median(FilterManager* filterMgr,
+                           int width, int height, TiledMode tiledMode,
+                           const Split& split, Output& output)
+  {
+    const Image* src = filterMgr->getSourceImage();
+    int x = filterMgr->getX();
+    int w = filterMgr->getWidth();
+    int y = filterMgr->getY();
+    int cy = height/2;
+    bool tiledY = ((tiledMode & TILED_Y_AXIS) == TILED_Y_AXIS);
+    WindowHistogram histogram[Split::nchannels];
+    int values[Split::nchannels];
+    int c, i, v;
+
+    ColumnHistograms* columns = dynamic_cast<ColumnHistograms*>(filterMgr->getRowsData());
+    if (columns && columns->isPreviousRow(src, x, w, y, width, height,
+                                          tiledMode, Split::nchannels)) {
+      const std::vector<int>& cols = columns->getImageCols();
+
+      // Move the column histograms one row down
+      int oldy = get_neighboring_coord(y-cy-1, src->h, tiledY);
+      int newy = get_neighboring_coord(y-cy+height-1, src->h, tiledY);
+      if (oldy != newy) {
+        typename Traits::const_address_t oldRow = image_address_fast<Traits>(src, 0, oldy);
+        typename Traits::const_address_t newRow = image_address_fast<Traits>(src, 0, newy);
+
+        for (i=0; i<(int)cols.size(); ++i) {
+          split(oldRow[cols[i]], values);
+          for (c=0; c<Split::nchannels; ++c)
+            columns->remove(i, c, values[c]);
+
+          split(newRow[cols[i]], values);
+          for (c=0; c<Split::nchannels; ++c)
+            columns->add(i, c, values[c]);
+        }
+      }
+      columns->setY(y);
+    }
+    else {
+      columns = new ColumnHistograms(src, x, w, y, width, height,
+                                     tiledMode, Split::nchannels);
+      filterMgr->setRowsData(columns);
+
+      const std::vector<int>& cols = columns->getImageCols();
+      for (v=0; v<height; ++v) {
+        typename Traits::const_address_t row = image_address_fast<Traits>(
+          src, 0, get_neighboring_coord(y-cy+v, src->h, tiledY));
+
+        for (i=0; i<(int)cols.size(); ++i) {
+          split(row[cols[i]], values);
+          for (c=0; c<Split::nchannels; ++c)
+            columns->add(i, c, values[c]);
+        }
+      }
+    }
+
+    for (c=0; c<Split::nchannels; ++c)
+      histogram[c].reset(columns, c, width, width*height);
+
+    for (i=0; ; ) {
+      output(x+i, filterMgr->skipPixel(), histogram);
+
+      if (++i == w)
+        break;
+
+      for (c=0; c<Split::nchannels; ++c)
+        histogram[c].next();
+    }
+  }
+
+  // Applies the median filter to the current row of the FilterManager
+  // with the fastest method for the given window.
+  template<typename Traits, typename Split, typename Output>
+  void apply_median(FilterManager* filterMgr,
+                    int width, int height, TiledMode tiledMode,
+                    const Split& split, Output& output)
+  {
+    // Column histograms count up to "height" pixels in 16-bit bins
+    if (height >= kMinColumnMedianHeight && height <= 0xffff)
+      apply_column_median<Traits>(filterMgr, width, height, tiledMode, split, output);
+    else
+      apply_sliding_median<Traits>(filterMgr, width, height, tiledMode, split, output);
+  }
+
+  struct OutputRgba {
+    const Image* src;
+    uint32_t* dst_address;
     Target target;
-    int c;
+    int y;
+
+    template<typename HistogramT>
+    void operator()(int x, bool skip, HistogramT* histogram) {
+      // Avoid the non-selected region
+      if (skip) {
+        ++dst_address;
+        return;
+      }
 
-    GetPixelsDelegateIndexed(const Palette* pal, std::vector<std::vector<uint8_t> >& channel, Target target)
-      : pal(pal), channel(channel), target(target) { }
+      int color = image_getpixel_fast<RgbTraits>(src, x, y);
+      int r = (target & TARGET_RED_CHANNEL ? histogram[0].getMedian(): _rgba_getr(color));
+      int g = (target & TARGET_GREEN_CHANNEL ? histogram[1].getMedian(): _rgba_getg(color));
+      int b = (target & TARGET_BLUE_CHANNEL ? histogram[2].getMedian(): _rgba_getb(color));
+      int a = (target & TARGET_ALPHA_CHANNEL ? histogram[3].getMedian(): _rgba_geta(color));
 
-    void reset() { c = 0; }
+      *(dst_address++) = _rgba(r, g, b, a);
+    }
+  };
 
-    void operator()(IndexedTraits::pixel_t color)
-    {
-      if (target & TARGET_INDEX_CHANNEL) {
-        channel[0][c] = color;
+  struct OutputGrayscale {
+    const Image* src;
+    uint16_t* dst_address;
+    Target target;
+    int y;
+
+    template<typename HistogramT>
+    void operator()(int x, bool skip, HistogramT* histogram) {
+      // Avoid the non-selected region
+      if (skip) {
+        ++dst_address;
+        return;
       }
-      else {
-        channel[0][c] = _rgba_getr(pal->getEntry(color));
-        channel[1][c] = _rgba_getg(pal->getEntry(color));
-        channel[2][c] = _rgba_getb(pal->getEntry(color));
+
+      int color = image_getpixel_fast<GrayscaleTraits>(src, x, y);
+      int k = (target & TARGET_GRAY_CHANNEL ? histogram[0].getMedian(): _graya_getv(color));
+      int a = (target & TARGET_ALPHA_CHANNEL ? histogram[1].getMedian(): _graya_geta(color));
+
+      *(dst_address++) = _graya(k, a);
+    }
+  };
+
+  struct OutputIndex {
+    uint8_t* dst_address;
+
+    template<typename HistogramT>
+    void operator()(int x, bool skip, HistogramT* histogram) {
+      if (!skip)
+        *dst_address = histogram[0].getMedian();
+      ++dst_address;
+    }
+  };
+
+  struct OutputPaletteRgb {
+    const Image* src;
+    const Palette* pal;
+    const RgbMap* rgbmap;
+    uint8_t* dst_address;
+    Target target;
+    int y;
+
+    template<typename HistogramT>
+    void operator()(int x, bool skip, HistogramT* histogram) {
+      // Avoid the non-selected region
+      if (skip) {
+        ++dst_address;
+        return;
       }
-      c++;
+
+      uint32_t color = pal->getEntry(image_getpixel_fast<IndexedTraits>(src, x, y));
+      int r = (target & TARGET_RED_CHANNEL ? histogram[0].getMedian(): _rgba_getr(color));
+      int g = (target & TARGET_GREEN_CHANNEL ? histogram[1].getMedian(): _rgba_getg(color));
+      int b = (target & TARGET_BLUE_CHANNEL ? histogram[2].getMedian(): _rgba_getb(color));
+
+      *(dst_address++) = rgbmap->mapColor(r, g, b);
     }
   };
 };
@@ -103,7 +558,6 @@ MedianFilter::MedianFilter()
   , m_width(0)
   , m_height(0)
   , m_ncolors(0)
-  , m_channel(4)
 {
 }
 
@@ -117,9 +571,6 @@ void MedianFilter::setSize(int width, int height)
   m_width = width;
   m_height = height;
   m_ncolors = width*height;
-
-  for (int c = 0; c < 4; ++c)
-    m_channel[c].resize(m_ncolors);
 }
 
 const char* MedianFilter::getName()
@@ -129,157 +580,51 @@ const char* MedianFilter::getName()
 
 void MedianFilter::applyToRgba(FilterManager* filterMgr)
 {
-  const Image* src = filterMgr->getSourceImage();
-  uint32_t* dst_address = (uint32_t*)filterMgr->getDestinationAddress();
-  Target target = filterMgr->getTarget();
-  int color;
-  int r, g, b, a;
-  GetPixelsDelegateRgba delegate(m_channel);
-  int x = filterMgr->getX();
-  int x2 = x+filterMgr->getWidth();
-  int y = filterMgr->getY();
-
-  for (; x<x2; ++x) {
-    // Avoid the non-selected region
-    if (filterMgr->skipPixel()) {
-      ++dst_address;
-      continue;
-    }
-
-    delegate.reset();
-    get_neighboring_pixels<RgbTraits>(src, x, y, m_width, m_height, m_width/2, m_height/2,
-                                      m_tiledMode, delegate);
-
-    color = image_getpixel_fast<RgbTraits>(src, x, y);
-
-    if (target & TARGET_RED_CHANNEL) {
-      std::sort(m_channel[0].begin(), m_channel[0].end());
-      r = m_channel[0][m_ncolors/2];
-    }
-    else
-      r = _rgba_getr(color);
-
-    if (target & TARGET_GREEN_CHANNEL) {
-      std::sort(m_channel[1].begin(), m_channel[1].end());
-      g = m_channel[1][m_ncolors/2];
-    }
-    else
-      g = _rgba_getg(color);
-
-    if (target & TARGET_BLUE_CHANNEL) {
-      std::sort(m_channel[2].begin(), m_channel[2].end());
-      b = m_channel[2][m_ncolors/2];
-    }
-    else
-      b = _rgba_getb(color);
-
-    if (target & TARGET_ALPHA_CHANNEL) {
-      std::sort(m_channel[3].begin(), m_channel[3].end());
-      a = m_channel[3][m_ncolors/2];
-    }
-    else
-      a = _rgba_geta(color);
-
-    *(dst_address++) = _rgba(r, g, b, a);
-  }
+  OutputRgba output;
+  output.src = filterMgr->getSourceImage();
+  output.dst_address = (uint32_t*)filterMgr->getDestinationAddress();
+  output.target = filterMgr->getTarget();
+  output.y = filterMgr->getY();
+
+  apply_median<RgbTraits>(filterMgr, m_width, m_height, m_tiledMode,
+                          SplitRgba(), output);
 }
 
 void MedianFilter::applyToGrayscale(FilterManager* filterMgr)
 {
-  const Image* src = filterMgr->getSourceImage();
-  uint16_t* dst_address = (uint16_t*)filterMgr->getDestinationAddress();
-  Target target = filterMgr->getTarget();
-  int color, k, a;
-  GetPixelsDelegateGrayscale delegate(m_channel);
-  int x = filterMgr->getX();
-  int x2 = x+filterMgr->getWidth();
-  int y = filterMgr->getY();
-
-  for (; x<x2; ++x) {
-    // Avoid the non-selected region
-    if (filterMgr->skipPixel()) {
-      ++dst_address;
-      continue;
-    }
-
-    delegate.reset();
-    get_neighboring_pixels<GrayscaleTraits>(src, x, y, m_width, m_height, m_width/2, m_height/2,
-                                            m_tiledMode, delegate);
-
-    color = image_getpixel_fast<GrayscaleTraits>(src, x, y);
-
-    if (target & TARGET_GRAY_CHANNEL) {
-      std::sort(m_channel[0].begin(), m_channel[0].end());
-      k = m_channel[0][m_ncolors/2];
-    }
-    else
-      k = _graya_getv(color);
-
-    if (target & TARGET_ALPHA_CHANNEL) {
-      std::sort(m_channel[1].begin(), m_channel[1].end());
-      a = m_channel[1][m_ncolors/2];
-    }
-    else
-      a = _graya_geta(color);
-
-    *(dst_address++) = _graya(k, a);
-  }
+  OutputGrayscale output;
+  output.src = filterMgr->getSourceImage();
+  output.dst_address = (uint16_t*)filterMgr->getDestinationAddress();
+  output.target = filterMgr->getTarget();
+  output.y = filterMgr->getY();
+
+  apply_median<GrayscaleTraits>(filterMgr, m_width, m_height, m_tiledMode,
+                                SplitGrayscale(), output);
 }
 
 void MedianFilter::applyToIndexed(FilterManager* filterMgr)
 {
-  const Image* src = filterMgr->getSourceImage();
-  uint8_t* dst_address = (uint8_t*)filterMgr->getDestinationAddress();
   const Palette* pal = filterMgr->getIndexedData()->getPalette();
-  const RgbMap* rgbmap = filterMgr->getIndexedData()->getRgbMap();
   Target target = filterMgr->getTarget();
-  int color, r, g, b;
-  GetPixelsDelegateIndexed delegate(pal, m_channel, target);
-  int x = filterMgr->getX();
-  int x2 = x+filterMgr->getWidth();
-  int y = filterMgr->getY();
-
-  for (; x<x2; ++x) {
-    // Avoid the non-selected region
-    if (filterMgr->skipPixel()) {
-      ++dst_address;
-      continue;
-    }
-
-    delegate.reset();
-    get_neighboring_pixels<IndexedTraits>(src, x, y, m_width, m_height, m_width/2, m_height/2,
-                                          m_tiledMode, delegate);
-
-    if (target & TARGET_INDEX_CHANNEL) {
-      std::sort(m_channel[0].begin(), m_channel[0].end());
-      *(dst_address++) = m_channel[0][m_ncolors/2];
-    }
-    else {
-      color = image_getpixel_fast<IndexedTraits>(src, x, y);
 
-      if (target & TARGET_RED_CHANNEL) {
-        std::sort(m_channel[0].begin(), m_channel[0].end());
-        r = m_channel[0][m_ncolors/2];
-      }
-      else
-        r = _rgba_getr(pal->getEntry(color));
+  if (target & TARGET_INDEX_CHANNEL) {
+    OutputIndex output;
+    output.dst_address = (uint8_t*)filterMgr->getDestinationAddress();
 
-      if (target & TARGET_GREEN_CHANNEL) {
-        std::sort(m_channel[1].begin(), m_channel[1].end());
-        g = m_channel[1][m_ncolors/2];
-      }
-      else
-        g = _rgba_getg(pal->getEntry(color));
-
-      if (target & TARGET_BLUE_CHANNEL) {
-        std::sort(m_channel[2].begin(), m_channel[2].end());
-        b = m_channel[2][m_ncolors/2];
-      }
-      else
-        b = _rgba_getb(pal->getEntry(color));
-
-      *(dst_address++) = rgbmap->mapColor(r, g, b);
-    }
+    apply_median<IndexedTraits>(filterMgr, m_width, m_height, m_tiledMode,
+                                SplitIndex(), output);
+  }
+  else {
+    OutputPaletteRgb output;
+    output.src = filterMgr->getSourceImage();
+    output.pal = pal;
+    output.rgbmap = filterMgr->getIndexedData()->getRgbMap();
+    output.dst_address = (uint8_t*)filterMgr->getDestinationAddress();
+    output.target = target;
+    output.y = filterMgr->getY();
+
+    apply_median<IndexedTraits>(filterMgr, m_width, m_height, m_tiledMode,
+                                SplitPaletteRgb(pal), output);
   }
 }
 
@@ -0,0 +1,215 @@
+/* Aseprite
+ * Copyright (C) 2001-2013  David Capello
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#include "tests/test.h"
+
+#include "base/unique_ptr.h"
+#include "filters/median_filter.h"
+#include "filters/neighboring_pixels.h"
+#include "raster/raster.h"
+#include "tests/simple_filter_manager.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <vector>
+
+using namespace filters;
+using namespace raster;
+using namespace tests;
+
+namespace {
+
+  // Old implementation of the median filter: all the values of each
+  // channel inside the window are sorted for each pixel.
+  struct OldChannels {
+    const Palette* pal;
+    std::vector<std::vector<int> > values;
+
+    OldChannels(const Palette* pal) : pal(pal), values(4) { }
+
+    void reset() {
+      for (int c=0; c<4; ++c)
+        values[c].clear();
+    }
+
+    void add(int c0, int c1, int c2, int c3) {
+      values[0].push_back(c0);
+      values[1].push_back(c1);
+      values[2].push_back(c2);
+      values[3].push_back(c3);
+    }
+
+    int median(int c) {
+      std::sort(values[c].begin(), values[c].end());
+      return values[c][values[c].size()/2];
+    }
+  };
+
+  struct OldRgbaChannels : OldChannels {
+    OldRgbaChannels() : OldChannels(NULL) { }
+    void operator()(RgbTraits::pixel_t color) {
+      add(_rgba_getr(color), _rgba_getg(color), _rgba_getb(color), _rgba_geta(color));
+    }
+  };
+
+  struct OldGrayscaleChannels : OldChannels {
+    OldGrayscaleChannels() : OldChannels(NULL) { }
+    void operator()(GrayscaleTraits::pixel_t color) {
+      add(_graya_getv(color), _graya_geta(color), 0, 0);
+    }
+  };
+
+  struct OldIndexedChannels : OldChannels {
+    OldIndexedChannels(const Palette* pal) : OldChannels(pal) { }
+    void operator()(IndexedTraits::pixel_t color) {
+      uint32_t rgba = pal->getEntry(color);
+      add(_rgba_getr(rgba), _rgba_getg(rgba), _rgba_getb(rgba), color);
+    }
+  };
+
+  template<class Traits, class Channels>
+  void apply_old_median(int w, int h, TiledMode tiledMode, const Image* src, Image* dst,
+                        Channels& channels, const Palette* pal, const RgbMap* rgbmap,
+                        Target target)
+  {
+    for (int y=0; y<src->h; ++y) {
+      for (int x=0; x<src->w; ++x) {
+        channels.reset();
+        get_neighboring_pixels<Traits>(src, x, y, w, h, w/2, h/2, tiledMode, channels);
+
+        int color = image_getpixel_fast<Traits>(src, x, y);
+        switch (src->getPixelFormat()) {
+          case IMAGE_RGB:
+            color = _rgba((target & TARGET_RED_CHANNEL) ? channels.median(0): _rgba_getr(color),
+                          (target & TARGET_GREEN_CHANNEL) ? channels.median(1): _rgba_getg(color),
+                          (target & TARGET_BLUE_CHANNEL) ? channels.median(2): _rgba_getb(color),
+                          (target & TARGET_ALPHA_CHANNEL) ? channels.median(3): _rgba_geta(color));
+            break;
+          case IMAGE_GRAYSCALE:
+            color = _graya((target & TARGET_GRAY_CHANNEL) ? channels.median(0): _graya_getv(color),
+                           (target & TARGET_ALPHA_CHANNEL) ? channels.median(1): _graya_geta(color));
+            break;
+          case IMAGE_INDEXED:
+            if (target & TARGET_INDEX_CHANNEL)
+              color = channels.median(3);
+            else {
+              uint32_t rgba = pal->getEntry(color);
+              color = rgbmap->mapColor(
+                (target & TARGET_RED_CHANNEL) ? channels.median(0): _rgba_getr(rgba),
+                (target & TARGET_GREEN_CHANNEL) ? channels.median(1): _rgba_getg(rgba),
+                (target & TARGET_BLUE_CHANNEL) ? channels.median(2): _rgba_getb(rgba));
+            }
+            break;
+        }
+        dst->putpixel(x, y, color);
+      }
+    }
+  }
+
+  void apply_old_median(int w, int h, TiledMode tiledMode, const Image* src, Image* dst,
+                        const Palette* pal, const RgbMap* rgbmap, Target target)
+  {
+    switch (src->getPixelFormat()) {
+      case IMAGE_RGB: {
+        OldRgbaChannels channels;
+        apply_old_median<RgbTraits>(w, h, tiledMode, src, dst, channels, pal, rgbmap, target);
+        break;
+      }
+      case IMAGE_GRAYSCALE: {
+        OldGrayscaleChannels channels;
+        apply_old_median<GrayscaleTraits>(w, h, tiledMode, src, dst, channels, pal, rgbmap, target);
+        break;
+      }
+      case IMAGE_INDEXED: {
+        OldIndexedChannels channels(pal);
+        apply_old_median<IndexedTraits>(w, h, tiledMode, src, dst, channels, pal, rgbmap, target);
+        break;
+      }
+    }
+  }
+
+  // Random image with few values in some channels, so the windows
+  // have several values equal to the median.
+  Image* create_random_image(PixelFormat format, int w, int h)
+  {
+    Image* image = Image::create(format, w, h);
+    for (int y=0; y<h; ++y) {
+      for (int x=0; x<w; ++x) {
+        int c;
+        switch (format) {
+          case IMAGE_RGB: c = _rgba(std::rand() & 255, std::rand() & 3, std::rand() & 255, (std::rand() & 1) * 255); break;
+          case IMAGE_GRAYSCALE: c = _graya(std::rand() & 255, std::rand() & 7); break;
+          default: c = std::rand() & 255; break;
+        }
+        image->putpixel(x, y, c);
+      }
+    }
+    return image;
+  }
+
+}
+
+TEST(MedianFilter, SameResultsThanSortingWindows)
+{
+  PixelFormat formats[] = { IMAGE_RGB, IMAGE_GRAYSCALE, IMAGE_INDEXED };
+  TiledMode tiledModes[] = { TILED_NONE, TILED_X_AXIS, TILED_Y_AXIS, TILED_BOTH };
+  Target targets[] = { TARGET_ALL_CHANNELS,
+                       TARGET_RED_CHANNEL | TARGET_ALPHA_CHANNEL,
+                       TARGET_INDEX_CHANNEL };
+  std::srand(1);
+
+  Palette palette(FrameNumber(0), 256);
+  for (int i=0; i<256; ++i)
+    palette.setEntry(i, _rgba(std::rand() & 255, std::rand() & 255, std::rand() & 255, 255));
+  RgbMap rgbmap;
+  rgbmap.regenerate(&palette);
+
+  for (int f=0; f<3; ++f) {
+    base::UniquePtr<Image> src(create_random_image(formats[f], 29, 17));
+
+    // Random window sizes, with less than 8 rows and with 8 rows or
+    // more (they use different algorithms). The image is not
+    // narrower than the window (see get_neighboring_pixels).
+    for (int i=0; i<6; ++i) {
+      int w = 1 + std::rand() % 15;
+      int h = ((i & 1) ? 8 + std::rand() % 16: 1 + std::rand() % 7);
+
+      for (int t=0; t<4; ++t) {
+        for (int g=0; g<3; ++g) {
+          if (targets[g] == TARGET_INDEX_CHANNEL && formats[f] != IMAGE_INDEXED)
+            continue;
+
+          base::UniquePtr<Image> expected(Image::create(formats[f], src->w, src->h));
+          base::UniquePtr<Image> result(Image::create(formats[f], src->w, src->h));
+
+          apply_old_median(w, h, tiledModes[t], src, expected, &palette, &rgbmap, targets[g]);
+
+          MedianFilter filter;
+          filter.setSize(w, h);
+          filter.setTiledMode(tiledModes[t]);
+          SimpleFilterManager filterMgr(src, result, &palette, &rgbmap, targets[g]);
+          filterMgr.apply(&filter);
+
+          EXPECT_EQ(0, image_count_diff(expected, result))
+            << "format=" << formats[f] << " size=" << w << "x" << h
+            << " tiled=" << tiledModes[t] << " target=" << targets[g];
+        }
+      }
+    }
+  }
+}
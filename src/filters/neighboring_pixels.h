@@ -28,6 +28,19 @@
 namespace filters {
   using namespace raster;
 
+  // Converts a coordinate of a neighboring pixel (that can be outside
+  // the image) to a valid coordinate in [0,size): it is clamped to the
+  // image edges or wrapped around if the axis is tiled.
+  inline int get_neighboring_coord(int c, int size, bool tiled)
+  {
+    if (c < 0)
+      return (tiled ? size - (-(c+1) % size) - 1: 0);
+    else if (c >= size)
+      return (tiled ? c % size: size-1);
+    else
+      return c;
+  }
+
   // Calls the specified "delegate" for all neighboring pixels in a 2D
   // (width*height) matrix located in (x,y) where its center is the
   // (centerX,centerY) element of the matrix.
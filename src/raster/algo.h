@@ -41,7 +41,8 @@ namespace raster {
                              double x2, double y2, double x3, double y3,
                              double in_x);
 
-  void algo_floodfill(Image* image, int x, int y, int tolerance, void* data, AlgoHLine proc);
+  void algo_floodfill(Image* image, int x, int y, int tolerance, bool contiguous,
+                      void* data, AlgoHLine proc);
 
   void algo_polygon(int vertices, const int* points, void* data, AlgoHLine proc);
 
@@ -12,323 +12,267 @@
 #include "raster/algo.h"
 #include "raster/image.h"
 
+#include "raster/image_traits.h"
+
 #include <allegro.h>
-#include <allegro/internal/aintern.h>
-#include <limits.h>
-#include <math.h>
+#include <vector>
 
 namespace raster {
 
-typedef struct FLOODED_LINE     /* store segments which have been flooded */
-{
-  short flags;                  /* status of the segment */
-  short lpos, rpos;             /* left and right ends of segment */
-  short y;                      /* y coordinate of the segment */
-  int next;                     /* linked list if several per line */
-} FLOODED_LINE;
-
-/* Note: a 'short' is not sufficient for 'next' above in some corner cases. */
+namespace {
+
+  inline bool color_equal_32(uint32_t c1, uint32_t c2, int tolerance)
+  {
+    if (tolerance == 0)
+      return (c1 == c2) || (_rgba_geta(c1) == 0 && _rgba_geta(c2) == 0);
+    else {
+      int r1 = _rgba_getr(c1);
+      int g1 = _rgba_getg(c1);
+      int b1 = _rgba_getb(c1);
+      int a1 = _rgba_geta(c1);
+      int r2 = _rgba_getr(c2);
+      int g2 = _rgba_getg(c2);
+      int b2 = _rgba_getb(c2);
+      int a2 = _rgba_geta(c2);
+
+      if (a1 == 0 && a2 == 0)
+        return true;
+
+      return ((ABS(r1-r2) <= tolerance) &&
+              (ABS(g1-g2) <= tolerance) &&
+              (ABS(b1-b2) <= tolerance) &&
+              (ABS(a1-a2) <= tolerance));
+    }
+  }
 
+  inline bool color_equal_16(uint16_t c1, uint16_t c2, int tolerance)
+  {
+    if (tolerance == 0)
+      return (c1 == c2) || (_graya_geta(c1) == 0 && _graya_geta(c2) == 0);
+    else {
+      int k1 = _graya_getv(c1);
+      int a1 = _graya_geta(c1);
+      int k2 = _graya_getv(c2);
+      int a2 = _graya_geta(c2);
+
+      if (a1 == 0 && a2 == 0)
+        return true;
+
+      return ((ABS(k1-k2) <= tolerance) &&
+              (ABS(a1-a2) <= tolerance));
+    }
+  }
 
-static int flood_count;          /* number of flooded segments */
+  inline bool color_equal_8(uint8_t c1, uint8_t c2, int tolerance)
+  {
+    if (tolerance == 0)
+      return (c1 == c2);
+    else
+      return ABS(c1-c2) <= tolerance;
+  }
 
-#define FLOOD_IN_USE             1
-#define FLOOD_TODO_ABOVE         2
-#define FLOOD_TODO_BELOW         4
+  template<typename Traits>
+  inline bool color_equal(typename Traits::pixel_t c1, typename Traits::pixel_t c2, int tolerance);
 
-#define FLOOD_LINE(c)            (((FLOODED_LINE *)_scratch_mem) + c)
+  template<>
+  inline bool color_equal<RgbTraits>(uint32_t c1, uint32_t c2, int tolerance) {
+    return color_equal_32(c1, c2, tolerance);
+  }
 
-static inline bool color_equal_32(uint32_t c1, uint32_t c2, int tolerance)
-{
-  if (tolerance == 0)
-    return (c1 == c2) || (_rgba_geta(c1) == 0 && _rgba_geta(c2) == 0);
-  else {
-    int r1 = _rgba_getr(c1);
-    int g1 = _rgba_getg(c1);
-    int b1 = _rgba_getb(c1);
-    int a1 = _rgba_geta(c1);
-    int r2 = _rgba_getr(c2);
-    int g2 = _rgba_getg(c2);
-    int b2 = _rgba_getb(c2);
-    int a2 = _rgba_geta(c2);
-
-    if (a1 == 0 && a2 == 0)
-      return true;
-
-    return ((ABS(r1-r2) <= tolerance) &&
-            (ABS(g1-g2) <= tolerance) &&
-            (ABS(b1-b2) <= tolerance) &&
-            (ABS(a1-a2) <= tolerance));
+  template<>
+  inline bool color_equal<GrayscaleTraits>(uint16_t c1, uint16_t c2, int tolerance) {
+    return color_equal_16(c1, c2, tolerance);
   }
-}
 
-static inline bool color_equal_16(uint16_t c1, uint16_t c2, int tolerance)
-{
-  if (tolerance == 0)
-    return (c1 == c2) || (_graya_geta(c1) == 0 && _graya_geta(c2) == 0);
-  else {
-    int k1 = _graya_getv(c1);
-    int a1 = _graya_geta(c1);
-    int k2 = _graya_getv(c2);
-    int a2 = _graya_geta(c2);
-
-    if (a1 == 0 && a2 == 0)
-      return true;
-
-    return ((ABS(k1-k2) <= tolerance) &&
-            (ABS(a1-a2) <= tolerance));
+  template<>
+  inline bool color_equal<IndexedTraits>(uint8_t c1, uint8_t c2, int tolerance) {
+    return color_equal_8(c1, c2, tolerance);
   }
-}
 
-static inline bool color_equal_8(uint8_t c1, uint8_t c2, int tolerance)
-{
-  if (tolerance == 0)
+  template<>
+  inline bool color_equal<BitmapTraits>(uint8_t c1, uint8_t c2, int tolerance) {
     return (c1 == c2);
-  else
-    return ABS(c1-c2) <= tolerance;
-}
-
-
-
-/* flooder:
- *  Fills a horizontal line around the specified position, and adds it
- *  to the list of drawn segments. Returns the first x coordinate after
- *  the part of the line which it has dealt with.
- */
-static int flooder (Image *image, int x, int y,
-                    int src_color, int tolerance, void *data, AlgoHLine proc)
-{
-  FLOODED_LINE *p;
-  int left = 0, right = 0;
-  int c;
-
-  switch (image->getPixelFormat()) {
-
-    case IMAGE_RGB:
-      {
-        uint32_t* address = ((uint32_t**)image->line)[y];
+  }
 
-        /* check start pixel */
-        if (!color_equal_32((int)*(address+x), src_color, tolerance))
-          return x+1;
+  // One bit for each pixel of the image to know which pixels were
+  // already filled.
+  class FloodedPixels {
+  public:
+    FloodedPixels(int w, int h)
+      : m_wordsPerRow((w+31) / 32)
+      , m_bits(m_wordsPerRow*h, 0) {
+    }
 
-        /* work left from starting point */
-        for (left=x-1; left>=0; left--) {
-          if (!color_equal_32((int)*(address+left), src_color, tolerance))
-            break;
-        }
+    bool get(int x, int y) const {
+      return (m_bits[y*m_wordsPerRow + x/32] & (1u << (x & 31))) != 0;
+    }
 
-        /* work right from starting point */
-        for (right=x+1; right<image->w; right++) {
-          if (!color_equal_32((int)*(address+right), src_color, tolerance))
-            break;
-        }
+    // Marks the pixels from x1 to x2 (inclusive) of the row y.
+    void set(int x1, int y, int x2) {
+      uint32_t* row = &m_bits[y*m_wordsPerRow];
+      int u1 = x1/32, u2 = x2/32;
+      uint32_t mask1 = (0xffffffff << (x1 & 31));
+      uint32_t mask2 = (0xffffffff >> (31 - (x2 & 31)));
+
+      if (u1 == u2)
+        row[u1] |= (mask1 & mask2);
+      else {
+        row[u1] |= mask1;
+        for (int u=u1+1; u<u2; ++u)
+          row[u] = 0xffffffff;
+        row[u2] |= mask2;
       }
-      break;
+    }
 
-    case IMAGE_GRAYSCALE:
-      {
-        uint16_t* address = ((uint16_t**)image->line)[y];
+  private:
+    int m_wordsPerRow;
+    std::vector<uint32_t> m_bits;
+  };
+
+  // Scanline fill: each time a pixel of the source color is found,
+  // the whole horizontal span around it is filled, and the rows
+  // above and below that span are pushed in a stack to be checked
+  // later. A span only needs to check the row where it came from in
+  // the parts that are wider than its parent span.
+  template<typename Traits>
+  class FloodFill {
+  public:
+    typedef typename Traits::pixel_t pixel_t;
+
+    FloodFill(const Image* image, int tolerance, void* data, AlgoHLine proc)
+      : m_image(image)
+      , m_tolerance(tolerance)
+      , m_data(data)
+      , m_proc(proc) {
+    }
 
-        /* check start pixel */
-        if (!color_equal_16((int)*(address+x), src_color, tolerance))
-          return x+1;
+    void fillContiguous(int x, int y) {
+      FloodedPixels flooded(m_image->w, m_image->h);
+      std::vector<Span> stack;
 
-        /* work left from starting point */
-        for (left=x-1; left>=0; left--) {
-          if (!color_equal_16((int)*(address+left), src_color, tolerance))
-            break;
-        }
+      m_srcColor = image_getpixel_fast<Traits>(m_image, x, y);
 
-        /* work right from starting point */
-        for (right=x+1; right<image->w; right++) {
-          if (!color_equal_16((int)*(address+right), src_color, tolerance))
-            break;
-        }
-      }
-      break;
+      // The first span checks the rows above and below it
+      int x2 = spanEnd(x, y);
+      for (; x > 0 && isSrcColor(x-1, y); --x)
+        ;
+      fillSpan(Span(x, x2, y, 1), x, x2, flooded, stack);
+      pushSpan(stack, x, x2, y-1, -1);
 
-    case IMAGE_INDEXED:
-      {
-        uint8_t* address = ((uint8_t**)image->line)[y];
+      while (!stack.empty()) {
+        Span span = stack.back();
+        stack.pop_back();
 
-        /* check start pixel */
-        if (!color_equal_8((int)*(address+x), src_color, tolerance))
-          return x+1;
+        for (x=span.x1; x<=span.x2; ++x) {
+          if (flooded.get(x, span.y) || !isSrcColor(x, span.y))
+            continue;
 
-        /* work left from starting point */
-        for (left=x-1; left>=0; left--) {
-          if (!color_equal_8((int)*(address+left), src_color, tolerance))
-            break;
-        }
+          int x1 = x;
+          while (x1 > 0 && !flooded.get(x1-1, span.y) && isSrcColor(x1-1, span.y))
+            --x1;
 
-        /* work right from starting point */
-        for (right=x+1; right<image->w; right++) {
-          if (!color_equal_8((int)*(address+right), src_color, tolerance))
-            break;
+          x = spanEnd(x, span.y);
+          fillSpan(span, x1, x, flooded, stack);
         }
       }
-      break;
-
-    default:
-      /* check start pixel */
-      if (image_getpixel(image, x, y) != src_color)
-        return x+1;
-
-      /* work left from starting point */
-      for (left=x-1; left>=0; left--) {
-        if (image_getpixel(image, left, y) != src_color)
-          break;
-      }
+    }
 
-      /* work right from starting point */
-      for (right=x+1; right<image->w; right++) {
-        if (image_getpixel(image, right, y) != src_color)
-          break;
+    // Fills all pixels of the source color, contiguous or not.
+    void fillAll(int x, int y) {
+      m_srcColor = image_getpixel_fast<Traits>(m_image, x, y);
+
+      for (y=0; y<m_image->h; ++y) {
+        for (x=0; x<m_image->w; ++x) {
+          if (isSrcColor(x, y)) {
+            int x2 = spanEnd(x, y);
+            (*m_proc)(x, y, x2, m_data);
+            x = x2+1;
+          }
+        }
       }
-      break;
-  }
-
-  left++;
-  right--;
-
-  /* draw the line */
-  (*proc)(left, y, right, data);
-
-  /* store it in the list of flooded segments */
-  c = y;
-  p = FLOOD_LINE(c);
-
-  if (p->flags) {
-    while (p->next) {
-      c = p->next;
-      p = FLOOD_LINE(c);
     }
 
-    p->next = c = flood_count++;
-    _grow_scratch_mem(sizeof(FLOODED_LINE) * flood_count);
-    p = FLOOD_LINE(c);
-  }
-
-  p->flags = FLOOD_IN_USE;
-  p->lpos = left;
-  p->rpos = right;
-  p->y = y;
-  p->next = 0;
-
-  if (y > 0)
-    p->flags |= FLOOD_TODO_ABOVE;
-
-  if (y+1 < image->h)
-    p->flags |= FLOOD_TODO_BELOW;
-
-  return right+2;
-}
-
-
-
-/* check_flood_line:
- *  Checks a line segment, using the scratch buffer is to store a list of
- *  segments which have already been drawn in order to minimise the required
- *  number of tests.
- */
-static int check_flood_line(Image* image, int y, int left, int right,
-                            int src_color, int tolerance, void *data, AlgoHLine proc)
-{
-  int c;
-  FLOODED_LINE *p;
-  int ret = false;
+  private:
+    // Pixels to check in the row "y", "dy" is the direction of the
+    // row that pushed this span (+1 if the parent is above).
+    struct Span {
+      int x1, x2, y, dy;
+      Span(int x1, int x2, int y, int dy) : x1(x1), x2(x2), y(y), dy(dy) { }
+    };
+
+    bool isSrcColor(int x, int y) const {
+      return color_equal<Traits>(image_getpixel_fast<Traits>(m_image, x, y),
+                                 m_srcColor, m_tolerance);
+    }
 
-  while (left <= right) {
-    c = y;
+    // Returns the last pixel of the source color from x to the right.
+    int spanEnd(int x, int y) const {
+      while (x+1 < m_image->w && isSrcColor(x+1, y))
+        ++x;
+      return x;
+    }
 
-    for (;;) {
-      p = FLOOD_LINE(c);
+    void pushSpan(std::vector<Span>& stack, int x1, int x2, int y, int dy) const {
+      if (y >= 0 && y < m_image->h)
+        stack.push_back(Span(x1, x2, y, dy));
+    }
 
-      if ((left >= p->lpos) && (left <= p->rpos)) {
-        left = p->rpos+2;
-        break;
-      }
+    // Fills the pixels from x1 to x2 found when "parent" was checked.
+    void fillSpan(const Span& parent, int x1, int x2,
+                  FloodedPixels& flooded, std::vector<Span>& stack) {
+      flooded.set(x1, parent.y, x2);
+      (*m_proc)(x1, parent.y, x2, m_data);
 
-      c = p->next;
+      // Continue in the same direction
+      pushSpan(stack, x1, x2, parent.y+parent.dy, parent.dy);
 
-      if (!c) {
-        left = flooder (image, left, y, src_color, tolerance, data, proc);
-        ret = true;
-        break;
-      }
+      // Go back only where this span is wider than the parent one
+      if (x1 < parent.x1-1)
+        pushSpan(stack, x1, parent.x1-2, parent.y-parent.dy, -parent.dy);
+      if (x2 > parent.x2+1)
+        pushSpan(stack, parent.x2+2, x2, parent.y-parent.dy, -parent.dy);
     }
+
+    const Image* m_image;
+    pixel_t m_srcColor;
+    int m_tolerance;
+    void* m_data;
+    AlgoHLine m_proc;
+  };
+
+  template<typename Traits>
+  void floodfill(const Image* image, int x, int y, int tolerance, bool contiguous,
+                 void* data, AlgoHLine proc)
+  {
+    FloodFill<Traits> fill(image, tolerance, data, proc);
+
+    if (contiguous)
+      fill.fillContiguous(x, y);
+    else
+      fill.fillAll(x, y);
   }
 
-  return ret;
 }
 
-
-
 /* floodfill:
  *  Fills an enclosed area (starting at point x, y) with the specified color.
+ *  If "contiguous" is false, all pixels with the color of the starting
+ *  point are filled (not just the enclosed area).
  */
-void algo_floodfill(Image* image, int x, int y, int tolerance, void *data, AlgoHLine proc)
+void algo_floodfill(Image* image, int x, int y, int tolerance, bool contiguous,
+                    void* data, AlgoHLine proc)
 {
-  int src_color;
-  int c, done;
-  FLOODED_LINE *p;
-
   /* make sure we have a valid starting point */
   if ((x < 0) || (x >= image->w) ||
       (y < 0) || (y >= image->h))
     return;
 
-  /* what color to replace? */
-  src_color = image_getpixel (image, x, y);
-
-  /* set up the list of flooded segments */
-  _grow_scratch_mem(sizeof(FLOODED_LINE) * image->h);
-  flood_count = image->h;
-  p = (FLOODED_LINE*)_scratch_mem;
-  for (c=0; c<flood_count; c++) {
-    p[c].flags = 0;
-    p[c].lpos = SHRT_MAX;
-    p[c].rpos = SHRT_MIN;
-    p[c].y = y;
-    p[c].next = 0;
+  switch (image->getPixelFormat()) {
+    case IMAGE_RGB:       floodfill<RgbTraits>(image, x, y, tolerance, contiguous, data, proc); break;
+    case IMAGE_GRAYSCALE: floodfill<GrayscaleTraits>(image, x, y, tolerance, contiguous, data, proc); break;
+    case IMAGE_INDEXED:   floodfill<IndexedTraits>(image, x, y, tolerance, contiguous, data, proc); break;
+    case IMAGE_BITMAP:    floodfill<BitmapTraits>(image, x, y, tolerance, contiguous, data, proc); break;
   }
-
-  /* start up the flood algorithm */
-  flooder(image, x, y, src_color, tolerance, data, proc);
-
-  /* continue as long as there are some segments still to test */
-  do {
-    done = true;
-
-    /* for each line on the screen */
-    for (c=0; c<flood_count; c++) {
-
-      p = FLOOD_LINE(c);
-
-      /* check below the segment? */
-      if (p->flags & FLOOD_TODO_BELOW) {
-        p->flags &= ~FLOOD_TODO_BELOW;
-        if (check_flood_line(image, p->y+1, p->lpos, p->rpos,
-                             src_color, tolerance, data, proc)) {
-          done = false;
-          p = FLOOD_LINE(c);
-        }
-      }
-
-      /* check above the segment? */
-      if (p->flags & FLOOD_TODO_ABOVE) {
-        p->flags &= ~FLOOD_TODO_ABOVE;
-        if (check_flood_line(image, p->y-1, p->lpos, p->rpos,
-                             src_color, tolerance, data, proc)) {
-          done = false;
-          /* special case shortcut for going backwards */
-          if ((c < image->h) && (c > 0))
-            c -= 2;
-        }
-      }
-    }
-  } while (!done);
 }
 
 } // namespace raster
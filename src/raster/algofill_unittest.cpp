@@ -0,0 +1,269 @@
+/* Aseprite
+ * Copyright (C) 2001-2013  David Capello
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#include "tests/test.h"
+
+#include "base/unique_ptr.h"
+#include "raster/algo.h"
+#include "raster/image.h"
+
+#include <cstdlib>
+#include <queue>
+#include <utility>
+#include <vector>
+
+using namespace raster;
+
+typedef std::vector<int> Counters;
+
+// Counts how many times each pixel is filled by algo_floodfill().
+struct FillResult {
+  int w;
+  Counters counters;
+  bool badSpan;
+
+  FillResult(int w, int h) : w(w), counters(w*h, 0), badSpan(false) { }
+};
+
+static void count_hline(int x1, int y, int x2, void* data)
+{
+  FillResult* result = reinterpret_cast<FillResult*>(data);
+  if (x1 < 0 || x2 >= result->w || x1 > x2) {
+    result->badSpan = true;
+    return;
+  }
+  for (int x=x1; x<=x2; ++x)
+    ++result->counters[y*result->w + x];
+}
+
+static bool similar_colors(const Image* image, int c1, int c2, int tolerance)
+{
+  switch (image->getPixelFormat()) {
+
+    case IMAGE_RGB:
+      if (_rgba_geta(c1) == 0 && _rgba_geta(c2) == 0)
+        return true;
+      return (std::abs(_rgba_getr(c1) - _rgba_getr(c2)) <= tolerance &&
+              std::abs(_rgba_getg(c1) - _rgba_getg(c2)) <= tolerance &&
+              std::abs(_rgba_getb(c1) - _rgba_getb(c2)) <= tolerance &&
+              std::abs(_rgba_geta(c1) - _rgba_geta(c2)) <= tolerance);
+
+    case IMAGE_GRAYSCALE:
+      if (_graya_geta(c1) == 0 && _graya_geta(c2) == 0)
+        return true;
+      return (std::abs(_graya_getv(c1) - _graya_getv(c2)) <= tolerance &&
+              std::abs(_graya_geta(c1) - _graya_geta(c2)) <= tolerance);
+
+    case IMAGE_INDEXED:
+      return std::abs(c1 - c2) <= tolerance;
+
+    case IMAGE_BITMAP:
+      return c1 == c2;
+  }
+  return false;
+}
+
+// Pixel by pixel flood fill with 4-connected neighbors (diagonal
+// pixels are not neighbors).
+static Counters reference_floodfill(const Image* image, int x, int y,
+                                    int tolerance, bool contiguous)
+{
+  Counters filled(image->w*image->h, 0);
+  int srcColor = image->getpixel(x, y);
+
+  if (!contiguous) {
+    for (int v=0; v<image->h; ++v)
+      for (int u=0; u<image->w; ++u)
+        if (similar_colors(image, image->getpixel(u, v), srcColor, tolerance))
+          filled[v*image->w + u] = 1;
+    return filled;
+  }
+
+  std::queue<std::pair<int, int> > queue;
+  queue.push(std::make_pair(x, y));
+  filled[y*image->w + x] = 1;
+
+  while (!queue.empty()) {
+    std::pair<int, int> pt = queue.front();
+    queue.pop();
+
+    const int dx[] = { -1, +1, 0, 0 };
+    const int dy[] = { 0, 0, -1, +1 };
+
+    for (int i=0; i<4; ++i) {
+      int u = pt.first + dx[i];
+      int v = pt.second + dy[i];
+      if (u >= 0 && u < image->w && v >= 0 && v < image->h &&
+          !filled[v*image->w + u] &&
+          similar_colors(image, image->getpixel(u, v), srcColor, tolerance)) {
+        filled[v*image->w + u] = 1;
+        queue.push(std::make_pair(u, v));
+      }
+    }
+  }
+
+  return filled;
+}
+
+// Fills from (x, y) and checks that each pixel of the reference fill
+// is filled exactly once, and the other ones are not filled.
+static void expect_same_fill(Image* image, int x, int y, int tolerance, bool contiguous)
+{
+  FillResult result(image->w, image->h);
+  algo_floodfill(image, x, y, tolerance, contiguous, &result, count_hline);
+  ASSERT_FALSE(result.badSpan);
+
+  Counters expected = reference_floodfill(image, x, y, tolerance, contiguous);
+  for (int v=0; v<image->h; ++v)
+    for (int u=0; u<image->w; ++u)
+      ASSERT_EQ(expected[v*image->w + u], result.counters[v*image->w + u])
+        << "(" << u << ", " << v << ") filling from (" << x << ", " << y << ")"
+        << " tolerance=" << tolerance << " contiguous=" << contiguous;
+}
+
+// Creates an image with random colors from a small set, so there are
+// a lot of regions with irregular shapes.
+static Image* create_regions_image(PixelFormat format, int w, int h, int ncolors)
+{
+  Image* image = Image::create(format, w, h);
+
+  for (int y=0; y<h; ++y) {
+    for (int x=0; x<w; ++x) {
+      int i = std::rand() % ncolors;
+      int color = 0;
+      switch (format) {
+        case IMAGE_RGB:       color = _rgba(i*20, 255-i*10, i*5, (i == 0 ? 0: 255)); break;
+        case IMAGE_GRAYSCALE: color = _graya(i*20, (i == 0 ? 0: 255)); break;
+        case IMAGE_INDEXED:   color = i*3; break;
+        case IMAGE_BITMAP:    color = i & 1; break;
+      }
+      image->putpixel(x, y, color);
+    }
+  }
+
+  return image;
+}
+
+TEST(FloodFill, ImageBorders)
+{
+  PixelFormat formats[] = { IMAGE_RGB, IMAGE_GRAYSCALE, IMAGE_INDEXED, IMAGE_BITMAP };
+  std::srand(1);
+
+  for (int f=0; f<4; ++f) {
+    // Widths around multiples of 32 (the bits of flooded pixels)
+    int sizes[] = { 1, 31, 32, 33, 65 };
+    for (int s=0; s<5; ++s) {
+      int w = sizes[s], h = sizes[(s+2) % 5];
+      base::UniquePtr<Image> image(create_regions_image(formats[f], w, h, 2));
+
+      expect_same_fill(image, 0, 0, 0, true);
+      expect_same_fill(image, w-1, 0, 0, true);
+      expect_same_fill(image, 0, h-1, 0, true);
+      expect_same_fill(image, w-1, h-1, 0, true);
+      expect_same_fill(image, w/2, h/2, 0, true);
+    }
+  }
+}
+
+TEST(FloodFill, WholeImage)
+{
+  base::UniquePtr<Image> image(Image::create(IMAGE_RGB, 40, 30));
+  image_clear(image, _rgba(255, 0, 0, 255));
+
+  FillResult result(40, 30);
+  algo_floodfill(image, 20, 15, 0, true, &result, count_hline);
+  for (int i=0; i<40*30; ++i)
+    ASSERT_EQ(1, result.counters[i]);
+}
+
+TEST(FloodFill, Tolerance)
+{
+  PixelFormat formats[] = { IMAGE_RGB, IMAGE_GRAYSCALE, IMAGE_INDEXED };
+  int tolerances[] = { 0, 10, 20, 60 };
+  std::srand(2);
+
+  for (int f=0; f<3; ++f) {
+    base::UniquePtr<Image> image(create_regions_image(formats[f], 50, 40, 8));
+
+    for (int t=0; t<4; ++t) {
+      for (int i=0; i<10; ++i) {
+        int x = std::rand() % 50;
+        int y = std::rand() % 40;
+        expect_same_fill(image, x, y, tolerances[t], true);
+        expect_same_fill(image, x, y, tolerances[t], false);
+      }
+    }
+  }
+}
+
+TEST(FloodFill, TransparentColors)
+{
+  // Transparent pixels are equal whatever their RGB components are
+  base::UniquePtr<Image> image(Image::create(IMAGE_RGB, 8, 1));
+  for (int x=0; x<8; ++x)
+    image->putpixel(x, 0, _rgba(x*30, 0, 0, 0));
+  image->putpixel(6, 0, _rgba(0, 0, 0, 255));
+
+  FillResult result(8, 1);
+  algo_floodfill(image, 0, 0, 0, true, &result, count_hline);
+  for (int x=0; x<8; ++x)
+    EXPECT_EQ(x < 6 ? 1: 0, result.counters[x]) << x;
+}
+
+TEST(FloodFill, FourConnectedPixels)
+{
+  // A chessboard: diagonal pixels are not connected, so only the
+  // starting pixel is filled.
+  base::UniquePtr<Image> image(Image::create(IMAGE_INDEXED, 9, 9));
+  for (int y=0; y<9; ++y)
+    for (int x=0; x<9; ++x)
+      image->putpixel(x, y, (x+y) & 1);
+
+  FillResult result(9, 9);
+  algo_floodfill(image, 4, 4, 0, true, &result, count_hline);
+  for (int y=0; y<9; ++y)
+    for (int x=0; x<9; ++x)
+      EXPECT_EQ(x == 4 && y == 4 ? 1: 0, result.counters[y*9 + x]);
+
+  expect_same_fill(image, 4, 4, 0, false);
+
+  // A spiral of pixels connected only by their sides
+  image_clear(image, 0);
+  for (int i=0; i<9; ++i) {
+    image->putpixel(i, 0, 1);
+    image->putpixel(8, i, 1);
+    image->putpixel(i, 8, 1);
+  }
+  for (int i=2; i<9; ++i)
+    image->putpixel(0, i, 1);
+  for (int i=0; i<7; ++i)
+    image->putpixel(i, 2, 1);
+  for (int i=2; i<7; ++i)
+    image->putpixel(6, i, 1);
+  for (int i=2; i<7; ++i)
+    image->putpixel(i, 6, 1);
+  image->putpixel(2, 5, 1);
+  image->putpixel(2, 4, 1);
+  image->putpixel(3, 4, 1);
+  image->putpixel(4, 4, 1);
+
+  expect_same_fill(image, 0, 0, 0, true);
+  expect_same_fill(image, 1, 1, 0, true);
+  expect_same_fill(image, 4, 4, 0, true);
+  expect_same_fill(image, 5, 5, 0, true);
+}
@@ -23,6 +23,20 @@
 #include "raster/blend.h"
 #include "raster/image.h"
 
+#include <cstring>
+
+#if defined(__GNUC__) && (defined(__i386__) || defined(__x86_64__))
+  #define BLEND_SSE2_TARGET __attribute__((target("sse2")))
+  #define BLEND_AVX2_TARGET __attribute__((target("avx2")))
+  #define BLEND_HAVE_SSE2
+  #define BLEND_HAVE_AVX2
+  #include <immintrin.h>
+#elif defined(_MSC_VER) && (defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2))
+  #define BLEND_SSE2_TARGET
+  #define BLEND_HAVE_SSE2
+  #include <emmintrin.h>
+#endif
+
 namespace raster {
 
 BLEND_COLOR _rgba_blenders[] =
@@ -211,4 +225,242 @@ int _graya_blend_merge(int back, int front, int opacity)
   return _graya(D_k, D_a);
 }
 
+/**********************************************************************/
+/* Row blenders                                                       */
+/**********************************************************************/
+
+static void rgba_blend_normal_row(uint32_t* back, const uint32_t* front, int n,
+                                  const uint32_t* mask_color, int opacity)
+{
+  for (int x=0; x<n; ++x) {
+    if (!mask_color || front[x] != *mask_color)
+      back[x] = _rgba_blend_normal(back[x], front[x], opacity);
+  }
+}
+
+static void rgba_blend_copy_row(uint32_t* back, const uint32_t* front, int n,
+                                const uint32_t* mask_color, int opacity)
+{
+  if (!mask_color) {
+    memcpy(back, front, n*sizeof(uint32_t));
+    return;
+  }
+
+  for (int x=0; x<n; ++x) {
+    if (front[x] != *mask_color)
+      back[x] = front[x];
+  }
+}
+
+static void graya_blend_normal_row(uint16_t* back, const uint16_t* front, int n,
+                                   const uint16_t* mask_color, int opacity)
+{
+  for (int x=0; x<n; ++x) {
+    if (!mask_color || front[x] != *mask_color)
+      back[x] = _graya_blend_normal(back[x], front[x], opacity);
+  }
+}
+
+static void graya_blend_copy_row(uint16_t* back, const uint16_t* front, int n,
+                                 const uint16_t* mask_color, int opacity)
+{
+  if (!mask_color) {
+    memcpy(back, front, n*sizeof(uint16_t));
+    return;
+  }
+
+  for (int x=0; x<n; ++x) {
+    if (front[x] != *mask_color)
+      back[x] = front[x];
+  }
+}
+
+// The SIMD versions of _rgba_blend_normal give exactly the same
+// results as the scalar version: the channel division is done with
+// floats, which is exact for these small integers, and truncated to
+// zero as the integer division does.
+
+#ifdef BLEND_HAVE_SSE2
+
+BLEND_SSE2_TARGET
+static inline __m128i sse2_int_mult(__m128i a, __m128i b)
+{
+  // Operands are less than 256 so the 16-bit product fits in the
+  // low word of each 32-bit lane.
+  __m128i t = _mm_add_epi32(_mm_mullo_epi16(a, b), _mm_set1_epi32(0x80));
+  return _mm_srli_epi32(_mm_add_epi32(_mm_srli_epi32(t, 8), t), 8);
+}
+
+BLEND_SSE2_TARGET
+static inline __m128i sse2_select(__m128i cond, __m128i a, __m128i b)
+{
+  return _mm_or_si128(_mm_and_si128(cond, a), _mm_andnot_si128(cond, b));
+}
+
+BLEND_SSE2_TARGET
+static void rgba_blend_normal_row_sse2(uint32_t* back, const uint32_t* front, int n,
+                                       const uint32_t* mask_color, int opacity)
+{
+  const __m128i zero = _mm_setzero_si128();
+  const __m128i ff = _mm_set1_epi32(0xff);
+  const __m128i rgb = _mm_set1_epi32(0xffffff);
+  const __m128i op = _mm_set1_epi32(opacity);
+  const __m128i mask = _mm_set1_epi32(mask_color ? *mask_color: 0);
+  int x = 0;
+
+  for (; x+4 <= n; x += 4) {
+    __m128i B = _mm_loadu_si128((const __m128i*)(back+x));
+    __m128i F = _mm_loadu_si128((const __m128i*)(front+x));
+    __m128i B_a = _mm_srli_epi32(B, 24);
+    __m128i F_a0 = _mm_srli_epi32(F, 24);
+    __m128i F_a = sse2_int_mult(F_a0, op);
+    __m128i D_a = _mm_sub_epi32(_mm_add_epi32(B_a, F_a), sse2_int_mult(B_a, F_a));
+    __m128 F_af = _mm_cvtepi32_ps(F_a);
+    __m128 D_af = _mm_cvtepi32_ps(D_a);
+    __m128i D = _mm_slli_epi32(D_a, 24);
+
+    for (int shift=0; shift<24; shift+=8) {
+      __m128i B_c = _mm_and_si128(_mm_srli_epi32(B, shift), ff);
+      __m128i F_c = _mm_and_si128(_mm_srli_epi32(F, shift), ff);
+      __m128 num = _mm_mul_ps(_mm_cvtepi32_ps(_mm_sub_epi32(F_c, B_c)), F_af);
+      __m128i D_c = _mm_add_epi32(B_c, _mm_cvttps_epi32(_mm_div_ps(num, D_af)));
+      D = _mm_or_si128(D, _mm_slli_epi32(_mm_and_si128(D_c, ff), shift));
+    }
+
+    // Special cases: transparent front, transparent back, mask color
+    D = sse2_select(_mm_cmpeq_epi32(F_a0, zero), B, D);
+    D = sse2_select(_mm_cmpeq_epi32(B_a, zero),
+                    _mm_or_si128(_mm_and_si128(F, rgb), _mm_slli_epi32(F_a, 24)), D);
+    if (mask_color)
+      D = sse2_select(_mm_cmpeq_epi32(F, mask), B, D);
+
+    _mm_storeu_si128((__m128i*)(back+x), D);
+  }
+
+  rgba_blend_normal_row(back+x, front+x, n-x, mask_color, opacity);
+}
+
+#endif // BLEND_HAVE_SSE2
+
+#ifdef BLEND_HAVE_AVX2
+
+BLEND_AVX2_TARGET
+static inline __m256i avx2_int_mult(__m256i a, __m256i b)
+{
+  __m256i t = _mm256_add_epi32(_mm256_mullo_epi16(a, b), _mm256_set1_epi32(0x80));
+  return _mm256_srli_epi32(_mm256_add_epi32(_mm256_srli_epi32(t, 8), t), 8);
+}
+
+BLEND_AVX2_TARGET
+static void rgba_blend_normal_row_avx2(uint32_t* back, const uint32_t* front, int n,
+                                       const uint32_t* mask_color, int opacity)
+{
+  const __m256i zero = _mm256_setzero_si256();
+  const __m256i ff = _mm256_set1_epi32(0xff);
+  const __m256i rgb = _mm256_set1_epi32(0xffffff);
+  const __m256i op = _mm256_set1_epi32(opacity);
+  const __m256i mask = _mm256_set1_epi32(mask_color ? *mask_color: 0);
+  int x = 0;
+
+  for (; x+8 <= n; x += 8) {
+    __m256i B = _mm256_loadu_si256((const __m256i*)(back+x));
+    __m256i F = _mm256_loadu_si256((const __m256i*)(front+x));
+    __m256i B_a = _mm256_srli_epi32(B, 24);
+    __m256i F_a0 = _mm256_srli_epi32(F, 24);
+    __m256i F_a = avx2_int_mult(F_a0, op);
+    __m256i D_a = _mm256_sub_epi32(_mm256_add_epi32(B_a, F_a), avx2_int_mult(B_a, F_a));
+    __m256 F_af = _mm256_cvtepi32_ps(F_a);
+    __m256 D_af = _mm256_cvtepi32_ps(D_a);
+    __m256i D = _mm256_slli_epi32(D_a, 24);
+
+    for (int shift=0; shift<24; shift+=8) {
+      __m256i B_c = _mm256_and_si256(_mm256_srli_epi32(B, shift), ff);
+      __m256i F_c = _mm256_and_si256(_mm256_srli_epi32(F, shift), ff);
+      __m256 num = _mm256_mul_ps(_mm256_cvtepi32_ps(_mm256_sub_epi32(F_c, B_c)), F_af);
+      __m256i D_c = _mm256_add_epi32(B_c, _mm256_cvttps_epi32(_mm256_div_ps(num, D_af)));
+      D = _mm256_or_si256(D, _mm256_slli_epi32(_mm256_and_si256(D_c, ff), shift));
+    }
+
+    D = _mm256_blendv_epi8(D, B, _mm256_cmpeq_epi32(F_a0, zero));
+    D = _mm256_blendv_epi8(D, _mm256_or_si256(_mm256_and_si256(F, rgb),
+                                              _mm256_slli_epi32(F_a, 24)),
+                           _mm256_cmpeq_epi32(B_a, zero));
+    if (mask_color)
+      D = _mm256_blendv_epi8(D, B, _mm256_cmpeq_epi32(F, mask));
+
+    _mm256_storeu_si256((__m256i*)(back+x), D);
+  }
+
+  rgba_blend_normal_row(back+x, front+x, n-x, mask_color, opacity);
+}
+
+#endif // BLEND_HAVE_AVX2
+
+BLEND_RGBA_ROW get_rgba_normal_row_blender(int impl)
+{
+  switch (impl) {
+
+    case BLEND_ROW_GENERIC:
+      return rgba_blend_normal_row;
+
+#if defined(BLEND_HAVE_SSE2) && defined(__GNUC__)
+    case BLEND_ROW_SSE2:
+      __builtin_cpu_init();
+      if (__builtin_cpu_supports("sse2"))
+        return rgba_blend_normal_row_sse2;
+      break;
+#elif defined(BLEND_HAVE_SSE2)
+    case BLEND_ROW_SSE2:
+      return rgba_blend_normal_row_sse2;
+#endif
+
+#if defined(BLEND_HAVE_AVX2)
+    case BLEND_ROW_AVX2:
+      __builtin_cpu_init();
+      if (__builtin_cpu_supports("avx2"))
+        return rgba_blend_normal_row_avx2;
+      break;
+#endif
+  }
+
+  return NULL;
+}
+
+static BLEND_RGBA_ROW select_rgba_blend_normal_row()
+{
+  for (int impl=BLEND_ROW_MAX-1; impl>BLEND_ROW_GENERIC; --impl) {
+    if (BLEND_RGBA_ROW row = get_rgba_normal_row_blender(impl))
+      return row;
+  }
+  return rgba_blend_normal_row;
+}
+
+// The best row blender is selected when the program is loaded, so it
+// is never modified when several threads are blending rows.
+static BLEND_RGBA_ROW rgba_normal_row = select_rgba_blend_normal_row();
+
+BLEND_RGBA_ROW get_rgba_row_blender(int blend_mode)
+{
+  ASSERT(blend_mode >= 0 && blend_mode < BLEND_MODE_MAX);
+
+  if (blend_mode == BLEND_MODE_COPY)
+    return rgba_blend_copy_row;
+
+  // Only NULL if this is called from other static initializer
+  if (!rgba_normal_row)
+    return select_rgba_blend_normal_row();
+
+  return rgba_normal_row;
+}
+
+BLEND_GRAYA_ROW get_graya_row_blender(int blend_mode)
+{
+  ASSERT(blend_mode >= 0 && blend_mode < BLEND_MODE_MAX);
+
+  if (blend_mode == BLEND_MODE_COPY)
+    return graya_blend_copy_row;
+  else
+    return graya_blend_normal_row;
+}
+
 } // namespace raster
@@ -32,9 +32,34 @@ namespace raster {
 
   typedef int (*BLEND_COLOR)(int back, int front, int opacity);
 
+  // Blends a whole row of "n" pixels from "front" over "back" (the
+  // result is stored in "back"). If "mask_color" isn't NULL, front
+  // pixels equal to *mask_color are skipped.
+  typedef void (*BLEND_RGBA_ROW)(uint32_t* back, const uint32_t* front, int n,
+                                 const uint32_t* mask_color, int opacity);
+  typedef void (*BLEND_GRAYA_ROW)(uint16_t* back, const uint16_t* front, int n,
+                                  const uint16_t* mask_color, int opacity);
+
   extern BLEND_COLOR _rgba_blenders[];
   extern BLEND_COLOR _graya_blenders[];
 
+  // Implementations of the RGBA normal row blender.
+  enum {
+    BLEND_ROW_GENERIC,
+    BLEND_ROW_SSE2,
+    BLEND_ROW_AVX2,
+    BLEND_ROW_MAX,
+  };
+
+  // Returns the best row blender for the running CPU (SSE2/AVX2
+  // versions are selected when the program is loaded).
+  BLEND_RGBA_ROW get_rgba_row_blender(int blend_mode);
+  BLEND_GRAYA_ROW get_graya_row_blender(int blend_mode);
+
+  // Returns the given implementation (BLEND_ROW_*) of the RGBA normal
+  // row blender, or NULL if the running CPU doesn't support it.
+  BLEND_RGBA_ROW get_rgba_normal_row_blender(int impl);
+
   int _rgba_blend_normal(int back, int front, int opacity);
   int _rgba_blend_copy(int back, int front, int opacity);
   int _rgba_blend_forpath(int back, int front, int opacity);
@@ -0,0 +1,104 @@
+/* Aseprite
+ * Copyright (C) 2001-2013  David Capello
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#include "tests/test.h"
+
+#include "raster/blend.h"
+#include "raster/image.h"
+
+#include <cstdlib>
+#include <vector>
+
+using namespace raster;
+
+typedef std::vector<uint32_t> Row;
+
+// Random pixels with special alpha values (transparent and opaque)
+// and some pixels equal to the mask color.
+static Row random_row(int n, uint32_t mask)
+{
+  Row row(n);
+  for (int x=0; x<n; ++x) {
+    int a;
+    switch (std::rand() % 4) {
+      case 0: a = 0; break;
+      case 1: a = 255; break;
+      default: a = std::rand() & 255; break;
+    }
+    row[x] = _rgba(std::rand() & 255, std::rand() & 255, std::rand() & 255, a);
+    if (std::rand() % 8 == 0)
+      row[x] = mask;
+  }
+  return row;
+}
+
+TEST(Blend, RowBlendersGiveSameResultsThanGeneric)
+{
+  BLEND_RGBA_ROW generic = get_rgba_normal_row_blender(BLEND_ROW_GENERIC);
+  ASSERT_TRUE(generic != NULL);
+
+  const int opacities[] = { 0, 1, 127, 128, 254, 255 };
+  const uint32_t masks[] = { 0, _rgba(255, 0, 255, 255), _rgba(10, 20, 30, 40) };
+  std::srand(1);
+
+  for (int impl=BLEND_ROW_GENERIC+1; impl<BLEND_ROW_MAX; ++impl) {
+    BLEND_RGBA_ROW blender = get_rgba_normal_row_blender(impl);
+    if (!blender)
+      continue;
+
+    for (int o=0; o<6; ++o) {
+      for (int m=0; m<3; ++m) {
+        for (int useMask=0; useMask<2; ++useMask) {
+          // Lengths that aren't multiples of 4/8 pixels use the
+          // generic blender for the last pixels.
+          for (int n=0; n<40; ++n) {
+            Row front = random_row(n, masks[m]);
+            Row expected = random_row(n, masks[m]);
+            Row result = expected;
+            const uint32_t* mask = (useMask ? &masks[m]: NULL);
+
+            if (n > 0) {
+              generic(&expected[0], &front[0], n, mask, opacities[o]);
+              blender(&result[0], &front[0], n, mask, opacities[o]);
+            }
+            EXPECT_TRUE(expected == result)
+              << "impl=" << impl << " opacity=" << opacities[o]
+              << " mask=" << m << "/" << useMask << " n=" << n;
+          }
+        }
+      }
+    }
+  }
+}
+
+TEST(Blend, BestRowBlenderGivesSameResultsThanGeneric)
+{
+  BLEND_RGBA_ROW generic = get_rgba_normal_row_blender(BLEND_ROW_GENERIC);
+  BLEND_RGBA_ROW best = get_rgba_row_blender(BLEND_MODE_NORMAL);
+  ASSERT_TRUE(best != NULL);
+
+  uint32_t mask = _rgba(0, 0, 0, 0);
+  std::srand(2);
+
+  Row front = random_row(1000, mask);
+  Row expected = random_row(1000, mask);
+  Row result = expected;
+  generic(&expected[0], &front[0], 1000, &mask, 200);
+  best(&result[0], &front[0], 1000, &mask, 200);
+  EXPECT_TRUE(expected == result);
+}
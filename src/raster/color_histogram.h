@@ -23,7 +23,9 @@
 #include "raster/image.h"
 #include "raster/image_traits.h"
 #include "raster/median_cut.h"
+#include "raster/octree.h"
 #include "raster/palette.h"
+#include "raster/quantization_method.h"
 
 namespace raster {
 namespace quantization {
@@ -83,11 +85,40 @@ namespace quantization {
       }
     }
 
+    // Adds all samples of other histogram (e.g. one created from other
+    // images in other thread). Colors of the high-precision table of
+    // "other" are added after the colors of this one.
+    void addHistogram(const ColorHistogram& other)
+    {
+      for (size_t i=0; i<m_histogram.size(); ++i) {
+        if (m_histogram[i] < std::numeric_limits<size_t>::max()-other.m_histogram[i]) // Avoid overflow
+          m_histogram[i] += other.m_histogram[i];
+        else
+          m_histogram[i] = std::numeric_limits<size_t>::max();
+      }
+
+      if (!other.m_useHighPrecision) {
+        m_useHighPrecision = false;
+        return;
+      }
+
+      for (int i=0; i<(int)other.m_highPrecision.size() && m_useHighPrecision; ++i) {
+        uint32_t color = other.m_highPrecision[i];
+        if (std::find(m_highPrecision.begin(), m_highPrecision.end(), color) == m_highPrecision.end()) {
+          if (m_highPrecision.size() < 256)
+            m_highPrecision.push_back(color);
+          else
+            m_useHighPrecision = false;
+        }
+      }
+    }
+
     // Creates a set of entries for the given palette in the given range
     // with the more important colors in the histogram. Returns the
     // number of used entries in the palette (maybe the range [from,to]
     // is more than necessary).
-    int createOptimizedPalette(Palette* palette, int from, int to)
+    int createOptimizedPalette(Palette* palette, int from, int to,
+                               QuantizationMethod method = QUANTIZATION_MEDIAN_CUT)
     {
       // Can we use the high-precision table?
       if (m_useHighPrecision && int(m_highPrecision.size()) <= (to-from+1)) {
@@ -100,7 +131,14 @@ namespace quantization {
       // median-cut) to quantize "optimal" colors.
       else {
         std::vector<uint32_t> result;
-        median_cut(*this, to-from+1, result);
+        switch (method) {
+          case QUANTIZATION_MEDIAN_CUT:
+            median_cut(*this, to-from+1, result);
+            break;
+          case QUANTIZATION_OCTREE:
+            octree_quantization(*this, to-from+1, result);
+            break;
+        }
 
         for (int i=0; i<(int)result.size(); ++i)
           palette->setEntry(from+i, result[i]);
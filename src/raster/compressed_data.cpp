@@ -0,0 +1,110 @@
+/* Aseprite
+ * Copyright (C) 2001-2013  David Capello
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "raster/compressed_data.h"
+
+#include "base/serialization.h"
+#include "zlib.h"
+
+#include <iostream>
+#include <stdexcept>
+
+namespace raster {
+
+using namespace base::serialization;
+using namespace base::serialization::little_endian;
+
+CompressedData::CompressedData()
+  : m_uncompressedSize(0)
+{
+}
+
+CompressedData::CompressedData(const void* data, size_t size)
+  : m_uncompressedSize(0)
+{
+  compress(data, size);
+}
+
+void CompressedData::compress(const void* data, size_t size)
+{
+  uLongf compressedSize = compressBound(size);
+  m_data.resize(compressedSize);
+
+  if (compress2(&m_data[0], &compressedSize,
+                (const Bytef*)data, size, Z_BEST_SPEED) != Z_OK)
+    throw std::runtime_error("Error compressing data");
+
+  // Free the extra space reserved by compressBound()
+  std::vector<uint8_t>(m_data.begin(), m_data.begin()+compressedSize).swap(m_data);
+  m_uncompressedSize = size;
+}
+
+void CompressedData::uncompress(void* data) const
+{
+  if (m_uncompressedSize == 0)
+    return;
+
+  uLongf size = m_uncompressedSize;
+  if (::uncompress((Bytef*)data, &size, &m_data[0], m_data.size()) != Z_OK ||
+      size != m_uncompressedSize)
+    throw std::runtime_error("Error uncompressing data");
+}
+
+void CompressedData::clear()
+{
+  m_uncompressedSize = 0;
+  std::vector<uint8_t>().swap(m_data);
+}
+
+// Serialized CompressedData:
+//
+//    DWORD             uncompressed size
+//    DWORD             compressed size
+//    BYTE[]            compressed data
+
+void CompressedData::write(std::ostream& os) const
+{
+  write32(os, m_uncompressedSize);
+  write32(os, m_data.size());
+  if (!m_data.empty())
+    os.write((const char*)&m_data[0], m_data.size());
+}
+
+void CompressedData::read(std::istream& is)
+{
+  size_t uncompressedSize = read32(is);
+  size_t compressedSize = read32(is);
+  if (!is.good() || compressedSize > compressBound(uncompressedSize))
+    throw std::runtime_error("Invalid compressed data in stream");
+
+  std::vector<uint8_t> data(compressedSize);
+  if (!data.empty()) {
+    is.read((char*)&data[0], data.size());
+    if (!is.good())
+      throw std::runtime_error("Error reading compressed data from stream");
+  }
+
+  m_uncompressedSize = uncompressedSize;
+  m_data.swap(data);
+}
+
+} // namespace raster
@@ -0,0 +1,64 @@
+/* Aseprite
+ * Copyright (C) 2001-2013  David Capello
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#ifndef RASTER_COMPRESSED_DATA_H_INCLUDED
+#define RASTER_COMPRESSED_DATA_H_INCLUDED
+
+#include <cstddef>
+#include <iosfwd>
+#include <stdint.h>
+#include <vector>
+
+namespace raster {
+
+  // A block of bytes compressed with zlib using the fastest
+  // compression level. Used to keep undo information (and other big
+  // copies of pixels) with a smaller memory footprint.
+  class CompressedData {
+  public:
+    CompressedData();
+    CompressedData(const void* data, size_t size);
+
+    size_t getUncompressedSize() const { return m_uncompressedSize; }
+    size_t getCompressedSize() const { return m_data.size(); }
+
+    // Replaces the content with the compressed version of the given
+    // "data".
+    void compress(const void* data, size_t size);
+
+    // Uncompresses the content in "data", which must have
+    // getUncompressedSize() bytes.
+    void uncompress(void* data) const;
+
+    // Releases the memory used by the data.
+    void clear();
+
+    // Serialization of the compressed data. read() throws a
+    // std::runtime_error (keeping the old content) if the stream
+    // cannot be read or doesn't contain valid data.
+    void write(std::ostream& os) const;
+    void read(std::istream& is);
+
+  private:
+    size_t m_uncompressedSize;
+    std::vector<uint8_t> m_data;
+  };
+
+} // namespace raster
+
+#endif
@@ -0,0 +1,150 @@
+/* Aseprite
+ * Copyright (C) 2001-2013  David Capello
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#include "tests/test.h"
+
+#include "raster/compressed_data.h"
+
+#include <cstdlib>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+using namespace raster;
+
+typedef std::vector<uint8_t> Bytes;
+
+static Bytes random_bytes(size_t size, int range)
+{
+  Bytes bytes(size);
+  for (size_t i=0; i<size; ++i)
+    bytes[i] = std::rand() % range;
+  return bytes;
+}
+
+static Bytes uncompress(const CompressedData& data)
+{
+  Bytes bytes(data.getUncompressedSize());
+  if (!bytes.empty())
+    data.uncompress(&bytes[0]);
+  return bytes;
+}
+
+TEST(CompressedData, CompressAndUncompress)
+{
+  size_t sizes[] = { 1, 2, 1000, 65536, 1000000 };
+  int ranges[] = { 1, 4, 256 };
+  std::srand(1);
+
+  for (int s=0; s<5; ++s) {
+    for (int r=0; r<3; ++r) {
+      Bytes bytes = random_bytes(sizes[s], ranges[r]);
+      CompressedData data(&bytes[0], bytes.size());
+
+      EXPECT_EQ(bytes.size(), data.getUncompressedSize());
+      EXPECT_TRUE(bytes == uncompress(data));
+
+      // Data with few different values must be smaller
+      if (sizes[s] >= 1000 && ranges[r] <= 4)
+        EXPECT_LT(data.getCompressedSize(), bytes.size() / 2);
+    }
+  }
+}
+
+TEST(CompressedData, EmptyAndClear)
+{
+  CompressedData empty;
+  EXPECT_EQ(0u, empty.getUncompressedSize());
+  EXPECT_TRUE(uncompress(empty).empty());
+
+  Bytes bytes(5000, 7);
+  CompressedData data(&bytes[0], bytes.size());
+  data.clear();
+  EXPECT_EQ(0u, data.getUncompressedSize());
+  EXPECT_EQ(0u, data.getCompressedSize());
+
+  // Compress again in the same object
+  bytes = random_bytes(3000, 256);
+  data.compress(&bytes[0], bytes.size());
+  EXPECT_TRUE(bytes == uncompress(data));
+}
+
+TEST(CompressedData, WriteAndRead)
+{
+  std::srand(2);
+
+  std::vector<Bytes> blocks;
+  blocks.push_back(random_bytes(10, 256));
+  blocks.push_back(random_bytes(100000, 3));
+  blocks.push_back(random_bytes(4096, 256));
+
+  std::stringstream stream;
+  for (int i=0; i<(int)blocks.size(); ++i)
+    CompressedData(&blocks[i][0], blocks[i].size()).write(stream);
+  CompressedData().write(stream);
+
+  for (int i=0; i<(int)blocks.size(); ++i) {
+    CompressedData data;
+    data.read(stream);
+    EXPECT_TRUE(blocks[i] == uncompress(data));
+  }
+
+  CompressedData empty;
+  empty.read(stream);
+  EXPECT_EQ(0u, empty.getUncompressedSize());
+}
+
+TEST(CompressedData, ReadErrors)
+{
+  std::srand(3);
+
+  Bytes bytes = random_bytes(20000, 16);
+  std::stringstream stream;
+  CompressedData(&bytes[0], bytes.size()).write(stream);
+  std::string serialized = stream.str();
+
+  Bytes old = random_bytes(100, 256);
+  CompressedData data(&old[0], old.size());
+
+  // Truncated streams (in the header and in the data)
+  size_t lengths[] = { 0, 3, 6, serialized.size()/2, serialized.size()-1 };
+  for (int i=0; i<5; ++i) {
+    std::stringstream truncated(serialized.substr(0, lengths[i]));
+    EXPECT_THROW(data.read(truncated), std::runtime_error);
+
+    // The old content is kept
+    EXPECT_TRUE(old == uncompress(data));
+  }
+
+  // A compressed size too big for the uncompressed size
+  std::string invalid = serialized;
+  invalid[0] = invalid[1] = invalid[2] = invalid[3] = 0;
+  std::stringstream invalidStream(invalid);
+  EXPECT_THROW(data.read(invalidStream), std::runtime_error);
+  EXPECT_TRUE(old == uncompress(data));
+
+  // Corrupted compressed data can be read, but not uncompressed
+  std::string corrupted = serialized;
+  for (size_t i=8; i<corrupted.size(); i+=7)
+    corrupted[i] = ~corrupted[i];
+  std::stringstream corruptedStream(corrupted);
+  data.read(corruptedStream);
+  Bytes result(data.getUncompressedSize());
+  EXPECT_THROW(data.uncompress(&result[0]), std::runtime_error);
+}
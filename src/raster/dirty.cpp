@@ -21,12 +21,126 @@
 #endif
 
 #include "raster/dirty.h"
+
+#include "gfx/point.h"
 #include "raster/image.h"
+#include "raster/image_traits.h"
 
 #include <algorithm>
 
 namespace raster {
 
+namespace {
+
+// Compares pixels of the same row of two images.
+template<class Traits>
+class RowComparer {
+public:
+  RowComparer(const Image* image1, const Image* image2, int y)
+    : m_row1(image_address_fast<Traits>(image1, 0, y))
+    , m_row2(image_address_fast<Traits>(image2, 0, y)) {
+  }
+
+  bool differ(int x) const {
+    return m_row1[x] != m_row2[x];
+  }
+
+private:
+  typename Traits::const_address_t m_row1;
+  typename Traits::const_address_t m_row2;
+};
+
+template<>
+class RowComparer<BitmapTraits> {
+public:
+  RowComparer(const Image* image1, const Image* image2, int y)
+    : m_row1(image_address_fast<BitmapTraits>(image1, 0, y))
+    , m_row2(image_address_fast<BitmapTraits>(image2, 0, y)) {
+  }
+
+  bool differ(int x) const {
+    return ((m_row1[x/8] ^ m_row2[x/8]) & (1 << (x%8))) != 0;
+  }
+
+private:
+  BitmapTraits::const_address_t m_row1;
+  BitmapTraits::const_address_t m_row2;
+};
+
+// Adds to "dirty" one column for each row with differences between
+// both images inside the given rectangles. The column goes from the
+// first to the last different pixel of the row.
+template<class Traits>
+void add_dirty_rows_templ(Dirty* dirty, const Image* image, const Image* image_diff,
+                          const std::vector<gfx::Rect>& rects)
+{
+  gfx::Rect bounds;
+  for (size_t i=0; i<rects.size(); ++i)
+    bounds = bounds.createUnion(rects[i]);
+
+  int x, y, x1, x2;
+
+  for (y=bounds.y; y<bounds.y+bounds.h; y++) {
+    RowComparer<Traits> row(image, image_diff, y);
+    x1 = x2 = -1;
+
+    for (size_t i=0; i<rects.size(); ++i) {
+      const gfx::Rect& rc = rects[i];
+      if (y < rc.y || y >= rc.y+rc.h)
+        continue;
+
+      for (x=rc.x; x<rc.x+rc.w && (x1 < 0 || x < x1); x++) {
+        if (row.differ(x)) {
+          x1 = x;
+          break;
+        }
+      }
+
+      for (x=rc.x+rc.w-1; x>=rc.x && x>x2; x--) {
+        if (row.differ(x)) {
+          x2 = x;
+          break;
+        }
+      }
+    }
+
+    if (x1 < 0)
+      continue;
+
+    Dirty::Col* col = new Dirty::Col(x1, x2-x1+1);
+    col->data.resize(dirty->getLineSize(col->w));
+
+    Dirty::Row* dirtyRow = new Dirty::Row(y);
+    dirtyRow->cols.push_back(col);
+
+    dirty->m_rows.push_back(dirtyRow);
+  }
+}
+
+void add_dirty_rows(Dirty* dirty, const Image* image, const Image* image_diff,
+                    const std::vector<gfx::Rect>& rects)
+{
+  ASSERT(image->getPixelFormat() == image_diff->getPixelFormat());
+  ASSERT(image->w == image_diff->w && image->h == image_diff->h);
+
+  switch (image->getPixelFormat()) {
+    case IMAGE_RGB:
+      add_dirty_rows_templ<RgbTraits>(dirty, image, image_diff, rects);
+      break;
+    case IMAGE_GRAYSCALE:
+      add_dirty_rows_templ<GrayscaleTraits>(dirty, image, image_diff, rects);
+      break;
+    case IMAGE_INDEXED:
+      add_dirty_rows_templ<IndexedTraits>(dirty, image, image_diff, rects);
+      break;
+    case IMAGE_BITMAP:
+      add_dirty_rows_templ<BitmapTraits>(dirty, image, image_diff, rects);
+      break;
+  }
+}
+
+} // anonymous namespace
+
 Dirty::Dirty(PixelFormat format, int x1, int y1, int x2, int y2)
   : m_format(format)
   , m_x1(x1), m_y1(y1)
@@ -61,32 +175,27 @@ Dirty::Dirty(Image* image, Image* image_diff)
   , m_x1(0), m_y1(0)
   , m_x2(image->w-1), m_y2(image->h-1)
 {
-  int x, y, x1, x2;
-
-  for (y=0; y<image->h; y++) {
-    x1 = -1;
-    for (x=0; x<image->w; x++) {
-      if (image_getpixel(image, x, y) != image_getpixel(image_diff, x, y)) {
-        x1 = x;
-        break;
-      }
-    }
-    if (x1 < 0)
-      continue;
-
-    for (x2=image->w-1; x2>x1; x2--) {
-      if (image_getpixel(image, x2, y) != image_getpixel(image_diff, x2, y))
-        break;
-    }
-
-    Col* col = new Col(x1, x2-x1+1);
-    col->data.resize(getLineSize(col->w));
+  std::vector<gfx::Rect> rects(1, gfx::Rect(0, 0, image->w, image->h));
+  add_dirty_rows(this, image, image_diff, rects);
+}
 
-    Row* row = new Row(y);
-    row->cols.push_back(col);
+// Compares both images only inside the given region.
+Dirty::Dirty(Image* image, Image* image_diff, const gfx::Region& region)
+  : m_format(image->getPixelFormat())
+  , m_x1(0), m_y1(0)
+  , m_x2(image->w-1), m_y2(image->h-1)
+{
+  gfx::Rect imageBounds(0, 0, image->w, image->h);
+  std::vector<gfx::Rect> rects;
 
-    m_rows.push_back(row);
+  for (gfx::Region::const_iterator it=region.begin(), end=region.end();
+       it != end; ++it) {
+    gfx::Rect rc = (*it).createIntersect(imageBounds);
+    if (!rc.isEmpty())
+      rects.push_back(rc);
   }
+
+  add_dirty_rows(this, image, image_diff, rects);
 }
 
 Dirty::~Dirty()
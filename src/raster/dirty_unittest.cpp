@@ -0,0 +1,116 @@
+/* Aseprite
+ * Copyright (C) 2001-2013  David Capello
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#include "tests/test.h"
+
+#include "base/unique_ptr.h"
+#include "raster/dirty.h"
+#include "raster/image.h"
+
+#include <cstdlib>
+#include <vector>
+
+using namespace raster;
+
+// Returns the columns of the given Dirty as a vector of x1, x2 for
+// each row (or -1, -1 for rows without differences).
+static std::vector<int> dirty_cols(const Dirty& dirty, int h)
+{
+  std::vector<int> cols(2*h, -1);
+  for (int i=0; i<dirty.getRowsCount(); ++i) {
+    const Dirty::Row& row = dirty.getRow(i);
+    EXPECT_EQ(1u, row.cols.size());
+    cols[2*row.y] = row.cols[0]->x;
+    cols[2*row.y+1] = row.cols[0]->x + row.cols[0]->w - 1;
+  }
+  return cols;
+}
+
+// Old implementation comparing each pixel with image_getpixel().
+static std::vector<int> reference_cols(Image* image, Image* image_diff,
+                                       const gfx::Rect& bounds)
+{
+  std::vector<int> cols(2*image->h, -1);
+  for (int y=bounds.y; y<bounds.y+bounds.h; ++y) {
+    for (int x=bounds.x; x<bounds.x+bounds.w; ++x) {
+      if (image_getpixel(image, x, y) != image_getpixel(image_diff, x, y)) {
+        if (cols[2*y] < 0)
+          cols[2*y] = x;
+        cols[2*y+1] = x;
+      }
+    }
+  }
+  return cols;
+}
+
+TEST(Dirty, DifferencesOfAllPixelFormats)
+{
+  PixelFormat formats[] = { IMAGE_RGB, IMAGE_GRAYSCALE, IMAGE_INDEXED, IMAGE_BITMAP };
+  int widths[] = { 1, 7, 9, 33, 64 };
+  std::srand(1);
+
+  for (int f=0; f<4; ++f) {
+    for (int i=0; i<5; ++i) {
+      int w = widths[i], h = 20;
+      base::UniquePtr<Image> image(Image::create(formats[f], w, h));
+      image_clear(image, 0);
+      base::UniquePtr<Image> image_diff(Image::createCopy(image));
+
+      for (int j=0; j<w*h/8; ++j)
+        image_diff->putpixel(std::rand() % w, std::rand() % h, 1);
+
+      gfx::Rect bounds(0, 0, w, h);
+      Dirty dirty(image, image_diff);
+      EXPECT_TRUE(reference_cols(image, image_diff, bounds) == dirty_cols(dirty, h))
+        << "format=" << formats[f] << " w=" << w;
+    }
+  }
+}
+
+TEST(Dirty, DifferencesInsideRegion)
+{
+  PixelFormat formats[] = { IMAGE_RGB, IMAGE_BITMAP };
+  std::srand(2);
+
+  for (int f=0; f<2; ++f) {
+    int w = 50, h = 40;
+    base::UniquePtr<Image> image(Image::create(formats[f], w, h));
+    image_clear(image, 0);
+    base::UniquePtr<Image> image_diff(Image::createCopy(image));
+
+    // Differences only inside the region
+    gfx::Region region(gfx::Rect(3, 2, 13, 20));
+    region.createUnion(region, gfx::Region(gfx::Rect(30, 10, 15, 25)));
+    for (gfx::Region::const_iterator it=region.begin(), end=region.end(); it!=end; ++it) {
+      const gfx::Rect& rc = *it;
+      for (int j=0; j<rc.w*rc.h/4; ++j)
+        image_diff->putpixel(rc.x + std::rand() % rc.w, rc.y + std::rand() % rc.h, 1);
+    }
+
+    // The region gives the same result than comparing all pixels
+    Dirty dirty(image, image_diff);
+    Dirty regionDirty(image, image_diff, region);
+    EXPECT_TRUE(dirty_cols(dirty, h) == dirty_cols(regionDirty, h));
+
+    // Differences outside the region are ignored
+    image_diff->putpixel(0, 0, 1);
+    image_diff->putpixel(w-1, 5, 1);
+    Dirty regionDirty2(image, image_diff, region);
+    EXPECT_TRUE(dirty_cols(dirty, h) == dirty_cols(regionDirty2, h));
+  }
+}
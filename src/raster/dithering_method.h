@@ -25,6 +25,8 @@ namespace raster {
   enum DitheringMethod {
     DITHERING_NONE,
     DITHERING_ORDERED,
+    DITHERING_FLOYD_STEINBERG,
+    DITHERING_ATKINSON,
   };
 
 } // namespace raster
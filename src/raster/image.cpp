@@ -22,13 +22,18 @@
 
 #include <allegro.h>
 #include <string.h>
+#include <algorithm>
 #include <stdexcept>
+#include <vector>
 
+#include "gfx/region.h"
 #include "raster/algo.h"
 #include "raster/blend.h"
 #include "raster/pen.h"
 #include "raster/image.h"
 #include "raster/image_impl.h"
+#include "raster/image_rows.h"
+#include "raster/image_traits.h"
 #include "raster/palette.h"
 #include "raster/rgbmap.h"
 
@@ -79,7 +84,13 @@ Image* Image::create(PixelFormat format, int w, int h)
 Image* Image::createCopy(const Image* image)
 {
   ASSERT(image);
-  return image_crop(image, 0, 0, image->w, image->h, 0);
+
+  // The copy covers the whole new image, so we don't need to clear
+  // it first as image_crop() does.
+  Image* copy = Image::create(image->getPixelFormat(), image->w, image->h);
+  copy->mask_color = image->mask_color;
+  image_copy(copy, image, 0, 0);
+  return copy;
 }
 
 int image_getpixel(const Image* image, int x, int y)
@@ -130,9 +141,49 @@ void image_copy(Image* dst, const Image* src, int x, int y)
   dst->copy(src, x, y);
 }
 
+void image_copy_region(Image* dst, const Image* src, const gfx::Region& region, int dx, int dy)
+{
+  ASSERT(dst->getPixelFormat() == src->getPixelFormat());
+  ASSERT(dst->w == src->w && dst->h == src->h);
+
+  gfx::Rect imageBounds(0, 0, src->w, src->h);
+
+  for (gfx::Region::const_iterator it=region.begin(), end=region.end();
+       it != end; ++it) {
+    gfx::Rect rc = *it;
+    rc.offset(dx, dy);
+    rc = rc.createIntersect(imageBounds);
+    if (rc.isEmpty())
+      continue;
+
+    if (src->getPixelFormat() == IMAGE_BITMAP) {
+      // Rows can start and end in the middle of a byte
+      for (int y=rc.y; y<rc.y+rc.h; ++y) {
+        RowReader<BitmapTraits> srcRow(src, rc.x, y);
+        RowWriter<BitmapTraits> dstRow(dst, rc.x, y);
+        for (int x=0; x<rc.w; ++x)
+          dstRow.next(srcRow.next());
+      }
+    }
+    else {
+      int x_offset = image_line_size(src, rc.x);
+      int line_size = image_line_size(src, rc.w);
+
+      for (int y=rc.y; y<rc.y+rc.h; ++y)
+        memcpy(dst->line[y] + x_offset,
+               src->line[y] + x_offset, line_size);
+    }
+  }
+}
+
 void image_merge(Image* dst, const Image* src, int x, int y, int opacity, int blend_mode)
 {
-  dst->merge(src, x, y, opacity, blend_mode);
+  dst->merge(src, x, y, opacity, blend_mode, src->mask_color);
+}
+
+void image_merge(Image* dst, const Image* src, int x, int y, int opacity, int blend_mode, uint32_t mask_color)
+{
+  dst->merge(src, x, y, opacity, blend_mode, mask_color);
 }
 
 Image* image_crop(const Image* image, int x, int y, int w, int h, int bgcolor)
@@ -149,44 +200,72 @@ Image* image_crop(const Image* image, int x, int y, int w, int h, int bgcolor)
   return trim;
 }
 
+namespace {
+
+  template<typename Traits>
+  void rotate_image(const Image* src, Image* dst, int angle)
+  {
+    int x, y;
+
+    switch (angle) {
+
+      case 180:
+        for (y=0; y<src->h; ++y) {
+          RowReader<Traits> srcRow(src, 0, y);
+          for (x=0; x<src->w; ++x)
+            image_putpixel_fast<Traits>(dst, src->w - x - 1,
+                                        src->h - y - 1, srcRow.next());
+        }
+        break;
+
+      case 90:
+        for (y=0; y<src->h; ++y) {
+          RowReader<Traits> srcRow(src, 0, y);
+          for (x=0; x<src->w; ++x)
+            image_putpixel_fast<Traits>(dst, src->h - y - 1, x, srcRow.next());
+        }
+        break;
+
+      case -90:
+        for (y=0; y<src->h; ++y) {
+          RowReader<Traits> srcRow(src, 0, y);
+          for (x=0; x<src->w; ++x)
+            image_putpixel_fast<Traits>(dst, y, src->w - x - 1, srcRow.next());
+        }
+        break;
+    }
+  }
+
+}
+
 void image_rotate(const Image* src, Image* dst, int angle)
 {
-  int x, y;
-
   switch (angle) {
 
     case 180:
       ASSERT(dst->w == src->w);
       ASSERT(dst->h == src->h);
-
-      for (y=0; y<src->h; ++y)
-        for (x=0; x<src->w; ++x)
-          dst->putpixel(src->w - x - 1,
-                        src->h - y - 1, src->getpixel(x, y));
       break;
 
     case 90:
-      ASSERT(dst->w == src->h);
-      ASSERT(dst->h == src->w);
-
-      for (y=0; y<src->h; ++y)
-        for (x=0; x<src->w; ++x)
-          dst->putpixel(src->h - y - 1, x, src->getpixel(x, y));
-      break;
-
     case -90:
       ASSERT(dst->w == src->h);
       ASSERT(dst->h == src->w);
-
-      for (y=0; y<src->h; ++y)
-        for (x=0; x<src->w; ++x)
-          dst->putpixel(y, src->w - x - 1, src->getpixel(x, y));
       break;
 
     // bad angle
     default:
       throw std::invalid_argument("Invalid angle specified to rotate the image");
   }
+
+  ASSERT(src->getPixelFormat() == dst->getPixelFormat());
+
+  switch (src->getPixelFormat()) {
+    case IMAGE_RGB:       rotate_image<RgbTraits>(src, dst, angle); break;
+    case IMAGE_GRAYSCALE: rotate_image<GrayscaleTraits>(src, dst, angle); break;
+    case IMAGE_INDEXED:   rotate_image<IndexedTraits>(src, dst, angle); break;
+    case IMAGE_BITMAP:    rotate_image<BitmapTraits>(src, dst, angle); break;
+  }
 }
 
 void image_hline(Image* image, int x1, int y, int x2, int color)
@@ -436,199 +515,447 @@ void image_fixup_transparent_colors(Image* image)
   }
 }
 
-/**
- * Resizes the source image @a src to the destination image @a dst.
- *
- * @warning If you are using the RESIZE_METHOD_BILINEAR, it is
- * recommended to use @ref image_fixup_transparent_colors function
- * over the source image @a src before using this routine.
- */
-void image_resize(const Image* src, Image* dst, ResizeMethod method, const Palette* pal, const RgbMap* rgbmap)
-{
-  switch (method) {
-
-    // TODO optimize this
-    case RESIZE_METHOD_NEAREST_NEIGHBOR: {
-      uint32_t color;
-      double u, v, du, dv;
-      int x, y;
-
-      u = v = 0.0;
-      du = src->w * 1.0 / dst->w;
-      dv = src->h * 1.0 / dst->h;
-      for (y=0; y<dst->h; ++y) {
-        for (x=0; x<dst->w; ++x) {
-          color = src->getpixel(MID(0, u, src->w-1),
-                                MID(0, v, src->h-1));
-          dst->putpixel(x, y, color);
-          u += du;
+namespace {
+
+  // Converts pixels to integer channels (and back) to interpolate them
+  // in the bilinear and area resize methods. Indexed images are
+  // interpolated using the RGB values of the palette, and the index 0
+  // as the transparent color.
+  template<typename Traits>
+  struct ResizeChannels;
+
+  template<>
+  struct ResizeChannels<RgbTraits> {
+    enum { nchannels = 4 };
+
+    ResizeChannels(const Palette* pal, const RgbMap* rgbmap) { }
+
+    void split(RgbTraits::pixel_t color, int* values) const {
+      values[0] = _rgba_getr(color);
+      values[1] = _rgba_getg(color);
+      values[2] = _rgba_getb(color);
+      values[3] = _rgba_geta(color);
+    }
+
+    RgbTraits::pixel_t join(const int* values) const {
+      return _rgba(values[0], values[1], values[2], values[3]);
+    }
+  };
+
+  template<>
+  struct ResizeChannels<GrayscaleTraits> {
+    enum { nchannels = 2 };
+
+    ResizeChannels(const Palette* pal, const RgbMap* rgbmap) { }
+
+    void split(GrayscaleTraits::pixel_t color, int* values) const {
+      values[0] = _graya_getv(color);
+      values[1] = _graya_geta(color);
+    }
+
+    GrayscaleTraits::pixel_t join(const int* values) const {
+      return _graya(values[0], values[1]);
+    }
+  };
+
+  template<>
+  struct ResizeChannels<IndexedTraits> {
+    enum { nchannels = 4 };
+    const Palette* pal;
+    const RgbMap* rgbmap;
+
+    ResizeChannels(const Palette* pal, const RgbMap* rgbmap)
+      : pal(pal), rgbmap(rgbmap) { }
+
+    void split(IndexedTraits::pixel_t color, int* values) const {
+      uint32_t rgba = pal->getEntry(color);
+      values[0] = _rgba_getr(rgba);
+      values[1] = _rgba_getg(rgba);
+      values[2] = _rgba_getb(rgba);
+      values[3] = (color == 0 ? 0: 255);
+    }
+
+    IndexedTraits::pixel_t join(const int* values) const {
+      return (values[3] > 127 ? rgbmap->mapColor(values[0], values[1], values[2]): 0);
+    }
+  };
+
+  template<>
+  struct ResizeChannels<BitmapTraits> {
+    enum { nchannels = 1 };
+
+    ResizeChannels(const Palette* pal, const RgbMap* rgbmap) { }
+
+    void split(BitmapTraits::pixel_t color, int* values) const {
+      values[0] = (color ? 255: 0);
+    }
+
+    BitmapTraits::pixel_t join(const int* values) const {
+      return (values[0] > 127 ? 1: 0);
+    }
+  };
+
+  // Unpacks the channels of the row "y" of the image in "row" (one
+  // array of image->w integers for each channel).
+  template<typename Traits>
+  void split_row(const Image* image, int y, const ResizeChannels<Traits>& channels, int* row)
+  {
+    const int n = ResizeChannels<Traits>::nchannels;
+    int values[n];
+
+    RowReader<Traits> src(image, 0, y);
+
+    for (int x=0; x<image->w; ++x) {
+      channels.split(src.next(), values);
+      for (int c=0; c<n; ++c)
+        row[c*image->w + x] = values[c];
+    }
+  }
+
+  // Source pixel of each destination pixel for the nearest-neighbor
+  // method. The position is accumulated in the same way as older
+  // versions to get exactly the same results.
+  void calculate_nearest_steps(int src_size, int dst_size, std::vector<int>& steps)
+  {
+    double pos = 0.0;
+    double delta = src_size * 1.0 / dst_size;
+
+    steps.resize(dst_size);
+    for (int i=0; i<dst_size; ++i) {
+      steps[i] = MID(0, int(pos), src_size-1);
+      pos += delta;
+    }
+  }
+
+  template<typename Traits>
+  void resize_nearest(const Image* src, Image* dst)
+  {
+    std::vector<int> cols, rows;
+    int x, y;
+
+    calculate_nearest_steps(src->w, dst->w, cols);
+    calculate_nearest_steps(src->h, dst->h, rows);
+
+    for (y=0; y<dst->h; ++y) {
+      for (x=0; x<dst->w; ++x)
+        image_putpixel_fast<Traits>(dst, x, y, image_getpixel_fast<Traits>(src, cols[x], rows[y]));
+    }
+  }
+
+  // Position of each destination pixel in the source image for the
+  // bilinear interpolation: the two source pixels to mix and the
+  // weight of the second one (8 bits of fixed-point precision).
+  struct BilinearStep {
+    int pos1, pos2, frac;
+  };
+
+  void calculate_bilinear_steps(int src_size, int dst_size, std::vector<BilinearStep>& steps)
+  {
+    steps.resize(dst_size);
+
+    for (int i=0; i<dst_size; ++i) {
+      int pos = (dst_size > 1 ? int(double(i) * (src_size-1) * 256 / (dst_size-1)): 0);
+
+      steps[i].pos1 = MIN(src_size-1, pos >> 8);
+      steps[i].pos2 = MIN(src_size-1, steps[i].pos1+1);
+      steps[i].frac = (steps[i].pos1 == src_size-1 ? 0: pos & 255);
+    }
+  }
+
+  // Interpolates the source row "y" horizontally to the destination
+  // width. The result is a row of channels scaled by 256.
+  template<typename Traits>
+  void bilinear_row(const Image* src, int y, const ResizeChannels<Traits>& channels,
+                    const std::vector<BilinearStep>& cols, int dst_w,
+                    std::vector<int>& srcRow, int* dstRow)
+  {
+    const int n = ResizeChannels<Traits>::nchannels;
+
+    split_row<Traits>(src, y, channels, &srcRow[0]);
+
+    for (int c=0; c<n; ++c) {
+      const int* s = &srcRow[c*src->w];
+      int* d = &dstRow[c*dst_w];
+
+      for (int x=0; x<dst_w; ++x)
+        d[x] = s[cols[x].pos1]*(256-cols[x].frac) + s[cols[x].pos2]*cols[x].frac;
+    }
+  }
+
+  // Bilinear resize as two separated passes: each source row is
+  // interpolated horizontally (just one time, consecutive destination
+  // rows reuse the same two interpolated rows), and then the two rows
+  // are interpolated vertically.
+  template<typename Traits>
+  void resize_bilinear(const Image* src, Image* dst, const ResizeChannels<Traits>& channels)
+  {
+    const int n = ResizeChannels<Traits>::nchannels;
+    std::vector<BilinearStep> cols, rows;
+    std::vector<int> srcRow(n*src->w);
+    std::vector<int> row1(n*dst->w), row2(n*dst->w);
+    int row1y = -1, row2y = -1;
+    int values[n];
+    int x, y, c;
+
+    calculate_bilinear_steps(src->w, dst->w, cols);
+    calculate_bilinear_steps(src->h, dst->h, rows);
+
+    for (y=0; y<dst->h; ++y) {
+      const BilinearStep& step = rows[y];
+
+      if (row1y != step.pos1) {
+        if (row2y == step.pos1) {
+          row1.swap(row2);
+          std::swap(row1y, row2y);
+        }
+        else {
+          bilinear_row<Traits>(src, step.pos1, channels, cols, dst->w, srcRow, &row1[0]);
+          row1y = step.pos1;
         }
-        u = 0.0;
-        v += dv;
       }
-      break;
+
+      if (row2y != step.pos2) {
+        if (step.pos2 == row1y)
+          row2 = row1;
+        else
+          bilinear_row<Traits>(src, step.pos2, channels, cols, dst->w, srcRow, &row2[0]);
+        row2y = step.pos2;
+      }
+
+      for (x=0; x<dst->w; ++x) {
+        for (c=0; c<n; ++c)
+          values[c] = (row1[c*dst->w + x]*(256-step.frac) +
+                       row2[c*dst->w + x]*step.frac) >> 16;
+
+        image_putpixel_fast<Traits>(dst, x, y, channels.join(values));
+      }
     }
+  }
 
-    // TODO optimize this
-    case RESIZE_METHOD_BILINEAR: {
-      uint32_t color[4], dst_color = 0;
-      double u, v, du, dv;
-      int u_floor, u_floor2;
-      int v_floor, v_floor2;
-      int x, y;
-
-      u = v = 0.0;
-      du = (src->w-1) * 1.0 / (dst->w-1);
-      dv = (src->h-1) * 1.0 / (dst->h-1);
-      for (y=0; y<dst->h; ++y) {
-        for (x=0; x<dst->w; ++x) {
-          u_floor = floor(u);
-          v_floor = floor(v);
-
-          if (u_floor > src->w-1) {
-            u_floor = src->w-1;
-            u_floor2 = src->w-1;
-          }
-          else if (u_floor == src->w-1)
-            u_floor2 = u_floor;
-          else
-            u_floor2 = u_floor+1;
-
-          if (v_floor > src->h-1) {
-            v_floor = src->h-1;
-            v_floor2 = src->h-1;
-          }
-          else if (v_floor == src->h-1)
-            v_floor2 = v_floor;
-          else
-            v_floor2 = v_floor+1;
-
-          // get the four colors
-          color[0] = src->getpixel(u_floor,  v_floor);
-          color[1] = src->getpixel(u_floor2, v_floor);
-          color[2] = src->getpixel(u_floor,  v_floor2);
-          color[3] = src->getpixel(u_floor2, v_floor2);
-
-          // calculate the interpolated color
-          double u1 = u - u_floor;
-          double v1 = v - v_floor;
-          double u2 = 1 - u1;
-          double v2 = 1 - v1;
-
-          switch (dst->getPixelFormat()) {
-            case IMAGE_RGB: {
-              int r = ((_rgba_getr(color[0])*u2 + _rgba_getr(color[1])*u1)*v2 +
-                       (_rgba_getr(color[2])*u2 + _rgba_getr(color[3])*u1)*v1);
-              int g = ((_rgba_getg(color[0])*u2 + _rgba_getg(color[1])*u1)*v2 +
-                       (_rgba_getg(color[2])*u2 + _rgba_getg(color[3])*u1)*v1);
-              int b = ((_rgba_getb(color[0])*u2 + _rgba_getb(color[1])*u1)*v2 +
-                       (_rgba_getb(color[2])*u2 + _rgba_getb(color[3])*u1)*v1);
-              int a = ((_rgba_geta(color[0])*u2 + _rgba_geta(color[1])*u1)*v2 +
-                       (_rgba_geta(color[2])*u2 + _rgba_geta(color[3])*u1)*v1);
-              dst_color = _rgba(r, g, b, a);
-              break;
-            }
-            case IMAGE_GRAYSCALE: {
-              int v = ((_graya_getv(color[0])*u2 + _graya_getv(color[1])*u1)*v2 +
-                       (_graya_getv(color[2])*u2 + _graya_getv(color[3])*u1)*v1);
-              int a = ((_graya_geta(color[0])*u2 + _graya_geta(color[1])*u1)*v2 +
-                       (_graya_geta(color[2])*u2 + _graya_geta(color[3])*u1)*v1);
-              dst_color = _graya(v, a);
-              break;
-            }
-            case IMAGE_INDEXED: {
-              int r = ((_rgba_getr(pal->getEntry(color[0]))*u2 + _rgba_getr(pal->getEntry(color[1]))*u1)*v2 +
-                       (_rgba_getr(pal->getEntry(color[2]))*u2 + _rgba_getr(pal->getEntry(color[3]))*u1)*v1);
-              int g = ((_rgba_getg(pal->getEntry(color[0]))*u2 + _rgba_getg(pal->getEntry(color[1]))*u1)*v2 +
-                       (_rgba_getg(pal->getEntry(color[2]))*u2 + _rgba_getg(pal->getEntry(color[3]))*u1)*v1);
-              int b = ((_rgba_getb(pal->getEntry(color[0]))*u2 + _rgba_getb(pal->getEntry(color[1]))*u1)*v2 +
-                       (_rgba_getb(pal->getEntry(color[2]))*u2 + _rgba_getb(pal->getEntry(color[3]))*u1)*v1);
-              int a = (((color[0] == 0 ? 0: 255)*u2 + (color[1] == 0 ? 0: 255)*u1)*v2 +
-                       ((color[2] == 0 ? 0: 255)*u2 + (color[3] == 0 ? 0: 255)*u1)*v1);
-              dst_color = a > 127 ? rgbmap->mapColor(r, g, b): 0;
-              break;
-            }
-            case IMAGE_BITMAP: {
-              int g = ((255*color[0]*u2 + 255*color[1]*u1)*v2 +
-                       (255*color[2]*u2 + 255*color[3]*u1)*v1);
-              dst_color = g > 127 ? 1: 0;
-              break;
-            }
-          }
+  // Source pixels covered by each destination pixel in the area
+  // resize method, and their weights (the covered area of each source
+  // pixel). The sum of weights of each destination pixel is
+  // 1<<precision.
+  struct AreaSpans {
+    std::vector<int> first;     // First source pixel of each destination pixel
+    std::vector<int> count;     // Number of source pixels
+    std::vector<int> offset;    // Index of the first weight in "weights"
+    std::vector<int> weights;
+
+    AreaSpans(int src_size, int dst_size, int precision)
+      : first(dst_size), count(dst_size), offset(dst_size) {
+      const double scale = double(1 << precision) / src_size;
+
+      for (int i=0; i<dst_size; ++i) {
+        // The destination pixel "i" covers [i*src_size, (i+1)*src_size)
+        // and the source pixel "j" [j*dst_size, (j+1)*dst_size).
+        double start = double(i) * src_size;
+        double end = start + src_size;
+        int j = int(start / dst_size);
+        int prev = 0;
+
+        first[i] = j;
+        offset[i] = weights.size();
+
+        for (; j < src_size && j*double(dst_size) < end; ++j) {
+          // Accumulated weights are rounded so they sum exactly 1<<precision
+          double covered = MIN(end, (j+1)*double(dst_size)) - start;
+          int weight = int(covered * scale + 0.5) - prev;
+          weights.push_back(weight);
+          prev += weight;
+        }
 
-          dst->putpixel(x, y, dst_color);
-          u += du;
+        count[i] = weights.size() - offset[i];
+      }
+    }
+  };
+
+  // Averages the pixels of the source row "y" covered by each
+  // destination pixel. The result is a row of channels scaled by 256.
+  template<typename Traits>
+  void area_row(const Image* src, int y, const ResizeChannels<Traits>& channels,
+                const AreaSpans& cols, int dst_w,
+                std::vector<int>& srcRow, int* dstRow)
+  {
+    const int n = ResizeChannels<Traits>::nchannels;
+
+    split_row<Traits>(src, y, channels, &srcRow[0]);
+
+    for (int c=0; c<n; ++c) {
+      const int* s = &srcRow[c*src->w];
+      int* d = &dstRow[c*dst_w];
+
+      for (int x=0; x<dst_w; ++x) {
+        const int* p = &s[cols.first[x]];
+        const int* w = &cols.weights[cols.offset[x]];
+        int sum = 0;
+
+        for (int i=0; i<cols.count[x]; ++i)
+          sum += p[i]*w[i];
+
+        d[x] = sum >> 8;
+      }
+    }
+  }
+
+  // Area (box) resize: each destination pixel is the average of the
+  // source pixels that it covers, weighted by the covered area. It's
+  // the best method to reduce images.
+  template<typename Traits>
+  void resize_area(const Image* src, Image* dst, const ResizeChannels<Traits>& channels)
+  {
+    const int n = ResizeChannels<Traits>::nchannels;
+    AreaSpans cols(src->w, dst->w, 16);
+    AreaSpans rows(src->h, dst->h, 12);
+    std::vector<int> srcRow(n*src->w);
+    std::vector<int> row(n*dst->w);
+    std::vector<int> sums(n*dst->w);
+    int rowy = -1;
+    int values[n];
+    int x, y, c, i;
+
+    for (y=0; y<dst->h; ++y) {
+      std::fill(sums.begin(), sums.end(), 0);
+
+      for (i=0; i<rows.count[y]; ++i) {
+        int v = rows.first[y] + i;
+        int weight = rows.weights[rows.offset[y] + i];
+
+        // Consecutive destination rows can share one source row
+        if (rowy != v) {
+          area_row<Traits>(src, v, channels, cols, dst->w, srcRow, &row[0]);
+          rowy = v;
         }
-        u = 0.0;
-        v += dv;
+
+        for (x=0; x<n*dst->w; ++x)
+          sums[x] += row[x]*weight;
+      }
+
+      for (x=0; x<dst->w; ++x) {
+        for (c=0; c<n; ++c)
+          values[c] = MID(0, (sums[c*dst->w + x] + (1<<19)) >> 20, 255);
+
+        image_putpixel_fast<Traits>(dst, x, y, channels.join(values));
       }
-      break;
     }
+  }
 
+  template<typename Traits>
+  void resize_image(const Image* src, Image* dst, ResizeMethod method,
+                    const Palette* pal, const RgbMap* rgbmap)
+  {
+    switch (method) {
+      case RESIZE_METHOD_NEAREST_NEIGHBOR:
+        resize_nearest<Traits>(src, dst);
+        break;
+      case RESIZE_METHOD_BILINEAR:
+        resize_bilinear<Traits>(src, dst, ResizeChannels<Traits>(pal, rgbmap));
+        break;
+      case RESIZE_METHOD_AREA:
+        resize_area<Traits>(src, dst, ResizeChannels<Traits>(pal, rgbmap));
+        break;
+    }
   }
+
 }
 
-int image_count_diff(const Image* i1, const Image* i2)
+/**
+ * Resizes the source image @a src to the destination image @a dst.
+ *
+ * @warning If you are using the RESIZE_METHOD_BILINEAR or
+ * RESIZE_METHOD_AREA, it is recommended to use @ref
+ * image_fixup_transparent_colors function over the source image @a
+ * src before using this routine.
+ */
+void image_resize(const Image* src, Image* dst, ResizeMethod method, const Palette* pal, const RgbMap* rgbmap)
 {
-  int c, size, diff = 0;
+  ASSERT(src->getPixelFormat() == dst->getPixelFormat());
+
+  switch (src->getPixelFormat()) {
+    case IMAGE_RGB:       resize_image<RgbTraits>(src, dst, method, pal, rgbmap); break;
+    case IMAGE_GRAYSCALE: resize_image<GrayscaleTraits>(src, dst, method, pal, rgbmap); break;
+    case IMAGE_INDEXED:   resize_image<IndexedTraits>(src, dst, method, pal, rgbmap); break;
+    case IMAGE_BITMAP:    resize_image<BitmapTraits>(src, dst, method, pal, rgbmap); break;
+  }
+}
+
+namespace {
 
+  struct CountDiff {
+    int diff;
+
+    CountDiff() : diff(0) { }
+
+    template<typename Pixel>
+    void operator()(Pixel a, Pixel b) {
+      if (a != b)
+        ++diff;
+    }
+  };
+
+  template<typename Traits>
+  int count_diff(const Image* i1, const Image* i2)
+  {
+    CountDiff counter;
+    for_each_pixel_pair<Traits, Traits>(i1, i2, counter);
+    return counter.diff;
+  }
+
+}
+
+int image_count_diff(const Image* i1, const Image* i2)
+{
   if ((i1->getPixelFormat() != i2->getPixelFormat()) ||
       (i1->w != i2->w) || (i1->h != i2->h))
     return -1;
 
-  size = i1->w * i1->h;
-
   switch (i1->getPixelFormat()) {
+    case IMAGE_RGB:       return count_diff<RgbTraits>(i1, i2);
+    case IMAGE_GRAYSCALE: return count_diff<GrayscaleTraits>(i1, i2);
+    case IMAGE_INDEXED:   return count_diff<IndexedTraits>(i1, i2);
+    case IMAGE_BITMAP:    return count_diff<BitmapTraits>(i1, i2);
+  }
 
-    case IMAGE_RGB:
-      {
-        uint32_t* address1 = (uint32_t*)i1->dat;
-        uint32_t* address2 = (uint32_t*)i2->dat;
-        for (c=0; c<size; c++)
-          if (*(address1++) != *(address2++))
-            diff++;
-      }
-      break;
+  return 0;
+}
 
-    case IMAGE_GRAYSCALE:
-      {
-        uint16_t* address1 = (uint16_t*)i1->dat;
-        uint16_t* address2 = (uint16_t*)i2->dat;
-        for (c=0; c<size; c++)
-          if (*(address1++) != *(address2++))
-            diff++;
-      }
-      break;
+// Returns true if both images have the same format, size, and pixels.
+// It's faster than image_count_diff() because it doesn't need to
+// count the different pixels.
+bool image_is_equal(const Image* i1, const Image* i2)
+{
+  if ((i1->getPixelFormat() != i2->getPixelFormat()) ||
+      (i1->w != i2->w) || (i1->h != i2->h))
+    return false;
 
-    case IMAGE_INDEXED:
-      {
-        uint8_t* address1 = (uint8_t*)i1->dat;
-        uint8_t* address2 = (uint8_t*)i2->dat;
-        for (c=0; c<size; c++)
-          if (*(address1++) != *(address2++))
-            diff++;
-      }
-      break;
+  int size = image_line_size(i1, i1->w);
+  for (int y=0; y<i1->h; ++y)
+    if (memcmp(i1->line[y], i2->line[y], size) != 0)
+      return false;
 
-    case IMAGE_BITMAP:
-      /* TODO test it */
-      {
-        uint8_t* address1 = (uint8_t*)i1->dat;
-        uint8_t* address2 = (uint8_t*)i2->dat;
-        div_t d1 = div (0, 8);
-        div_t d2 = div (0, 8);
-        for (c=0; c<size; c++) {
-          if (((*address1) & (1<<d1.rem)) !=
-              ((*address2) & (1<<d2.rem)))
-            diff++;
-          _image_bitmap_next_bit(d1, address1);
-          _image_bitmap_next_bit(d2, address2);
-        }
-      }
-      break;
+  return true;
+}
+
+// Returns a hash of the image format, size and pixels (FNV-1a), so
+// equal images have the same hash. It can be used to find images
+// with the same content quickly (comparing them with image_is_equal()
+// only when hashes are equal).
+uint32_t image_hash(const Image* image)
+{
+  uint32_t hash = 2166136261u;
+  int size = image_line_size(image, image->w);
+
+  hash = (hash ^ image->getPixelFormat()) * 16777619u;
+  hash = (hash ^ image->w) * 16777619u;
+  hash = (hash ^ image->h) * 16777619u;
+
+  for (int y=0; y<image->h; ++y) {
+    const uint8_t* p = image->line[y];
+    for (int x=0; x<size; ++x, ++p)
+      hash = (hash ^ *p) * 16777619u;
   }
 
-  return diff;
+  return hash;
 }
 
 static bool is_same_pixel(PixelFormat pixelFormat, int pixel1, int pixel2)
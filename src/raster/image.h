@@ -23,22 +23,20 @@
 #include "raster/blend.h"
 #include "raster/gfxobj.h"
 #include "raster/pixel_format.h"
+#include "raster/resize_method.h"
 
 #include <allegro/color.h>
 
 struct BITMAP;
 
+namespace gfx { class Region; }
+
 namespace raster {
 
   class Palette;
   class Pen;
   class RgbMap;
 
-  enum ResizeMethod {
-    RESIZE_METHOD_NEAREST_NEIGHBOR,
-    RESIZE_METHOD_BILINEAR,
-  };
-
   class Image : public GfxObj {
   public:
     int w, h;
@@ -60,7 +58,7 @@ namespace raster {
     virtual void putpixel(int x, int y, int color) = 0;
     virtual void clear(int color) = 0;
     virtual void copy(const Image* src, int x, int y) = 0;
-    virtual void merge(const Image* src, int x, int y, int opacity, int blend_mode) = 0;
+    virtual void merge(const Image* src, int x, int y, int opacity, int blend_mode, uint32_t mask_color) = 0;
     virtual void hline(int x1, int y, int x2, int color) = 0;
     virtual void rectfill(int x1, int y1, int x2, int y2, int color) = 0;
     virtual void rectblend(int x1, int y1, int x2, int y2, int color, int opacity) = 0;
@@ -77,9 +75,20 @@ namespace raster {
   void image_clear(Image* image, int color);
 
   void image_copy(Image* dst, const Image* src, int x, int y);
+
+  // Copies the pixels of "src" inside the given region (displaced by
+  // dx/dy and clipped to the image bounds) to the same position in
+  // "dst". Both images must have the same format and size.
+  void image_copy_region(Image* dst, const Image* src, const gfx::Region& region, int dx, int dy);
   void image_merge(Image* dst, const Image* src, int x, int y, int opacity,
                    int blend_mode);
 
+  // Merges "src" skipping the given "mask_color" instead of
+  // src->mask_color (so "src" is not modified, e.g. to render the same
+  // image from several threads).
+  void image_merge(Image* dst, const Image* src, int x, int y, int opacity,
+                   int blend_mode, uint32_t mask_color);
+
   Image* image_crop(const Image* image, int x, int y, int w, int h, int bgcolor);
   void image_rotate(const Image* src, Image* dst, int angle);
 
@@ -97,6 +106,8 @@ namespace raster {
   void image_fixup_transparent_colors(Image* image);
   void image_resize(const Image* src, Image* dst, ResizeMethod method, const Palette* palette, const RgbMap* rgbmap);
   int image_count_diff(const Image* i1, const Image* i2);
+  bool image_is_equal(const Image* i1, const Image* i2);
+  uint32_t image_hash(const Image* image);
   bool image_shrink_rect(Image *image, gfx::Rect& bounds, int refpixel);
 
 } // namespace raster
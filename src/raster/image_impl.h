@@ -143,14 +143,17 @@ namespace raster {
       }
     }
 
-    virtual void merge(const Image* src, int x, int y, int opacity, int blend_mode)
+    virtual void merge(const Image* src, int x, int y, int opacity, int blend_mode, uint32_t src_mask_color)
     {
-      BLEND_COLOR blender = Traits::get_blender(blend_mode);
-      register uint32_t mask_color = src->mask_color;
+      typedef typename Traits::pixel_t pixel_t;
+      pixel_t mask_color = src_mask_color;
+      // If the mask color cannot be represented with pixel_t no pixel
+      // can be equal to it.
+      const pixel_t* mask = (mask_color == src_mask_color ? &mask_color: NULL);
       Image* dst = this;
       address_t src_address;
       address_t dst_address;
-      int xbeg, xend, xsrc, xdst;
+      int xbeg, xend, xsrc;
       int ybeg, yend, ysrc, ydst;
 
       // nothing to do
@@ -189,17 +192,13 @@ namespace raster {
 
       // merge process
 
+      typename Traits::row_blender_t row_blender = Traits::get_row_blender(blend_mode);
+
       for (ydst=ybeg; ydst<=yend; ydst++, ysrc++) {
         src_address = ((ImageImpl<Traits>*)src)->line_address(ysrc)+xsrc;
         dst_address = ((ImageImpl<Traits>*)dst)->line_address(ydst)+xbeg;
 
-        for (xdst=xbeg; xdst<=xend; xdst++) {
-          if (*src_address != mask_color)
-            *dst_address = (*blender)(*dst_address, *src_address, opacity);
-
-          dst_address++;
-          src_address++;
-        }
+        (*row_blender)(dst_address, src_address, xend-xbeg+1, mask, opacity);
       }
     }
 
@@ -257,7 +256,7 @@ namespace raster {
   }
 
   template<>
-  void ImageImpl<IndexedTraits>::merge(const Image* src, int x, int y, int opacity, int blend_mode)
+  void ImageImpl<IndexedTraits>::merge(const Image* src, int x, int y, int opacity, int blend_mode, uint32_t src_mask_color)
   {
     Image* dst = this;
     address_t src_address;
@@ -313,7 +312,7 @@ namespace raster {
     }
     // with mask
     else {
-      register int mask_color = src->mask_color;
+      register int mask_color = src_mask_color;
 
       for (ydst=ybeg; ydst<=yend; ydst++, ysrc++) {
         src_address = ((ImageImpl<IndexedTraits>*)src)->line_address(ysrc)+xsrc;
@@ -446,7 +445,7 @@ namespace raster {
   }
 
   template<>
-  void ImageImpl<BitmapTraits>::merge(const Image* src, int x, int y, int opacity, int blend_mode)
+  void ImageImpl<BitmapTraits>::merge(const Image* src, int x, int y, int opacity, int blend_mode, uint32_t src_mask_color)
   {
     Image* dst = this;
     address_t src_address;
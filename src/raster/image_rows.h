@@ -0,0 +1,183 @@
+/* Aseprite
+ * Copyright (C) 2001-2013  David Capello
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#ifndef RASTER_IMAGE_ROWS_H_INCLUDED
+#define RASTER_IMAGE_ROWS_H_INCLUDED
+
+#include "raster/image.h"
+#include "raster/image_traits.h"
+
+namespace raster {
+
+  // Sequential access to the pixels of one row of an image. The
+  // address of the row is calculated just one time, so iterating a
+  // row doesn't need a virtual call (or a line lookup) per pixel.
+  template<class Traits>
+  class RowReader {
+  public:
+    RowReader(const Image* image, int x, int y)
+      : m_addr(image_address_fast<Traits>(image, x, y)) {
+    }
+
+    typename Traits::pixel_t next() {
+      return *(m_addr++);
+    }
+
+  private:
+    typename Traits::const_address_t m_addr;
+  };
+
+  template<class Traits>
+  class RowWriter {
+  public:
+    RowWriter(Image* image, int x, int y)
+      : m_addr(image_address_fast<Traits>(image, x, y)) {
+    }
+
+    void next(typename Traits::pixel_t color) {
+      *(m_addr++) = color;
+    }
+
+  private:
+    typename Traits::address_t m_addr;
+  };
+
+  // Bitmaps have 8 pixels in each byte, so we have to keep the
+  // current bit too.
+  template<>
+  class RowReader<BitmapTraits> {
+  public:
+    RowReader(const Image* image, int x, int y)
+      : m_addr(image_address_fast<BitmapTraits>(image, x/8, y))
+      , m_bit(1 << (x%8)) {
+    }
+
+    BitmapTraits::pixel_t next() {
+      BitmapTraits::pixel_t color = ((*m_addr & m_bit) ? 1: 0);
+      if (m_bit == 0x80) {
+        m_bit = 1;
+        ++m_addr;
+      }
+      else
+        m_bit <<= 1;
+      return color;
+    }
+
+  private:
+    BitmapTraits::const_address_t m_addr;
+    int m_bit;
+  };
+
+  // Bits are accumulated and each byte is written just one time (when
+  // it's completed, or when the writer is destroyed).
+  template<>
+  class RowWriter<BitmapTraits> {
+  public:
+    RowWriter(Image* image, int x, int y)
+      : m_addr(image_address_fast<BitmapTraits>(image, x/8, y))
+      , m_bit(1 << (x%8))
+      , m_mask(0)
+      , m_bits(0) {
+    }
+
+    ~RowWriter() {
+      flush();
+    }
+
+    void next(BitmapTraits::pixel_t color) {
+      m_mask |= m_bit;
+      if (color)
+        m_bits |= m_bit;
+
+      if (m_bit == 0x80) {
+        flush();
+        m_bit = 1;
+        ++m_addr;
+      }
+      else
+        m_bit <<= 1;
+    }
+
+  private:
+    void flush() {
+      if (m_mask) {
+        *m_addr = (*m_addr & ~m_mask) | m_bits;
+        m_mask = m_bits = 0;
+      }
+    }
+
+    BitmapTraits::address_t m_addr;
+    int m_bit;
+    int m_mask;
+    int m_bits;
+  };
+
+  // Calls "func(pixel)" for each pixel of the image (row by row).
+  template<class Traits, class Func>
+  void for_each_pixel(const Image* image, Func& func)
+  {
+    ASSERT(image->getPixelFormat() == Traits::pixel_format);
+
+    for (int y=0; y<image->h; ++y) {
+      RowReader<Traits> src(image, 0, y);
+      for (int x=0; x<image->w; ++x)
+        func(src.next());
+    }
+  }
+
+  // Calls "func(pixel1, pixel2)" for each pair of pixels in the same
+  // position of two images with the same size.
+  template<class Traits1, class Traits2, class Func>
+  void for_each_pixel_pair(const Image* image1, const Image* image2, Func& func)
+  {
+    ASSERT(image1->getPixelFormat() == Traits1::pixel_format);
+    ASSERT(image2->getPixelFormat() == Traits2::pixel_format);
+    ASSERT(image1->w == image2->w && image1->h == image2->h);
+
+    for (int y=0; y<image1->h; ++y) {
+      RowReader<Traits1> src1(image1, 0, y);
+      RowReader<Traits2> src2(image2, 0, y);
+      for (int x=0; x<image1->w; ++x) {
+        typename Traits1::pixel_t c1 = src1.next();
+        func(c1, src2.next());
+      }
+    }
+  }
+
+  // Replaces each pixel of "dst" with "func(pixel)", where "pixel" is
+  // the pixel of "src" in the same position. Both images must have
+  // the same size, but they can have different pixel formats (e.g. to
+  // convert a RGB image to indexed).
+  template<class SrcTraits, class DstTraits, class Func>
+  void transform_pixels(const Image* src, Image* dst, Func& func)
+  {
+    ASSERT(src->getPixelFormat() == SrcTraits::pixel_format);
+    ASSERT(dst->getPixelFormat() == DstTraits::pixel_format);
+    ASSERT(src->w == dst->w && src->h == dst->h);
+
+    for (int y=0; y<src->h; ++y) {
+      RowReader<SrcTraits> srcRow(src, 0, y);
+      RowWriter<DstTraits> dstRow(dst, 0, y);
+      for (int x=0; x<src->w; ++x)
+        dstRow.next(func(srcRow.next()));
+    }
+  }
+
+} // namespace raster
+
+#endif
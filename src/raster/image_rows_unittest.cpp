@@ -0,0 +1,166 @@
+/* Aseprite
+ * Copyright (C) 2001-2013  David Capello
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#include "tests/test.h"
+
+#include "base/unique_ptr.h"
+#include "raster/image_rows.h"
+#include "raster/raster.h"
+
+#include <cstdlib>
+#include <vector>
+
+using namespace raster;
+
+static const int widths[] = { 1, 3, 7, 8, 9, 15, 16, 17, 31, 45 };
+static const int nwidths = sizeof(widths) / sizeof(widths[0]);
+
+// Fills all bytes of each row (including the unused bits after the
+// last pixel) with random bits.
+static Image* create_random_bitmap(int w, int h)
+{
+  Image* image = Image::create(IMAGE_BITMAP, w, h);
+  for (int y=0; y<h; ++y)
+    for (int i=0; i<image_line_size(image, w); ++i)
+      image->line[y][i] = std::rand() & 255;
+  return image;
+}
+
+// Copies all bytes of each row (Image::createCopy() copies only the
+// pixels).
+static Image* copy_bitmap(const Image* image)
+{
+  Image* copy = Image::create(IMAGE_BITMAP, image->w, image->h);
+  for (int y=0; y<image->h; ++y)
+    for (int i=0; i<image_line_size(image, image->w); ++i)
+      copy->line[y][i] = image->line[y][i];
+  return copy;
+}
+
+// Returns the unused bits of the last byte of the row "y".
+static int padding_bits(const Image* image, int y)
+{
+  if (image->w % 8 == 0)
+    return 0;
+  return image->line[y][image->w/8] & ~((1 << (image->w % 8)) - 1);
+}
+
+TEST(ImageRows, BitmapRowWriter)
+{
+  std::srand(1);
+
+  for (int i=0; i<nwidths; ++i) {
+    int w = widths[i];
+
+    for (int x1=0; x1<w; x1+=3) {
+      base::UniquePtr<Image> image(create_random_bitmap(w, 1));
+      base::UniquePtr<Image> original(copy_bitmap(image));
+      int n = 1 + std::rand() % (w-x1);
+      std::vector<int> bits(n);
+
+      {
+        // The last byte is written when the writer is destroyed
+        RowWriter<BitmapTraits> row(image, x1, 0);
+        for (int x=0; x<n; ++x)
+          row.next(bits[x] = std::rand() & 1);
+      }
+
+      for (int x=0; x<w; ++x) {
+        int expected = (x >= x1 && x < x1+n ? bits[x-x1]: original->getpixel(x, 0));
+        EXPECT_EQ(expected, image->getpixel(x, 0)) << "w=" << w << " x1=" << x1 << " x=" << x;
+      }
+
+      // Unused bits are not modified
+      EXPECT_EQ(padding_bits(original, 0), padding_bits(image, 0));
+    }
+  }
+}
+
+TEST(ImageRows, BitmapRowReader)
+{
+  std::srand(2);
+
+  for (int i=0; i<nwidths; ++i) {
+    int w = widths[i];
+    base::UniquePtr<Image> image(create_random_bitmap(w, 1));
+
+    for (int x1=0; x1<w; ++x1) {
+      RowReader<BitmapTraits> row(image, x1, 0);
+      for (int x=x1; x<w; ++x)
+        EXPECT_EQ(image->getpixel(x, 0), row.next());
+    }
+  }
+}
+
+static int is_opaque(RgbTraits::pixel_t color)
+{
+  return (_rgba_geta(color) ? 1: 0);
+}
+
+TEST(ImageRows, TransformToBitmap)
+{
+  std::srand(3);
+
+  for (int i=0; i<nwidths; ++i) {
+    int w = widths[i], h = 3;
+    base::UniquePtr<Image> src(Image::create(IMAGE_RGB, w, h));
+    for (int y=0; y<h; ++y)
+      for (int x=0; x<w; ++x)
+        src->putpixel(x, y, _rgba(0, 0, 0, (std::rand() & 1) * 255));
+
+    base::UniquePtr<Image> dst(create_random_bitmap(w, h));
+    base::UniquePtr<Image> original(copy_bitmap(dst));
+    transform_pixels<RgbTraits, BitmapTraits>(src, dst, is_opaque);
+
+    for (int y=0; y<h; ++y) {
+      for (int x=0; x<w; ++x)
+        EXPECT_EQ(is_opaque(src->getpixel(x, y)), dst->getpixel(x, y));
+
+      EXPECT_EQ(padding_bits(original, y), padding_bits(dst, y));
+    }
+  }
+}
+
+TEST(ImageRows, CountDiffOfBitmaps)
+{
+  std::srand(4);
+
+  for (int i=0; i<nwidths; ++i) {
+    int w = widths[i], h = 4;
+    base::UniquePtr<Image> image1(create_random_bitmap(w, h));
+    base::UniquePtr<Image> image2(create_random_bitmap(w, h));
+
+    int diff = 0;
+    for (int y=0; y<h; ++y)
+      for (int x=0; x<w; ++x)
+        if (image1->getpixel(x, y) != image2->getpixel(x, y))
+          ++diff;
+
+    EXPECT_EQ(diff, image_count_diff(image1, image2)) << "w=" << w;
+
+    // Unused bits of the last byte aren't pixels
+    if (w % 8 != 0) {
+      image2.reset(copy_bitmap(image1));
+      for (int y=0; y<h; ++y)
+        image2->line[y][w/8] ^= ~((1 << (w % 8)) - 1) & 255;
+
+      EXPECT_NE(padding_bits(image1, 0), padding_bits(image2, 0));
+      EXPECT_EQ(0, image_count_diff(image1, image2)) << "w=" << w;
+    }
+  }
+}
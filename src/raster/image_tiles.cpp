@@ -0,0 +1,246 @@
+/* Aseprite
+ * Copyright (C) 2001-2013  David Capello
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "raster/image_tiles.h"
+
+#include "raster/image.h"
+#include "zlib.h"
+
+#include <cstring>
+#include <iostream>
+#include <stdexcept>
+
+namespace raster {
+
+// Bitmap images are stored with one byte per pixel inside tiles, so
+// tiles don't need to be aligned to 8 pixels.
+static int tile_line_size(PixelFormat format, int width)
+{
+  if (format == IMAGE_BITMAP)
+    return width;
+  else
+    return pixelformat_line_size(format, width);
+}
+
+static uint32_t pixels_checksum(const std::vector<uint8_t>& pixels)
+{
+  return adler32(adler32(0, Z_NULL, 0), &pixels[0], pixels.size());
+}
+
+ImageTiles::ImageTiles(const Image* image, const gfx::Rect& bounds)
+  : m_format(image->getPixelFormat())
+  , m_bounds(bounds)
+  , m_cols((bounds.w+TileSize-1) / TileSize)
+{
+  ASSERT(!bounds.isEmpty());
+  ASSERT(gfx::Rect(0, 0, image->w, image->h).contains(bounds));
+
+  int rows = (bounds.h+TileSize-1) / TileSize;
+  m_tiles.resize(m_cols*rows);
+
+  Pixels pixels;
+
+  for (int v=0; v<rows; ++v) {
+    for (int u=0; u<m_cols; ++u) {
+      gfx::Rect tileBounds(bounds.x + u*TileSize,
+                           bounds.y + v*TileSize, TileSize, TileSize);
+      tileBounds = tileBounds.createIntersect(bounds);
+
+      TilePtr tile(new Tile(tileBounds, tile_line_size(m_format, tileBounds.w)));
+      getImagePixels(image, tile, pixels);
+      setTilePixels(tile, pixels);
+      m_tiles[v*m_cols + u] = tile;
+    }
+  }
+}
+
+ImageTiles::ImageTiles(const ImageTiles& other)
+  : m_format(other.m_format)
+  , m_bounds(other.m_bounds)
+  , m_cols(other.m_cols)
+  , m_tiles(other.m_tiles)
+{
+}
+
+ImageTiles::~ImageTiles()
+{
+}
+
+int ImageTiles::getSharedTilesCount() const
+{
+  int count = 0;
+  for (Tiles::const_iterator it=m_tiles.begin(), end=m_tiles.end(); it!=end; ++it)
+    if (!it->unique())
+      ++count;
+  return count;
+}
+
+int ImageTiles::getMemSize() const
+{
+  int size = sizeof(ImageTiles) + m_tiles.size()*sizeof(TilePtr);
+
+  for (Tiles::const_iterator it=m_tiles.begin(), end=m_tiles.end(); it!=end; ++it)
+    size += sizeof(Tile) + (*it)->data.getCompressedSize();
+
+  return size;
+}
+
+void ImageTiles::updateFromImage(const Image* image, const gfx::Rect& bounds)
+{
+  ASSERT(image->getPixelFormat() == m_format);
+
+  gfx::Rect area = m_bounds.createIntersect(bounds);
+  if (area.isEmpty())
+    return;
+
+  int u1 = (area.x - m_bounds.x) / TileSize;
+  int v1 = (area.y - m_bounds.y) / TileSize;
+  int u2 = (area.x+area.w-1 - m_bounds.x) / TileSize;
+  int v2 = (area.y+area.h-1 - m_bounds.y) / TileSize;
+
+  // The same buffers are used for all tiles
+  Pixels pixels, buffer;
+
+  for (int v=v1; v<=v2; ++v) {
+    for (int u=u1; u<=u2; ++u) {
+      TilePtr& tile = m_tiles[v*m_cols + u];
+
+      getImagePixels(image, tile, pixels);
+      if (tileHasPixels(tile, pixels, buffer))
+        continue;
+
+      // Copy-on-write
+      if (!tile.unique())
+        tile.reset(new Tile(tile->bounds, tile->lineSize));
+
+      setTilePixels(tile, pixels);
+    }
+  }
+}
+
+void ImageTiles::copyToImage(Image* image) const
+{
+  copyToImage(image, m_bounds);
+}
+
+void ImageTiles::copyToImage(Image* image, const gfx::Rect& bounds) const
+{
+  ASSERT(image->getPixelFormat() == m_format);
+
+  Pixels data;
+
+  for (Tiles::const_iterator it=m_tiles.begin(), end=m_tiles.end(); it!=end; ++it) {
+    const Tile* tile = *it;
+    gfx::Rect area = tile->bounds.createIntersect(bounds);
+    if (area.isEmpty())
+      continue;
+
+    data.resize(tile->data.getUncompressedSize());
+    tile->data.uncompress(&data[0]);
+
+    for (int y=area.y; y<area.y+area.h; ++y) {
+      const uint8_t* src = &data[tile->lineSize*(y - tile->bounds.y)];
+
+      if (m_format == IMAGE_BITMAP) {
+        for (int x=area.x; x<area.x+area.w; ++x)
+          image_putpixel_fast<BitmapTraits>(image, x, y, src[x - tile->bounds.x]);
+      }
+      else {
+        src += tile_line_size(m_format, area.x - tile->bounds.x);
+        memcpy(image_address(image, area.x, y), src, tile_line_size(m_format, area.w));
+      }
+    }
+  }
+}
+
+bool ImageTiles::swapOut(std::ostream& os)
+{
+  for (Tiles::const_iterator it=m_tiles.begin(), end=m_tiles.end(); it!=end; ++it)
+    (*it)->data.write(os);
+
+  // Nothing is released if the data cannot be written
+  os.flush();
+  if (!os.good())
+    return false;
+
+  // Replace the tiles with empty ones (other ImageTiles can share
+  // the original tiles)
+  for (Tiles::iterator it=m_tiles.begin(), end=m_tiles.end(); it!=end; ++it) {
+    Tile* tile = new Tile((*it)->bounds, (*it)->lineSize);
+    tile->checksum = (*it)->checksum;
+    it->reset(tile);
+  }
+
+  return true;
+}
+
+void ImageTiles::swapIn(std::istream& is)
+{
+  for (Tiles::iterator it=m_tiles.begin(), end=m_tiles.end(); it!=end; ++it) {
+    Tile* tile = it->get();
+    tile->data.read(is);
+
+    if (tile->data.getUncompressedSize() != (size_t)(tile->lineSize*tile->bounds.h))
+      throw std::runtime_error("Invalid tile size in stream");
+  }
+}
+
+// static
+void ImageTiles::getImagePixels(const Image* image, const Tile* tile, Pixels& pixels)
+{
+  const gfx::Rect& bounds = tile->bounds;
+  pixels.resize(tile->lineSize*bounds.h);
+
+  for (int y=0; y<bounds.h; ++y) {
+    uint8_t* data = &pixels[tile->lineSize*y];
+
+    if (image->getPixelFormat() == IMAGE_BITMAP) {
+      for (int x=0; x<bounds.w; ++x)
+        data[x] = image_getpixel_fast<BitmapTraits>(image, bounds.x+x, bounds.y+y);
+    }
+    else
+      memcpy(data, image_address(const_cast<Image*>(image), bounds.x, bounds.y+y),
+             tile->lineSize);
+  }
+}
+
+// static
+void ImageTiles::setTilePixels(Tile* tile, const Pixels& pixels)
+{
+  tile->checksum = pixels_checksum(pixels);
+  tile->data.compress(&pixels[0], pixels.size());
+}
+
+// static
+bool ImageTiles::tileHasPixels(const Tile* tile, const Pixels& pixels, Pixels& buffer)
+{
+  // Modified tiles are detected without uncompressing them
+  if (pixels_checksum(pixels) != tile->checksum)
+    return false;
+
+  // The checksum can be equal for different pixels
+  buffer.resize(tile->data.getUncompressedSize());
+  tile->data.uncompress(&buffer[0]);
+  return (buffer == pixels);
+}
+
+} // namespace raster
@@ -0,0 +1,121 @@
+/* Aseprite
+ * Copyright (C) 2001-2013  David Capello
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#ifndef RASTER_IMAGE_TILES_H_INCLUDED
+#define RASTER_IMAGE_TILES_H_INCLUDED
+
+#include "base/shared_ptr.h"
+#include "gfx/point.h"
+#include "gfx/rect.h"
+#include "raster/compressed_data.h"
+#include "raster/pixel_format.h"
+
+#include <iosfwd>
+#include <vector>
+
+namespace raster {
+
+  class Image;
+
+  // A copy of a rectangular area of an Image split in square tiles.
+  // The pixels of each tile are kept compressed (see CompressedData).
+  //
+  // Tiles are reference-counted and copy-on-write: copying an
+  // ImageTiles only copies the tile pointers, and updateFromImage()
+  // only re-allocates the tiles that really changed. In this way
+  // consecutive snapshots of the same big image share all the tiles
+  // that were not modified between them.
+  class ImageTiles {
+  public:
+    enum { TileSize = 64 };
+
+    ImageTiles(const Image* image, const gfx::Rect& bounds);
+    ImageTiles(const ImageTiles& other);
+    ~ImageTiles();
+
+    PixelFormat getPixelFormat() const { return m_format; }
+    const gfx::Rect& getBounds() const { return m_bounds; }
+
+    int getTilesCount() const { return m_tiles.size(); }
+
+    // Returns the number of tiles that are shared with other
+    // ImageTiles instances.
+    int getSharedTilesCount() const;
+
+    // Memory used by this instance. Shared tiles are counted with
+    // their full size, so the result doesn't change when other
+    // instances start or stop sharing them (an undoer must report the
+    // same size while it is in an UndoersStack).
+    int getMemSize() const;
+
+    // Copies the pixels of the given "image" inside "bounds" (image
+    // coordinates) to the tiles. Shared tiles are duplicated before
+    // they are modified, and tiles with the same content are kept
+    // untouched (shared).
+    void updateFromImage(const Image* image, const gfx::Rect& bounds);
+
+    // Copies all tiles (or only the tiles portion inside "bounds") to
+    // the same location in the given image.
+    void copyToImage(Image* image) const;
+    void copyToImage(Image* image, const gfx::Rect& bounds) const;
+
+    // Saves the pixels of all tiles in the given stream and releases
+    // them from memory. The tiles cannot be used until swapIn() is
+    // called. Returns false if the stream cannot be written.
+    bool swapOut(std::ostream& os);
+
+    // Loads the tiles saved with swapOut(). Throws a
+    // std::runtime_error if the stream cannot be read.
+    void swapIn(std::istream& is);
+
+  private:
+    struct Tile {
+      gfx::Rect bounds;           // Bounds of the tile in image coordinates.
+      int lineSize;
+      uint32_t checksum;          // Checksum of the uncompressed pixels.
+      CompressedData data;        // Pixels of the tile (lineSize*bounds.h bytes).
+
+      Tile(const gfx::Rect& bounds, int lineSize)
+        : bounds(bounds), lineSize(lineSize), checksum(0) { }
+    };
+
+    typedef SharedPtr<Tile> TilePtr;
+    typedef std::vector<TilePtr> Tiles;
+    typedef std::vector<uint8_t> Pixels;
+
+    // Copies the pixels of "image" inside the tile bounds to
+    // "pixels" (with the layout used in the tile data).
+    static void getImagePixels(const Image* image, const Tile* tile, Pixels& pixels);
+    static void setTilePixels(Tile* tile, const Pixels& pixels);
+
+    // Returns true if the tile contains the given "pixels". The tile
+    // is uncompressed (in "buffer") only when the checksums match.
+    static bool tileHasPixels(const Tile* tile, const Pixels& pixels, Pixels& buffer);
+
+    // Disable operator=
+    ImageTiles& operator=(const ImageTiles&);
+
+    PixelFormat m_format;
+    gfx::Rect m_bounds;
+    int m_cols;
+    Tiles m_tiles;
+  };
+
+} // namespace raster
+
+#endif
@@ -0,0 +1,155 @@
+/* Aseprite
+ * Copyright (C) 2001-2013  David Capello
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#include "tests/test.h"
+
+#include "base/unique_ptr.h"
+#include "raster/image.h"
+#include "raster/image_tiles.h"
+
+#include <cstdlib>
+#include <sstream>
+#include <stdexcept>
+
+using namespace raster;
+
+static Image* create_random_image(PixelFormat format, int w, int h)
+{
+  Image* image = Image::create(format, w, h);
+  int mask = (format == IMAGE_BITMAP ? 1: (format == IMAGE_INDEXED ? 255: 0xffffffff));
+
+  image_clear(image, 0);
+  for (int i=0; i<w*h/4; ++i)
+    image->putpixel(std::rand() % w, std::rand() % h, std::rand() & mask);
+
+  return image;
+}
+
+static void expect_equal_area(const Image* a, const Image* b, const gfx::Rect& bounds)
+{
+  for (int y=bounds.y; y<bounds.y+bounds.h; ++y)
+    for (int x=bounds.x; x<bounds.x+bounds.w; ++x)
+      ASSERT_EQ(a->getpixel(x, y), b->getpixel(x, y)) << "(" << x << ", " << y << ")";
+}
+
+TEST(ImageTiles, SwapOutAndSwapIn)
+{
+  PixelFormat formats[] = { IMAGE_RGB, IMAGE_GRAYSCALE, IMAGE_INDEXED, IMAGE_BITMAP };
+  gfx::Rect bounds(5, 7, 300, 200);
+
+  std::srand(1);
+
+  for (int f=0; f<4; ++f) {
+    base::UniquePtr<Image> image(create_random_image(formats[f], 320, 240));
+    ImageTiles tiles(image, bounds);
+    int memSize = tiles.getMemSize();
+
+    std::stringstream stream;
+    ASSERT_TRUE(tiles.swapOut(stream));
+    EXPECT_LT(tiles.getMemSize(), memSize);
+
+    tiles.swapIn(stream);
+    EXPECT_EQ(memSize, tiles.getMemSize());
+
+    base::UniquePtr<Image> copy(Image::create(formats[f], 320, 240));
+    image_clear(copy, 0);
+    tiles.copyToImage(copy);
+    expect_equal_area(image, copy, bounds);
+  }
+}
+
+TEST(ImageTiles, SwapOutSharedTiles)
+{
+  // The original tiles are shared with the copy, which must keep its
+  // pixels when the other one is swapped out.
+  base::UniquePtr<Image> image(create_random_image(IMAGE_RGB, 200, 200));
+  gfx::Rect bounds(0, 0, 200, 200);
+  ImageTiles tiles(image, bounds);
+  ImageTiles copy(tiles);
+
+  std::stringstream stream;
+  ASSERT_TRUE(tiles.swapOut(stream));
+
+  base::UniquePtr<Image> result(Image::create(IMAGE_RGB, 200, 200));
+  image_clear(result, 0);
+  copy.copyToImage(result);
+  expect_equal_area(image, result, bounds);
+}
+
+TEST(ImageTiles, SwapInTruncatedStream)
+{
+  base::UniquePtr<Image> image(create_random_image(IMAGE_RGB, 200, 200));
+  ImageTiles tiles(image, gfx::Rect(0, 0, 200, 200));
+
+  std::stringstream stream;
+  ASSERT_TRUE(tiles.swapOut(stream));
+
+  std::string data = stream.str();
+  std::stringstream truncated(data.substr(0, data.size()/2));
+  EXPECT_THROW(tiles.swapIn(truncated), std::runtime_error);
+}
+
+TEST(ImageTiles, UpdateFromImageKeepsUnchangedTilesShared)
+{
+  PixelFormat formats[] = { IMAGE_RGB, IMAGE_GRAYSCALE, IMAGE_INDEXED, IMAGE_BITMAP };
+  gfx::Rect bounds(3, 2, 190, 150);
+
+  std::srand(2);
+
+  for (int f=0; f<4; ++f) {
+    base::UniquePtr<Image> image(create_random_image(formats[f], 200, 160));
+    base::UniquePtr<Image> original(Image::createCopy(image));
+    ImageTiles tiles(image, bounds);
+    ImageTiles copy(tiles);
+    ASSERT_EQ(9, tiles.getSharedTilesCount());
+
+    // Change one pixel of two tiles
+    image->putpixel(10, 10, !image->getpixel(10, 10));
+    image->putpixel(150, 100, !image->getpixel(150, 100));
+    tiles.updateFromImage(image, gfx::Rect(0, 0, 200, 160));
+    EXPECT_EQ(7, tiles.getSharedTilesCount());
+
+    base::UniquePtr<Image> result(Image::create(formats[f], 200, 160));
+    image_clear(result, 0);
+    tiles.copyToImage(result);
+    expect_equal_area(image, result, bounds);
+
+    // The copy keeps the original pixels
+    copy.copyToImage(result);
+    expect_equal_area(original, result, bounds);
+  }
+}
+
+TEST(ImageTiles, UpdateFromImageWithSameChecksum)
+{
+  base::UniquePtr<Image> image(Image::create(IMAGE_INDEXED, 100, 100));
+  image_clear(image, 10);
+  ImageTiles tiles(image, gfx::Rect(0, 0, 100, 100));
+
+  // Adding +1, -2, +1 to three consecutive bytes doesn't change the
+  // Adler-32 checksum of the tile
+  image->putpixel(20, 30, 11);
+  image->putpixel(21, 30, 8);
+  image->putpixel(22, 30, 11);
+  tiles.updateFromImage(image, gfx::Rect(20, 30, 3, 1));
+
+  base::UniquePtr<Image> result(Image::create(IMAGE_INDEXED, 100, 100));
+  image_clear(result, 0);
+  tiles.copyToImage(result);
+  expect_equal_area(image, result, gfx::Rect(0, 0, 100, 100));
+}
@@ -76,6 +76,7 @@ namespace raster {
     typedef uint32_t pixel_t;
     typedef pixel_t* address_t;
     typedef const pixel_t* const_address_t;
+    typedef BLEND_RGBA_ROW row_blender_t;
 
     static inline int scanline_size(int w)
     {
@@ -87,6 +88,11 @@ namespace raster {
       ASSERT(blend_mode >= 0 && blend_mode < BLEND_MODE_MAX);
       return _rgba_blenders[blend_mode];
     }
+
+    static inline BLEND_RGBA_ROW get_row_blender(int blend_mode)
+    {
+      return get_rgba_row_blender(blend_mode);
+    }
   };
 
   //////////////////////////////////////////////////////////////////////
@@ -118,6 +124,7 @@ namespace raster {
     typedef uint16_t pixel_t;
     typedef pixel_t* address_t;
     typedef const pixel_t* const_address_t;
+    typedef BLEND_GRAYA_ROW row_blender_t;
 
     static inline int scanline_size(int w)
     {
@@ -129,6 +136,11 @@ namespace raster {
       ASSERT(blend_mode >= 0 && blend_mode < BLEND_MODE_MAX);
       return _graya_blenders[blend_mode];
     }
+
+    static inline BLEND_GRAYA_ROW get_row_blender(int blend_mode)
+    {
+      return get_graya_row_blender(blend_mode);
+    }
   };
 
   //////////////////////////////////////////////////////////////////////
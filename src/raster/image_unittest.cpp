@@ -0,0 +1,285 @@
+/* Aseprite
+ * Copyright (C) 2001-2013  David Capello
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#include "tests/test.h"
+
+#include "base/unique_ptr.h"
+#include "gfx/region.h"
+#include "raster/raster.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+
+using namespace raster;
+
+static Image* create_random_image(PixelFormat format, int w, int h)
+{
+  Image* image = Image::create(format, w, h);
+  for (int y=0; y<h; ++y) {
+    for (int x=0; x<w; ++x) {
+      int c;
+      switch (format) {
+        case IMAGE_RGB: c = _rgba(std::rand() & 255, std::rand() & 255, std::rand() & 255, std::rand() & 255); break;
+        case IMAGE_GRAYSCALE: c = _graya(std::rand() & 255, std::rand() & 255); break;
+        case IMAGE_INDEXED: c = std::rand() & 255; break;
+        default: c = std::rand() & 1; break;
+      }
+      image->putpixel(x, y, c);
+    }
+  }
+  return image;
+}
+
+// Old implementation of RESIZE_METHOD_NEAREST_NEIGHBOR.
+static void old_resize_nearest(const Image* src, Image* dst)
+{
+  double u, v, du, dv;
+  int x, y;
+
+  u = v = 0.0;
+  du = src->w * 1.0 / dst->w;
+  dv = src->h * 1.0 / dst->h;
+  for (y=0; y<dst->h; ++y) {
+    for (x=0; x<dst->w; ++x) {
+      dst->putpixel(x, y, src->getpixel(MID(0, u, src->w-1),
+                                        MID(0, v, src->h-1)));
+      u += du;
+    }
+    u = 0.0;
+    v += dv;
+  }
+}
+
+// Old implementation of RESIZE_METHOD_BILINEAR for RGB images (with
+// doubles).
+static void old_resize_bilinear_rgb(const Image* src, Image* dst)
+{
+  uint32_t color[4];
+  double u, v, du, dv;
+  int u_floor, u_floor2;
+  int v_floor, v_floor2;
+  int x, y;
+
+  u = v = 0.0;
+  du = (src->w-1) * 1.0 / (dst->w-1);
+  dv = (src->h-1) * 1.0 / (dst->h-1);
+  for (y=0; y<dst->h; ++y) {
+    for (x=0; x<dst->w; ++x) {
+      u_floor = std::floor(u);
+      v_floor = std::floor(v);
+
+      if (u_floor > src->w-1) {
+        u_floor = src->w-1;
+        u_floor2 = src->w-1;
+      }
+      else if (u_floor == src->w-1)
+        u_floor2 = u_floor;
+      else
+        u_floor2 = u_floor+1;
+
+      if (v_floor > src->h-1) {
+        v_floor = src->h-1;
+        v_floor2 = src->h-1;
+      }
+      else if (v_floor == src->h-1)
+        v_floor2 = v_floor;
+      else
+        v_floor2 = v_floor+1;
+
+      color[0] = src->getpixel(u_floor,  v_floor);
+      color[1] = src->getpixel(u_floor2, v_floor);
+      color[2] = src->getpixel(u_floor,  v_floor2);
+      color[3] = src->getpixel(u_floor2, v_floor2);
+
+      double u1 = u - u_floor;
+      double v1 = v - v_floor;
+      double u2 = 1 - u1;
+      double v2 = 1 - v1;
+      int r = ((_rgba_getr(color[0])*u2 + _rgba_getr(color[1])*u1)*v2 +
+               (_rgba_getr(color[2])*u2 + _rgba_getr(color[3])*u1)*v1);
+      int g = ((_rgba_getg(color[0])*u2 + _rgba_getg(color[1])*u1)*v2 +
+               (_rgba_getg(color[2])*u2 + _rgba_getg(color[3])*u1)*v1);
+      int b = ((_rgba_getb(color[0])*u2 + _rgba_getb(color[1])*u1)*v2 +
+               (_rgba_getb(color[2])*u2 + _rgba_getb(color[3])*u1)*v1);
+      int a = ((_rgba_geta(color[0])*u2 + _rgba_geta(color[1])*u1)*v2 +
+               (_rgba_geta(color[2])*u2 + _rgba_geta(color[3])*u1)*v1);
+      dst->putpixel(x, y, _rgba(r, g, b, a));
+
+      u += du;
+    }
+    u = 0.0;
+    v += dv;
+  }
+}
+
+// Average of the source pixels covered by the destination pixel
+// (x, y) weighted by the covered area (with doubles).
+static double area_average(const Image* src, int dstW, int dstH, int x, int y, int shift)
+{
+  double sx = double(src->w) / dstW;
+  double sy = double(src->h) / dstH;
+  double sum = 0.0;
+
+  for (int v=0; v<src->h; ++v) {
+    double h = std::min(v+1.0, (y+1)*sy) - std::max(double(v), y*sy);
+    if (h <= 0.0)
+      continue;
+
+    for (int u=0; u<src->w; ++u) {
+      double w = std::min(u+1.0, (x+1)*sx) - std::max(double(u), x*sx);
+      if (w > 0.0)
+        sum += ((src->getpixel(u, v) >> shift) & 255) * w * h;
+    }
+  }
+
+  return sum / (sx*sy);
+}
+
+static int max_channel_diff(const Image* a, const Image* b)
+{
+  int diff = 0;
+  for (int y=0; y<a->h; ++y) {
+    for (int x=0; x<a->w; ++x) {
+      for (int shift=0; shift<32; shift+=8) {
+        int c1 = (a->getpixel(x, y) >> shift) & 255;
+        int c2 = (b->getpixel(x, y) >> shift) & 255;
+        diff = std::max(diff, std::abs(c1 - c2));
+      }
+    }
+  }
+  return diff;
+}
+
+static const int sizes[][4] = {
+  { 37, 23, 100, 50 },          // Enlarge
+  { 100, 80, 13, 7 },           // Reduce
+  { 50, 50, 51, 49 },
+  { 16, 16, 32, 32 },           // Whole number scale
+  { 1, 1, 5, 3 },
+};
+
+TEST(ImageResize, NearestIsEqualToOldImplementation)
+{
+  PixelFormat formats[] = { IMAGE_RGB, IMAGE_GRAYSCALE, IMAGE_INDEXED, IMAGE_BITMAP };
+  std::srand(1);
+
+  for (int f=0; f<4; ++f) {
+    for (int i=0; i<5; ++i) {
+      base::UniquePtr<Image> src(create_random_image(formats[f], sizes[i][0], sizes[i][1]));
+      base::UniquePtr<Image> dst(Image::create(formats[f], sizes[i][2], sizes[i][3]));
+      base::UniquePtr<Image> expected(Image::create(formats[f], sizes[i][2], sizes[i][3]));
+
+      image_resize(src, dst, RESIZE_METHOD_NEAREST_NEIGHBOR, NULL, NULL);
+      old_resize_nearest(src, expected);
+      EXPECT_EQ(0, image_count_diff(expected, dst)) << "format=" << formats[f] << " i=" << i;
+    }
+  }
+}
+
+TEST(ImageResize, BilinearIsSimilarToOldImplementation)
+{
+  std::srand(2);
+
+  for (int i=0; i<5; ++i) {
+    // The old implementation divides by zero with 1 pixel images
+    if (sizes[i][0] == 1)
+      continue;
+
+    base::UniquePtr<Image> src(create_random_image(IMAGE_RGB, sizes[i][0], sizes[i][1]));
+    base::UniquePtr<Image> dst(Image::create(IMAGE_RGB, sizes[i][2], sizes[i][3]));
+    base::UniquePtr<Image> expected(Image::create(IMAGE_RGB, sizes[i][2], sizes[i][3]));
+
+    image_resize(src, dst, RESIZE_METHOD_BILINEAR, NULL, NULL);
+    old_resize_bilinear_rgb(src, expected);
+    EXPECT_LE(max_channel_diff(expected, dst), 2) << "i=" << i;
+  }
+}
+
+TEST(ImageResize, AreaWithNonWholeNumberScales)
+{
+  const int reductions[][4] = {
+    { 10, 10, 3, 3 },
+    { 7, 5, 5, 4 },
+    { 100, 37, 33, 11 },
+    { 64, 64, 48, 40 },
+  };
+  std::srand(3);
+
+  for (int i=0; i<4; ++i) {
+    int w = reductions[i][2], h = reductions[i][3];
+    base::UniquePtr<Image> src(create_random_image(IMAGE_RGB, reductions[i][0], reductions[i][1]));
+    base::UniquePtr<Image> dst(Image::create(IMAGE_RGB, w, h));
+    image_resize(src, dst, RESIZE_METHOD_AREA, NULL, NULL);
+
+    for (int y=0; y<h; ++y) {
+      for (int x=0; x<w; ++x) {
+        for (int shift=0; shift<32; shift+=8) {
+          double expected = area_average(src, w, h, x, y, shift);
+          int value = (dst->getpixel(x, y) >> shift) & 255;
+          EXPECT_NEAR(expected, value, 1.0) << "i=" << i << " x=" << x << " y=" << y;
+        }
+      }
+    }
+  }
+
+  // A solid color is kept
+  base::UniquePtr<Image> src(Image::create(IMAGE_RGB, 17, 13));
+  base::UniquePtr<Image> dst(Image::create(IMAGE_RGB, 5, 4));
+  image_clear(src, _rgba(10, 200, 255, 128));
+  image_resize(src, dst, RESIZE_METHOD_AREA, NULL, NULL);
+  for (int y=0; y<dst->h; ++y)
+    for (int x=0; x<dst->w; ++x)
+      EXPECT_EQ(_rgba(10, 200, 255, 128), dst->getpixel(x, y));
+}
+
+TEST(ImageCopyRegion, CopiesOnlyTheRegion)
+{
+  PixelFormat formats[] = { IMAGE_RGB, IMAGE_GRAYSCALE, IMAGE_INDEXED, IMAGE_BITMAP };
+  int widths[] = { 1, 7, 8, 13, 29 };
+  int offsets[][2] = { { 0, 0 }, { 3, -2 }, { -5, 1 } };
+  std::srand(4);
+
+  // Rectangles that start and end in the middle of bitmap bytes,
+  // and others outside the images (which must be clipped)
+  gfx::Region region(gfx::Rect(1, 0, 5, 2));
+  region.createUnion(region, gfx::Region(gfx::Rect(3, 3, 11, 2)));
+  region.createUnion(region, gfx::Region(gfx::Rect(-4, 4, 40, 3)));
+  region.createUnion(region, gfx::Region(gfx::Rect(9, -3, 2, 20)));
+
+  for (int f=0; f<4; ++f) {
+    for (int i=0; i<5; ++i) {
+      for (int o=0; o<3; ++o) {
+        int w = widths[i], h = 6;
+        int dx = offsets[o][0], dy = offsets[o][1];
+        base::UniquePtr<Image> src(create_random_image(formats[f], w, h));
+        base::UniquePtr<Image> dst(create_random_image(formats[f], w, h));
+        base::UniquePtr<Image> expected(Image::createCopy(dst));
+
+        for (int y=0; y<h; ++y)
+          for (int x=0; x<w; ++x)
+            if (region.contains(gfx::Point(x-dx, y-dy)))
+              expected->putpixel(x, y, src->getpixel(x, y));
+
+        image_copy_region(dst, src, region, dx, dy);
+        EXPECT_EQ(0, image_count_diff(expected, dst))
+          << "format=" << formats[f] << " w=" << w << " dx=" << dx << " dy=" << dy;
+      }
+    }
+  }
+}
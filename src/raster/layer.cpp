@@ -317,13 +317,14 @@ void layer_render(const Layer* layer, Image* image, int x, int y, FrameNumber fr
         src_image = layer->getSprite()->getStock()->getImage(cel->getImage());
         ASSERT(src_image != NULL);
 
-        src_image->mask_color = layer->getSprite()->getTransparentColor();
-
+        // The mask color is not stored in src_image because layers
+        // can be rendered from several threads at the same time.
         image_merge(image, src_image,
                     cel->getX() + x,
                     cel->getY() + y,
                     MID (0, cel->getOpacity(), 255),
-                    static_cast<const LayerImage*>(layer)->getBlendMode());
+                    static_cast<const LayerImage*>(layer)->getBlendMode(),
+                    layer->getSprite()->getTransparentColor());
       }
       break;
     }
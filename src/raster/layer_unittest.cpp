@@ -0,0 +1,69 @@
+/* Aseprite
+ * Copyright (C) 2001-2013  David Capello
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#include "tests/test.h"
+
+#include "base/unique_ptr.h"
+#include "raster/raster.h"
+
+using namespace raster;
+
+static Image* create_row(const int* pixels, int w)
+{
+  Image* image = Image::create(IMAGE_INDEXED, w, 1);
+  for (int x=0; x<w; ++x)
+    image->putpixel(x, 0, pixels[x]);
+  return image;
+}
+
+static void add_cel(Sprite* sprite, LayerImage* layer, Image* image)
+{
+  layer->addCel(new Cel(FrameNumber(0), sprite->getStock()->addImage(image)));
+}
+
+TEST(LayerRender, UsesTransparentColorOfSprite)
+{
+  Sprite sprite(IMAGE_INDEXED, 4, 1, 256);
+  sprite.setTransparentColor(3);
+
+  LayerImage* bottom = new LayerImage(&sprite);
+  LayerImage* top = new LayerImage(&sprite);
+  sprite.getFolder()->addLayer(bottom);
+  sprite.getFolder()->addLayer(top);
+
+  const int bottomPixels[] = { 5, 5, 5, 3 };
+  const int topPixels[] = { 3, 0, 3, 7 };
+  Image* topImage = create_row(topPixels, 4);
+  add_cel(&sprite, bottom, create_row(bottomPixels, 4));
+  add_cel(&sprite, top, topImage);
+
+  base::UniquePtr<Image> result(Image::create(IMAGE_INDEXED, 4, 1));
+  image_clear(result, 3);
+  layer_render(sprite.getFolder(), result, 0, 0, FrameNumber(0));
+
+  // The transparent color (3) is skipped, the mask color of the image
+  // (0) is not.
+  EXPECT_EQ(5, result->getpixel(0, 0));
+  EXPECT_EQ(0, result->getpixel(1, 0));
+  EXPECT_EQ(5, result->getpixel(2, 0));
+  EXPECT_EQ(7, result->getpixel(3, 0));
+
+  // Cel images are not modified, so they can be rendered from several
+  // threads at the same time.
+  EXPECT_EQ(0u, topImage->mask_color);
+}
@@ -24,6 +24,7 @@
 
 #include "base/memory.h"
 #include "raster/image.h"
+#include "raster/image_rows.h"
 
 #include <cstdlib>
 #include <cstring>
@@ -221,105 +222,94 @@ void Mask::intersect(int x, int y, int w, int h)
   }
 }
 
-void Mask::byColor(const Image *src, int color, int fuzziness)
-{
-  replace(0, 0, src->w, src->h);
+namespace {
+
+  // Returns 1 for pixels that are similar to the given color (each
+  // channel inside the range [color-fuzziness, color+fuzziness]).
+  class MatchRgb {
+  public:
+    MatchRgb(int color, int fuzziness)
+      : m_r(_rgba_getr(color))
+      , m_g(_rgba_getg(color))
+      , m_b(_rgba_getb(color))
+      , m_a(_rgba_geta(color))
+      , m_fuzziness(fuzziness) { }
+
+    BitmapTraits::pixel_t operator()(RgbTraits::pixel_t c) const {
+      return (inRange(_rgba_getr(c), m_r) &&
+              inRange(_rgba_getg(c), m_g) &&
+              inRange(_rgba_getb(c), m_b) &&
+              inRange(_rgba_geta(c), m_a)) ? 1: 0;
+    }
 
-  Image* dst = m_bitmap;
+  private:
+    bool inRange(int value, int ref) const {
+      return (value >= ref-m_fuzziness && value <= ref+m_fuzziness);
+    }
 
-  switch (src->getPixelFormat()) {
+    int m_r, m_g, m_b, m_a;
+    int m_fuzziness;
+  };
 
-    case IMAGE_RGB: {
-      uint32_t* src_address;
-      uint8_t* dst_address;
-      int src_r, src_g, src_b, src_a;
-      int dst_r, dst_g, dst_b, dst_a;
-      int u, v, c;
-      div_t d;
-
-      dst_r = _rgba_getr(color);
-      dst_g = _rgba_getg(color);
-      dst_b = _rgba_getb(color);
-      dst_a = _rgba_geta(color);
-
-      for (v=0; v<src->h; v++) {
-        src_address = ((uint32_t**)src->line)[v];
-        dst_address = ((uint8_t**)dst->line)[v];
-
-        d = div (0, 8);
-
-        for (u=0; u<src->w; u++) {
-          c = *(src_address++);
-
-          src_r = _rgba_getr(c);
-          src_g = _rgba_getg(c);
-          src_b = _rgba_getb(c);
-          src_a = _rgba_geta(c);
-
-          if (!((src_r >= dst_r-fuzziness) && (src_r <= dst_r+fuzziness) &&
-                (src_g >= dst_g-fuzziness) && (src_g <= dst_g+fuzziness) &&
-                (src_b >= dst_b-fuzziness) && (src_b <= dst_b+fuzziness) &&
-                (src_a >= dst_a-fuzziness) && (src_a <= dst_a+fuzziness)))
-            (*dst_address) ^= (1 << d.rem);
-
-          _image_bitmap_next_bit(d, dst_address);
-        }
-      }
-    } break;
-
-    case IMAGE_GRAYSCALE: {
-      uint16_t* src_address;
-      uint8_t* dst_address;
-      int src_k, src_a;
-      int dst_k, dst_a;
-      int u, v, c;
-      div_t d;
+  class MatchGrayscale {
+  public:
+    MatchGrayscale(int color, int fuzziness)
+      : m_k(_graya_getv(color))
+      , m_a(_graya_geta(color))
+      , m_fuzziness(fuzziness) { }
 
-      dst_k = _graya_getv(color);
-      dst_a = _graya_geta(color);
+    BitmapTraits::pixel_t operator()(GrayscaleTraits::pixel_t c) const {
+      return (inRange(_graya_getv(c), m_k) &&
+              inRange(_graya_geta(c), m_a)) ? 1: 0;
+    }
 
-      for (v=0; v<src->h; v++) {
-        src_address = ((uint16_t**)src->line)[v];
-        dst_address = ((uint8_t**)dst->line)[v];
+  private:
+    bool inRange(int value, int ref) const {
+      return (value >= ref-m_fuzziness && value <= ref+m_fuzziness);
+    }
 
-        d = div (0, 8);
+    int m_k, m_a;
+    int m_fuzziness;
+  };
 
-        for (u=0; u<src->w; u++) {
-          c = *(src_address++);
+  class MatchIndexed {
+  public:
+    MatchIndexed(int color, int fuzziness)
+      : m_color(color)
+      , m_fuzziness(fuzziness) { }
 
-          src_k = _graya_getv(c);
-          src_a = _graya_geta(c);
+    BitmapTraits::pixel_t operator()(IndexedTraits::pixel_t c) const {
+      return (c >= m_color-m_fuzziness && c <= m_color+m_fuzziness) ? 1: 0;
+    }
 
-          if (!((src_k >= dst_k-fuzziness) && (src_k <= dst_k+fuzziness) &&
-                (src_a >= dst_a-fuzziness) && (src_a <= dst_a+fuzziness)))
-            (*dst_address) ^= (1 << d.rem);
+  private:
+    int m_color;
+    int m_fuzziness;
+  };
 
-          _image_bitmap_next_bit(d, dst_address);
-        }
-      }
-    } break;
+}
 
-    case IMAGE_INDEXED: {
-      uint8_t* src_address;
-      uint8_t* dst_address;
-      int u, v, c;
-      div_t d;
+void Mask::byColor(const Image *src, int color, int fuzziness)
+{
+  replace(0, 0, src->w, src->h);
 
-      for (v=0; v<src->h; v++) {
-        src_address = ((uint8_t**)src->line)[v];
-        dst_address = ((uint8_t**)dst->line)[v];
+  Image* dst = m_bitmap;
 
-        d = div (0, 8);
+  switch (src->getPixelFormat()) {
 
-        for (u=0; u<src->w; u++) {
-          c = *(src_address++);
+    case IMAGE_RGB: {
+      MatchRgb match(color, fuzziness);
+      transform_pixels<RgbTraits, BitmapTraits>(src, dst, match);
+    } break;
 
-          if (!((c >= color-fuzziness) && (c <= color+fuzziness)))
-            (*dst_address) ^= (1 << d.rem);
+    case IMAGE_GRAYSCALE: {
+      MatchGrayscale match(color, fuzziness);
+      transform_pixels<GrayscaleTraits, BitmapTraits>(src, dst, match);
+    } break;
 
-          _image_bitmap_next_bit(d, dst_address);
-        }
-      }
+    case IMAGE_INDEXED: {
+      MatchIndexed match(color, fuzziness);
+      transform_pixels<IndexedTraits, BitmapTraits>(src, dst, match);
     } break;
   }
 
@@ -0,0 +1,200 @@
+/* Aseprite
+ * Copyright (C) 2001-2013  David Capello
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#ifndef RASTER_OCTREE_H_INCLUDED
+#define RASTER_OCTREE_H_INCLUDED
+
+#include <algorithm>
+#include <vector>
+
+namespace raster {
+namespace quantization {
+
+  // Octree used to reduce the colors of a histogram. Each level of
+  // the tree uses one bit of each 8-bit component (the most
+  // significant bit in the root). The histogram has less precision
+  // than 8 bits, so "levels" can be less than 8 and the leaves at the
+  // deepest level are still the colors of the histogram.
+  class Octree {
+  public:
+    Octree(int levels) : m_levels(levels), m_leaves(0) {
+      m_nodes.push_back(Node());
+    }
+
+    void addColor(int r, int g, int b, size_t count) {
+      int n = 0;
+      for (int level=0; level<m_levels; ++level) {
+        int shift = 7 - level;
+        int child =
+          (((r >> shift) & 1) << 2) |
+          (((g >> shift) & 1) << 1) |
+          (((b >> shift) & 1));
+
+        if (m_nodes[n].children[child] == 0) {
+          m_nodes[n].children[child] = m_nodes.size();
+          m_nodes.push_back(Node());
+        }
+        n = m_nodes[n].children[child];
+      }
+
+      Node& leaf = m_nodes[n];
+      if (leaf.count == 0)
+        ++m_leaves;
+      leaf.r += r * count;
+      leaf.g += g * count;
+      leaf.b += b * count;
+      leaf.count += count;
+    }
+
+    // Merges the leaves of the nodes with less samples (starting from
+    // the deepest level) until the tree has "maxColors" leaves or
+    // less, and returns the mean color of each leaf.
+    void reduce(size_t maxColors, std::vector<uint32_t>& result) {
+      for (int level=m_levels-1; level>=0 && m_leaves > maxColors; --level) {
+        std::vector<int> nodes;
+        collectNodes(0, 0, level, nodes);
+        std::sort(nodes.begin(), nodes.end(), CompareCount(m_nodes));
+
+        for (int i=0; i<(int)nodes.size() && m_leaves > maxColors; ++i)
+          mergeChildren(nodes[i]);
+      }
+
+      collectLeaves(0, result);
+    }
+
+  private:
+    struct Node {
+      // Sum of components of all samples, and number of samples, in
+      // this node (leaves) or in the whole subtree (inner nodes).
+      size_t r, g, b, count;
+      // Index of each child in m_nodes (0 if there is no child).
+      int children[8];
+      bool leaf;
+
+      Node() : r(0), g(0), b(0), count(0), leaf(false) {
+        std::fill(children, children+8, 0);
+      }
+    };
+
+    struct CompareCount {
+      const std::vector<Node>& nodes;
+      CompareCount(const std::vector<Node>& nodes) : nodes(nodes) { }
+      bool operator()(int a, int b) const {
+        return nodes[a].count < nodes[b].count;
+      }
+    };
+
+    // Collects the inner nodes of the given level, calculating the
+    // number of samples in each subtree.
+    size_t collectNodes(int n, int level, int wantedLevel, std::vector<int>& nodes) {
+      Node& node = m_nodes[n];
+      if (level == m_levels || node.leaf)
+        return node.count;
+
+      size_t count = 0;
+      for (int i=0; i<8; ++i)
+        if (node.children[i])
+          count += collectNodes(node.children[i], level+1, wantedLevel, nodes);
+
+      node.count = count;
+      if (level == wantedLevel)
+        nodes.push_back(n);
+      return count;
+    }
+
+    // Converts the node in a leaf with all the samples of its
+    // children (which are leaves because deeper levels are reduced
+    // first).
+    void mergeChildren(int n) {
+      Node& node = m_nodes[n];
+      int children = 0;
+      node.r = node.g = node.b = node.count = 0;
+
+      for (int i=0; i<8; ++i) {
+        if (node.children[i]) {
+          const Node& child = m_nodes[node.children[i]];
+          node.r += child.r;
+          node.g += child.g;
+          node.b += child.b;
+          node.count += child.count;
+          node.children[i] = 0;
+          ++children;
+        }
+      }
+
+      node.leaf = true;
+      m_leaves -= children-1;
+    }
+
+    void collectLeaves(int n, std::vector<uint32_t>& result) const {
+      const Node& node = m_nodes[n];
+      bool hasChildren = false;
+
+      for (int i=0; i<8; ++i) {
+        if (node.children[i]) {
+          collectLeaves(node.children[i], result);
+          hasChildren = true;
+        }
+      }
+
+      if (!hasChildren && node.count > 0)
+        result.push_back(_rgba(node.r / node.count,
+                               node.g / node.count,
+                               node.b / node.count, 255));
+    }
+
+    std::vector<Node> m_nodes;
+    int m_levels;
+    size_t m_leaves;
+  };
+
+  // Octree quantization as described in M. Gervautz and
+  // W. Purgathofer, "A simple method for color quantization: octree
+  // quantization", New Trends in Computer Graphics, pp. 219-231
+  // (1988). The octree is created with the colors of the histogram
+  // (instead of the pixels of the image), so it has at most one leaf
+  // for each histogram entry.
+  template<class Histogram>
+  void octree_quantization(const Histogram& histogram, size_t maxColors, std::vector<uint32_t>& result)
+  {
+    int maxElements = std::max<int>(Histogram::RElements,
+                                    std::max<int>(Histogram::GElements,
+                                                  Histogram::BElements));
+    int levels = 0;
+    while ((1 << levels) < maxElements)
+      ++levels;
+
+    Octree octree(levels);
+
+    for (int i=0; i<Histogram::RElements; ++i)
+      for (int j=0; j<Histogram::GElements; ++j)
+        for (int k=0; k<Histogram::BElements; ++k) {
+          size_t count = histogram.at(i, j, k);
+          if (count > 0)
+            octree.addColor(255 * i / (Histogram::RElements-1),
+                            255 * j / (Histogram::GElements-1),
+                            255 * k / (Histogram::BElements-1), count);
+        }
+
+    octree.reduce(maxColors, result);
+  }
+
+} // namespace quantization
+} // namespace raster
+
+#endif
@@ -22,7 +22,11 @@
 
 #include <allegro.h>
 #include <algorithm>
+#include <climits>
 
+#include "base/atomic.h"
+#include "base/mutex.h"
+#include "base/scoped_lock.h"
 #include "gfx/hsv.h"
 #include "gfx/rgb.h"
 #include "raster/image.h"
@@ -42,6 +46,8 @@ Palette::Palette(FrameNumber frame, int ncolors)
   m_frame = frame;
   m_colors.resize(ncolors);
   m_modifications = 0;
+  m_bestfitIndex = NULL;
+  m_bestfitIndexModifications = -1;
 
   std::fill(m_colors.begin(), m_colors.end(), _rgba(0, 0, 0, 255));
 }
@@ -52,10 +58,8 @@ Palette::Palette(const Palette& palette)
   m_frame = palette.m_frame;
   m_colors = palette.m_colors;
   m_modifications = 0;
-}
-
-Palette::~Palette()
-{
+  m_bestfitIndex = NULL;
+  m_bestfitIndexModifications = -1;
 }
 
 Palette* Palette::createGrayscale()
@@ -390,6 +394,8 @@ void Palette::sort(int from, int to, SortPalette* sort_palette, std::vector<int>
     m_colors[from+i] = temp[i].color;
     mapping[from+i] = temp[i].index;
   }
+
+  ++m_modifications;
 }
 
 // End of Sort stuff
@@ -496,67 +502,176 @@ bool Palette::save(const char *filename) const
   return success;
 }
 
-/**********************************************************************/
-/* Based on Allegro's bestfit_color */
+//////////////////////////////////////////////////////////////////////
+// Based on Allegro's bestfit_color: components are reduced to 5 bits
+// and the distance is weighted with the luminance of each component.
+// Instead of checking all colors, we use a k-d tree of the palette.
+
+class BestfitIndex {
+public:
+  BestfitIndex(const std::vector<uint32_t>& colors) {
+    // Only the first entry of repeated colors is added (as ties are
+    // resolved with the lowest index), so a palette with a lot of
+    // equal entries (e.g. black) doesn't create a degenerated tree.
+    std::vector<bool> added(1 << 15, false);
+
+    // The index 0 is never used (it's the mask color)
+    for (int i=1; i<(int)colors.size(); ++i) {
+      Node node;
+      node.c[0] = _rgba_getr(colors[i]) >> 3;
+      node.c[1] = _rgba_getg(colors[i]) >> 3;
+      node.c[2] = _rgba_getb(colors[i]) >> 3;
+
+      int key = (node.c[0] << 10) | (node.c[1] << 5) | node.c[2];
+      if (added[key])
+        continue;
+      added[key] = true;
+
+      node.index = i;
+      node.axis = 0;
+      m_nodes.push_back(node);
+    }
 
-static unsigned int col_diff[3*128];
+    build(0, m_nodes.size());
+  }
 
-static void bestfit_init()
-{
-  register int i, k;
+  int findBestfit(int r, int g, int b) const {
+    int q[3] = { r >> 3, g >> 3, b >> 3 };
+    int bestfit = 0;
+    int lowest = INT_MAX;
+
+    search(0, m_nodes.size(), q, bestfit, lowest);
+    return bestfit;
+  }
+
+private:
+  // Subtrees with less nodes are checked linearly
+  enum { LeafSize = 8 };
+
+  struct Node {
+    int c[3];
+    int index;
+    int axis;
+  };
+
+  struct CompareAxis {
+    int axis;
+    CompareAxis(int axis) : axis(axis) { }
+    bool operator()(const Node& a, const Node& b) const {
+      return a.c[axis] < b.c[axis];
+    }
+  };
+
+  static int weight(int axis) {
+    static const int weights[3] = { 30*30, 59*59, 11*11 };
+    return weights[axis];
+  }
+
+  static int distance(const Node& node, const int* q) {
+    int dr = node.c[0] - q[0];
+    int dg = node.c[1] - q[1];
+    int db = node.c[2] - q[2];
+    return dr*dr*weight(0) + dg*dg*weight(1) + db*db*weight(2);
+  }
+
+  // The nodes in [lo, hi) are sorted so the median of the axis with
+  // the biggest (weighted) spread is in the middle, nodes in [lo, mid)
+  // have lesser or equal values in that axis, and nodes in (mid, hi)
+  // greater or equal.
+  void build(int lo, int hi) {
+    if (hi - lo <= LeafSize)
+      return;
+
+    int axis = 0;
+    int spread = -1;
+    for (int k=0; k<3; ++k) {
+      int min = INT_MAX, max = INT_MIN;
+      for (int i=lo; i<hi; ++i) {
+        min = std::min(min, m_nodes[i].c[k]);
+        max = std::max(max, m_nodes[i].c[k]);
+      }
+      if ((max-min)*(max-min)*weight(k) > spread) {
+        spread = (max-min)*(max-min)*weight(k);
+        axis = k;
+      }
+    }
+
+    int mid = (lo + hi) / 2;
+    std::nth_element(m_nodes.begin()+lo, m_nodes.begin()+mid,
+                     m_nodes.begin()+hi, CompareAxis(axis));
+    m_nodes[mid].axis = axis;
 
-  for (i=1; i<64; i++) {
-    k = i * i;
-    col_diff[0  +i] = col_diff[0  +128-i] = k * (59 * 59);
-    col_diff[128+i] = col_diff[128+128-i] = k * (30 * 30);
-    col_diff[256+i] = col_diff[256+128-i] = k * (11 * 11);
+    build(lo, mid);
+    build(mid+1, hi);
   }
+
+  // Ties are resolved with the lowest palette index (as the old
+  // linear search did).
+  void search(int lo, int hi, const int* q, int& bestfit, int& lowest) const {
+    if (hi - lo <= LeafSize) {
+      for (int i=lo; i<hi; ++i)
+        check(m_nodes[i], q, bestfit, lowest);
+      return;
+    }
+
+    int mid = (lo + hi) / 2;
+    const Node& node = m_nodes[mid];
+    check(node, q, bestfit, lowest);
+
+    int diff = q[node.axis] - node.c[node.axis];
+    if (diff < 0) {
+      search(lo, mid, q, bestfit, lowest);
+      if (diff*diff*weight(node.axis) <= lowest)
+        search(mid+1, hi, q, bestfit, lowest);
+    }
+    else {
+      search(mid+1, hi, q, bestfit, lowest);
+      if (diff*diff*weight(node.axis) <= lowest)
+        search(lo, mid, q, bestfit, lowest);
+    }
+  }
+
+  static void check(const Node& node, const int* q, int& bestfit, int& lowest) {
+    int d = distance(node, q);
+    if (d < lowest || (d == lowest && node.index < bestfit)) {
+      bestfit = node.index;
+      lowest = d;
+    }
+  }
+
+  std::vector<Node> m_nodes;
+};
+
+// Defined after BestfitIndex as it must be a complete type to be
+// deleted.
+Palette::~Palette()
+{
+  delete m_bestfitIndex;
 }
 
+// The index is created again the first time this function is called
+// after a modification of the palette. The palette must not be
+// modified while other threads are using this function.
 int Palette::findBestfit(int r, int g, int b) const
 {
-#ifdef __GNUC__
-  register int bestfit asm("%eax");
-#else
-  register int bestfit;
-#endif
-  int i, coldiff, lowest;
-
   ASSERT(r >= 0 && r <= 255);
   ASSERT(g >= 0 && g <= 255);
   ASSERT(b >= 0 && b <= 255);
 
-  if (col_diff[1] == 0)
-    bestfit_init();
-
-  bestfit = 0;
-  lowest = INT_MAX;
-
-  r >>= 3;
-  g >>= 3;
-  b >>= 3;
-
-  i = 1;
-  while (i < size()) {
-    uint32_t rgb = m_colors[i];
-
-    coldiff = (col_diff + 0) [ ((_rgba_getg(rgb)>>3) - g) & 0x7F ];
-    if (coldiff < lowest) {
-      coldiff += (col_diff + 128) [ ((_rgba_getr(rgb)>>3) - r) & 0x7F ];
-      if (coldiff < lowest) {
-        coldiff += (col_diff + 256) [ ((_rgba_getb(rgb)>>3) - b) & 0x7F ];
-        if (coldiff < lowest) {
-          bestfit = i;
-          if (coldiff == 0)
-            return bestfit;
-          lowest = coldiff;
-        }
-      }
+  // The index can be used only after m_bestfitIndexModifications is
+  // seen updated
+  if (base::atomic_load_acquire(&m_bestfitIndexModifications) != m_modifications) {
+    base::scoped_lock lock(m_bestfitMutex);
+
+    // Other thread could have created the index
+    if (m_bestfitIndexModifications != m_modifications) {
+      delete m_bestfitIndex;
+      m_bestfitIndex = new BestfitIndex(m_colors);
+      base::atomic_store_release(&m_bestfitIndexModifications, m_modifications);
     }
-    i++;
   }
 
-  return bestfit;
+  return m_bestfitIndex->findBestfit(r, g, b);
 }
 
 } // namespace raster
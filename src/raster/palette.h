@@ -19,6 +19,7 @@
 #ifndef RASTER_PALETTE_H_INCLUDED
 #define RASTER_PALETTE_H_INCLUDED
 
+#include "base/mutex.h"
 #include "raster/frame_number.h"
 #include "raster/gfxobj.h"
 
@@ -100,9 +101,21 @@ namespace raster {
     int findBestfit(int r, int g, int b) const;
 
   private:
+    // Not implemented (the bestfit index cannot be shared).
+    Palette& operator=(const Palette&);
+
     FrameNumber m_frame;
     std::vector<uint32_t> m_colors;
     int m_modifications;
+
+    // Index used by findBestfit(), it's valid while
+    // m_bestfitIndexModifications is equal to m_modifications. Several
+    // threads can use findBestfit() at the same time, so the index is
+    // created with m_bestfitMutex locked, and then
+    // m_bestfitIndexModifications is updated (with release semantics).
+    mutable class BestfitIndex* m_bestfitIndex;
+    mutable volatile int m_bestfitIndexModifications;
+    mutable base::mutex m_bestfitMutex;
   };
 
 } // namespace raster
@@ -0,0 +1,160 @@
+/* Aseprite
+ * Copyright (C) 2001-2013  David Capello
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#include "tests/test.h"
+
+#include "base/thread.h"
+#include "raster/image.h"
+#include "raster/palette.h"
+
+#include <climits>
+#include <cstdlib>
+#include <vector>
+
+using namespace raster;
+
+// The old linear search of Palette::findBestfit()
+static int linear_bestfit(const Palette* pal, int r, int g, int b)
+{
+  int bestfit = 0;
+  int lowest = INT_MAX;
+
+  r >>= 3;
+  g >>= 3;
+  b >>= 3;
+
+  for (int i=1; i<pal->size(); ++i) {
+    uint32_t c = pal->getEntry(i);
+    int dr = (_rgba_getr(c)>>3) - r;
+    int dg = (_rgba_getg(c)>>3) - g;
+    int db = (_rgba_getb(c)>>3) - b;
+    int d = dr*dr*30*30 + dg*dg*59*59 + db*db*11*11;
+    if (d < lowest) {
+      bestfit = i;
+      lowest = d;
+    }
+  }
+
+  return bestfit;
+}
+
+static void expect_same_bestfit(const Palette* pal)
+{
+  for (int r=0; r<256; r+=8)
+    for (int g=0; g<256; g+=8)
+      for (int b=0; b<256; b+=8)
+        ASSERT_EQ(linear_bestfit(pal, r, g, b), pal->findBestfit(r, g, b))
+          << "rgb(" << r << ", " << g << ", " << b << ")";
+}
+
+TEST(Palette, FindBestfitRandom)
+{
+  std::srand(1);
+
+  for (int n=2; n<=256; n*=2) {
+    Palette pal(FrameNumber(0), n);
+    for (int i=0; i<n; ++i)
+      pal.setEntry(i, _rgba(std::rand() & 255, std::rand() & 255, std::rand() & 255, 255));
+
+    expect_same_bestfit(&pal);
+  }
+}
+
+TEST(Palette, FindBestfitRepeatedEntries)
+{
+  // Lots of equal entries (black) and a few repeated colors in
+  // different positions, so the lowest index must be returned.
+  Palette pal(FrameNumber(0), 256);
+  for (int i=0; i<256; ++i)
+    pal.setEntry(i, _rgba(0, 0, 0, 255));
+  for (int i=20; i<256; i+=20) {
+    pal.setEntry(i, _rgba(255, i, 0, 255));
+    pal.setEntry(i+3, _rgba(255, i, 0, 255));
+  }
+
+  expect_same_bestfit(&pal);
+  EXPECT_EQ(1, pal.findBestfit(0, 0, 0));
+  EXPECT_EQ(40, pal.findBestfit(255, 40, 0));
+}
+
+TEST(Palette, FindBestfitTies)
+{
+  // Colors that are different with 8 bits per component but equal
+  // with 5 bits, and colors at the same distance of a lot of others.
+  Palette pal(FrameNumber(0), 64);
+  for (int i=0; i<64; ++i)
+    pal.setEntry(i, _rgba(128 + (i & 7), 64 + ((i >> 3) & 1) * 16, 64 - ((i >> 3) & 1) * 16, 255));
+
+  expect_same_bestfit(&pal);
+  EXPECT_EQ(1, pal.findBestfit(128, 64, 64));
+}
+
+TEST(Palette, FindBestfitAfterModifications)
+{
+  Palette pal(FrameNumber(0), 16);
+  for (int i=0; i<16; ++i)
+    pal.setEntry(i, _rgba(i*16, i*16, i*16, 255));
+  expect_same_bestfit(&pal);
+
+  pal.setEntry(15, _rgba(255, 0, 0, 255));
+  expect_same_bestfit(&pal);
+  EXPECT_EQ(15, pal.findBestfit(255, 0, 0));
+
+  pal.resize(32);
+  for (int i=16; i<32; ++i)
+    pal.setEntry(i, _rgba(0, i*8, 255, 255));
+  expect_same_bestfit(&pal);
+
+  SortPalette sorter(SortPalette::RGB_Green, true);
+  std::vector<int> mapping;
+  pal.sort(1, 31, &sorter, mapping);
+  expect_same_bestfit(&pal);
+}
+
+static void find_bestfit_colors(const Palette* pal, std::vector<int>* result)
+{
+  for (int c=0; c<(int)result->size(); ++c)
+    (*result)[c] = pal->findBestfit((c*7) & 255, (c*13) & 255, (c*29) & 255);
+}
+
+TEST(Palette, FindBestfitFromSeveralThreads)
+{
+  std::srand(2);
+
+  Palette pal(FrameNumber(0), 256);
+  for (int i=0; i<256; ++i)
+    pal.setEntry(i, _rgba(std::rand() & 255, std::rand() & 255, std::rand() & 255, 255));
+
+  // All threads start with an old index
+  std::vector<int> results[4];
+  for (int t=0; t<4; ++t)
+    results[t].resize(4096);
+
+  base::thread thr1(&find_bestfit_colors, &pal, &results[1]);
+  base::thread thr2(&find_bestfit_colors, &pal, &results[2]);
+  base::thread thr3(&find_bestfit_colors, &pal, &results[3]);
+  find_bestfit_colors(&pal, &results[0]);
+  thr1.join();
+  thr2.join();
+  thr3.join();
+
+  for (int t=0; t<4; ++t)
+    for (int c=0; c<4096; ++c)
+      ASSERT_EQ(linear_bestfit(&pal, (c*7) & 255, (c*13) & 255, (c*29) & 255), results[t][c])
+        << "thread=" << t << " c=" << c;
+}
@@ -22,8 +22,15 @@
 
 #include <algorithm>
 #include <limits>
+#include <string>
 #include <vector>
 
+#include "base/exception.h"
+#include "base/mutex.h"
+#include "base/parallel_for.h"
+#include "base/scoped_lock.h"
+#include "base/thread.h"
+#include "base/unique_ptr.h"
 #include "gfx/hsv.h"
 #include "gfx/rgb.h"
 #include "raster/blend.h"
@@ -47,37 +54,110 @@ static Image* ordered_dithering(const Image* src_image,
                                 const RgbMap* rgbmap,
                                 const Palette* palette);
 
-static void create_palette_from_bitmaps(const std::vector<Image*>& images, Palette* palette, bool has_background_layer);
+// Converts a RGB image to indexed diffusing the error of each pixel
+// to its neighbours (Floyd-Steinberg or Atkinson).
+static Image* error_diffusion_dithering(const Image* src_image,
+                                        DitheringMethod ditheringMethod,
+                                        const RgbMap* rgbmap,
+                                        const Palette* palette);
+
+typedef ColorHistogram<5, 6, 5> Histogram;
+
+static void add_image_samples(const Image* image, Histogram& histogram);
+
+// Adds the pixels of several images (cels, or frames rendered) to one
+// histogram for each group of contiguous images, so the histograms
+// can be created in parallel and then merged in the same order.
+class HistogramTask {
+public:
+  HistogramTask(const Sprite* sprite,
+                const std::vector<Image*>& images,
+                bool renderFrames,
+                std::vector<Histogram>& histograms)
+    : m_sprite(sprite)
+    , m_images(images)
+    , m_renderFrames(renderFrames)
+    , m_histograms(histograms)
+    , m_items(renderFrames ? (int)sprite->getTotalFrames(): (int)images.size()) {
+  }
 
-Palette* create_palette_from_rgb(const Sprite* sprite, FrameNumber frameNumber)
+  void operator()(int group) {
+    Histogram& histogram = m_histograms[group];
+    int groups = m_histograms.size();
+    int from = m_items * group / groups;
+    int to = m_items * (group+1) / groups;
+    base::UniquePtr<Image> flat_image;
+
+    if (m_renderFrames)
+      flat_image.reset(Image::create(IMAGE_RGB, m_sprite->getWidth(), m_sprite->getHeight()));
+
+    for (int i=from; i<to; ++i) {
+      if (m_renderFrames) {
+        // Sprite::render() doesn't modify the cel images (not even
+        // their mask color), so frames can be rendered from several
+        // threads.
+        image_clear(flat_image, 0);
+        m_sprite->render(flat_image, 0, 0, FrameNumber(i));
+        add_image_samples(flat_image, histogram);
+      }
+      else
+        add_image_samples(m_images[i], histogram);
+    }
+  }
+
+private:
+  const Sprite* m_sprite;
+  const std::vector<Image*>& m_images;
+  bool m_renderFrames;
+  std::vector<Histogram>& m_histograms;
+  int m_items;
+};
+
+Palette* create_palette_from_rgb(const Sprite* sprite, FrameNumber frameNumber,
+                                 QuantizationMethod method, bool allFrames)
 {
   bool has_background_layer = (sprite->getBackgroundLayer() != NULL);
   Palette* palette = new Palette(FrameNumber(0), 256);
-  Image* flat_image;
-
-  ImagesCollector images(sprite->getFolder(), // All layers
-                         frameNumber,         // Ignored, we'll use all frames
-                         true,                // All frames,
-                         false); // forWrite=false, read only
+  base::UniquePtr<Image> flat_image;
+  std::vector<Image*> image_array;
+
+  if (!allFrames) {
+    ImagesCollector images(sprite->getFolder(), // All layers
+                           frameNumber,         // Ignored, we'll use all frames
+                           true,                // All frames,
+                           false); // forWrite=false, read only
+
+    // Add a flat image with the current sprite's frame rendered
+    flat_image.reset(Image::create(sprite->getPixelFormat(), sprite->getWidth(), sprite->getHeight()));
+    image_clear(flat_image, 0);
+    sprite->render(flat_image, 0, 0, frameNumber);
+
+    // Create an array of images
+    for (ImagesCollector::ItemsIterator it=images.begin(); it!=images.end(); ++it)
+      image_array.push_back(it->image());
+    image_array.push_back(flat_image); // The 'flat_image'
+  }
 
-  // Add a flat image with the current sprite's frame rendered
-  flat_image = Image::create(sprite->getPixelFormat(), sprite->getWidth(), sprite->getHeight());
-  image_clear(flat_image, 0);
-  sprite->render(flat_image, 0, 0, frameNumber);
+  // Create one histogram for each thread and merge them
+  int items = (allFrames ? (int)sprite->getTotalFrames(): (int)image_array.size());
+  int groups = MID(1, base::thread::hardware_concurrency(), items);
+  std::vector<Histogram> histograms(groups);
+  HistogramTask task(sprite, image_array, allFrames, histograms);
+  base::parallel_for(groups, task);
 
-  // Create an array of images
-  size_t nimage = images.size() + 1; // +1 for flat_image
-  std::vector<Image*> image_array(nimage);
+  for (int i=1; i<groups; ++i)
+    histograms[0].addHistogram(histograms[i]);
 
-  size_t c = 0;
-  for (ImagesCollector::ItemsIterator it=images.begin(); it!=images.end(); ++it)
-    image_array[c++] = it->image();
-  image_array[c++] = flat_image; // The 'flat_image'
+  // If the sprite has a background layer, the first entry can be
+  // used, in other case the 0 indexed will be the mask color, so it
+  // will not be used later in the color conversion (from RGB to
+  // Indexed).
+  int first_usable_entry = (has_background_layer ? 0: 1);
 
   // Generate an optimized palette for all images
-  create_palette_from_bitmaps(image_array, palette, has_background_layer);
+  int used_colors = histograms[0].createOptimizedPalette(palette, first_usable_entry, 255, method);
+  //palette->resize(first_usable_entry+used_colors);   // TODO
 
-  delete flat_image;
   return palette;
 }
 
@@ -104,6 +184,13 @@ Image* convert_pixel_format(const Image* image,
            ditheringMethod == DITHERING_ORDERED) {
     return ordered_dithering(image, 0, 0, rgbmap, palette);
   }
+  // RGB -> Indexed with error diffusion
+  else if (image->getPixelFormat() == IMAGE_RGB &&
+           pixelFormat == IMAGE_INDEXED &&
+           (ditheringMethod == DITHERING_FLOYD_STEINBERG ||
+            ditheringMethod == DITHERING_ATKINSON)) {
+    return error_diffusion_dithering(image, ditheringMethod, rgbmap, palette);
+  }
 
   new_image = Image::create(pixelFormat, image->w, image->h);
   if (!new_image)
@@ -142,10 +229,7 @@ Image* convert_pixel_format(const Image* image,
             r = _rgba_getr(c);
             g = _rgba_getg(c);
             b = _rgba_getb(c);
-            if (_rgba_geta(c) == 0)
-              *idx_address = 0;
-            else
-              *idx_address = rgbmap->mapColor(r, g, b);
+            *idx_address = rgbmap->mapColor(r, g, b, _rgba_geta(c));
             rgb_address++;
             idx_address++;
           }
@@ -338,43 +422,221 @@ static Image* ordered_dithering(const Image* src_image,
   return dst_image;
 }
 
+//////////////////////////////////////////////////////////////////////
+// Error diffusion dithering
+//
+// The error of each pixel depends on the pixels at its left and in
+// the previous rows, so rows are converted in a pipeline: each row
+// is converted in blocks of pixels by a different thread, and a
+// block is started only when the previous row has finished the
+// blocks that diffuse error to it.
+
+namespace {
+
+  struct ErrorDiffusionEntry {
+    int dx, dy, weight;
+  };
+
+  struct ErrorDiffusionKernel {
+    int divisor;
+    int size;
+    ErrorDiffusionEntry entries[6];
+  };
+
+  const ErrorDiffusionKernel floyd_steinberg_kernel = {
+    16, 4, { { 1, 0, 7 }, { -1, 1, 3 }, { 0, 1, 5 }, { 1, 1, 1 } }
+  };
+
+  // Only 6/8 of the error is diffused
+  const ErrorDiffusionKernel atkinson_kernel = {
+    8, 6, { { 1, 0, 1 }, { 2, 0, 1 }, { -1, 1, 1 }, { 0, 1, 1 }, { 1, 1, 1 }, { 0, 2, 1 } }
+  };
+
+  // Width of the blocks of pixels. Entries of the kernels cannot be
+  // more than 2 pixels at the right/left, so rows of the pipeline
+  // don't write the error of the same pixels at the same time.
+  const int kErrorDiffusionBlockWidth = 64;
+
+  // Number of rows of accumulated errors (kernels diffuse the error
+  // two rows down at most). A row resets the errors it reads, so they
+  // can be reused by the next rows.
+  const int kErrorRows = 3;
+
+  class ErrorDiffusionTask {
+  public:
+    ErrorDiffusionTask(const Image* src_image, Image* dst_image,
+                       const ErrorDiffusionKernel& kernel,
+                       const RgbMap* rgbmap, const Palette* palette)
+      : m_src(src_image)
+      , m_dst(dst_image)
+      , m_kernel(kernel)
+      , m_rgbmap(rgbmap)
+      , m_palette(palette)
+      , m_blocks((src_image->w + kErrorDiffusionBlockWidth - 1) / kErrorDiffusionBlockWidth)
+      , m_errors(kErrorRows * src_image->w * 3, 0)
+      , m_progress(src_image->h, 0)
+      , m_failed(false) {
+    }
+
+    void operator()(int y) {
+      // If a row fails, the next rows (which wait its blocks) must
+      // fail too.
+      try {
+        convertRow(y);
+      }
+      catch (const std::exception& e) {
+        fail(e.what());
+        throw;
+      }
+      catch (...) {
+        fail("Unknown error in error diffusion dithering");
+        throw;
+      }
+    }
+
+  private:
+    void convertRow(int y) {
+      int w = m_src->w;
+
+      for (int block=0; block<m_blocks; ++block) {
+        // Wait the previous row to finish the next block
+        if (y > 0)
+          waitBlocks(y-1, MIN(block+2, m_blocks));
+
+        int x1 = block * kErrorDiffusionBlockWidth;
+        int x2 = MIN(x1 + kErrorDiffusionBlockWidth, w);
+        const uint32_t* src_address = image_address_fast<RgbTraits>(m_src, x1, y);
+        uint8_t* dst_address = image_address_fast<IndexedTraits>(m_dst, x1, y);
+        int* err = errorsAt(x1, y);
+
+        for (int x=x1; x<x2; ++x, ++src_address, ++dst_address, err+=3) {
+          uint32_t c = *src_address;
+
+          if (_rgba_geta(c) == 0) {
+            *dst_address = 0;
+            err[0] = err[1] = err[2] = 0;
+            continue;
+          }
+
+          int r = MID(0, _rgba_getr(c) + err[0] / m_kernel.divisor, 255);
+          int g = MID(0, _rgba_getg(c) + err[1] / m_kernel.divisor, 255);
+          int b = MID(0, _rgba_getb(c) + err[2] / m_kernel.divisor, 255);
+          err[0] = err[1] = err[2] = 0;
+
+          int index = m_rgbmap->mapColor(r, g, b);
+          uint32_t nearest = m_palette->getEntry(index);
+          *dst_address = index;
+
+          int er = r - _rgba_getr(nearest);
+          int eg = g - _rgba_getg(nearest);
+          int eb = b - _rgba_getb(nearest);
+
+          for (int i=0; i<m_kernel.size; ++i) {
+            const ErrorDiffusionEntry& entry = m_kernel.entries[i];
+            int u = x + entry.dx;
+            int v = y + entry.dy;
+            if (u < 0 || u >= w || v >= m_src->h)
+              continue;
+
+            int* dst_err = errorsAt(u, v);
+            dst_err[0] += er * entry.weight;
+            dst_err[1] += eg * entry.weight;
+            dst_err[2] += eb * entry.weight;
+          }
+        }
+
+        base::scoped_lock lock(m_mutex);
+        m_progress[y] = block+1;
+      }
+    }
+
+    int* errorsAt(int x, int y) {
+      return &m_errors[((y % kErrorRows) * m_src->w + x) * 3];
+    }
+
+    // Throws an exception with the same message if a row failed.
+    void waitBlocks(int y, int blocks) {
+      for (;;) {
+        {
+          base::scoped_lock lock(m_mutex);
+          if (m_progress[y] >= blocks)
+            return;
+          if (m_failed)
+            throw base::Exception(m_error);
+        }
+        base::this_thread::yield();
+      }
+    }
+
+    void fail(const char* msg) {
+      base::scoped_lock lock(m_mutex);
+      if (!m_failed) {
+        m_failed = true;
+        m_error = msg;
+      }
+    }
+
+    const Image* m_src;
+    Image* m_dst;
+    const ErrorDiffusionKernel& m_kernel;
+    const RgbMap* m_rgbmap;
+    const Palette* m_palette;
+    int m_blocks;
+    std::vector<int> m_errors;
+    // Number of finished blocks of each row, and the error of the
+    // first row that failed (guarded by m_mutex)
+    std::vector<int> m_progress;
+    bool m_failed;
+    std::string m_error;
+    base::mutex m_mutex;
+  };
+
+} // anonymous namespace
+
+static Image* error_diffusion_dithering(const Image* src_image,
+                                        DitheringMethod ditheringMethod,
+                                        const RgbMap* rgbmap,
+                                        const Palette* palette)
+{
+  Image* dst_image = Image::create(IMAGE_INDEXED, src_image->w, src_image->h);
+  if (!dst_image)
+    return NULL;
+
+  ErrorDiffusionTask task(src_image, dst_image,
+                          (ditheringMethod == DITHERING_ATKINSON ? atkinson_kernel:
+                                                                  floyd_steinberg_kernel),
+                          rgbmap, palette);
+
+  // Rows are given to threads in order (see base::parallel_for), so
+  // the previous row of each one is always being converted.
+  base::parallel_for(src_image->h, task);
+
+  return dst_image;
+}
+
 //////////////////////////////////////////////////////////////////////
 // Creation of optimized palette for RGB images
 // by David Capello
 
-static void create_palette_from_bitmaps(const std::vector<Image*>& images, Palette* palette, bool has_background_layer)
+static void add_image_samples(const Image* image, Histogram& histogram)
 {
-  quantization::ColorHistogram<5, 6, 5> histogram;
   uint32_t color;
   RgbTraits::address_t address;
 
-  // If the sprite has a background layer, the first entry can be
-  // used, in other case the 0 indexed will be the mask color, so it
-  // will not be used later in the color conversion (from RGB to
-  // Indexed).
-  int first_usable_entry = (has_background_layer ? 0: 1);
-
-  for (int i=0; i<(int)images.size(); ++i) {
-    const Image* image = images[i];
-
-    for (int y=0; y<image->h; ++y) {
-      address = image_address_fast<RgbTraits>(image, 0, y);
-
-      for (int x=0; x<image->w; ++x) {
-        color = *address;
+  for (int y=0; y<image->h; ++y) {
+    address = image_address_fast<RgbTraits>(image, 0, y);
 
-        if (_rgba_geta(color) > 0) {
-          color |= _rgba(0, 0, 0, 255);
-          histogram.addSamples(color, 1);
-        }
+    for (int x=0; x<image->w; ++x) {
+      color = *address;
 
-        ++address;
+      if (_rgba_geta(color) > 0) {
+        color |= _rgba(0, 0, 0, 255);
+        histogram.addSamples(color, 1);
       }
+
+      ++address;
     }
   }
-
-  int used_colors = histogram.createOptimizedPalette(palette, first_usable_entry, 255);
-  //palette->resize(first_usable_entry+used_colors);   // TODO
 }
 
 } // namespace quantization
@@ -22,6 +22,7 @@
 #include "raster/dithering_method.h"
 #include "raster/frame_number.h"
 #include "raster/pixel_format.h"
+#include "raster/quantization_method.h"
 
 namespace raster {
 
@@ -34,7 +35,12 @@ namespace raster {
   namespace quantization {
 
     // Creates a new palette suitable to quantize the given RGB sprite to Indexed color.
-    Palette* create_palette_from_rgb(const Sprite* sprite, FrameNumber frameNumber);
+    // If "allFrames" is false, the palette is created from the images
+    // of all cels and the given frame rendered; if it's true, from all
+    // frames rendered (one palette optimized for the whole animation).
+    Palette* create_palette_from_rgb(const Sprite* sprite, FrameNumber frameNumber,
+                                     QuantizationMethod method = QUANTIZATION_MEDIAN_CUT,
+                                     bool allFrames = false);
 
     // Changes the image pixel format. The dithering method is used only
     // when you want to convert from RGB to Indexed.
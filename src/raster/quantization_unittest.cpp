@@ -0,0 +1,384 @@
+/* Aseprite
+ * Copyright (C) 2001-2013  David Capello
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#include "tests/test.h"
+
+#include "base/unique_ptr.h"
+#include "raster/cel.h"
+#include "raster/color_histogram.h"
+#include "raster/image.h"
+#include "raster/images_collector.h"
+#include "raster/layer.h"
+#include "raster/octree.h"
+#include "raster/palette.h"
+#include "raster/quantization.h"
+#include "raster/rgbmap.h"
+#include "raster/sprite.h"
+#include "raster/stock.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <vector>
+
+using namespace raster;
+using namespace raster::quantization;
+
+typedef ColorHistogram<5, 6, 5> Histogram;
+
+static uint32_t random_color(int ncolors)
+{
+  int i = std::rand() % ncolors;
+  return _rgba((i*37) & 255, (i*101) & 255, (i*13) & 255, 255);
+}
+
+static void expect_same_palettes(const Palette* a, const Palette* b)
+{
+  ASSERT_EQ(a->size(), b->size());
+  for (int i=0; i<a->size(); ++i)
+    ASSERT_EQ(a->getEntry(i), b->getEntry(i)) << "entry " << i;
+}
+
+static void expect_same_histograms(Histogram& a, Histogram& b)
+{
+  for (int i=0; i<Histogram::RElements; ++i)
+    for (int j=0; j<Histogram::GElements; ++j)
+      for (int k=0; k<Histogram::BElements; ++k)
+        ASSERT_EQ(a.at(i, j, k), b.at(i, j, k));
+
+  QuantizationMethod methods[] = { QUANTIZATION_MEDIAN_CUT, QUANTIZATION_OCTREE };
+  for (int m=0; m<2; ++m) {
+    Palette palA(FrameNumber(0), 256);
+    Palette palB(FrameNumber(0), 256);
+    EXPECT_EQ(a.createOptimizedPalette(&palA, 1, 255, methods[m]),
+              b.createOptimizedPalette(&palB, 1, 255, methods[m]));
+    expect_same_palettes(&palA, &palB);
+  }
+}
+
+TEST(ColorHistogram, AddHistogram)
+{
+  // Few colors (high-precision table) and a lot of colors
+  int ncolors[] = { 20, 255, 256, 5000 };
+  std::srand(1);
+
+  for (int n=0; n<4; ++n) {
+    std::vector<uint32_t> samples(20000);
+    for (int i=0; i<(int)samples.size(); ++i)
+      samples[i] = random_color(ncolors[n]);
+
+    Histogram whole;
+    for (int i=0; i<(int)samples.size(); ++i)
+      whole.addSamples(samples[i]);
+
+    // Split the samples in groups like create_palette_from_rgb()
+    for (int groups=2; groups<=5; ++groups) {
+      std::vector<Histogram> histograms(groups);
+      for (int g=0; g<groups; ++g) {
+        int from = samples.size() * g / groups;
+        int to = samples.size() * (g+1) / groups;
+        for (int i=from; i<to; ++i)
+          histograms[g].addSamples(samples[i]);
+      }
+
+      for (int g=1; g<groups; ++g)
+        histograms[0].addHistogram(histograms[g]);
+
+      expect_same_histograms(whole, histograms[0]);
+    }
+  }
+}
+
+TEST(Octree, KeepsColorsThatFit)
+{
+  // Colors with the precision of the histogram (5, 6 and 5 bits)
+  Histogram histogram;
+  std::vector<uint32_t> expected;
+  for (int i=0; i<40; ++i) {
+    int r = (i*7) & 31, g = (i*13) & 63, b = (i*3) & 31;
+    uint32_t color = _rgba(255*r/31, 255*g/63, 255*b/31, 255);
+    histogram.addSamples(color, i+1);
+    expected.push_back(color);
+  }
+
+  std::vector<uint32_t> result;
+  octree_quantization(histogram, 40, result);
+
+  std::sort(expected.begin(), expected.end());
+  std::sort(result.begin(), result.end());
+  EXPECT_TRUE(expected == result);
+}
+
+TEST(Octree, ReducesToMaxColors)
+{
+  std::srand(2);
+
+  Histogram histogram;
+  for (int i=0; i<100000; ++i)
+    histogram.addSamples(_rgba(std::rand() & 255, std::rand() & 255, std::rand() & 255, 255));
+
+  size_t maxColors[] = { 1, 2, 16, 255 };
+  for (int i=0; i<4; ++i) {
+    std::vector<uint32_t> result;
+    octree_quantization(histogram, maxColors[i], result);
+
+    EXPECT_LE(result.size(), maxColors[i]);
+    EXPECT_GT(result.size(), maxColors[i]/8);
+
+    // Each leaf has different samples, so there are no repeated colors
+    std::sort(result.begin(), result.end());
+    EXPECT_TRUE(std::adjacent_find(result.begin(), result.end()) == result.end());
+  }
+}
+
+TEST(Octree, MergedColorsAreWeightedMeans)
+{
+  Octree octree(8);
+  octree.addColor(0, 0, 0, 3);
+  octree.addColor(4, 8, 12, 1);
+
+  std::vector<uint32_t> result;
+  octree.reduce(1, result);
+
+  ASSERT_EQ(1u, result.size());
+  EXPECT_EQ(_rgba(1, 2, 3, 255), result[0]);
+}
+
+// Sprite with "nframes" frames, each one with a cel of random colors
+// in one of two layers.
+static Sprite* create_sprite(int nframes, int ncolors)
+{
+  base::UniquePtr<Sprite> sprite(new Sprite(IMAGE_RGB, 32, 32, 256));
+  sprite->setTotalFrames(FrameNumber(nframes));
+
+  for (int l=0; l<2; ++l) {
+    LayerImage* layer = new LayerImage(sprite);
+    sprite->getFolder()->addLayer(layer);
+
+    for (int f=l; f<nframes; f+=2) {
+      Image* image = Image::create(IMAGE_RGB, 16, 16);
+      for (int y=0; y<16; ++y)
+        for (int x=0; x<16; ++x)
+          image->putpixel(x, y, (std::rand() % 4 == 0 ? 0: random_color(ncolors)));
+
+      Cel* cel = new Cel(FrameNumber(f), sprite->getStock()->addImage(image));
+      cel->setPosition(f, 16-f);
+      layer->addCel(cel);
+    }
+  }
+
+  return sprite.release();
+}
+
+static void add_image_samples(const Image* image, Histogram& histogram)
+{
+  for (int y=0; y<image->h; ++y)
+    for (int x=0; x<image->w; ++x) {
+      uint32_t color = image->getpixel(x, y);
+      if (_rgba_geta(color) > 0)
+        histogram.addSamples(color | _rgba(0, 0, 0, 255));
+    }
+}
+
+TEST(Quantization, CreatePaletteFromRgb)
+{
+  int ncolors[] = { 50, 1000 };
+  QuantizationMethod methods[] = { QUANTIZATION_MEDIAN_CUT, QUANTIZATION_OCTREE };
+  std::srand(3);
+
+  for (int n=0; n<2; ++n) {
+    base::UniquePtr<Sprite> sprite(create_sprite(9, ncolors[n]));
+    base::UniquePtr<Image> flat(Image::create(IMAGE_RGB, 32, 32));
+
+    // Histogram of all cels plus the frame 4 rendered
+    Histogram celsHistogram;
+    ImagesCollector images(sprite->getFolder(), FrameNumber(0), true, false);
+    for (ImagesCollector::ItemsIterator it=images.begin(); it!=images.end(); ++it)
+      add_image_samples(it->image(), celsHistogram);
+    image_clear(flat, 0);
+    sprite->render(flat, 0, 0, FrameNumber(4));
+    add_image_samples(flat, celsHistogram);
+
+    // Histogram of all frames rendered
+    Histogram framesHistogram;
+    for (int f=0; f<9; ++f) {
+      image_clear(flat, 0);
+      sprite->render(flat, 0, 0, FrameNumber(f));
+      add_image_samples(flat, framesHistogram);
+    }
+
+    for (int m=0; m<2; ++m) {
+      Palette expected(FrameNumber(0), 256);
+      celsHistogram.createOptimizedPalette(&expected, 1, 255, methods[m]);
+      base::UniquePtr<Palette> palette(create_palette_from_rgb(sprite, FrameNumber(4), methods[m], false));
+      expect_same_palettes(&expected, palette);
+
+      Palette expectedAllFrames(FrameNumber(0), 256);
+      framesHistogram.createOptimizedPalette(&expectedAllFrames, 1, 255, methods[m]);
+      palette.reset(create_palette_from_rgb(sprite, FrameNumber(4), methods[m], true));
+      expect_same_palettes(&expectedAllFrames, palette);
+    }
+  }
+}
+
+TEST(Quantization, CreatePaletteFromRgbKeepsCelImages)
+{
+  std::srand(4);
+  base::UniquePtr<Sprite> sprite(create_sprite(9, 200));
+  Stock* stock = sprite->getStock();
+
+  // Cel images with a mask color different from the transparent
+  // color of the sprite (the frames are rendered from several threads,
+  // so they cannot modify the cel images).
+  std::vector<Image*> copies;
+  for (int i=1; i<stock->size(); ++i) {
+    stock->getImage(i)->mask_color = _rgba(1, 2, 3, 0);
+    copies.push_back(Image::createCopy(stock->getImage(i)));
+  }
+
+  base::UniquePtr<Palette> palette(create_palette_from_rgb(sprite, FrameNumber(0),
+                                                           QUANTIZATION_OCTREE, true));
+
+  for (int i=1; i<stock->size(); ++i) {
+    EXPECT_EQ(_rgba(1, 2, 3, 0), stock->getImage(i)->mask_color);
+    EXPECT_EQ(0, image_count_diff(copies[i-1], stock->getImage(i)));
+    delete copies[i-1];
+  }
+}
+
+// Error diffusion of the whole image in one thread, keeping the
+// errors of all pixels.
+static Image* reference_error_diffusion(const Image* src, DitheringMethod method,
+                                        const RgbMap* rgbmap, const Palette* palette)
+{
+  struct Entry { int dx, dy, weight; };
+  const Entry floydSteinberg[] = { { 1, 0, 7 }, { -1, 1, 3 }, { 0, 1, 5 }, { 1, 1, 1 } };
+  const Entry atkinson[] = { { 1, 0, 1 }, { 2, 0, 1 }, { -1, 1, 1 }, { 0, 1, 1 }, { 1, 1, 1 }, { 0, 2, 1 } };
+  const Entry* kernel = (method == DITHERING_ATKINSON ? atkinson: floydSteinberg);
+  int size = (method == DITHERING_ATKINSON ? 6: 4);
+  int divisor = (method == DITHERING_ATKINSON ? 8: 16);
+
+  Image* dst = Image::create(IMAGE_INDEXED, src->w, src->h);
+  std::vector<int> errors(src->w*src->h*3, 0);
+
+  for (int y=0; y<src->h; ++y) {
+    for (int x=0; x<src->w; ++x) {
+      uint32_t c = src->getpixel(x, y);
+      if (_rgba_geta(c) == 0) {
+        dst->putpixel(x, y, 0);
+        continue;
+      }
+
+      int* err = &errors[(y*src->w + x)*3];
+      int r = MID(0, _rgba_getr(c) + err[0] / divisor, 255);
+      int g = MID(0, _rgba_getg(c) + err[1] / divisor, 255);
+      int b = MID(0, _rgba_getb(c) + err[2] / divisor, 255);
+      int index = rgbmap->mapColor(r, g, b);
+      uint32_t nearest = palette->getEntry(index);
+      dst->putpixel(x, y, index);
+
+      for (int i=0; i<size; ++i) {
+        int u = x + kernel[i].dx;
+        int v = y + kernel[i].dy;
+        if (u >= 0 && u < src->w && v < src->h) {
+          int* e = &errors[(v*src->w + u)*3];
+          e[0] += (r - _rgba_getr(nearest)) * kernel[i].weight;
+          e[1] += (g - _rgba_getg(nearest)) * kernel[i].weight;
+          e[2] += (b - _rgba_getb(nearest)) * kernel[i].weight;
+        }
+      }
+    }
+  }
+
+  return dst;
+}
+
+static void expect_same_images(const Image* a, const Image* b)
+{
+  ASSERT_EQ(a->w, b->w);
+  ASSERT_EQ(a->h, b->h);
+  for (int y=0; y<a->h; ++y)
+    for (int x=0; x<a->w; ++x)
+      ASSERT_EQ(a->getpixel(x, y), b->getpixel(x, y)) << "(" << x << ", " << y << ")";
+}
+
+TEST(Quantization, ErrorDiffusionDithering)
+{
+  DitheringMethod methods[] = { DITHERING_FLOYD_STEINBERG, DITHERING_ATKINSON };
+  // Widths around the blocks of 64 pixels of the pipeline
+  int sizes[][2] = { { 1, 1 }, { 3, 50 }, { 63, 5 }, { 64, 64 }, { 65, 20 }, { 200, 33 } };
+  std::srand(4);
+
+  Palette palette(FrameNumber(0), 16);
+  for (int i=0; i<16; ++i)
+    palette.setEntry(i, _rgba(std::rand() & 255, std::rand() & 255, std::rand() & 255, 255));
+  RgbMap rgbmap;
+  rgbmap.regenerate(&palette);
+
+  for (int s=0; s<6; ++s) {
+    int w = sizes[s][0], h = sizes[s][1];
+    base::UniquePtr<Image> src(Image::create(IMAGE_RGB, w, h));
+    for (int y=0; y<h; ++y)
+      for (int x=0; x<w; ++x)
+        src->putpixel(x, y, (std::rand() % 10 == 0 ?
+                             _rgba(255, 0, 0, 0):
+                             _rgba(x*255/w, y*255/h, std::rand() & 255, 255)));
+
+    for (int m=0; m<2; ++m) {
+      base::UniquePtr<Image> expected(reference_error_diffusion(src, methods[m], &rgbmap, &palette));
+      base::UniquePtr<Image> result(convert_pixel_format(src, IMAGE_INDEXED, methods[m],
+                                                         &rgbmap, &palette, false));
+      expect_same_images(expected, result);
+    }
+  }
+}
+
+TEST(Quantization, ErrorDiffusionKeepsMeanColor)
+{
+  // 50% gray with black and white: about half of the pixels are white
+  Palette palette(FrameNumber(0), 3);
+  palette.setEntry(0, _rgba(0, 0, 0, 0));
+  palette.setEntry(1, _rgba(0, 0, 0, 255));
+  palette.setEntry(2, _rgba(255, 255, 255, 255));
+  RgbMap rgbmap;
+  rgbmap.regenerate(&palette);
+
+  base::UniquePtr<Image> src(Image::create(IMAGE_RGB, 100, 100));
+  image_clear(src, _rgba(128, 128, 128, 255));
+
+  base::UniquePtr<Image> result(convert_pixel_format(src, IMAGE_INDEXED, DITHERING_FLOYD_STEINBERG,
+                                                     &rgbmap, &palette, false));
+  int white = 0;
+  for (int y=0; y<100; ++y)
+    for (int x=0; x<100; ++x) {
+      int index = result->getpixel(x, y);
+      ASSERT_TRUE(index == 1 || index == 2);
+      if (index == 2)
+        ++white;
+    }
+
+  EXPECT_NEAR(100*100*128/255, white, 100);
+
+  // Colors of the palette don't have error to diffuse
+  image_clear(src, _rgba(255, 255, 255, 255));
+  src->putpixel(10, 10, _rgba(0, 0, 0, 255));
+  result.reset(convert_pixel_format(src, IMAGE_INDEXED, DITHERING_ATKINSON,
+                                    &rgbmap, &palette, false));
+  for (int y=0; y<100; ++y)
+    for (int x=0; x<100; ++x)
+      ASSERT_EQ(x == 10 && y == 10 ? 1: 2, result->getpixel(x, y));
+}
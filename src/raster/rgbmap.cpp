@@ -22,84 +22,211 @@
 
 #include "raster/rgbmap.h"
 
+#include "base/scoped_lock.h"
+#include "raster/image.h"
 #include "raster/palette.h"
 
-#include <allegro.h>
+#include <algorithm>
+#include <climits>
+#include <cstdlib>
 
 namespace raster {
 
-class RgbMapImpl {
-public:
-  RgbMapImpl() {
-    m_allegMap = new RGB_MAP;
-    m_palette = NULL;
-    m_modifications = 0;
-  }
+namespace {
 
-  ~RgbMapImpl() {
-    delete m_allegMap;
-  }
+  // Weights of each component to calculate the distance between two
+  // colors (the same used by Palette::findBestfit()).
+  enum { RWeight = 30*30, GWeight = 59*59, BWeight = 11*11 };
 
-  bool match(const Palette* palette) const {
-    return (m_palette == palette &&
-            m_modifications == palette->getModifications());
+  // Minimum and maximum distance between a value and any value in the
+  // range [lo, hi].
+  inline int min_distance(int value, int lo, int hi)
+  {
+    return (value < lo ? lo-value: (value > hi ? value-hi: 0));
   }
 
-  void regenerate(const Palette* palette) {
-    m_palette = palette;
-    m_modifications = palette->getModifications();
-
-    PALETTE allegPal;
-    palette->toAllegro(allegPal);
-    create_rgb_table(m_allegMap, allegPal, NULL);
-
-    for (int r=0; r<32; ++r)
-      for (int g=0; g<32; ++g)
-        for (int b=0; b<32; ++b) {
-          if (m_allegMap->data[r][g][b] >= palette->size())
-            m_allegMap->data[r][g][b] = palette->findBestfit(_rgb_scale_5[r],
-                                                             _rgb_scale_5[g],
-                                                             _rgb_scale_5[b]);
-        }
+  inline int max_distance(int value, int lo, int hi)
+  {
+    return std::max(std::abs(value-lo), std::abs(value-hi));
   }
 
-  int mapColor(int r, int g, int b) const {
-    ASSERT(r >= 0 && r < 256);
-    ASSERT(g >= 0 && g < 256);
-    ASSERT(b >= 0 && b < 256);
-    return m_allegMap->data[r>>3][g>>3][b>>3];
-  }
-
-private:
-  RGB_MAP* m_allegMap;
-  const Palette* m_palette;
-  int m_modifications;
-};
+}
 
-RgbMap::RgbMap()
+RgbMap::RgbMap(int bits)
   : GfxObj(GFXOBJ_RGBMAP)
+  , m_bits(bits)
+  , m_shift(8 - bits)
+  , m_palette(NULL)
+  , m_modifications(0)
+  , m_map(1 << (3*bits), 0)
+  , m_blockReady(1 << (3*BlockBits), 0)
 {
-  m_impl = new RgbMapImpl;
+  ASSERT(bits >= 5 && bits <= 6);
 }
 
 RgbMap::~RgbMap()
 {
-  delete m_impl;
 }
 
 bool RgbMap::match(const Palette* palette) const
 {
-  return m_impl->match(palette);
+  return (m_palette == palette &&
+          m_modifications == palette->getModifications());
 }
 
+// For each block and palette entry, we keep the minimum and maximum
+// (weighted) distance in each axis between the entry and the block,
+// so calculateBlock() can discard entries quickly.
 void RgbMap::regenerate(const Palette* palette)
 {
-  m_impl->regenerate(palette);
+  m_palette = palette;
+  m_modifications = palette->getModifications();
+
+  m_entries.clear();
+  for (int i=1; i<palette->size(); ++i) {
+    uint32_t c = palette->getEntry(i);
+    if (_rgba_geta(c) != 0) {
+      Entry entry = { i, _rgba_getr(c), _rgba_getg(c), _rgba_getb(c) };
+      m_entries.push_back(entry);
+    }
+  }
+
+  const int n = m_entries.size();
+  const int blocks = (1 << BlockBits);
+  const int blockSize = (1 << (m_bits - BlockBits));
+  const int weights[3] = { RWeight, GWeight, BWeight };
+
+  m_axisDist.resize(3*blockSize*std::max(n, 1));
+  m_minDist.resize(3*blocks*n);
+  m_maxDist.resize(3*blocks*n);
+
+  for (int axis=0; axis<3; ++axis) {
+    for (int u=0; u<blocks; ++u) {
+      int lo = cellValue(u*blockSize);
+      int hi = cellValue((u+1)*blockSize - 1);
+      int* minDist = &m_minDist[(axis*blocks + u)*n];
+      int* maxDist = &m_maxDist[(axis*blocks + u)*n];
+
+      for (int e=0; e<n; ++e) {
+        int value = (axis == 0 ? m_entries[e].r:
+                     axis == 1 ? m_entries[e].g: m_entries[e].b);
+        int d1 = min_distance(value, lo, hi);
+        int d2 = max_distance(value, lo, hi);
+        minDist[e] = d1*d1*weights[axis];
+        maxDist[e] = d2*d2*weights[axis];
+      }
+    }
+  }
+
+  // Entries will be calculated again when they are used
+  std::fill(m_blockReady.begin(), m_blockReady.end(), 0);
+}
+
+void RgbMap::calculateEntry(int i) const
+{
+  const int mask = (1 << m_bits) - 1;
+  const int blockShift = m_bits - BlockBits;
+  const int rb = ((i >> (2*m_bits)) & mask) >> blockShift;
+  const int gb = ((i >> m_bits) & mask) >> blockShift;
+  const int bb = (i & mask) >> blockShift;
+  int& ready = m_blockReady[(rb << (2*BlockBits)) | (gb << BlockBits) | bb];
+
+  base::scoped_lock lock(m_mutex);
+
+  // Other thread could have calculated this block
+  if (!ready) {
+    calculateBlock(rb, gb, bb);
+    base::atomic_store_release(&ready, 1);
+  }
+}
+
+// Calculates the nearest palette entry of each cell in the block.
+// Only entries which minimum distance to the block is less than the
+// maximum distance of the best entry can be the nearest one of some
+// cell, so we filter them first.
+void RgbMap::calculateBlock(int rb, int gb, int bb) const
+{
+  const int n = m_entries.size();
+  const int blocks = (1 << BlockBits);
+  const int blockSize = (1 << (m_bits - BlockBits));
+  const int r1 = rb*blockSize;
+  const int g1 = gb*blockSize;
+  const int b1 = bb*blockSize;
+
+  m_candidates.clear();
+
+  if (n > 0) {
+    const int* rmin = &m_minDist[(0*blocks + rb)*n];
+    const int* gmin = &m_minDist[(1*blocks + gb)*n];
+    const int* bmin = &m_minDist[(2*blocks + bb)*n];
+    const int* rmax = &m_maxDist[(0*blocks + rb)*n];
+    const int* gmax = &m_maxDist[(1*blocks + gb)*n];
+    const int* bmax = &m_maxDist[(2*blocks + bb)*n];
+    int e, lowestMax = INT_MAX;
+
+    for (e=0; e<n; ++e)
+      lowestMax = std::min(lowestMax, rmax[e] + gmax[e] + bmax[e]);
+
+    for (e=0; e<n; ++e)
+      if (rmin[e] + gmin[e] + bmin[e] <= lowestMax)
+        m_candidates.push_back(m_entries[e]);
+  }
+  else {
+    // Without usable entries, all colors are mapped to the index 0
+    Entry entry = { 0, 0, 0, 0 };
+    m_candidates.push_back(entry);
+  }
+
+  // Distance in each axis between each candidate and each cell of
+  // the block, so the distance to a cell is just the sum of three
+  // values of this table.
+  const int nc = m_candidates.size();
+  int* rdist = &m_axisDist[0];
+  int* gdist = rdist + blockSize*nc;
+  int* bdist = gdist + blockSize*nc;
+
+  for (int j=0; j<blockSize; ++j) {
+    int r = cellValue(r1+j);
+    int g = cellValue(g1+j);
+    int b = cellValue(b1+j);
+
+    for (int k=0; k<nc; ++k) {
+      const Entry& entry = m_candidates[k];
+      rdist[j*nc + k] = (entry.r-r)*(entry.r-r)*RWeight;
+      gdist[j*nc + k] = (entry.g-g)*(entry.g-g)*GWeight;
+      bdist[j*nc + k] = (entry.b-b)*(entry.b-b)*BWeight;
+    }
+  }
+
+  for (int rj=0; rj<blockSize; ++rj) {
+    for (int gj=0; gj<blockSize; ++gj) {
+      const int* rd = rdist + rj*nc;
+      const int* gd = gdist + gj*nc;
+      uint16_t* cell = &m_map[((r1+rj) << (2*m_bits)) | ((g1+gj) << m_bits) | b1];
+
+      for (int bj=0; bj<blockSize; ++bj, ++cell) {
+        const int* bd = bdist + bj*nc;
+        int bestfit = 0;
+        int lowest = INT_MAX;
+
+        for (int k=0; k<nc; ++k) {
+          int diff = rd[k] + gd[k] + bd[k];
+          if (diff < lowest) {
+            bestfit = k;
+            lowest = diff;
+          }
+        }
+
+        *cell = m_candidates[bestfit].index;
+      }
+    }
+  }
 }
 
-int RgbMap::mapColor(int r, int g, int b) const
+// Returns the 8-bit value of the color component of the given cell.
+int RgbMap::cellValue(int cell) const
 {
-  return m_impl->mapColor(r, g, b);
+  return cell * 255 / ((1 << m_bits) - 1);
 }
 
 } // namespace raster
@@ -19,25 +19,100 @@
 #ifndef RASTER_RGBMAP_H_INCLUDED
 #define RASTER_RGBMAP_H_INCLUDED
 
+#include "base/atomic.h"
 #include "base/disable_copying.h"
+#include "base/mutex.h"
 #include "raster/gfxobj.h"
 
+#include <vector>
+
 namespace raster {
 
   class Palette;
 
+  // Table to convert RGB colors to the nearest palette index. Each
+  // component is reduced to "bits" (5 or 6) bits, so the table has
+  // 2^(3*bits) entries.
+  //
+  // Entries are calculated the first time they are used, so
+  // regenerate() is cheap (e.g. when the palette is being edited and
+  // it changes frequently). The index 0 is reserved for the
+  // transparent color, and fully transparent palette entries are
+  // never used.
   class RgbMap : public GfxObj {
   public:
-    RgbMap();
+    enum { DefaultBits = 5 };
+
+    explicit RgbMap(int bits = DefaultBits);
     virtual ~RgbMap();
 
+    int getBits() const { return m_bits; }
+
     bool match(const Palette* palette) const;
     void regenerate(const Palette* palette);
 
-    int mapColor(int r, int g, int b) const;
+    int mapColor(int r, int g, int b) const {
+      ASSERT(r >= 0 && r < 256);
+      ASSERT(g >= 0 && g < 256);
+      ASSERT(b >= 0 && b < 256);
+
+      int i = (((r >> m_shift) << (2*m_bits)) |
+               ((g >> m_shift) << m_bits) |
+               (b >> m_shift));
+      int block = (((r >> (8-BlockBits)) << (2*BlockBits)) |
+                   ((g >> (8-BlockBits)) << BlockBits) |
+                   (b >> (8-BlockBits)));
+
+      // The entry can be read only after the block is marked as ready
+      if (!base::atomic_load_acquire(&m_blockReady[block]))
+        calculateEntry(i);
+      return m_map[i];
+    }
+
+    // Like mapColor() but a fully transparent color is converted to
+    // the index 0 (the transparent index of indexed images).
+    int mapColor(int r, int g, int b, int a) const {
+      return (a == 0 ? 0: mapColor(r, g, b));
+    }
 
   private:
-    class RgbMapImpl* m_impl;
+    // The color space is divided in 8x8x8 blocks of cells, all cells
+    // of a block are calculated at the same time.
+    enum { BlockBits = 3 };
+
+    struct Entry {
+      int index, r, g, b;
+    };
+
+    typedef std::vector<Entry> Entries;
+
+    void calculateEntry(int i) const;
+    void calculateBlock(int rb, int gb, int bb) const;
+    int cellValue(int cell) const;
+
+    int m_bits;
+    int m_shift;
+    const Palette* m_palette;
+    int m_modifications;
+
+    // Palette entries that can be used by the map.
+    Entries m_entries;
+
+    // Minimum/maximum distance in each axis between each block and
+    // each entry, indexed by [(axis*blocks + block)*entries + entry].
+    std::vector<int> m_minDist;
+    std::vector<int> m_maxDist;
+
+    // Several threads can use the same RgbMap (e.g. filters applied
+    // in parallel), so blocks are calculated with m_mutex locked, and
+    // then they are marked as ready in m_blockReady (with release
+    // semantics). Entries of a block are read only after its ready
+    // flag is seen (with acquire semantics).
+    mutable std::vector<uint16_t> m_map;
+    mutable std::vector<int> m_blockReady;
+    mutable Entries m_candidates;
+    mutable std::vector<int> m_axisDist;
+    mutable base::mutex m_mutex;
 
     DISABLE_COPYING(RgbMap);
   };
@@ -0,0 +1,170 @@
+/* Aseprite
+ * Copyright (C) 2001-2013  David Capello
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#include "tests/test.h"
+
+#include "raster/image.h"
+#include "raster/palette.h"
+#include "raster/rgbmap.h"
+
+#include <climits>
+#include <cstdlib>
+
+using namespace raster;
+
+static int cell_value(int cell, int bits)
+{
+  return cell * 255 / ((1 << bits) - 1);
+}
+
+// Nearest palette entry of the given color calculating the whole map
+// (the result that all RgbMap entries must have).
+static int full_bestfit(const Palette* pal, int r, int g, int b)
+{
+  int bestfit = 0;
+  int lowest = INT_MAX;
+
+  for (int i=1; i<pal->size(); ++i) {
+    uint32_t c = pal->getEntry(i);
+    if (_rgba_geta(c) == 0)
+      continue;
+
+    int dr = _rgba_getr(c) - r;
+    int dg = _rgba_getg(c) - g;
+    int db = _rgba_getb(c) - b;
+    int d = dr*dr*30*30 + dg*dg*59*59 + db*db*11*11;
+    if (d < lowest) {
+      bestfit = i;
+      lowest = d;
+    }
+  }
+
+  return bestfit;
+}
+
+// Maps all cells in a scattered order (so the map is calculated
+// lazily in different blocks) and compares them with the full map.
+static void expect_full_map(const RgbMap& rgbmap, const Palette* pal)
+{
+  int bits = rgbmap.getBits();
+  int n = (1 << bits);
+  int cells = n*n*n;
+
+  // 7919 is prime, so i*7919 % cells visits all cells
+  for (int i=0; i<cells; ++i) {
+    int cell = (int)(((long long)i*7919) % cells);
+    int r = cell_value((cell >> (2*bits)) & (n-1), bits);
+    int g = cell_value((cell >> bits) & (n-1), bits);
+    int b = cell_value(cell & (n-1), bits);
+
+    ASSERT_EQ(full_bestfit(pal, r, g, b), rgbmap.mapColor(r, g, b))
+      << "rgb(" << r << ", " << g << ", " << b << ")";
+  }
+}
+
+static void randomize_palette(Palette* pal)
+{
+  for (int i=0; i<pal->size(); ++i)
+    pal->setEntry(i, _rgba(std::rand() & 255, std::rand() & 255, std::rand() & 255, 255));
+}
+
+TEST(RgbMap, LazyMapEqualsFullMap)
+{
+  int bits[] = { 5, 6 };
+  int sizes[] = { 2, 16, 256 };
+  std::srand(1);
+
+  for (int i=0; i<2; ++i) {
+    for (int j=0; j<3; ++j) {
+      Palette pal(FrameNumber(0), sizes[j]);
+      randomize_palette(&pal);
+
+      RgbMap rgbmap(bits[i]);
+      rgbmap.regenerate(&pal);
+      expect_full_map(rgbmap, &pal);
+    }
+  }
+}
+
+TEST(RgbMap, RegenerateAfterPaletteChanges)
+{
+  std::srand(2);
+
+  Palette pal(FrameNumber(0), 64);
+  randomize_palette(&pal);
+
+  RgbMap rgbmap;
+  rgbmap.regenerate(&pal);
+  EXPECT_TRUE(rgbmap.match(&pal));
+
+  // Calculate only some blocks before the palette changes
+  for (int i=0; i<100; ++i)
+    rgbmap.mapColor(std::rand() & 255, std::rand() & 255, std::rand() & 255);
+
+  for (int change=0; change<5; ++change) {
+    for (int i=0; i<8; ++i)
+      pal.setEntry(1 + std::rand() % 63,
+                   _rgba(std::rand() & 255, std::rand() & 255, std::rand() & 255, 255));
+    EXPECT_FALSE(rgbmap.match(&pal));
+
+    rgbmap.regenerate(&pal);
+    EXPECT_TRUE(rgbmap.match(&pal));
+
+    // Map some random colors first, so only some blocks are
+    // calculated, and then all the other ones.
+    for (int i=0; i<100; ++i) {
+      int r = std::rand() & 255, g = std::rand() & 255, b = std::rand() & 255;
+      ASSERT_EQ(full_bestfit(&pal, cell_value(r >> 3, 5), cell_value(g >> 3, 5), cell_value(b >> 3, 5)),
+                rgbmap.mapColor(r, g, b));
+    }
+    expect_full_map(rgbmap, &pal);
+  }
+
+  // Other palette (match() compares the palette too)
+  Palette other(FrameNumber(0), 64);
+  randomize_palette(&other);
+  EXPECT_FALSE(rgbmap.match(&other));
+  rgbmap.regenerate(&other);
+  expect_full_map(rgbmap, &other);
+}
+
+TEST(RgbMap, TransparentEntries)
+{
+  std::srand(3);
+
+  Palette pal(FrameNumber(0), 32);
+  randomize_palette(&pal);
+  for (int i=0; i<32; i+=3)
+    pal.setEntry(i, _rgba(_rgba_getr(pal.getEntry(i)), 0, 0, 0));
+
+  RgbMap rgbmap;
+  rgbmap.regenerate(&pal);
+  expect_full_map(rgbmap, &pal);
+
+  // Transparent colors are mapped to the index 0
+  EXPECT_EQ(0, rgbmap.mapColor(255, 255, 255, 0));
+  EXPECT_NE(0, rgbmap.mapColor(255, 255, 255, 255));
+
+  // Without usable entries everything is mapped to 0
+  for (int i=0; i<32; ++i)
+    pal.setEntry(i, _rgba(i*8, i*8, i*8, 0));
+  rgbmap.regenerate(&pal);
+  EXPECT_EQ(0, rgbmap.mapColor(0, 0, 0));
+  EXPECT_EQ(0, rgbmap.mapColor(128, 64, 255));
+  EXPECT_EQ(0, rgbmap.mapColor(255, 255, 255));
+}
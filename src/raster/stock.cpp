@@ -22,6 +22,7 @@
 
 #include "raster/stock.h"
 
+#include "base/scoped_lock.h"
 #include "raster/image.h"
 
 #include <cstring>
@@ -31,6 +32,8 @@ namespace raster {
 Stock::Stock(PixelFormat format)
   : GfxObj(GFXOBJ_STOCK)
   , m_format(format)
+  , m_lazy(false)
+  , m_pendingLoaders(0)
 {
   // Image with index=0 is always NULL.
   m_image.push_back(NULL);
@@ -39,6 +42,8 @@ Stock::Stock(PixelFormat format)
 Stock::Stock(const Stock& stock)
   : GfxObj(stock)
   , m_format(stock.getPixelFormat())
+  , m_lazy(false)
+  , m_pendingLoaders(0)
 {
   try {
     for (int i=0; i<stock.size(); ++i) {
@@ -64,9 +69,12 @@ Stock::Stock(const Stock& stock)
 Stock::~Stock()
 {
   for (int i=0; i<size(); ++i) {
-    if (getImage(i))
-      delete getImage(i);
+    if (m_image[i])
+      delete m_image[i];
   }
+
+  for (ImageLoadersList::iterator it=m_loaders.begin(), end=m_loaders.end(); it!=end; ++it)
+    delete *it;
 }
 
 PixelFormat Stock::getPixelFormat() const
@@ -83,6 +91,19 @@ Image* Stock::getImage(int index) const
 {
   ASSERT((index >= 0) && (index < size()));
 
+  // Fast path for stocks without lazy images
+  if (!m_lazy)
+    return m_image[index];
+
+  base::scoped_lock lock(m_mutex);
+
+  if (index < (int)m_loaders.size() && m_loaders[index]) {
+    Image*& image = const_cast<ImagesList&>(m_image)[index];
+
+    image = m_loaders[index]->loadImage();
+    removeLoader(index);
+  }
+
   return m_image[index];
 }
 
@@ -100,6 +121,24 @@ int Stock::addImage(Image* image)
   return i;
 }
 
+int Stock::addLazyImage(ImageLoader* loader)
+{
+  int i = addImage(NULL);
+
+  try {
+    m_loaders.resize(size());
+  }
+  catch (...) {
+    delete loader;
+    throw;
+  }
+
+  m_loaders[i] = loader;
+  ++m_pendingLoaders;
+  m_lazy = true;
+  return i;
+}
+
 void Stock::removeImage(Image* image)
 {
   for (int i=0; i<size(); i++)
@@ -114,7 +153,28 @@ void Stock::removeImage(Image* image)
 void Stock::replaceImage(int index, Image* image)
 {
   ASSERT((index > 0) && (index < size()));
-  m_image[index] = image;
+
+  if (m_lazy) {
+    base::scoped_lock lock(m_mutex);
+    if (index < (int)m_loaders.size() && m_loaders[index])
+      removeLoader(index);
+
+    m_image[index] = image;
+  }
+  else
+    m_image[index] = image;
+}
+
+// Must be called with m_mutex locked.
+void Stock::removeLoader(int index) const
+{
+  delete m_loaders[index];
+  m_loaders[index] = NULL;
+
+  // When the last lazy image is loaded the list is cleared (the
+  // image was already stored in m_image).
+  if (--m_pendingLoaders == 0)
+    m_loaders.clear();
 }
 
 } // namespace raster
@@ -19,6 +19,7 @@
 #ifndef RASTER_STOCK_H_INCLUDED
 #define RASTER_STOCK_H_INCLUDED
 
+#include "base/mutex.h"
 #include "raster/gfxobj.h"
 #include "raster/pixel_format.h"
 
@@ -30,6 +31,17 @@ namespace raster {
 
   typedef std::vector<Image*> ImagesList;
 
+  // Creates an image when it's used for first time (e.g. to decode
+  // images from a file only when they are needed). See
+  // Stock::addLazyImage().
+  class ImageLoader {
+  public:
+    virtual ~ImageLoader() { }
+    virtual Image* loadImage() = 0;
+  };
+
+  typedef std::vector<ImageLoader*> ImageLoadersList;
+
   class Stock : public GfxObj {
   public:
     Stock(PixelFormat format);
@@ -44,7 +56,9 @@ namespace raster {
       return m_image.size();
     }
 
-    // Returns the image in the "index" position
+    // Returns the image in the "index" position. If the image was
+    // added with addLazyImage(), it's loaded in this call (it can be
+    // called from different threads at the same time).
     Image* getImage(int index) const;
 
     // Adds a new image in the stock resizing the images-array. Returns
@@ -52,6 +66,11 @@ namespace raster {
     // Stock::getImage() function).
     int addImage(Image* image);
 
+    // Adds an image that will be created by the given loader the first
+    // time that it is requested with getImage(). The stock takes the
+    // ownership of the loader.
+    int addLazyImage(ImageLoader* loader);
+
     // Removes a image from the stock, it doesn't resize the stock.
     void removeImage(Image* image);
 
@@ -68,6 +87,21 @@ namespace raster {
     //private: TODO uncomment this line
     PixelFormat m_format; // Type of images (all images in the stock must be of this type).
     ImagesList m_image;   // The images-array where the images are.
+
+  private:
+    void removeLoader(int index) const;
+
+    // True if addLazyImage() was used. In this case m_image and
+    // m_loaders are accessed with m_mutex locked (the images can be
+    // loaded from several threads). It's never reset, so it can be
+    // read without locking the mutex.
+    bool m_lazy;
+
+    // Loaders of images that were not requested yet (it's empty if
+    // all lazy images were loaded).
+    mutable ImageLoadersList m_loaders;
+    mutable int m_pendingLoaders;
+    mutable base::mutex m_mutex;
   };
 
 } // namespace raster
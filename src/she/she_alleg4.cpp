@@ -13,6 +13,8 @@
 #include <allegro.h>
 #ifdef ALLEGRO_WINDOWS
   #include <winalleg.h>
+#elif defined ALLEGRO_UNIX
+  #include <allegro/platform/aintunix.h>
 #endif
 #include "loadpng.h"
 
@@ -268,12 +270,36 @@ public:
   }
 };
 
+// System driver used when Allegro cannot be initialized with a real
+// one (e.g. batch mode running in a server without X11). It's the
+// agnostic driver with some platform-specific functions.
+static SYSTEM_DRIVER headless_system_driver;
+
+static void install_headless_system()
+{
+  install_allegro(SYSTEM_NONE, &errno, atexit);
+
+  headless_system_driver = *system_driver;
+#ifdef ALLEGRO_UNIX
+  // Used to find the "data" directory relative to the executable.
+  headless_system_driver.get_executable_name = _unix_get_executable_name;
+#endif
+  system_driver = &headless_system_driver;
+}
+
 class Alleg4System : public System {
 public:
   Alleg4System() {
-    allegro_init();
+    // Without a windowing system (e.g. running the batch mode in a
+    // server) we can still use Allegro to load/save images.
+    if (allegro_init() != 0)
+      install_headless_system();
+
     set_uformat(U_ASCII);
-    install_timer();
+
+    // The agnostic system driver doesn't support timers.
+    if (system_driver->id != SYSTEM_NONE)
+      install_timer();
 
     // Register PNG as a supported bitmap type
     register_bitmap_file_type("png", load_png, save_png);
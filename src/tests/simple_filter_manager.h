@@ -0,0 +1,86 @@
+/* Aseprite
+ * Copyright (C) 2001-2013  David Capello
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#ifndef TESTS_SIMPLE_FILTER_MANAGER_H_INCLUDED
+#define TESTS_SIMPLE_FILTER_MANAGER_H_INCLUDED
+
+#include "base/unique_ptr.h"
+#include "filters/filter.h"
+#include "filters/filter_indexed_data.h"
+#include "filters/filter_manager.h"
+#include "raster/image.h"
+
+namespace tests {
+
+  using namespace filters;
+  using namespace raster;
+
+  // Applies a filter to all rows of an image (without selection) in
+  // the same way that app::FilterManagerImpl does for each band of
+  // rows. Used by unit tests and benchmarks of filters.
+  class SimpleFilterManager : public FilterManager,
+                              public FilterIndexedData {
+  public:
+    SimpleFilterManager(Image* src, Image* dst, Palette* palette, RgbMap* rgbmap,
+                        Target target = TARGET_ALL_CHANNELS)
+      : m_src(src), m_dst(dst), m_palette(palette), m_rgbmap(rgbmap)
+      , m_target(target), m_row(0) {
+    }
+
+    void apply(Filter* filter) {
+      m_rowsData.reset();
+
+      for (m_row=0; m_row<m_src->h; ++m_row) {
+        switch (m_src->getPixelFormat()) {
+          case IMAGE_RGB:       filter->applyToRgba(this); break;
+          case IMAGE_GRAYSCALE: filter->applyToGrayscale(this); break;
+          case IMAGE_INDEXED:   filter->applyToIndexed(this); break;
+        }
+      }
+    }
+
+    // FilterManager implementation
+    const void* getSourceAddress() { return image_address(m_src, 0, m_row); }
+    void* getDestinationAddress() { return image_address(m_dst, 0, m_row); }
+    int getWidth() { return m_src->w; }
+    Target getTarget() { return m_target; }
+    FilterIndexedData* getIndexedData() { return this; }
+    bool skipPixel() { return false; }
+    const Image* getSourceImage() { return m_src; }
+    int getX() { return 0; }
+    int getY() { return m_row; }
+    FilterRowsData* getRowsData() { return m_rowsData; }
+    void setRowsData(FilterRowsData* data) { m_rowsData.reset(data); }
+
+    // FilterIndexedData implementation
+    Palette* getPalette() { return m_palette; }
+    RgbMap* getRgbMap() { return m_rgbmap; }
+
+  private:
+    Image* m_src;
+    Image* m_dst;
+    Palette* m_palette;
+    RgbMap* m_rgbmap;
+    Target m_target;
+    int m_row;
+    base::UniquePtr<FilterRowsData> m_rowsData;
+  };
+
+} // namespace tests
+
+#endif
@@ -101,8 +101,12 @@ int _ji_system_init()
   LOCK_VARIABLE(m_b);
   LOCK_FUNCTION(clock_inc);
 
-  if (install_int_ex(clock_inc, BPS_TO_TIMER(1000)) < 0)
-    return -1;
+  // There are no timers without a real system driver (e.g. batch
+  // mode without a windowing system).
+  if (system_driver->id != SYSTEM_NONE) {
+    if (install_int_ex(clock_inc, BPS_TO_TIMER(1000)) < 0)
+      return -1;
+  }
 
   if (screen)
     jmouse_poll();
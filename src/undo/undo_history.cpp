@@ -11,9 +11,11 @@
 #include "undo/undo_history.h"
 
 #include "undo/objects_container.h"
+#include "undo/undo_exception.h"
 #include "undo/undoer.h"
 #include "undo/undoers_stack.h"
 
+#include <iostream>
 #include <limits>
 
 namespace undo {
@@ -24,6 +26,10 @@ UndoHistory::UndoHistory(UndoHistoryDelegate* delegate)
   m_groupLevel = 0;
   m_diffCount = 0;
   m_diffSaved = 0;
+  m_version = 0;
+  m_swapStream = NULL;
+  m_swapEnd = 0;
+  m_checkedTail = 0;
 
   m_undoers = new UndoersStack(this);
   try {
@@ -106,6 +112,12 @@ void UndoHistory::runUndo(Direction direction)
   UndoersStack* redoers = ((direction == RedoDirection)? m_undoers: m_redoers);
   int level = 0;
 
+  // Load the whole group from the swap stream before reverting it, so
+  // a read error doesn't leave the group partially reverted.
+  swapInGroup(undoers);
+
+  ++m_version;
+
   do {
     const char* itemLabel = NULL;
 
@@ -124,7 +136,9 @@ void UndoHistory::runUndo(Direction direction)
       level--;
 
     // Delete the undoer
-    undoer->dispose();
+    disposeUndoer(undoer);
+    if (undoers == m_undoers && m_checkedTail > m_undoers->size())
+      m_checkedTail = m_undoers->size();
 
     // Adjust m_diffCount (just one time, when the level backs to zero)
     if (level == 0 && itemModification == ModifyDocument) {
@@ -145,12 +159,15 @@ void UndoHistory::discardTail()
     if (!undoer)
       break;
 
+    if (m_checkedTail > 0)
+      --m_checkedTail;
+
     if (undoer->isOpenGroup())
       level++;
     else if (undoer->isCloseGroup())
       level--;
 
-    undoer->dispose();
+    disposeUndoer(undoer);
   } while (level);
 }
 
@@ -175,6 +192,11 @@ bool UndoHistory::implantUndoerInLastGroup(Undoer* undoer)
     result = false;
   }
   else {
+    // If the last undoer was already checked by swapOutTail(), the
+    // new undoer (which is not) cannot be inside the checked tail.
+    if (m_checkedTail > m_undoers->size())
+      m_checkedTail = m_undoers->size();
+
     m_undoers->pushUndoer(undoer);
     m_undoers->pushUndoer(lastUndoer);
     result = true;
@@ -189,6 +211,8 @@ void UndoHistory::postUndoerAddedEvent(Undoer* undoer)
   // Reset the "redo" stack.
   clearRedo();
 
+  ++m_version;
+
   // Adjust m_groupLevel
   if (undoer->isOpenGroup()) {
     ++m_groupLevel;
@@ -208,16 +232,122 @@ void UndoHistory::postUndoerAddedEvent(Undoer* undoer)
   }
 }
 
-// Discards undoers in in case the UndoHistory is bigger than the given limit.
+// Swaps out or discards undoers in case the UndoHistory is bigger
+// than the given limit.
 void UndoHistory::checkSizeLimit()
 {
-  // Is undo history too big?
-  size_t groups = m_undoers->countUndoGroups();
   size_t undoLimit = m_delegate->getUndoSizeLimit();
+
+  // Is undo history too big? Try to move the oldest undoers to the
+  // swap stream.
+  if (m_undoers->getMemSize() > undoLimit) {
+    std::iostream* swapStream = m_delegate->getSwapStream();
+    if (swapStream) {
+      ASSERT(m_swapStream == NULL || m_swapStream == swapStream);
+      m_swapStream = swapStream;
+      swapOutTail(undoLimit);
+    }
+  }
+
+  // Discard the oldest undo groups that cannot be swapped out.
+  size_t groups = m_undoers->countUndoGroups();
   while (groups > 1 && m_undoers->getMemSize() > undoLimit) {
     discardTail();
     groups--;
   }
 }
 
+// Saves undoers from the tail (the oldest ones) in the swap stream
+// until the size of the undo history is below the given limit. Each
+// undoer is checked just one time: the m_checkedTail oldest undoers
+// were already swapped out or cannot be swapped out.
+void UndoHistory::swapOutTail(size_t undoLimit)
+{
+  if (m_checkedTail == m_undoers->size())
+    return;
+
+  UndoersStack::iterator it = m_undoers->end() - m_checkedTail;
+
+  m_swapStream->clear();
+  m_swapStream->seekp(m_swapEnd);
+
+  while (it != m_undoers->begin() && m_undoers->getMemSize() > undoLimit) {
+    Undoer* undoer = *(--it);
+    ++m_checkedTail;
+
+    if (m_swappedUndoers.find(undoer) != m_swappedUndoers.end())
+      continue;
+
+    if (m_undoers->swapOutUndoer(undoer, *m_swapStream)) {
+      m_swappedUndoers[undoer] = m_swapEnd;
+      m_swapEnd = m_swapStream->tellp();
+    }
+    else {
+      // The undoer could have written something
+      m_swapStream->clear();
+      m_swapStream->seekp(m_swapEnd);
+    }
+  }
+}
+
+// Loads the swapped out undoers of the group in the head of the
+// stack (the next group to be reverted). If the data cannot be read,
+// the group and all older groups (which were swapped out before) are
+// discarded and an UndoException is thrown.
+//
+// Undoers are swapped out from the oldest to the newest one, so the
+// group in the head is always at the end of the swap stream and its
+// space can be reused by the next undoers that are swapped out.
+void UndoHistory::swapInGroup(UndoersStack* undoers)
+{
+  // Only undoers in the undo stack are swapped out
+  if (undoers != m_undoers || m_swappedUndoers.empty())
+    return;
+
+  int level = 0;
+
+  for (UndoersStack::iterator it=undoers->begin(), end=undoers->end(); it!=end; ++it) {
+    Undoer* undoer = *it;
+
+    SwappedUndoers::iterator swapped = m_swappedUndoers.find(undoer);
+    if (swapped != m_swappedUndoers.end()) {
+      try {
+        m_swapStream->clear();
+        m_swapStream->seekg(swapped->second);
+        if (!m_swapStream->good())
+          throw UndoException("Invalid position in the undo swap stream");
+
+        undoers->swapInUndoer(undoer, *m_swapStream);
+      }
+      catch (...) {
+        while (m_swappedUndoers.find(undoer) != m_swappedUndoers.end())
+          discardTail();
+
+        throw UndoException("The undo information cannot be read from the swap file");
+      }
+
+      m_swapEnd = swapped->second;
+      m_swappedUndoers.erase(swapped);
+    }
+
+    if (undoer->isOpenGroup())
+      level++;
+    else if (undoer->isCloseGroup())
+      level--;
+
+    if (level == 0)
+      break;
+  }
+}
+
+void UndoHistory::disposeUndoer(Undoer* undoer)
+{
+  m_swappedUndoers.erase(undoer);
+  undoer->dispose();
+
+  // Reuse the whole swap stream when it doesn't contain undoers
+  if (m_swappedUndoers.empty())
+    m_swapEnd = 0;
+}
+
 } // namespace undo
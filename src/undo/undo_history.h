@@ -10,6 +10,8 @@
 #include "undo/modification.h"
 #include "undo/undoers_collector.h"
 
+#include <iosfwd>
+#include <map>
 #include <vector>
 
 namespace undo {
@@ -27,6 +29,12 @@ namespace undo {
 
     // Returns the limit of undo history in bytes.
     virtual size_t getUndoSizeLimit() const = 0;
+
+    // Returns a stream where the oldest undoers are saved when the
+    // history is bigger than the size limit (instead of discarding
+    // them), or NULL to discard them. The stream must be valid while
+    // the UndoHistory is alive.
+    virtual std::iostream* getSwapStream() = 0;
   };
 
   class UndoHistory : public UndoersCollector {
@@ -48,6 +56,11 @@ namespace undo {
     bool isSavedState() const;
     void markSavedState();
 
+    // Returns a number that is incremented each time an undoer is
+    // added or an undo/redo is made (i.e. each time the document
+    // could be modified through this history).
+    int getVersion() const { return m_version; }
+
     ObjectsContainer* getObjects() const { return m_delegate->getObjects(); }
 
     // UndoersCollector interface
@@ -65,6 +78,12 @@ namespace undo {
     void updateUndo();
     void postUndoerAddedEvent(Undoer* undoer);
     void checkSizeLimit();
+    void swapOutTail(size_t undoLimit);
+    void swapInGroup(UndoersStack* undoers);
+    void disposeUndoer(Undoer* undoer);
+
+    // Position in m_swapStream of each undoer that was swapped out.
+    typedef std::map<Undoer*, std::streamoff> SwappedUndoers;
 
     UndoHistoryDelegate* m_delegate;
     UndoersStack* m_undoers;
@@ -72,6 +91,16 @@ namespace undo {
     int m_groupLevel;
     int m_diffCount;
     int m_diffSaved;
+    int m_version;
+    std::iostream* m_swapStream;
+    SwappedUndoers m_swappedUndoers;
+
+    // Position in m_swapStream where the next undoer is swapped out.
+    std::streamoff m_swapEnd;
+
+    // Number of undoers in the tail of m_undoers that were already
+    // checked by swapOutTail().
+    size_t m_checkedTail;
   };
 
 } // namespace undo
@@ -0,0 +1,244 @@
+// Aseprite Undo Library
+// Copyright (C) 2001-2013 David Capello
+//
+// This source file is distributed under MIT license,
+// please read LICENSE.txt for more information.
+
+#include <gtest/gtest.h>
+
+#include "base/serialization.h"
+#include "undo/undo_exception.h"
+#include "undo/undo_history.h"
+#include "undo/undoer.h"
+#include "undo/undoers_collector.h"
+
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+using namespace base::serialization;
+using namespace base::serialization::little_endian;
+using namespace undo;
+
+typedef std::vector<std::string> Values;
+
+// Undoer that reverts a "value" adding it to a list.
+class ValueUndoer : public Undoer {
+public:
+  enum Kind { Value, OpenGroup, CloseGroup };
+
+  ValueUndoer(Values* reverted, Kind kind, const std::string& value = std::string())
+    : m_reverted(reverted), m_kind(kind), m_value(value) { }
+
+  void dispose() { delete this; }
+  size_t getMemSize() const { return sizeof(*this) + m_value.size(); }
+  Modification getModification() const { return ModifyDocument; }
+  bool isOpenGroup() const { return m_kind == OpenGroup; }
+  bool isCloseGroup() const { return m_kind == CloseGroup; }
+
+  bool swapOut(std::ostream& os) {
+    ++swapOutCalls;
+    if (m_kind != Value)
+      return false;
+
+    write32(os, m_value.size());
+    os.write(m_value.c_str(), m_value.size());
+    m_value.clear();
+    return os.good();
+  }
+
+  void swapIn(std::istream& is) {
+    std::string value(read32(is), 0);
+    if (!value.empty())
+      is.read(&value[0], value.size());
+    if (!is.good())
+      throw std::runtime_error("Error reading value");
+    m_value = value;
+  }
+
+  void revert(ObjectsContainer* objects, UndoersCollector* redoers) {
+    switch (m_kind) {
+      case Value:
+        m_reverted->push_back(m_value);
+        redoers->pushUndoer(new ValueUndoer(m_reverted, Value, m_value));
+        break;
+      case OpenGroup:
+        redoers->pushUndoer(new ValueUndoer(m_reverted, CloseGroup));
+        break;
+      case CloseGroup:
+        redoers->pushUndoer(new ValueUndoer(m_reverted, OpenGroup));
+        break;
+    }
+  }
+
+  static int swapOutCalls;
+
+private:
+  Values* m_reverted;
+  Kind m_kind;
+  std::string m_value;
+};
+
+int ValueUndoer::swapOutCalls = 0;
+
+class TestDelegate : public UndoHistoryDelegate {
+public:
+  TestDelegate(bool swap) : m_swap(swap) { }
+
+  ObjectsContainer* getObjects() const { return NULL; }
+  size_t getUndoSizeLimit() const { return 32*1024; }
+  std::iostream* getSwapStream() { return m_swap ? &m_stream: NULL; }
+
+  std::stringstream& stream() { return m_stream; }
+
+private:
+  bool m_swap;
+  std::stringstream m_stream;
+};
+
+static std::string value_for_group(int i)
+{
+  std::ostringstream os;
+  os << std::string(1000, 'a' + (i % 26)) << i;
+  return os.str();
+}
+
+// Adds "n" groups of undoers (an open group, a value and a close
+// group) in the given history.
+static void add_groups(UndoHistory& history, Values& reverted, int n)
+{
+  for (int i=0; i<n; ++i) {
+    history.pushUndoer(new ValueUndoer(&reverted, ValueUndoer::OpenGroup));
+    history.pushUndoer(new ValueUndoer(&reverted, ValueUndoer::Value, value_for_group(i)));
+    history.pushUndoer(new ValueUndoer(&reverted, ValueUndoer::CloseGroup));
+  }
+}
+
+TEST(UndoHistory, DiscardOldGroupsWithoutSwapStream)
+{
+  TestDelegate delegate(false);
+  UndoHistory history(&delegate);
+  Values reverted;
+
+  add_groups(history, reverted, 100);
+  while (history.canUndo())
+    history.doUndo();
+
+  ASSERT_LT(reverted.size(), 100u);
+  for (int i=0; i<(int)reverted.size(); ++i)
+    EXPECT_EQ(value_for_group(99-i), reverted[i]);
+}
+
+TEST(UndoHistory, SwapOutAndSwapIn)
+{
+  TestDelegate delegate(true);
+  UndoHistory history(&delegate);
+  Values reverted;
+
+  add_groups(history, reverted, 100);
+  EXPECT_FALSE(delegate.stream().str().empty());
+
+  while (history.canUndo())
+    history.doUndo();
+
+  ASSERT_EQ(100u, reverted.size());
+  for (int i=0; i<100; ++i)
+    EXPECT_EQ(value_for_group(99-i), reverted[i]);
+
+  // Redo everything and undo it again (redoers are not swapped out)
+  while (history.canRedo())
+    history.doRedo();
+
+  reverted.clear();
+  while (history.canUndo())
+    history.doUndo();
+
+  ASSERT_EQ(100u, reverted.size());
+  for (int i=0; i<100; ++i)
+    EXPECT_EQ(value_for_group(99-i), reverted[i]);
+}
+
+TEST(UndoHistory, SwapStreamReadError)
+{
+  TestDelegate delegate(true);
+  UndoHistory history(&delegate);
+  Values reverted;
+
+  add_groups(history, reverted, 100);
+
+  // Truncate the swap stream, so swapped out undoers cannot be read
+  delegate.stream().str(std::string());
+
+  int undos = 0;
+  while (history.canUndo()) {
+    try {
+      history.doUndo();
+      ++undos;
+    }
+    catch (const UndoException&) {
+      break;
+    }
+  }
+
+  // Groups in memory were reverted, and the swapped out ones were
+  // discarded without reverting corrupt data.
+  EXPECT_GT(undos, 0);
+  EXPECT_LT(undos, 100);
+  EXPECT_FALSE(history.canUndo());
+  ASSERT_EQ(undos, (int)reverted.size());
+  for (int i=0; i<undos; ++i)
+    EXPECT_EQ(value_for_group(99-i), reverted[i]);
+}
+
+TEST(UndoHistory, SwapOutEachUndoerOneTime)
+{
+  TestDelegate delegate(true);
+  UndoHistory history(&delegate);
+  Values reverted;
+
+  // Groups and values that cannot be swapped out are not checked
+  // again each time a new undoer is added.
+  ValueUndoer::swapOutCalls = 0;
+  add_groups(history, reverted, 1000);
+  EXPECT_LE(ValueUndoer::swapOutCalls, 3*1000);
+  EXPECT_GT(ValueUndoer::swapOutCalls, 3*900);
+}
+
+TEST(UndoHistory, ReuseSwapStream)
+{
+  TestDelegate delegate(true);
+  UndoHistory history(&delegate);
+  Values reverted;
+
+  add_groups(history, reverted, 100);
+  size_t size = delegate.stream().str().size();
+  EXPECT_GT(size, 0u);
+
+  // The space of the swapped in groups is reused
+  for (int i=0; i<50; ++i)
+    history.doUndo();
+  add_groups(history, reverted, 50);
+  EXPECT_EQ(size, delegate.stream().str().size());
+
+  // All the stream is reused when the undo history is empty
+  while (history.canUndo())
+    history.doUndo();
+  add_groups(history, reverted, 100);
+  EXPECT_EQ(size, delegate.stream().str().size());
+
+  // Check that the swapped out data is still valid
+  reverted.clear();
+  while (history.canUndo())
+    history.doUndo();
+
+  ASSERT_EQ(100u, reverted.size());
+  for (int i=0; i<100; ++i)
+    EXPECT_EQ(value_for_group(99-i), reverted[i]);
+}
+
+int main(int argc, char** argv)
+{
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
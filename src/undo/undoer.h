@@ -9,6 +9,8 @@
 
 #include "undo/modification.h"
 
+#include <iosfwd>
+
 namespace undo {
 
   class ObjectsContainer;
@@ -41,6 +43,16 @@ namespace undo {
     // Returns true if this undoer is the last action of a group.
     virtual bool isCloseGroup() const = 0;
 
+    // Saves the data used to revert the action in the given stream
+    // and releases it from memory (see UndoHistoryDelegate::getSwapStream).
+    // Returns false if the undoer doesn't support this, in that case
+    // its data is kept in memory.
+    virtual bool swapOut(std::ostream& os) = 0;
+
+    // Loads the data saved with swapOut(). It's called before
+    // revert().
+    virtual void swapIn(std::istream& is) = 0;
+
     // Reverts the action and adds to the "redoers" stack other set of
     // actions to redo the reverted action. It is the main method used
     // to undo any action.
@@ -73,6 +73,9 @@ Undoer* UndoersStack::popUndoer(PopFrom popFrom)
 
     undoer = (*it);                 // Set the undoer to return.
     m_items.erase(it);              // Erase the item from the stack.
+
+    // The size of the undoer cannot change while it is in the stack
+    ASSERT(m_size >= undoer->getMemSize());
     m_size -= undoer->getMemSize(); // Reduce the stack size.
   }
   else
@@ -81,6 +84,38 @@ Undoer* UndoersStack::popUndoer(PopFrom popFrom)
   return undoer;
 }
 
+bool UndoersStack::swapOutUndoer(Undoer* undoer, std::ostream& os)
+{
+  ASSERT(undoer != NULL);
+
+  size_t size = undoer->getMemSize();
+  if (!undoer->swapOut(os))
+    return false;
+
+  m_size -= size;
+  m_size += undoer->getMemSize();
+  return true;
+}
+
+void UndoersStack::swapInUndoer(Undoer* undoer, std::istream& is)
+{
+  ASSERT(undoer != NULL);
+
+  size_t size = undoer->getMemSize();
+  try {
+    undoer->swapIn(is);
+  }
+  catch (...) {
+    // The undoer could be partially loaded
+    m_size -= size;
+    m_size += undoer->getMemSize();
+    throw;
+  }
+
+  m_size -= size;
+  m_size += undoer->getMemSize();
+}
+
 size_t UndoersStack::countUndoGroups() const
 {
   size_t groups = 0;
@@ -9,6 +9,7 @@
 
 #include "undo/undoers_collector.h"
 
+#include <iosfwd>
 #include <vector>
 
 namespace undo {
@@ -45,6 +46,7 @@ namespace undo {
     const_iterator begin() const { return m_items.begin(); }
     const_iterator end() const { return m_items.end(); }
     bool empty() const { return m_items.empty(); }
+    size_t size() const { return m_items.size(); }
 
     void clear();
 
@@ -57,6 +59,14 @@ namespace undo {
     // deleted by the caller using Undoer::dispose().
     Undoer* popUndoer(PopFrom popFrom);
 
+    // Calls Undoer::swapOut() for the given undoer (which must be in
+    // the stack) and updates the size of the stack.
+    bool swapOutUndoer(Undoer* undoer, std::ostream& os);
+
+    // Calls Undoer::swapIn() for the given undoer (which must be in
+    // the stack) and updates the size of the stack.
+    void swapInUndoer(Undoer* undoer, std::istream& is);
+
     size_t countUndoGroups() const;
 
   private: